@@ -39,13 +39,31 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #include "ae.h"
 #include "zmalloc.h"
 #include "config.h"
 
+#define aeFiredSize(setsize) ((setsize) < AE_FIRED_MAX ? (setsize) : AE_FIRED_MAX)
+#define aePageCount(setsize) (((setsize) + AE_FD_PAGE_SIZE - 1) >> AE_FD_PAGE_BITS)
+
+/* The entry of fd, NULL if its page was never allocated. The backends only
+ * call it for fds that are registered, or were. */
+static inline aeFileEvent *aeFileEventGet(aeEventLoop *eventLoop, int fd) {
+    aeFilePage *page = eventLoop->events[fd >> AE_FD_PAGE_BITS];
+    return page ? &page->events[fd & (AE_FD_PAGE_SIZE-1)] : NULL;
+}
+
 /* Include the best multiplexing layer supported by this system.
  * The following should be ordered by performances, descending. */
+#ifdef HAVE_IO_URING
+#include "ae_uring.c"
+#else
 #ifdef HAVE_EPOLL
 #include "ae_epoll.c"
 #else
@@ -55,28 +73,140 @@
     #error "Epoll & Kqueue support only"
     #endif
 #endif
+#endif
+
+/* Per fd flags the backend implements, AE_ONESHOT is done here. */
+#ifndef AE_API_FLAGS
+#define AE_API_FLAGS 0
+#endif
+
+#ifdef AE_HAVE_EDGE
+int aeSetEdgeTriggered(aeEventLoop *eventLoop, int on) {
+    return aeApiSetEdge(eventLoop, on) == 0 ? AE_OK : AE_ERR;
+}
+#else
+int aeSetEdgeTriggered(aeEventLoop *eventLoop, int on) {
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(on);
+    return AE_ERR;
+}
+#endif
+
+/* Completion based I/O needs a backend that does the I/O itself. */
+#ifdef AE_HAVE_COMPLETION_IO
+#define aeIoPending(eventLoop) (((aeApiState *)(eventLoop)->apidata)->ops != NULL)
+#else
+#define aeIoPending(eventLoop) 0
+
+int aeRegisterBuffers(aeEventLoop *eventLoop, const struct iovec *iov, int n) {
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(iov);
+    AE_NOTUSED(n);
+    return AE_ERR;
+}
+
+int aeSubmitRead(aeEventLoop *eventLoop, int fd, void *buf, size_t len,
+        int bufIndex, aeIoProc *proc, void *clientData)
+{
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(fd);
+    AE_NOTUSED(buf);
+    AE_NOTUSED(len);
+    AE_NOTUSED(bufIndex);
+    AE_NOTUSED(proc);
+    AE_NOTUSED(clientData);
+    return AE_ERR;
+}
+
+int aeSubmitWrite(aeEventLoop *eventLoop, int fd, const void *buf, size_t len,
+        int bufIndex, aeIoProc *proc, void *clientData)
+{
+    return aeSubmitRead(eventLoop, fd, (void *)buf, len, bufIndex, proc, clientData);
+}
+#endif
+
+/* Deadlines come from a monotonic clock, so setting the wall clock neither
+ * fires nor stalls time events. Build with -DAE_COARSE_CLOCK to read the
+ * cheaper coarse clock instead (jiffy resolution, a few ms). */
+#if defined(AE_COARSE_CLOCK) && defined(CLOCK_MONOTONIC_COARSE)
+#define AE_CLOCK CLOCK_MONOTONIC_COARSE
+#elif defined(CLOCK_MONOTONIC)
+#define AE_CLOCK CLOCK_MONOTONIC
+#endif
+
+static long long aeGetTime(void)
+{
+#ifdef AE_CLOCK
+    struct timespec ts;
+
+    clock_gettime(AE_CLOCK, &ts);
+    return (long long)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec*1000 + tv.tv_usec/1000;
+#endif
+}
+
+/* Same clock in microseconds, for instrumentation. */
+static long long aeGetTimeUs(void)
+{
+#ifdef AE_CLOCK
+    struct timespec ts;
+
+    clock_gettime(AE_CLOCK, &ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec*1000000 + tv.tv_usec;
+#endif
+}
+
+long long aeNow(aeEventLoop *eventLoop) {
+    return eventLoop->now;
+}
+
+void aeUpdateTime(aeEventLoop *eventLoop) {
+    eventLoop->now = aeGetTime();
+}
 
 aeEventLoop *aeCreateEventLoop(int setsize) {
     aeEventLoop *eventLoop;
-    int i;
+    int i, npages = aePageCount(setsize);
 
     if ((eventLoop = zmalloc(sizeof(*eventLoop))) == NULL) goto err;
-    eventLoop->events = zmalloc(sizeof(aeFileEvent)*setsize);
-    eventLoop->fired = zmalloc(sizeof(aeFiredEvent)*setsize);
+    eventLoop->events = zmalloc(sizeof(aeFilePage *)*npages);
+    eventLoop->fired = zmalloc(sizeof(aeFiredEvent)*aeFiredSize(setsize));
     if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
+    for (i = 0; i < npages; i++)
+        eventLoop->events[i] = NULL;
     eventLoop->setsize = setsize;
-    eventLoop->lastTime = time(NULL);
-    eventLoop->timeEventHead = NULL;
+    eventLoop->firedsize = aeFiredSize(setsize);
+    eventLoop->nfds = 0;
+    eventLoop->now = aeGetTime();
+    eventLoop->timeHeap = NULL;
+    eventLoop->timeHeapSize = 0;
+    eventLoop->timeHeapCap = 0;
+    eventLoop->timeSlots = NULL;
+    eventLoop->timeFreeSlots = NULL;
+    eventLoop->timeSlotsCap = 0;
+    eventLoop->timeFreeCount = 0;
+    eventLoop->timeEventRunning = NULL;
     eventLoop->timeEventNextId = 0;
     eventLoop->stop = 0;
+    eventLoop->postfd[0] = eventLoop->postfd[1] = -1;
+    eventLoop->postHead = NULL;
+    eventLoop->stats = NULL;
+    eventLoop->slowThreshold = 0;
+    eventLoop->slowProc = NULL;
+    eventLoop->slowPrivdata = NULL;
     eventLoop->maxfd = -1;
     eventLoop->beforesleep = NULL;
     eventLoop->aftersleep = NULL;
     if (aeApiCreate(eventLoop) == -1) goto err;
-    /* Events with mask == AE_NONE are not set. So let's initialize the
-     * vector with it. */
-    for (i = 0; i < setsize; i++)
-        eventLoop->events[i].mask = AE_NONE;
     return eventLoop;
 
 err:
@@ -93,6 +223,23 @@ int aeGetSetSize(aeEventLoop *eventLoop) {
     return eventLoop->setsize;
 }
 
+/* Make maxfd exact again, skipping empty pages. */
+static void aeUpdateMaxFd(aeEventLoop *eventLoop) {
+    int p, j;
+
+    for (p = eventLoop->maxfd >> AE_FD_PAGE_BITS; p >= 0; p--) {
+        aeFilePage *page = eventLoop->events[p];
+        if (page == NULL || page->used == 0) continue;
+        for (j = AE_FD_PAGE_SIZE-1; j >= 0; j--) {
+            if (page->events[j].mask != AE_NONE) {
+                eventLoop->maxfd = (p << AE_FD_PAGE_BITS) + j;
+                return;
+            }
+        }
+    }
+    eventLoop->maxfd = -1;
+}
+
 /* Resize the maximum set size of the event loop.
  * If the requested set size is smaller than the current set size, but
  * there is already a file descriptor in use that is >= the requested
@@ -101,25 +248,56 @@ int aeGetSetSize(aeEventLoop *eventLoop) {
  *
  * Otherwise AE_OK is returned and the operation is successful. */
 int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
-    int i;
+    int i, npages = aePageCount(setsize), oldpages = aePageCount(eventLoop->setsize);
+    aeFilePage **events;
+    aeFiredEvent *fired;
 
     if (setsize == eventLoop->setsize) return AE_OK;
-    if (eventLoop->maxfd >= setsize) return AE_ERR;
+    if (eventLoop->maxfd >= setsize) {
+        aeUpdateMaxFd(eventLoop);
+        if (eventLoop->maxfd >= setsize) return AE_ERR;
+    }
     if (aeApiResize(eventLoop,setsize) == -1) return AE_ERR;
 
-    eventLoop->events = zrealloc(eventLoop->events,sizeof(aeFileEvent)*setsize);
-    eventLoop->fired = zrealloc(eventLoop->fired,sizeof(aeFiredEvent)*setsize);
+    /* Pages past the new size hold no registered fd. */
+    for (i = npages; i < oldpages; i++) {
+        zfree(eventLoop->events[i]);
+        eventLoop->events[i] = NULL;
+    }
+    events = zrealloc(eventLoop->events,sizeof(aeFilePage *)*npages);
+    fired = zrealloc(eventLoop->fired,sizeof(aeFiredEvent)*aeFiredSize(setsize));
+    if (events) eventLoop->events = events;
+    if (fired) eventLoop->fired = fired;
+    if (events == NULL || fired == NULL) return AE_ERR;
+    for (i = oldpages; i < npages; i++)
+        eventLoop->events[i] = NULL;
     eventLoop->setsize = setsize;
-
-    /* Make sure that if we created new slots, they are initialized with
-     * an AE_NONE mask. */
-    for (i = eventLoop->maxfd+1; i < setsize; i++)
-        eventLoop->events[i].mask = AE_NONE;
+    eventLoop->firedsize = aeFiredSize(setsize);
     return AE_OK;
 }
 
 void aeDeleteEventLoop(aeEventLoop *eventLoop) {
+    int j;
+
+    for (j = 0; j < eventLoop->timeHeapSize; j++)
+        zfree(eventLoop->timeHeap[j].te);
+    zfree(eventLoop->timeHeap);
+    zfree(eventLoop->timeSlots);
+    zfree(eventLoop->timeFreeSlots);
+    if (eventLoop->postfd[0] != -1) {
+        aePostTask *task = eventLoop->postHead, *next;
+        for (; task; task = next) {
+            next = task->next;
+            zfree(task);
+        }
+        close(eventLoop->postfd[0]);
+        if (eventLoop->postfd[1] != eventLoop->postfd[0])
+            close(eventLoop->postfd[1]);
+    }
+    zfree(eventLoop->stats);
     aeApiFree(eventLoop);
+    for (j = 0; j < aePageCount(eventLoop->setsize); j++)
+        zfree(eventLoop->events[j]);
     zfree(eventLoop->events);
     zfree(eventLoop->fired);
     zfree(eventLoop);
@@ -132,14 +310,54 @@ void aeStop(aeEventLoop *eventLoop) {
 int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
         aeFileProc *proc, void *clientData)
 {
-    if (fd >= eventLoop->setsize) {
+    return aeCreateFileEventFlags(eventLoop, fd, mask, 0, proc, clientData);
+}
+
+int aeCreateFileEventFlags(aeEventLoop *eventLoop, int fd, int mask, int flags,
+        aeFileProc *proc, void *clientData)
+{
+    aeFilePage *page;
+    aeFileEvent *fe;
+
+    if (fd < 0 || fd >= eventLoop->setsize) {
         errno = ERANGE;
         return AE_ERR;
     }
-    aeFileEvent *fe = &eventLoop->events[fd];
+    if (flags & ~(AE_ONESHOT|AE_API_FLAGS)) {
+        errno = EINVAL;
+        return AE_ERR;
+    }
+    page = eventLoop->events[fd >> AE_FD_PAGE_BITS];
+    if (page == NULL) {
+        int i;
+
+        if ((page = zmalloc(sizeof(*page))) == NULL) return AE_ERR;
+        page->used = 0;
+        for (i = 0; i < AE_FD_PAGE_SIZE; i++) {
+            page->events[i].mask = AE_NONE;
+            page->events[i].flags = 0;
+            page->events[i].clientData = NULL;
+            page->events[i].apiMask = AE_NONE;
+            page->events[i].apiFlags = 0;
+        }
+        eventLoop->events[fd >> AE_FD_PAGE_BITS] = page;
+    }
+    fe = &page->events[fd & (AE_FD_PAGE_SIZE-1)];
 
-    if (aeApiAddEvent(eventLoop, fd, mask) == -1)
+    if (fe->mask == AE_NONE) {
+        fe->flags = flags;
+    } else if ((fe->flags & AE_EXCLUSIVE) && (mask & ~fe->mask)) {
+        errno = EINVAL;
         return AE_ERR;
+    }
+    if (aeApiAddEvent(eventLoop, fd, mask) == -1) {
+        if (fe->mask == AE_NONE) fe->flags = 0;
+        return AE_ERR;
+    }
+    if (fe->mask == AE_NONE && mask != AE_NONE) {
+        page->used++;
+        eventLoop->nfds++;
+    }
     fe->mask |= mask;
     if (mask & AE_READABLE) fe->rfileProc = proc;
     if (mask & AE_WRITABLE) fe->wfileProc = proc;
@@ -151,181 +369,350 @@ int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
 
 void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask)
 {
-    if (fd >= eventLoop->setsize) return;
-    aeFileEvent *fe = &eventLoop->events[fd];
-    if (fe->mask == AE_NONE) return;
+    aeFileEvent *fe;
+
+    if (fd < 0 || fd >= eventLoop->setsize) return;
+    fe = aeFileEventGet(eventLoop, fd);
+    if (fe == NULL || fe->mask == AE_NONE) return;
 
     aeApiDelEvent(eventLoop, fd, mask);
     fe->mask = fe->mask & (~mask);
-    if (fd == eventLoop->maxfd && fe->mask == AE_NONE) {
-        /* Update the max fd */
-        int j;
-
-        for (j = eventLoop->maxfd-1; j >= 0; j--)
-            if (eventLoop->events[j].mask != AE_NONE) break;
-        eventLoop->maxfd = j;
+    if (fe->mask == AE_NONE) {
+        fe->flags = 0;
+        eventLoop->events[fd >> AE_FD_PAGE_BITS]->used--;
+        /* maxfd stays an upper bound: no downward scan here. */
+        if (--eventLoop->nfds == 0) eventLoop->maxfd = -1;
     }
 }
 
 int aeGetFileEvents(aeEventLoop *eventLoop, int fd) {
-    if (fd >= eventLoop->setsize) return 0;
-    aeFileEvent *fe = &eventLoop->events[fd];
+    aeFileEvent *fe;
 
-    return fe->mask;
+    if (fd < 0 || fd >= eventLoop->setsize) return 0;
+    fe = aeFileEventGet(eventLoop, fd);
+    return fe ? fe->mask : 0;
 }
 
-static void aeGetTime(long *seconds, long *milliseconds)
-{
-    struct timeval tv;
+void *aeGetClientData(aeEventLoop *eventLoop, int fd) {
+    aeFileEvent *fe;
 
-    gettimeofday(&tv, NULL);
-    *seconds = tv.tv_sec;
-    *milliseconds = tv.tv_usec/1000;
+    if (fd < 0 || fd >= eventLoop->setsize) return NULL;
+    fe = aeFileEventGet(eventLoop, fd);
+    return fe ? fe->clientData : NULL;
 }
 
-static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms) {
-    long cur_sec, cur_ms, when_sec, when_ms;
+/* ----------------------------- Timer heap ----------------------------------
+ * Time events live in a 4-ary min-heap ordered by (when, id): the nearest
+ * timer is always timeHeap[0], insert and delete are O(log N) and a 4-ary
+ * heap touches fewer cache lines than a binary one while sifting down.
+ * Each event also owns a slot in timeSlots so aeDeleteTimeEvent() can find
+ * it from the id in O(1). */
 
-    aeGetTime(&cur_sec, &cur_ms);
-    when_sec = cur_sec + milliseconds/1000;
-    when_ms = cur_ms + milliseconds%1000;
-    if (when_ms >= 1000) {
-        when_sec ++;
-        when_ms -= 1000;
+static inline int aeTimeLess(const aeTimeNode *a, const aeTimeNode *b) {
+    return a->when < b->when || (a->when == b->when && a->id < b->id);
+}
+
+static inline void aeHeapSet(aeEventLoop *eventLoop, int i, const aeTimeNode *node) {
+    eventLoop->timeHeap[i] = *node;
+    node->te->heapIndex = i;
+}
+
+static void aeHeapUp(aeEventLoop *eventLoop, int i) {
+    aeTimeNode *heap = eventLoop->timeHeap;
+    aeTimeNode node = heap[i];
+
+    while (i > 0) {
+        int parent = (i-1)/4;
+        if (!aeTimeLess(&node, &heap[parent])) break;
+        aeHeapSet(eventLoop, i, &heap[parent]);
+        i = parent;
+    }
+    aeHeapSet(eventLoop, i, &node);
+}
+
+static void aeHeapDown(aeEventLoop *eventLoop, int i) {
+    aeTimeNode *heap = eventLoop->timeHeap;
+    aeTimeNode node = heap[i];
+    int size = eventLoop->timeHeapSize;
+
+    while (1) {
+        int child = 4*i+1, best = child, j;
+        if (child >= size) break;
+        for (j = child+1; j < child+4 && j < size; j++)
+            if (aeTimeLess(&heap[j], &heap[best])) best = j;
+        if (!aeTimeLess(&heap[best], &node)) break;
+        aeHeapSet(eventLoop, i, &heap[best]);
+        i = best;
     }
-    *sec = when_sec;
-    *ms = when_ms;
+    aeHeapSet(eventLoop, i, &node);
+}
+
+static int aeHeapPush(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    aeTimeNode *node;
+
+    if (eventLoop->timeHeapSize == eventLoop->timeHeapCap) {
+        int cap = eventLoop->timeHeapCap ? eventLoop->timeHeapCap*2 : 64;
+        aeTimeNode *heap = zrealloc(eventLoop->timeHeap, sizeof(*heap)*cap);
+        if (heap == NULL) return AE_ERR;
+        eventLoop->timeHeap = heap;
+        eventLoop->timeHeapCap = cap;
+    }
+    node = &eventLoop->timeHeap[eventLoop->timeHeapSize];
+    node->when = te->when;
+    node->id = te->id;
+    node->te = te;
+    te->heapIndex = eventLoop->timeHeapSize++;
+    aeHeapUp(eventLoop, te->heapIndex);
+    return AE_OK;
+}
+
+static void aeHeapRemove(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    int i = te->heapIndex;
+    aeTimeNode *last = &eventLoop->timeHeap[--eventLoop->timeHeapSize];
+
+    te->heapIndex = -1;
+    if (last->te == te) return;
+    aeHeapSet(eventLoop, i, last);
+    if (i > 0 && aeTimeLess(last, &eventLoop->timeHeap[(i-1)/4]))
+        aeHeapUp(eventLoop, i);
+    else
+        aeHeapDown(eventLoop, i);
+}
+
+static int aeTimeSlotAlloc(aeEventLoop *eventLoop) {
+    if (eventLoop->timeFreeCount == 0) {
+        int cap = eventLoop->timeSlotsCap ? eventLoop->timeSlotsCap*2 : 64;
+        int j;
+        aeTimeEvent **slots;
+        int *freeSlots;
+
+        if (cap > AE_TIME_SLOT_MASK+1) cap = AE_TIME_SLOT_MASK+1;
+        if (cap == eventLoop->timeSlotsCap) return -1;
+        slots = zrealloc(eventLoop->timeSlots, sizeof(*slots)*cap);
+        if (slots == NULL) return -1;
+        eventLoop->timeSlots = slots;
+        freeSlots = zrealloc(eventLoop->timeFreeSlots, sizeof(*freeSlots)*cap);
+        if (freeSlots == NULL) return -1;
+        eventLoop->timeFreeSlots = freeSlots;
+        /* Push in reverse so that low slots are handed out first. */
+        for (j = cap-1; j >= eventLoop->timeSlotsCap; j--) {
+            slots[j] = NULL;
+            freeSlots[eventLoop->timeFreeCount++] = j;
+        }
+        eventLoop->timeSlotsCap = cap;
+    }
+    return eventLoop->timeFreeSlots[--eventLoop->timeFreeCount];
+}
+
+static void aeTimeSlotFree(aeEventLoop *eventLoop, long long id) {
+    int slot = id & AE_TIME_SLOT_MASK;
+    eventLoop->timeSlots[slot] = NULL;
+    eventLoop->timeFreeSlots[eventLoop->timeFreeCount++] = slot;
+}
+
+static aeTimeEvent *aeTimeLookup(aeEventLoop *eventLoop, long long id) {
+    long long slot = id & AE_TIME_SLOT_MASK;
+    aeTimeEvent *te;
+
+    if (id < 0 || slot >= eventLoop->timeSlotsCap) return NULL;
+    te = eventLoop->timeSlots[slot];
+    return (te && te->id == id) ? te : NULL;
+}
+
+static void aeTimeEventRelease(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    if (te->finalizerProc)
+        te->finalizerProc(eventLoop, te->clientData);
+    zfree(te);
 }
 
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
         aeTimeProc *proc, void *clientData,
         aeEventFinalizerProc *finalizerProc)
 {
-    long long id = eventLoop->timeEventNextId++;
+    int slot = aeTimeSlotAlloc(eventLoop);
     aeTimeEvent *te;
 
+    if (slot == -1) return AE_ERR;
     te = zmalloc(sizeof(*te));
-    if (te == NULL) return AE_ERR;
-    te->id = id;
-    aeAddMillisecondsToNow(milliseconds,&te->when_sec,&te->when_ms);
+    if (te == NULL) {
+        eventLoop->timeFreeSlots[eventLoop->timeFreeCount++] = slot;
+        return AE_ERR;
+    }
+    te->id = (eventLoop->timeEventNextId++ << AE_TIME_SLOT_BITS) | slot;
+    te->when = eventLoop->now + milliseconds;
     te->timeProc = proc;
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
-    te->next = eventLoop->timeEventHead;
-    eventLoop->timeEventHead = te;
-    return id;
+    te->next = NULL;
+    if (aeHeapPush(eventLoop, te) == AE_ERR) {
+        eventLoop->timeFreeSlots[eventLoop->timeFreeCount++] = slot;
+        zfree(te);
+        return AE_ERR;
+    }
+    eventLoop->timeSlots[slot] = te;
+    return te->id;
 }
 
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    while(te) {
-        if (te->id == id) {
-            te->id = AE_DELETED_EVENT_ID;
-            return AE_OK;
-        }
-        te = te->next;
+    aeTimeEvent *te = aeTimeLookup(eventLoop, id);
+
+    if (te == NULL) return AE_ERR; /* NO event with the specified ID found */
+    aeTimeSlotFree(eventLoop, id);
+    if (te->heapIndex != -1) {
+        aeHeapRemove(eventLoop, te);
+        aeTimeEventRelease(eventLoop, te);
+    } else {
+        /* Running right now, or already fired in this iteration and
+         * waiting to be rescheduled: processTimeEvents() frees it. */
+        te->id = AE_DELETED_EVENT_ID;
     }
-    return AE_ERR; /* NO event with the specified ID found */
+    return AE_OK;
 }
 
-/* Search the first timer to fire.
- * This operation is useful to know how many time the select can be
- * put in sleep without to delay any event.
- * If there are no timers NULL is returned.
- *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
-static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
-{
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    aeTimeEvent *nearest = NULL;
+/* ----------------------------- Instrumentation -----------------------------
+ * Only the aeTimed* paths read the clock, the plain ones are what the loop
+ * always did. */
+
+void aeHistogramAdd(aeHistogram *h, unsigned long long v) {
+    int i = v ? 64 - __builtin_clzll(v) : 0;
+
+    if (i >= AE_HIST_BUCKETS) i = AE_HIST_BUCKETS-1;
+    h->buckets[i]++;
+    h->count++;
+    h->sum += v;
+    if (v > h->max) h->max = v;
+}
+
+unsigned long long aeHistogramPercentile(const aeHistogram *h, double p) {
+    unsigned long long want, seen = 0;
+    int i;
 
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
+    if (h->count == 0) return 0;
+    want = (unsigned long long)(h->count * p / 100);
+    if (want == 0) want = 1;
+    for (i = 0; i < AE_HIST_BUCKETS-1; i++) {
+        seen += h->buckets[i];
+        if (seen >= want) break;
     }
-    return nearest;
+    if (i == 0) return 0;
+    if (i >= 64 || ((1ULL << i) - 1) > h->max) return h->max;
+    return (1ULL << i) - 1;
+}
+
+int aeEnableStats(aeEventLoop *eventLoop) {
+    if (eventLoop->stats) return AE_OK;
+    if ((eventLoop->stats = zmalloc(sizeof(aeStats))) == NULL) return AE_ERR;
+    aeResetStats(eventLoop);
+    return AE_OK;
+}
+
+void aeDisableStats(aeEventLoop *eventLoop) {
+    zfree(eventLoop->stats);
+    eventLoop->stats = NULL;
+}
+
+aeStats *aeGetStats(aeEventLoop *eventLoop) {
+    return eventLoop->stats;
+}
+
+void aeResetStats(aeEventLoop *eventLoop) {
+    if (eventLoop->stats) memset(eventLoop->stats, 0, sizeof(aeStats));
+}
+
+void aeSetSlowProc(aeEventLoop *eventLoop, long long thresholdUs,
+        aeSlowProc *proc, void *privdata) {
+    eventLoop->slowThreshold = thresholdUs;
+    eventLoop->slowProc = proc;
+    eventLoop->slowPrivdata = privdata;
+}
+
+#define aeTimed(eventLoop) ((eventLoop)->stats || (eventLoop)->slowProc)
+
+/* The callback may disable stats or change the slow hook: both are read
+ * again once it returns. */
+static void aeTimedFileProc(aeEventLoop *eventLoop, aeFileProc *proc, int fd,
+        void *clientData, int mask, int which) {
+    long long start = aeGetTimeUs(), us;
+
+    proc(eventLoop, fd, clientData, mask);
+    us = aeGetTimeUs() - start;
+    if (eventLoop->stats) aeHistogramAdd(&eventLoop->stats->fileProc, us);
+    if (eventLoop->slowProc && us >= eventLoop->slowThreshold) {
+        aeSlowCall call = {proc, NULL, fd, which, -1, clientData, us};
+        eventLoop->slowProc(eventLoop, &call, eventLoop->slowPrivdata);
+    }
+}
+
+static int aeTimedTimeProc(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    long long start = aeGetTimeUs(), us, id = te->id;
+    aeTimeProc *proc = te->timeProc;
+    void *clientData = te->clientData;
+    int retval;
+
+    if (eventLoop->stats) {
+        long long late = start - te->when*1000;
+        aeHistogramAdd(&eventLoop->stats->timerLate, late > 0 ? late : 0);
+    }
+    retval = proc(eventLoop, id, clientData);
+    us = aeGetTimeUs() - start;
+    if (eventLoop->stats) aeHistogramAdd(&eventLoop->stats->timeProc, us);
+    if (eventLoop->slowProc && us >= eventLoop->slowThreshold) {
+        aeSlowCall call = {NULL, proc, -1, 0, id, clientData, us};
+        eventLoop->slowProc(eventLoop, &call, eventLoop->slowPrivdata);
+    }
+    return retval;
 }
 
 /* Process time events */
 static int processTimeEvents(aeEventLoop *eventLoop) {
     int processed = 0;
-    aeTimeEvent *te, *prev;
-    long long maxId;
-    time_t now = time(NULL);
-
-    /* If the system clock is moved to the future, and then set back to the
-     * right value, time events may be delayed in a random way. Often this
-     * means that scheduled operations will not be performed soon enough.
-     *
-     * Here we try to detect system clock skews, and force all the time
-     * events to be processed ASAP when this happens: the idea is that
-     * processing events earlier is less dangerous than delaying them
-     * indefinitely, and practice suggests it is. */
-    if (now < eventLoop->lastTime) {
-        te = eventLoop->timeEventHead;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
-        }
-    }
-    eventLoop->lastTime = now;
+    aeTimeEvent *te, *resched = NULL;
+    long long maxId, now = eventLoop->now;
+
+    /* Events created by time events in this iteration have a larger id:
+     * leave them for the next iteration, as the old list walk did. */
+    maxId = (eventLoop->timeEventNextId << AE_TIME_SLOT_BITS) - 1;
+    while (eventLoop->timeHeapSize > 0) {
+        int retval;
+
+        aeTimeNode *top = &eventLoop->timeHeap[0];
+        if (top->when > now || top->id > maxId) break;
+        te = top->te;
+        aeHeapRemove(eventLoop, te);
+
+        eventLoop->timeEventRunning = te;
+        if (aeTimed(eventLoop))
+            retval = aeTimedTimeProc(eventLoop, te);
+        else
+            retval = te->timeProc(eventLoop, te->id, te->clientData);
+        eventLoop->timeEventRunning = NULL;
+        processed++;
 
-    prev = NULL;
-    te = eventLoop->timeEventHead;
-    maxId = eventLoop->timeEventNextId-1;
-    while(te) {
-        long now_sec, now_ms;
-        long long id;
-
-        /* Remove events scheduled for deletion. */
         if (te->id == AE_DELETED_EVENT_ID) {
-            aeTimeEvent *next = te->next;
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
-            if (te->finalizerProc)
-                te->finalizerProc(eventLoop, te->clientData);
-            zfree(te);
-            te = next;
-            continue;
+            aeTimeEventRelease(eventLoop, te);
+        } else if (retval == AE_NOMORE) {
+            aeTimeSlotFree(eventLoop, te->id);
+            aeTimeEventRelease(eventLoop, te);
+        } else {
+            /* Put it back after the loop, so a 0ms periodic timer runs
+             * at most once per iteration. */
+            te->when = now + retval;
+            te->next = resched;
+            resched = te;
         }
+    }
 
-        /* Make sure we don't process time events created by time events in
-         * this iteration. Note that this check is currently useless: we always
-         * add new timers on the head, however if we change the implementation
-         * detail, this check may be useful again: we keep it here for future
-         * defense. */
-        if (te->id > maxId) {
-            te = te->next;
-            continue;
-        }
-        aeGetTime(&now_sec, &now_ms);
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms))
-        {
-            int retval;
-
-            id = te->id;
-            retval = te->timeProc(eventLoop, id, te->clientData);
-            processed++;
-            if (retval != AE_NOMORE) {
-                aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
-            } else {
-                te->id = AE_DELETED_EVENT_ID;
-            }
+    while (resched) {
+        te = resched;
+        resched = te->next;
+        te->next = NULL;
+        if (te->id == AE_DELETED_EVENT_ID) {
+            aeTimeEventRelease(eventLoop, te);
+        } else if (aeHeapPush(eventLoop, te) == AE_ERR) {
+            aeTimeSlotFree(eventLoop, te->id);
+            aeTimeEventRelease(eventLoop, te);
         }
-        prev = te;
-        te = te->next;
     }
     return processed;
 }
@@ -347,33 +734,34 @@ static int processTimeEvents(aeEventLoop *eventLoop) {
 int aeProcessEvents(aeEventLoop *eventLoop, int flags)
 {
     int processed = 0, numevents;
+    long long busyStart = 0;
 
     /* Nothing to do? return ASAP */
     if (!(flags & AE_TIME_EVENTS) && !(flags & AE_FILE_EVENTS)) return 0;
 
+    /* One clock read before computing the timeout and one after polling:
+     * callbacks and new time events use the cached value, see aeNow(). */
+    aeUpdateTime(eventLoop);
+
     /* Note that we want call select() even if there are no
      * file events to process as long as we want to process time
      * events, in order to sleep until the next time event is ready
      * to fire. */
-    if (eventLoop->maxfd != -1 ||
+    if (eventLoop->maxfd != -1 || aeIoPending(eventLoop) ||
         ((flags & AE_TIME_EVENTS) && !(flags & AE_DONT_WAIT))) {
         int j;
         aeTimeEvent *shortest = NULL;
         struct timeval tv, *tvp;
 
-        if (flags & AE_TIME_EVENTS && !(flags & AE_DONT_WAIT))
-            shortest = aeSearchNearestTimer(eventLoop);
+        if (flags & AE_TIME_EVENTS && !(flags & AE_DONT_WAIT) &&
+            eventLoop->timeHeapSize > 0)
+            shortest = eventLoop->timeHeap[0].te;
         if (shortest) {
-            long now_sec, now_ms;
-
-            aeGetTime(&now_sec, &now_ms);
             tvp = &tv;
 
             /* How many milliseconds we need to wait for the next
              * time event to fire? */
-            long long ms =
-                (shortest->when_sec - now_sec)*1000 +
-                shortest->when_ms - now_ms;
+            long long ms = shortest->when - eventLoop->now;
 
             if (ms > 0) {
                 tvp->tv_sec = ms/1000;
@@ -397,28 +785,54 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
 
         /* Call the multiplexing API, will return only on timeout or when
          * some event fires. */
-        numevents = aeApiPoll(eventLoop, tvp);
+        if (eventLoop->stats) {
+            long long start = aeGetTimeUs();
+            numevents = aeApiPoll(eventLoop, tvp);
+            busyStart = aeGetTimeUs();
+            eventLoop->now = busyStart/1000;
+            eventLoop->stats->iterations++;
+            aeHistogramAdd(&eventLoop->stats->pollWait, busyStart - start);
+            aeHistogramAdd(&eventLoop->stats->fired, numevents > 0 ? numevents : 0);
+        } else {
+            numevents = aeApiPoll(eventLoop, tvp);
+            aeUpdateTime(eventLoop);
+        }
 
         /* After sleep callback. */
         if (eventLoop->aftersleep != NULL && flags & AE_CALL_AFTER_SLEEP)
             eventLoop->aftersleep(eventLoop);
 
         for (j = 0; j < numevents; j++) {
-            aeFileEvent *fe = &eventLoop->events[eventLoop->fired[j].fd];
+            aeFileEvent *fe = aeFileEventGet(eventLoop, eventLoop->fired[j].fd);
             int mask = eventLoop->fired[j].mask;
             int fd = eventLoop->fired[j].fd;
             int rfired = 0;
+            aeFileEvent once;
+
+            /* Delete first, so the callbacks can re-arm. */
+            if (fe->flags & AE_ONESHOT) {
+                once = *fe;
+                aeDeleteFileEvent(eventLoop, fd, AE_READABLE|AE_WRITABLE);
+                fe = &once;
+            }
 
 	    /* note the fe->mask & mask & ... code: maybe an already processed
              * event removed an element that fired and we still didn't
              * processed, so we check if the event is still valid. */
             if (fe->mask & mask & AE_READABLE) {
                 rfired = 1;
-                fe->rfileProc(eventLoop,fd,fe->clientData,mask);
+                if (aeTimed(eventLoop))
+                    aeTimedFileProc(eventLoop,fe->rfileProc,fd,fe->clientData,mask,AE_READABLE);
+                else
+                    fe->rfileProc(eventLoop,fd,fe->clientData,mask);
             }
             if (fe->mask & mask & AE_WRITABLE) {
-                if (!rfired || fe->wfileProc != fe->rfileProc)
-                    fe->wfileProc(eventLoop,fd,fe->clientData,mask);
+                if (!rfired || fe->wfileProc != fe->rfileProc) {
+                    if (aeTimed(eventLoop))
+                        aeTimedFileProc(eventLoop,fe->wfileProc,fd,fe->clientData,mask,AE_WRITABLE);
+                    else
+                        fe->wfileProc(eventLoop,fd,fe->clientData,mask);
+                }
             }
             processed++;
         }
@@ -427,9 +841,36 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
     if (flags & AE_TIME_EVENTS)
         processed += processTimeEvents(eventLoop);
 
+    if (eventLoop->stats && busyStart)
+        aeHistogramAdd(&eventLoop->stats->busy, aeGetTimeUs() - busyStart);
     return processed; /* return the number of processed file/time events */
 }
 
+int aePoll(aeEventLoop *eventLoop, long long milliseconds, int max) {
+    struct timeval tv, *tvp = NULL;
+    int j, numevents, firedsize = eventLoop->firedsize;
+
+    if (milliseconds >= 0) {
+        tv.tv_sec = milliseconds/1000;
+        tv.tv_usec = (milliseconds % 1000)*1000;
+        tvp = &tv;
+    }
+    /* The backends fill at most firedsize entries. */
+    if (max < firedsize) eventLoop->firedsize = max > 0 ? max : 1;
+    numevents = aeApiPoll(eventLoop, tvp);
+    eventLoop->firedsize = firedsize;
+    aeUpdateTime(eventLoop);
+
+    for (j = 0; j < numevents; j++) {
+        int fd = eventLoop->fired[j].fd;
+        aeFileEvent *fe = aeFileEventGet(eventLoop, fd);
+
+        if (fe->flags & AE_ONESHOT)
+            aeDeleteFileEvent(eventLoop, fd, AE_READABLE|AE_WRITABLE);
+    }
+    return numevents;
+}
+
 /* Wait for milliseconds until the given file descriptor becomes
  * writable/readable/exception */
 int aeWait(int fd, int mask, long long milliseconds) {
@@ -461,6 +902,90 @@ void aeMain(aeEventLoop *eventLoop) {
     }
 }
 
+/* ----------------------------- Posting -------------------------------------
+ * Producers push onto a lock-free stack. Only the push that finds it empty
+ * writes the wakeup fd, the loop then swaps out the whole stack and runs it
+ * in reverse, i.e. in push order. */
+
+static void aePostDrain(aeEventLoop *eventLoop, int fd, void *clientData, int mask) {
+    aePostTask *task, *fifo = NULL;
+    char buf[64];
+    AE_NOTUSED(clientData);
+    AE_NOTUSED(mask);
+
+    /* Drain the fd before taking the stack: a push after the swap finds
+     * it empty and writes again, so no wakeup is lost. One read resets an
+     * eventfd, a pipe is read until EAGAIN. */
+    if (fd == eventLoop->postfd[1]) {
+        if (read(fd, buf, sizeof(uint64_t)) == -1) { /* EAGAIN */ }
+    } else {
+        while (read(fd, buf, sizeof(buf)) > 0);
+    }
+    task = __atomic_exchange_n(&eventLoop->postHead, NULL, __ATOMIC_ACQUIRE);
+    while (task) {
+        aePostTask *next = task->next;
+        task->next = fifo;
+        fifo = task;
+        task = next;
+    }
+    while (fifo) {
+        task = fifo;
+        fifo = task->next;
+        task->proc(eventLoop, task->clientData);
+        zfree(task);
+    }
+}
+
+int aeEnablePost(aeEventLoop *eventLoop) {
+    int fds[2];
+
+    if (eventLoop->postfd[0] != -1) return AE_OK;
+#ifdef __linux__
+    fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (fds[0] == -1) return AE_ERR;
+#else
+    if (pipe(fds) == -1) return AE_ERR;
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+    if (aeCreateFileEvent(eventLoop, fds[0], AE_READABLE, aePostDrain, NULL) == AE_ERR) {
+        close(fds[0]);
+        if (fds[1] != fds[0]) close(fds[1]);
+        return AE_ERR;
+    }
+    eventLoop->postfd[0] = fds[0];
+    eventLoop->postfd[1] = fds[1];
+    return AE_OK;
+}
+
+int aePost(aeEventLoop *eventLoop, aePostProc *proc, void *clientData) {
+    aePostTask *task, *head;
+
+    if (eventLoop->postfd[1] == -1) return AE_ERR;
+    if ((task = zmalloc(sizeof(*task))) == NULL) return AE_ERR;
+    task->proc = proc;
+    task->clientData = clientData;
+    head = __atomic_load_n(&eventLoop->postHead, __ATOMIC_RELAXED);
+    do {
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&eventLoop->postHead, &head, task,
+                1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (head == NULL) {
+#ifdef __linux__
+        uint64_t one = 1;
+#else
+        char one = 1;
+#endif
+        if (write(eventLoop->postfd[1], &one, sizeof(one)) == -1) {
+            /* Nothing to do: EAGAIN means a wakeup is pending anyway. */
+        }
+    }
+    return AE_OK;
+}
+
 char *aeGetApiName(void) {
     return aeApiName();
 }
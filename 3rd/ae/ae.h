@@ -34,6 +34,7 @@
 #define __AE_H__
 
 #include <time.h>
+#include <stddef.h>
 
 #define AE_OK 0
 #define AE_ERR -1
@@ -42,6 +43,17 @@
 #define AE_READABLE 1
 #define AE_WRITABLE 2
 
+/* Only ever set in aeFiredEvent.mask, next to READABLE / WRITABLE: the
+ * kernel reported an error on the fd (EPOLLERR / EV_ERROR / POLLERR).
+ * An orderly peer close (HUP / EV_EOF) is not an error, it shows up as
+ * READABLE and read() returns 0. */
+#define AE_ERROR 4
+
+/* Per fd flags, see aeCreateFileEventFlags() */
+#define AE_EDGE_TRIGGERED 1
+#define AE_ONESHOT 2
+#define AE_EXCLUSIVE 4
+
 #define AE_FILE_EVENTS 1
 #define AE_TIME_EVENTS 2
 #define AE_ALL_EVENTS (AE_FILE_EVENTS|AE_TIME_EVENTS)
@@ -51,53 +63,144 @@
 #define AE_NOMORE -1
 #define AE_DELETED_EVENT_ID -1
 
+/* Time event ids are (sequence << AE_TIME_SLOT_BITS | slot): still
+ * increasing with creation order, and the slot gives O(1) lookup. */
+#define AE_TIME_SLOT_BITS 24
+#define AE_TIME_SLOT_MASK ((1LL << AE_TIME_SLOT_BITS) - 1)
+
+/* File events live in a two-level table: fd >> AE_FD_PAGE_BITS selects a
+ * page of AE_FD_PAGE_SIZE entries, allocated the first time one of its fds
+ * is registered. A large setsize only costs the page pointers. */
+#define AE_FD_PAGE_BITS 10
+#define AE_FD_PAGE_SIZE (1 << AE_FD_PAGE_BITS)
+
+/* At most this many events are reported by a single poll: the rest are
+ * picked up by the next one. */
+#define AE_FIRED_MAX 4096
+
 /* Macros */
 #define AE_NOTUSED(V) ((void) V)
 
 struct aeEventLoop;
+struct iovec;
 
 /* Types and data structures */
 typedef void aeFileProc(struct aeEventLoop *eventLoop, int fd, void *clientData, int mask);
 typedef int aeTimeProc(struct aeEventLoop *eventLoop, long long id, void *clientData);
 typedef void aeEventFinalizerProc(struct aeEventLoop *eventLoop, void *clientData);
 typedef void aeBeforeSleepProc(struct aeEventLoop *eventLoop);
+typedef void aePostProc(struct aeEventLoop *eventLoop, void *clientData);
+typedef void aeIoProc(struct aeEventLoop *eventLoop, int fd, void *clientData, int res);
 
 /* File event structure */
 typedef struct aeFileEvent {
     int mask; /* one of AE_(READABLE|WRITABLE) */
+    int flags; /* AE_EDGE_TRIGGERED|AE_ONESHOT|AE_EXCLUSIVE, fixed while registered */
+    int apiMask; /* backend private, the interest the kernel knows about */
+    unsigned int apiFlags; /* backend private */
     aeFileProc *rfileProc;
     aeFileProc *wfileProc;
     void *clientData;
 } aeFileEvent;
 
+typedef struct aeFilePage {
+    int used; /* entries with mask != AE_NONE */
+    aeFileEvent events[AE_FD_PAGE_SIZE];
+} aeFilePage;
+
 /* Time event structure */
 typedef struct aeTimeEvent {
     long long id; /* time event identifier. */
-    long when_sec; /* seconds */
-    long when_ms; /* milliseconds */
+    long long when; /* milliseconds */
+    int heapIndex; /* position in eventLoop->timeHeap, -1 when not in it */
     aeTimeProc *timeProc;
     aeEventFinalizerProc *finalizerProc;
     void *clientData;
-    struct aeTimeEvent *next;
+    struct aeTimeEvent *next; /* used to batch rescheduled events */
 } aeTimeEvent;
 
+/* Heap entry: the key is kept inline so sifting never touches the events */
+typedef struct aeTimeNode {
+    long long when;
+    long long id;
+    aeTimeEvent *te;
+} aeTimeNode;
+
+/* A task handed to the loop from another thread, see aePost() */
+typedef struct aePostTask {
+    aePostProc *proc;
+    void *clientData;
+    struct aePostTask *next;
+} aePostTask;
+
 /* A fired event */
 typedef struct aeFiredEvent {
     int fd;
     int mask;
 } aeFiredEvent;
 
+/* Instrumentation, see aeEnableStats(). Histograms are log2 bucketed:
+ * bucket 0 counts zeros, bucket i counts values in [2^(i-1), 2^i). */
+#define AE_HIST_BUCKETS 40
+
+typedef struct aeHistogram {
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+    unsigned long long buckets[AE_HIST_BUCKETS];
+} aeHistogram;
+
+typedef struct aeStats {
+    unsigned long long iterations; /* aeProcessEvents calls that polled */
+    aeHistogram pollWait;  /* us blocked in the multiplexing API */
+    aeHistogram fired;     /* file events reported per poll */
+    aeHistogram busy;      /* us from poll return to the end of the iteration */
+    aeHistogram fileProc;  /* us per aeFileProc call */
+    aeHistogram timeProc;  /* us per aeTimeProc call */
+    aeHistogram timerLate; /* us between a timer's due time and its call */
+} aeStats;
+
+/* A callback that ran longer than the slow threshold: exactly one of
+ * fileProc / timeProc is set. */
+typedef struct aeSlowCall {
+    aeFileProc *fileProc;
+    aeTimeProc *timeProc;
+    int fd;          /* file events: the fd, else -1 */
+    int mask;        /* file events: AE_READABLE or AE_WRITABLE */
+    long long id;    /* time events: the id, else -1 */
+    void *clientData;
+    long long us;    /* time spent in the callback */
+} aeSlowCall;
+
+typedef void aeSlowProc(struct aeEventLoop *eventLoop, const aeSlowCall *call, void *privdata);
+
 /* State of an event based program */
 typedef struct aeEventLoop {
-    int maxfd;   /* highest file descriptor currently registered */
+    int maxfd;   /* -1 if no fd is registered, else an upper bound of the
+                    highest one (made exact only when aeResizeSetSize needs it) */
     int setsize; /* max number of file descriptors tracked */
+    int nfds;    /* fds currently registered */
+    int firedsize; /* min(setsize, AE_FIRED_MAX) */
     long long timeEventNextId;
-    time_t lastTime;     /* Used to detect system clock skew */
-    aeFileEvent *events; /* Registered events */
+    long long now;       /* Monotonic ms, refreshed around each poll */
+    aeFilePage **events; /* Registered events, see AE_FD_PAGE_BITS */
     aeFiredEvent *fired; /* Fired events */
-    aeTimeEvent *timeEventHead;
+    aeTimeNode *timeHeap; /* 4-ary min-heap ordered by (when, id) */
+    int timeHeapSize;
+    int timeHeapCap;
+    aeTimeEvent **timeSlots; /* id -> event, slot is the low AE_TIME_SLOT_BITS of id */
+    int *timeFreeSlots;
+    int timeSlotsCap;
+    int timeFreeCount;
+    aeTimeEvent *timeEventRunning; /* event whose timeProc is being called */
     int stop;
+    int postfd[2]; /* wakeup eventfd (both ends the same) or pipe, -1 when off */
+    aePostTask *postHead; /* MPSC stack: any thread pushes, the loop takes all */
     void *apidata; /* This is used for polling API specific data */
+    aeStats *stats; /* NULL unless aeEnableStats() was called */
+    long long slowThreshold; /* us, see aeSetSlowProc() */
+    aeSlowProc *slowProc;
+    void *slowPrivdata;
     aeBeforeSleepProc *beforesleep;
     aeBeforeSleepProc *aftersleep;
 } aeEventLoop;
@@ -108,18 +211,73 @@ void aeDeleteEventLoop(aeEventLoop *eventLoop);
 void aeStop(aeEventLoop *eventLoop);
 int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
         aeFileProc *proc, void *clientData);
+/* Flags are taken when the fd goes from no events to some, and dropped
+ * with its last event:
+ * AE_EDGE_TRIGGERED  as aeSetEdgeTriggered() but for this fd only
+ * AE_ONESHOT         all events of the fd are deleted right before its
+ *                    callbacks run, create them again to re-arm
+ * AE_EXCLUSIVE       EPOLLEXCLUSIVE: of several loops waiting on this fd
+ *                    (a shared listening socket) only some are woken. The
+ *                    mask cannot change afterwards.
+ * Returns AE_ERR (errno EINVAL) for a flag the backend lacks: epoll has
+ * all of them, the others only AE_ONESHOT. */
+int aeCreateFileEventFlags(aeEventLoop *eventLoop, int fd, int mask, int flags,
+        aeFileProc *proc, void *clientData);
 void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask);
 int aeGetFileEvents(aeEventLoop *eventLoop, int fd);
+/* clientData last given for fd, kept after its events are deleted */
+void *aeGetClientData(aeEventLoop *eventLoop, int fd);
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
         aeTimeProc *proc, void *clientData,
         aeEventFinalizerProc *finalizerProc);
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id);
+/* Monotonic milliseconds cached by the loop: no syscall, same value for
+ * every callback of one iteration. Time events are scheduled relative to
+ * it, call aeUpdateTime() first after blocking outside the loop. */
+long long aeNow(aeEventLoop *eventLoop);
+void aeUpdateTime(aeEventLoop *eventLoop);
 int aeProcessEvents(aeEventLoop *eventLoop, int flags);
+/* Poll without dispatching, for callers with their own event loop: wait
+ * at most milliseconds (-1 forever) and leave up to max events in
+ * eventLoop->fired, returning how many (0 on timeout or EINTR). AE_ONESHOT
+ * fds are deleted as they are reported. Time events are not run. */
+int aePoll(aeEventLoop *eventLoop, long long milliseconds, int max);
 int aeWait(int fd, int mask, long long milliseconds);
 void aeMain(aeEventLoop *eventLoop);
 char *aeGetApiName(void);
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep);
 void aeSetAfterSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *aftersleep);
+/* Edge triggered notification (epoll only, AE_ERR elsewhere). Applies to
+ * fds registered afterwards, so call it right after aeCreateEventLoop().
+ * Handlers must then read / write until EAGAIN. */
+int aeSetEdgeTriggered(aeEventLoop *eventLoop, int on);
+/* Cross thread posting. aeEnablePost() must be called by the owner before
+ * other threads see the loop; after that aePost() is safe from any thread
+ * and runs proc in the loop thread, in FIFO order per posting thread. */
+int aeEnablePost(aeEventLoop *eventLoop);
+int aePost(aeEventLoop *eventLoop, aePostProc *proc, void *clientData);
+/* Completion based I/O, io_uring backend only (AE_ERR elsewhere): proc gets
+ * the read(2)/write(2) style result, or -errno. buf must stay valid until
+ * then. bufIndex >= 0 selects a buffer registered with aeRegisterBuffers()
+ * and buf must lie inside it. */
+int aeRegisterBuffers(aeEventLoop *eventLoop, const struct iovec *iov, int n);
+int aeSubmitRead(aeEventLoop *eventLoop, int fd, void *buf, size_t len,
+        int bufIndex, aeIoProc *proc, void *clientData);
+int aeSubmitWrite(aeEventLoop *eventLoop, int fd, const void *buf, size_t len,
+        int bufIndex, aeIoProc *proc, void *clientData);
+/* Instrumentation. Off by default, it then costs one branch per callback;
+ * on, two clock reads per callback. Times use the loop clock, so they have
+ * jiffy resolution with AE_COARSE_CLOCK. aeSetSlowProc() reports every
+ * callback taking at least thresholdUs, it works with stats off too. */
+int aeEnableStats(aeEventLoop *eventLoop);
+void aeDisableStats(aeEventLoop *eventLoop);
+aeStats *aeGetStats(aeEventLoop *eventLoop);
+void aeResetStats(aeEventLoop *eventLoop);
+void aeSetSlowProc(aeEventLoop *eventLoop, long long thresholdUs,
+        aeSlowProc *proc, void *privdata);
+void aeHistogramAdd(aeHistogram *h, unsigned long long v);
+/* Upper bound of the bucket holding the p-th percentile (0 < p <= 100) */
+unsigned long long aeHistogramPercentile(const aeHistogram *h, double p);
 int aeGetSetSize(aeEventLoop *eventLoop);
 int aeResizeSetSize(aeEventLoop *eventLoop, int setsize);
 
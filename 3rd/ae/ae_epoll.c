@@ -31,16 +31,37 @@
 
 #include <sys/epoll.h>
 
+#define AE_HAVE_EDGE 1
+#ifdef EPOLLEXCLUSIVE
+#define AE_API_FLAGS (AE_EDGE_TRIGGERED|AE_EXCLUSIVE)
+#else
+#define AE_API_FLAGS AE_EDGE_TRIGGERED
+#endif
+
+/* Interest changes on an fd that is already registered (the usual
+ * AE_WRITABLE on / off around a partial write) are not applied right away:
+ * the fd is queued and aeApiPoll() issues one EPOLL_CTL_MOD with the final
+ * mask before epoll_wait(), nothing at all if the changes cancelled out.
+ * Registering a new fd and removing the last event still hit the kernel
+ * immediately, so errors are reported and a closed fd cannot leave a
+ * stale registration behind for the next fd with the same number.
+ *
+ * Per fd state lives in the aeFileEvent: apiMask is the mask the kernel
+ * has, apiFlags is set while the fd is queued. */
 typedef struct aeApiState {
     int epfd;
     struct epoll_event *events;
+    int *pending;
+    int npending;
+    int pendingCap;
+    int edge; /* register with EPOLLET */
 } aeApiState;
 
 static int aeApiCreate(aeEventLoop *eventLoop) {
     aeApiState *state = zmalloc(sizeof(aeApiState));
 
     if (!state) return -1;
-    state->events = zmalloc(sizeof(struct epoll_event)*eventLoop->setsize);
+    state->events = zmalloc(sizeof(struct epoll_event)*eventLoop->firedsize);
     if (!state->events) {
         zfree(state);
         return -1;
@@ -51,14 +72,21 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
         zfree(state);
         return -1;
     }
+    state->pending = NULL;
+    state->npending = 0;
+    state->pendingCap = 0;
+    state->edge = 0;
     eventLoop->apidata = state;
     return 0;
 }
 
 static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
     aeApiState *state = eventLoop->apidata;
+    struct epoll_event *events;
 
-    state->events = zrealloc(state->events, sizeof(struct epoll_event)*setsize);
+    events = zrealloc(state->events, sizeof(struct epoll_event)*aeFiredSize(setsize));
+    if (events == NULL) return -1;
+    state->events = events;
     return 0;
 }
 
@@ -67,49 +95,102 @@ static void aeApiFree(aeEventLoop *eventLoop) {
 
     close(state->epfd);
     zfree(state->events);
+    zfree(state->pending);
     zfree(state);
 }
 
-static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+static int aeApiSetEdge(aeEventLoop *eventLoop, int on) {
     aeApiState *state = eventLoop->apidata;
+
+    state->edge = on;
+    return 0;
+}
+
+static int aeApiCtl(aeApiState *state, aeFileEvent *fe, int fd, int mask) {
     struct epoll_event ee = {0}; /* avoid valgrind warning */
-    /* If the fd was already monitored for some event, we need a MOD
-     * operation. Otherwise we need an ADD operation. */
-    int op = eventLoop->events[fd].mask == AE_NONE ?
-            EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    int op;
+
+    if (mask == AE_NONE) op = EPOLL_CTL_DEL;
+    else if (fe->apiMask == AE_NONE) op = EPOLL_CTL_ADD;
+    else op = EPOLL_CTL_MOD;
 
     ee.events = 0;
-    mask |= eventLoop->events[fd].mask; /* Merge old events */
     if (mask & AE_READABLE) ee.events |= EPOLLIN;
     if (mask & AE_WRITABLE) ee.events |= EPOLLOUT;
+    if (state->edge || (fe->flags & AE_EDGE_TRIGGERED)) ee.events |= EPOLLET;
+#ifdef EPOLLEXCLUSIVE
+    /* Only allowed with ADD, the core refuses mask changes later on. */
+    if (fe->flags & AE_EXCLUSIVE) ee.events |= EPOLLEXCLUSIVE;
+#endif
     ee.data.fd = fd;
-    if (epoll_ctl(state->epfd,op,fd,&ee) == -1) return -1;
+    /* Note, Kernel < 2.6.9 requires a non null event pointer even for
+     * EPOLL_CTL_DEL. */
+    if (epoll_ctl(state->epfd,op,fd,&ee) == -1 && op != EPOLL_CTL_DEL) return -1;
+    fe->apiMask = mask;
+    return 0;
+}
+
+static int aeApiQueue(aeApiState *state, aeFileEvent *fe, int fd) {
+    if (fe->apiFlags) return 0;
+    if (state->npending == state->pendingCap) {
+        int cap = state->pendingCap ? state->pendingCap*2 : 64;
+        int *pending = zrealloc(state->pending, sizeof(int)*cap);
+        if (pending == NULL) return -1;
+        state->pending = pending;
+        state->pendingCap = cap;
+    }
+    fe->apiFlags = 1;
+    state->pending[state->npending++] = fd;
+    return 0;
+}
+
+static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeApiState *state = eventLoop->apidata;
+    aeFileEvent *fe = aeFileEventGet(eventLoop, fd);
+
+    mask |= fe->mask; /* Merge old events */
+    if (fe->apiMask == AE_NONE) return aeApiCtl(state, fe, fd, mask);
+    /* Already registered: the final mask is read back when flushing.
+     * If the queue cannot grow, apply it now. */
+    if (aeApiQueue(state, fe, fd) == -1) return aeApiCtl(state, fe, fd, mask);
     return 0;
 }
 
 static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
     aeApiState *state = eventLoop->apidata;
-    struct epoll_event ee = {0}; /* avoid valgrind warning */
-    int mask = eventLoop->events[fd].mask & (~delmask);
+    aeFileEvent *fe = aeFileEventGet(eventLoop, fd);
+    int mask = fe->mask & (~delmask);
 
-    ee.events = 0;
-    if (mask & AE_READABLE) ee.events |= EPOLLIN;
-    if (mask & AE_WRITABLE) ee.events |= EPOLLOUT;
-    ee.data.fd = fd;
-    if (mask != AE_NONE) {
-        epoll_ctl(state->epfd,EPOLL_CTL_MOD,fd,&ee);
-    } else {
-        /* Note, Kernel < 2.6.9 requires a non null event pointer even for
-         * EPOLL_CTL_DEL. */
-        epoll_ctl(state->epfd,EPOLL_CTL_DEL,fd,&ee);
+    if (mask == AE_NONE) {
+        if (fe->apiMask != AE_NONE) aeApiCtl(state, fe, fd, AE_NONE);
+    } else if (aeApiQueue(state, fe, fd) == -1) {
+        aeApiCtl(state, fe, fd, mask);
+    }
+}
+
+static void aeApiFlush(aeEventLoop *eventLoop) {
+    aeApiState *state = eventLoop->apidata;
+    int j;
+
+    for (j = 0; j < state->npending; j++) {
+        int fd = state->pending[j];
+        aeFileEvent *fe;
+
+        /* Its page may be gone after shrinking the set size. */
+        if (fd >= eventLoop->setsize || (fe = aeFileEventGet(eventLoop, fd)) == NULL)
+            continue;
+        fe->apiFlags = 0;
+        if (fe->mask != fe->apiMask) aeApiCtl(state, fe, fd, fe->mask);
     }
+    state->npending = 0;
 }
 
 static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
     aeApiState *state = eventLoop->apidata;
     int retval, numevents = 0;
 
-    retval = epoll_wait(state->epfd,state->events,eventLoop->setsize,
+    aeApiFlush(eventLoop);
+    retval = epoll_wait(state->epfd,state->events,eventLoop->firedsize,
             tvp ? (tvp->tv_sec*1000 + tvp->tv_usec/1000) : -1);
     if (retval > 0) {
         int j;
@@ -129,7 +210,8 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
             // https://stackoverflow.com/questions/30529883/what-do-epollerr-and-epollhup-really-mean-and-how-to-deal-with-them
             // https://github.com/antirez/redis/pull/569
             // 个人认为这里将 ERR 和 HUP 当成 WRITABLE 或者 READABLE 都可以, 但是都要保证正确判断 read 与 write 返回值
-            if (e->events & EPOLLERR) mask |= AE_WRITABLE;
+            if (e->events & EPOLLERR) mask |= AE_WRITABLE|AE_ERROR;
+            // HUP 是对端正常关闭, 不标 AE_ERROR, 由 read 返回 0 判断
             if (e->events & EPOLLHUP) mask |= AE_WRITABLE;
             eventLoop->fired[j].fd = e->data.fd;
             eventLoop->fired[j].mask = mask;
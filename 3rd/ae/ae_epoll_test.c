@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "ae.h"
+
+// 链接时 -Wl,--wrap=epoll_ctl, 统计系统调用次数
+static int nctl;
+
+int __real_epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev);
+int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
+{
+    nctl++;
+    return __real_epoll_ctl(epfd, op, fd, ev);
+}
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int rfired, wfired;
+
+static void on_read(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    rfired++;
+}
+
+static void on_write(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    wfired++;
+}
+
+static void pair(int sv[2])
+{
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+}
+
+// 同一轮内开关 AE_WRITABLE 相互抵消, 不进内核也不触发
+void test_toggle()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    int sv[2];
+    pair(sv);
+    rfired = wfired = 0;
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_read, NULL) == AE_OK);
+    aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+
+    nctl = 0;
+    int i;
+    for (i = 0; i < 10; i++)
+    {
+        assert(aeCreateFileEvent(el, sv[0], AE_WRITABLE, on_write, NULL) == AE_OK);
+        aeDeleteFileEvent(el, sv[0], AE_WRITABLE);
+    }
+    // 删除未注册的事件
+    aeDeleteFileEvent(el, sv[0], AE_WRITABLE);
+    aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    assert(nctl == 0 && wfired == 0);
+
+    // 真正的修改在 poll 前一次下发
+    assert(aeCreateFileEvent(el, sv[0], AE_WRITABLE, on_write, NULL) == AE_OK);
+    assert(nctl == 0);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(nctl == 1 && wfired == 1);
+
+    // 删光事件立即 DEL, 关闭后同号 fd 重新注册
+    int fd = sv[0];
+    aeDeleteFileEvent(el, fd, AE_READABLE | AE_WRITABLE);
+    assert(nctl == 2);
+    close(sv[0]);
+    close(sv[1]);
+    pair(sv);
+    assert(sv[0] == fd);
+    assert(aeCreateFileEvent(el, fd, AE_READABLE, on_read, NULL) == AE_OK);
+    assert(write(sv[1], "x", 1) == 1);
+    rfired = 0;
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired == 1);
+
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+// 边沿触发: 未读走的数据不会再次通知, 新数据到达才通知
+void test_edge()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    int sv[2];
+    pair(sv);
+    assert(aeSetEdgeTriggered(el, 1) == AE_OK);
+    rfired = 0;
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_read, NULL) == AE_OK);
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    assert(rfired == 1);
+    assert(write(sv[1], "y", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired == 2);
+
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+#define BENCH_CONN 64
+#define BENCH_ROUNDS 200000
+
+static int left;
+
+// dubbo_client 的写法: 每次写完无条件删 AE_WRITABLE, 写不完才加
+static void on_resp(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[64];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+    {
+        return;
+    }
+    if (--left <= 0)
+    {
+        aeStop(el);
+        return;
+    }
+    assert(write(fd, buf, n) == n);
+    aeDeleteFileEvent(el, fd, AE_WRITABLE);
+}
+
+void bench()
+{
+    aeEventLoop *el = aeCreateEventLoop(1024);
+    int sv[BENCH_CONN][2];
+    int i;
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        pair(sv[i]);
+        assert(aeCreateFileEvent(el, sv[i][0], AE_READABLE, on_resp, NULL) == AE_OK);
+        assert(aeCreateFileEvent(el, sv[i][1], AE_READABLE, on_resp, NULL) == AE_OK);
+    }
+    left = BENCH_ROUNDS;
+    nctl = 0;
+    long long start = now_us();
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        assert(write(sv[i][0], "ping", 4) == 4);
+    }
+    aeMain(el);
+    long long cost = now_us() - start;
+    printf("%d connections ping-pong: %.1f ns, %.2f epoll_ctl per message\n",
+           BENCH_CONN, cost * 1000.0 / BENCH_ROUNDS, (double)nctl / BENCH_ROUNDS);
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        close(sv[i][0]);
+        close(sv[i][1]);
+    }
+    aeDeleteEventLoop(el);
+}
+
+int main(int argc, char **argv)
+{
+    test_toggle();
+    test_edge();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
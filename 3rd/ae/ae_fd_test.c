@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#include "ae.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int rfired;
+
+static void pair(int sv[2])
+{
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+}
+
+static void on_read(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[16];
+    rfired++;
+    // 两个 fd 可能指向同一 socket, 后一个读到 EAGAIN
+    (void)read(fd, buf, sizeof(buf));
+}
+
+// 分页 fd 表: 大 setsize, 高位 fd 跨页注册, maxfd 与 nfds 维护
+void test_pages()
+{
+    aeEventLoop *el = aeCreateEventLoop(1 << 20);
+    int sv[2];
+    assert(el);
+    pair(sv);
+    int hi = dup2(sv[0], 3 * AE_FD_PAGE_SIZE + 7);
+    assert(hi == 3 * AE_FD_PAGE_SIZE + 7);
+
+    assert(aeGetFileEvents(el, hi) == AE_NONE);
+    assert(aeGetFileEvents(el, (1 << 20) - 1) == AE_NONE);
+    assert(aeGetFileEvents(el, 1 << 20) == AE_NONE);
+    assert(aeCreateFileEvent(el, 1 << 20, AE_READABLE, on_read, NULL) == AE_ERR);
+
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_read, NULL) == AE_OK);
+    assert(aeCreateFileEvent(el, hi, AE_READABLE, on_read, NULL) == AE_OK);
+    assert(el->maxfd == hi && el->nfds == 2);
+    assert(aeGetFileEvents(el, hi) == AE_READABLE);
+
+    // 两个 fd 指向同一 socket, 都会触发
+    rfired = 0;
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired >= 1);
+
+    // 删掉最大的 fd 不回扫, maxfd 只是上界
+    aeDeleteFileEvent(el, hi, AE_READABLE);
+    assert(el->nfds == 1 && el->maxfd >= sv[0]);
+    aeDeleteFileEvent(el, hi, AE_READABLE);
+    assert(el->nfds == 1);
+    aeDeleteFileEvent(el, sv[0], AE_READABLE);
+    assert(el->nfds == 0 && el->maxfd == -1);
+
+    close(hi);
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+// 缩小 setsize: 真正还在用的 fd 超出时失败, 否则先把 maxfd 算准再缩
+void test_resize()
+{
+    aeEventLoop *el = aeCreateEventLoop(4 * AE_FD_PAGE_SIZE);
+    int sv[2];
+    pair(sv);
+    int hi = dup2(sv[0], 2 * AE_FD_PAGE_SIZE + 1);
+
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_read, NULL) == AE_OK);
+    assert(aeCreateFileEvent(el, hi, AE_READABLE, on_read, NULL) == AE_OK);
+    assert(aeResizeSetSize(el, AE_FD_PAGE_SIZE) == AE_ERR);
+    aeDeleteFileEvent(el, hi, AE_READABLE);
+    assert(aeResizeSetSize(el, AE_FD_PAGE_SIZE) == AE_OK);
+    assert(el->maxfd == sv[0] && aeGetSetSize(el) == AE_FD_PAGE_SIZE);
+    assert(aeCreateFileEvent(el, hi, AE_READABLE, on_read, NULL) == AE_ERR);
+
+    // 再放大, 新页可用
+    assert(aeResizeSetSize(el, 8 * AE_FD_PAGE_SIZE) == AE_OK);
+    assert(aeCreateFileEvent(el, hi, AE_READABLE, on_read, NULL) == AE_OK);
+    rfired = 0;
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired >= 1);
+
+    close(hi);
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+void bench()
+{
+    int i, n = 20;
+    long long start = now_us();
+    for (i = 0; i < n; i++)
+    {
+        aeDeleteEventLoop(aeCreateEventLoop(1 << 20));
+    }
+    long long create_us = (now_us() - start) / n;
+
+    // 低位 fd 常驻, 高位 fd 反复注册删除: 旧实现每次删除从 maxfd 往下扫
+    aeEventLoop *el = aeCreateEventLoop(1 << 20);
+    int sv[2];
+    pair(sv);
+    int hi = dup2(sv[1], 16000);
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_read, NULL) == AE_OK);
+    n = 100000;
+    start = now_us();
+    for (i = 0; i < n; i++)
+    {
+        aeCreateFileEvent(el, hi, AE_READABLE, on_read, NULL);
+        aeDeleteFileEvent(el, hi, AE_READABLE);
+    }
+    long long churn_ns = (now_us() - start) * 1000 / n;
+    printf("setsize 1M: create+delete loop %lld us, add+del fd %d %lld ns\n", create_us, hi, churn_ns);
+    close(hi);
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+int main(int argc, char **argv)
+{
+    test_pages();
+    test_resize();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
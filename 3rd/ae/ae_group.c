@@ -0,0 +1,139 @@
+/* Event loop group: N aeEventLoop running on N threads.
+ * See ae_group.h for the threading rules. */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "ae_group.h"
+#include "zmalloc.h"
+
+typedef struct aeAssignTask {
+    aeAssignProc *proc;
+    int fd;
+    void *clientData;
+} aeAssignTask;
+
+static void *aeLoopThread(void *arg) {
+    aeMain((aeEventLoop *)arg);
+    return NULL;
+}
+
+static void aeStopProc(aeEventLoop *eventLoop, void *clientData) {
+    AE_NOTUSED(clientData);
+    aeStop(eventLoop);
+}
+
+static void aeAssignRun(aeEventLoop *eventLoop, void *clientData) {
+    aeAssignTask *task = clientData;
+
+    task->proc(eventLoop, task->fd, task->clientData);
+    zfree(task);
+}
+
+aeLoopGroup *aeCreateLoopGroup(int n, int setsize) {
+    aeLoopGroup *group;
+    int i;
+
+    if (n <= 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n = ncpu > 0 ? (int)ncpu : 1;
+    }
+    if ((group = zmalloc(sizeof(*group))) == NULL) return NULL;
+    group->size = n;
+    group->started = 0;
+    group->next = 0;
+    group->loops = zmalloc(sizeof(aeEventLoop *)*n);
+    group->threads = zmalloc(sizeof(pthread_t)*n);
+    if (group->loops)
+        for (i = 0; i < n; i++) group->loops[i] = NULL;
+    if (group->loops == NULL || group->threads == NULL) goto err;
+    for (i = 0; i < n; i++) {
+        group->loops[i] = aeCreateEventLoop(setsize);
+        if (group->loops[i] == NULL) goto err;
+        if (aeEnablePost(group->loops[i]) == AE_ERR) goto err;
+    }
+    return group;
+
+err:
+    aeDeleteLoopGroup(group);
+    return NULL;
+}
+
+int aeLoopGroupStart(aeLoopGroup *group, int pin) {
+    int i;
+
+    if (group->started) return AE_ERR;
+    for (i = 0; i < group->size; i++) {
+        if (pthread_create(&group->threads[i], NULL, aeLoopThread, group->loops[i]) != 0) {
+            /* Unwind the threads already running. */
+            aeLoopGroupStop(group);
+            return AE_ERR;
+        }
+#ifdef __linux__
+        if (pin) {
+            long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(i % (ncpu > 0 ? ncpu : 1), &set);
+            pthread_setaffinity_np(group->threads[i], sizeof(set), &set);
+        }
+#else
+        AE_NOTUSED(pin);
+#endif
+        group->started++;
+    }
+    return AE_OK;
+}
+
+void aeLoopGroupStop(aeLoopGroup *group) {
+    int i;
+
+    if (!group->started) return;
+    for (i = 0; i < group->started; i++)
+        aePost(group->loops[i], aeStopProc, NULL);
+    for (i = 0; i < group->started; i++)
+        pthread_join(group->threads[i], NULL);
+    group->started = 0;
+}
+
+void aeDeleteLoopGroup(aeLoopGroup *group) {
+    int i;
+
+    if (group == NULL) return;
+    aeLoopGroupStop(group);
+    if (group->loops) {
+        for (i = 0; i < group->size; i++)
+            if (group->loops[i]) aeDeleteEventLoop(group->loops[i]);
+    }
+    zfree(group->loops);
+    zfree(group->threads);
+    zfree(group);
+}
+
+aeEventLoop *aeLoopGroupNext(aeLoopGroup *group) {
+    unsigned int i = __atomic_fetch_add(&group->next, 1, __ATOMIC_RELAXED);
+    return group->loops[i % group->size];
+}
+
+aeEventLoop *aeLoopGroupHash(aeLoopGroup *group, unsigned long hash) {
+    return group->loops[hash % group->size];
+}
+
+int aeLoopGroupAssign(aeLoopGroup *group, int fd, aeAssignProc *proc, void *clientData) {
+    aeAssignTask *task;
+
+    if ((task = zmalloc(sizeof(*task))) == NULL) return AE_ERR;
+    task->proc = proc;
+    task->fd = fd;
+    task->clientData = clientData;
+    if (aePost(aeLoopGroupNext(group), aeAssignRun, task) == AE_ERR) {
+        zfree(task);
+        return AE_ERR;
+    }
+    return AE_OK;
+}
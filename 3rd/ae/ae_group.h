@@ -0,0 +1,39 @@
+/* A group of event loops, one thread each, so a server or a client can
+ * spread its connections over several cores. Every loop is an ordinary
+ * single threaded aeEventLoop: an fd must only be touched from the loop
+ * that owns it, work for another loop goes through aePost(). */
+
+#ifndef __AE_GROUP_H__
+#define __AE_GROUP_H__
+
+#include <pthread.h>
+#include "ae.h"
+
+typedef struct aeLoopGroup {
+    int size;
+    aeEventLoop **loops;
+    pthread_t *threads;
+    int started; /* threads running, loops[0..started) */
+    unsigned int next; /* round robin cursor */
+} aeLoopGroup;
+
+/* n loops of setsize each, posting enabled. n <= 0 means one per CPU. */
+aeLoopGroup *aeCreateLoopGroup(int n, int setsize);
+/* Run aeMain() for every loop in its own thread. With pin, loop i is
+ * bound to CPU i % ncpu where the platform allows it. */
+int aeLoopGroupStart(aeLoopGroup *group, int pin);
+/* Stop every loop and join the threads. */
+void aeLoopGroupStop(aeLoopGroup *group);
+void aeDeleteLoopGroup(aeLoopGroup *group);
+
+/* Pick the loop for a new fd: round robin, or by hash so the same key
+ * (a peer address, a session id...) always lands on the same loop. */
+aeEventLoop *aeLoopGroupNext(aeLoopGroup *group);
+aeEventLoop *aeLoopGroupHash(aeLoopGroup *group, unsigned long hash);
+
+/* Hand fd to a loop picked round robin: proc runs in that loop's thread
+ * with (fd, clientData) and registers whatever file events it needs. */
+typedef void aeAssignProc(aeEventLoop *eventLoop, int fd, void *clientData);
+int aeLoopGroupAssign(aeLoopGroup *group, int fd, aeAssignProc *proc, void *clientData);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#include "ae.h"
+#include "ae_group.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+#define PRODUCERS 4
+
+struct producer
+{
+    pthread_t tid;
+    aeEventLoop *el;
+    int id;
+    int n;
+};
+
+// 只在 loop 线程读写
+static int last_seq[PRODUCERS];
+static int received;
+static int expected;
+
+static void on_task(aeEventLoop *el, void *ud)
+{
+    long v = (long)ud;
+    int id = v >> 24, seq = v & 0xffffff;
+    // 同一生产者按投递顺序执行
+    assert(seq == last_seq[id] + 1);
+    last_seq[id] = seq;
+    if (++received == expected)
+    {
+        aeStop(el);
+    }
+}
+
+static void *produce(void *ud)
+{
+    struct producer *p = ud;
+    int i;
+    for (i = 1; i <= p->n; i++)
+    {
+        assert(aePost(p->el, on_task, (void *)(long)((p->id << 24) | i)) == AE_OK);
+    }
+    return NULL;
+}
+
+// 多线程投递, loop 线程全部收到且每个生产者内有序
+static long long run_producers(int nproducer, int n)
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct producer ps[PRODUCERS];
+    int i;
+
+    assert(aePost(el, on_task, NULL) == AE_ERR); // 未开启
+    assert(aeEnablePost(el) == AE_OK);
+    memset(last_seq, 0, sizeof(last_seq));
+    received = 0;
+    expected = nproducer * n;
+
+    long long start = now_us();
+    for (i = 0; i < nproducer; i++)
+    {
+        ps[i].el = el;
+        ps[i].id = i;
+        ps[i].n = n;
+        pthread_create(&ps[i].tid, NULL, produce, &ps[i]);
+    }
+    aeMain(el);
+    long long cost = now_us() - start;
+    for (i = 0; i < nproducer; i++)
+    {
+        pthread_join(ps[i].tid, NULL);
+        assert(last_seq[i] == n);
+    }
+    assert(received == expected);
+    aeDeleteEventLoop(el);
+    return cost;
+}
+
+void test_post()
+{
+    run_producers(1, 10000);
+    run_producers(PRODUCERS, 10000);
+}
+
+static void free_task(aeEventLoop *el, void *ud)
+{
+    assert(0);
+}
+
+// 未执行的任务随 loop 释放
+void test_post_pending()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    assert(aeEnablePost(el) == AE_OK);
+    assert(aeEnablePost(el) == AE_OK);
+    assert(aePost(el, free_task, NULL) == AE_OK);
+    assert(aePost(el, free_task, NULL) == AE_OK);
+    aeDeleteEventLoop(el);
+}
+
+#define NCONN 8
+#define NLOOP 4
+
+static aeEventLoop *owner[NCONN];
+
+static void on_echo(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[64];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+    {
+        aeDeleteFileEvent(el, fd, AE_READABLE);
+        close(fd);
+        return;
+    }
+    assert(write(fd, buf, n) == n);
+}
+
+static void on_assign(aeEventLoop *el, int fd, void *ud)
+{
+    owner[(long)ud] = el;
+    assert(aeCreateFileEvent(el, fd, AE_READABLE, on_echo, NULL) == AE_OK);
+}
+
+// fd 轮询分给各 loop, 在所属线程注册并服务
+void test_group()
+{
+    aeLoopGroup *g = aeCreateLoopGroup(NLOOP, 1024);
+    int sv[NCONN][2];
+    long i;
+
+    assert(g && g->size == NLOOP);
+    assert(aeLoopGroupStart(g, 1) == AE_OK);
+    assert(aeLoopGroupStart(g, 1) == AE_ERR);
+    for (i = 0; i < NCONN; i++)
+    {
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv[i]) == 0);
+        assert(aeLoopGroupAssign(g, sv[i][1], on_assign, (void *)i) == AE_OK);
+    }
+    for (i = 0; i < NCONN; i++)
+    {
+        char buf[16];
+        assert(write(sv[i][0], "ping", 4) == 4);
+        assert(read(sv[i][0], buf, sizeof(buf)) == 4);
+        assert(memcmp(buf, "ping", 4) == 0);
+    }
+    // 轮询: 每个 loop 各分到 NCONN / NLOOP 个
+    int j, k;
+    for (j = 0; j < NLOOP; j++)
+    {
+        int n = 0;
+        for (k = 0; k < NCONN; k++)
+        {
+            n += owner[k] == g->loops[j];
+        }
+        assert(n == NCONN / NLOOP);
+    }
+    assert(aeLoopGroupHash(g, 6) == g->loops[6 % NLOOP]);
+
+    for (i = 0; i < NCONN; i++)
+    {
+        close(sv[i][0]);
+    }
+    aeDeleteLoopGroup(g);
+}
+
+void bench()
+{
+    int n = 1000000;
+    long long cost = run_producers(1, n);
+    printf("aePost 1 producer: %.1f ns per task\n", cost * 1000.0 / n);
+    cost = run_producers(PRODUCERS, n / PRODUCERS);
+    printf("aePost %d producers: %.1f ns per task\n", PRODUCERS, cost * 1000.0 / n);
+}
+
+int main(int argc, char **argv)
+{
+    test_post();
+    test_post_pending();
+    test_group();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
@@ -42,7 +42,7 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
     aeApiState *state = zmalloc(sizeof(aeApiState));
 
     if (!state) return -1;
-    state->events = zmalloc(sizeof(struct kevent)*eventLoop->setsize);
+    state->events = zmalloc(sizeof(struct kevent)*eventLoop->firedsize);
     if (!state->events) {
         zfree(state);
         return -1;
@@ -60,7 +60,7 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
 static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
     aeApiState *state = eventLoop->apidata;
 
-    state->events = zrealloc(state->events, sizeof(struct kevent)*setsize);
+    state->events = zrealloc(state->events, sizeof(struct kevent)*aeFiredSize(setsize));
     return 0;
 }
 
@@ -109,10 +109,10 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
         struct timespec timeout;
         timeout.tv_sec = tvp->tv_sec;
         timeout.tv_nsec = tvp->tv_usec * 1000;
-        retval = kevent(state->kqfd, NULL, 0, state->events, eventLoop->setsize,
+        retval = kevent(state->kqfd, NULL, 0, state->events, eventLoop->firedsize,
                         &timeout);
     } else {
-        retval = kevent(state->kqfd, NULL, 0, state->events, eventLoop->setsize,
+        retval = kevent(state->kqfd, NULL, 0, state->events, eventLoop->firedsize,
                         NULL);
     }
 
@@ -126,6 +126,10 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
 
             if (e->filter == EVFILT_READ) mask |= AE_READABLE;
             if (e->filter == EVFILT_WRITE) mask |= AE_WRITABLE;
+            /* EV_EOF alone is an orderly shutdown (read returns 0); it is
+             * an error only when fflags carries the socket error. */
+            if ((e->flags & EV_ERROR) || ((e->flags & EV_EOF) && e->fflags))
+                mask |= AE_ERROR;
             eventLoop->fired[j].fd = e->ident;
             eventLoop->fired[j].mask = mask;
         }
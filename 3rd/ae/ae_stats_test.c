@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+
+#include "ae.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void pair(int sv[2])
+{
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+}
+
+// 对数分桶与分位数
+void test_histogram()
+{
+    aeHistogram h;
+    memset(&h, 0, sizeof(h));
+    assert(aeHistogramPercentile(&h, 99) == 0);
+
+    int i;
+    for (i = 0; i < 90; i++)
+    {
+        aeHistogramAdd(&h, 10);
+    }
+    for (i = 0; i < 10; i++)
+    {
+        aeHistogramAdd(&h, 1000);
+    }
+    aeHistogramAdd(&h, 0);
+    assert(h.count == 101 && h.max == 1000 && h.sum == 10900);
+    assert(h.buckets[0] == 1 && h.buckets[4] == 90 && h.buckets[10] == 10);
+    assert(aeHistogramPercentile(&h, 50) == 15);
+    assert(aeHistogramPercentile(&h, 99) == 1000);
+    assert(aeHistogramPercentile(&h, 100) == 1000);
+
+    aeHistogramAdd(&h, ~0ULL);
+    assert(h.buckets[AE_HIST_BUCKETS - 1] == 1);
+}
+
+static int slow_n;
+static aeSlowCall slow_last;
+
+static void on_slow_call(aeEventLoop *el, const aeSlowCall *call, void *privdata)
+{
+    assert(privdata == (void *)&slow_n);
+    slow_n++;
+    slow_last = *call;
+}
+
+static void on_sleepy_read(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[16];
+    (void)read(fd, buf, sizeof(buf));
+    usleep(20000);
+}
+
+static void on_quick_read(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[16];
+    (void)read(fd, buf, sizeof(buf));
+}
+
+static int on_sleepy_timer(aeEventLoop *el, long long id, void *ud)
+{
+    usleep(20000);
+    return AE_NOMORE;
+}
+
+// 慢回调: 超过阈值的上报函数指针和 fd / 定时器 id
+void test_slow()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    int sv[2];
+    pair(sv);
+    aeSetSlowProc(el, 10000, on_slow_call, &slow_n);
+    assert(aeGetStats(el) == NULL);
+
+    slow_n = 0;
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_quick_read, NULL) == AE_OK);
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(slow_n == 0);
+
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_sleepy_read, (void *)1) == AE_OK);
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(slow_n == 1);
+    assert(slow_last.fileProc == on_sleepy_read && slow_last.timeProc == NULL);
+    assert(slow_last.fd == sv[0] && slow_last.mask == AE_READABLE);
+    assert(slow_last.clientData == (void *)1 && slow_last.us >= 10000);
+
+    long long id = aeCreateTimeEvent(el, 0, on_sleepy_timer, NULL, NULL);
+    aeProcessEvents(el, AE_TIME_EVENTS | AE_DONT_WAIT);
+    assert(slow_n == 2);
+    assert(slow_last.timeProc == on_sleepy_timer && slow_last.fileProc == NULL);
+    assert(slow_last.id == id && slow_last.fd == -1);
+
+    aeSetSlowProc(el, 0, NULL, NULL);
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(slow_n == 2);
+
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+static int on_timer(aeEventLoop *el, long long id, void *ud)
+{
+    return AE_NOMORE;
+}
+
+static void on_block_read(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[16];
+    (void)read(fd, buf, sizeof(buf));
+    // 拖住本轮, 让已到期的定时器迟到
+    usleep(20000);
+}
+
+// 计数与直方图: poll 等待, 每轮事件数, 回调耗时, 定时器迟到
+void test_stats()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    int sv[2];
+    pair(sv);
+    assert(aeEnableStats(el) == AE_OK);
+    aeStats *st = aeGetStats(el);
+    assert(st && st->iterations == 0);
+
+    // 空等一个 10ms 定时器
+    aeCreateTimeEvent(el, 10, on_timer, NULL, NULL);
+    aeProcessEvents(el, AE_ALL_EVENTS);
+    assert(st->iterations == 1 && st->pollWait.count == 1);
+    assert(st->pollWait.max >= 5000);
+    assert(st->fired.buckets[0] == 1);
+    assert(st->timeProc.count == 1 && st->timerLate.count == 1);
+
+    // 一轮两个 fd, 读回调拖住 20ms, 0ms 定时器至少迟到这么久
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_block_read, NULL) == AE_OK);
+    assert(aeCreateFileEvent(el, sv[1], AE_READABLE, on_block_read, NULL) == AE_OK);
+    aeCreateTimeEvent(el, 0, on_timer, NULL, NULL);
+    assert(write(sv[0], "x", 1) == 1);
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_ALL_EVENTS);
+    assert(st->iterations == 2);
+    assert(st->fired.max == 2);
+    assert(st->fileProc.count == 2 && st->fileProc.max >= 15000);
+    assert(st->timerLate.count == 2 && st->timerLate.max >= 30000);
+    assert(st->busy.count == 2 && st->busy.max >= 30000);
+
+    aeResetStats(el);
+    assert(st->iterations == 0 && st->fileProc.count == 0);
+    aeDisableStats(el);
+    assert(aeGetStats(el) == NULL);
+    assert(write(sv[0], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+#define BENCH_CONN 64
+#define BENCH_ROUNDS 200000
+
+static int left;
+
+static void on_pong(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[64];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+    {
+        return;
+    }
+    if (--left <= 0)
+    {
+        aeStop(el);
+        return;
+    }
+    assert(write(fd, buf, n) == n);
+}
+
+static double pingpong(int stats)
+{
+    aeEventLoop *el = aeCreateEventLoop(1024);
+    int sv[BENCH_CONN][2];
+    int i;
+    if (stats)
+    {
+        aeEnableStats(el);
+    }
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        pair(sv[i]);
+        assert(aeCreateFileEvent(el, sv[i][0], AE_READABLE, on_pong, NULL) == AE_OK);
+        assert(aeCreateFileEvent(el, sv[i][1], AE_READABLE, on_pong, NULL) == AE_OK);
+    }
+    left = BENCH_ROUNDS;
+    long long start = now_us();
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        assert(write(sv[i][0], "ping", 4) == 4);
+    }
+    aeMain(el);
+    double ns = (now_us() - start) * 1000.0 / BENCH_ROUNDS;
+    aeStats *st = aeGetStats(el);
+    if (st)
+    {
+        printf("  fileProc p50 %llu us p99 %llu us max %llu us, fired p50 %llu max %llu\n",
+               aeHistogramPercentile(&st->fileProc, 50), aeHistogramPercentile(&st->fileProc, 99),
+               st->fileProc.max, aeHistogramPercentile(&st->fired, 50), st->fired.max);
+    }
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        close(sv[i][0]);
+        close(sv[i][1]);
+    }
+    aeDeleteEventLoop(el);
+    return ns;
+}
+
+// 统计开关对 ping-pong 的开销
+void bench()
+{
+    double off = pingpong(0);
+    double on = pingpong(1);
+    printf("%d connections ping-pong: stats off %.1f ns, on %.1f ns per message\n", BENCH_CONN, off, on);
+}
+
+int main(int argc, char **argv)
+{
+    test_histogram();
+    test_slow();
+    test_stats();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
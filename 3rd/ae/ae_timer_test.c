@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "ae.h"
+
+static int fired;
+static int finalized;
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int once(struct aeEventLoop *el, long long id, void *ud)
+{
+    fired++;
+    if (ud)
+    {
+        *(long long *)ud = now_us();
+    }
+    return AE_NOMORE;
+}
+
+static void finalizer(struct aeEventLoop *el, void *ud)
+{
+    finalized++;
+}
+
+static void run_until(aeEventLoop *el, int n)
+{
+    while (fired < n)
+    {
+        aeProcessEvents(el, AE_TIME_EVENTS);
+    }
+}
+
+// 按到期时间先后触发
+void test_order()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    long long t[3];
+    fired = 0;
+    aeCreateTimeEvent(el, 30, once, &t[2], NULL);
+    aeCreateTimeEvent(el, 10, once, &t[0], NULL);
+    aeCreateTimeEvent(el, 20, once, &t[1], NULL);
+    run_until(el, 3);
+    assert(t[0] <= t[1] && t[1] <= t[2]);
+    aeDeleteEventLoop(el);
+}
+
+// 删除: 不触发, finalizer 调用一次, 重复删除返回 AE_ERR
+void test_delete()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    fired = finalized = 0;
+    long long a = aeCreateTimeEvent(el, 1, once, NULL, finalizer);
+    long long b = aeCreateTimeEvent(el, 2, once, NULL, finalizer);
+    assert(a != b && a >= 0 && b > a);
+    assert(aeDeleteTimeEvent(el, a) == AE_OK);
+    assert(finalized == 1);
+    assert(aeDeleteTimeEvent(el, a) == AE_ERR);
+    assert(aeDeleteTimeEvent(el, 12345678) == AE_ERR);
+    run_until(el, 1);
+    assert(finalized == 2);
+    assert(aeDeleteTimeEvent(el, b) == AE_ERR);
+
+    // slot 复用后旧 id 失效
+    long long c = aeCreateTimeEvent(el, 1000, once, NULL, NULL);
+    assert((c & AE_TIME_SLOT_MASK) == (a & AE_TIME_SLOT_MASK) || (c & AE_TIME_SLOT_MASK) == (b & AE_TIME_SLOT_MASK));
+    assert(aeDeleteTimeEvent(el, a) == AE_ERR);
+    assert(aeDeleteTimeEvent(el, b) == AE_ERR);
+    assert(aeDeleteTimeEvent(el, c) == AE_OK);
+    aeDeleteEventLoop(el);
+}
+
+static int periodic_n;
+static long long periodic_id;
+
+static int periodic(struct aeEventLoop *el, long long id, void *ud)
+{
+    periodic_n++;
+    if (periodic_n == 5)
+    {
+        // 回调中删除自己
+        assert(aeDeleteTimeEvent(el, id) == AE_OK);
+    }
+    return 0;
+}
+
+// 0ms 周期定时器每轮最多跑一次, 回调内删除自己安全
+void test_periodic()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    finalized = 0;
+    periodic_n = 0;
+    periodic_id = aeCreateTimeEvent(el, 0, periodic, NULL, finalizer);
+    int i;
+    for (i = 1; i <= 5; i++)
+    {
+        aeProcessEvents(el, AE_TIME_EVENTS | AE_DONT_WAIT);
+        assert(periodic_n == i);
+    }
+    assert(finalized == 1);
+    aeProcessEvents(el, AE_TIME_EVENTS | AE_DONT_WAIT);
+    assert(periodic_n == 5);
+    aeDeleteEventLoop(el);
+}
+
+static long long victim;
+
+static int killer(struct aeEventLoop *el, long long id, void *ud)
+{
+    assert(aeDeleteTimeEvent(el, victim) == AE_OK);
+    return AE_NOMORE;
+}
+
+// 回调中删除同一轮已到期的其他定时器
+void test_delete_in_callback()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    fired = finalized = 0;
+    aeCreateTimeEvent(el, 0, killer, NULL, NULL);
+    victim = aeCreateTimeEvent(el, 0, once, NULL, finalizer);
+    aeProcessEvents(el, AE_TIME_EVENTS | AE_DONT_WAIT);
+    assert(fired == 0 && finalized == 1);
+    aeDeleteEventLoop(el);
+}
+
+static long long seen[2];
+static int seen_n;
+
+static int record_now(struct aeEventLoop *el, long long id, void *ud)
+{
+    seen[seen_n++] = aeNow(el);
+    usleep(2000);
+    return AE_NOMORE;
+}
+
+// aeNow 单调, 同一轮回调看到同一时刻, 定时器不会早于 aeNow 意义下的到期时间触发
+void test_now()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    long long start = aeNow(el);
+    seen_n = 0;
+    aeCreateTimeEvent(el, 0, record_now, NULL, NULL);
+    aeCreateTimeEvent(el, 0, record_now, NULL, NULL);
+    aeProcessEvents(el, AE_TIME_EVENTS | AE_DONT_WAIT);
+    assert(seen_n == 2 && seen[0] == seen[1] && seen[0] >= start);
+
+    aeUpdateTime(el);
+    long long t0 = aeNow(el);
+    fired = 0;
+    aeCreateTimeEvent(el, 20, once, NULL, NULL);
+    run_until(el, 1);
+    assert(aeNow(el) - t0 >= 20);
+    aeDeleteEventLoop(el);
+}
+
+#define BENCH_N 100000
+
+void bench()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    long long *ids = malloc(sizeof(long long) * BENCH_N);
+    int i;
+
+    srand(1);
+    long long start = now_us();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        ids[i] = aeCreateTimeEvent(el, 60000 + rand() % 60000, once, NULL, NULL);
+    }
+    long long insert_us = now_us() - start;
+
+    // 定时器都未到期时每轮循环的开销
+    start = now_us();
+    for (i = 0; i < 1000; i++)
+    {
+        aeProcessEvents(el, AE_TIME_EVENTS | AE_DONT_WAIT);
+    }
+    long long iter_us = now_us() - start;
+
+    start = now_us();
+    for (i = 0; i < BENCH_N; i += 2)
+    {
+        aeDeleteTimeEvent(el, ids[i]);
+    }
+    long long cancel_us = now_us() - start;
+
+    // 剩余一半全部删掉, 再创建 BENCH_N 个 0~50ms 的定时器, 等全部到期后计时处理
+    for (i = 1; i < BENCH_N; i += 2)
+    {
+        aeDeleteTimeEvent(el, ids[i]);
+    }
+    fired = 0;
+    for (i = 0; i < BENCH_N; i++)
+    {
+        aeCreateTimeEvent(el, rand() % 50, once, NULL, NULL);
+    }
+    usleep(60 * 1000);
+    start = now_us();
+    run_until(el, BENCH_N);
+    long long expire_us = now_us() - start;
+
+    printf("%d timers: insert %.1f ns, idle loop iteration %.1f ns, cancel %.1f ns, expire %.1f ns per timer\n",
+           BENCH_N, insert_us * 1000.0 / BENCH_N, iter_us * 1000.0 / 1000, cancel_us * 1000.0 / (BENCH_N / 2),
+           expire_us * 1000.0 / BENCH_N);
+    free(ids);
+    aeDeleteEventLoop(el);
+}
+
+int main(int argc, char **argv)
+{
+    test_order();
+    test_delete();
+    test_periodic();
+    test_delete_in_callback();
+    test_now();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
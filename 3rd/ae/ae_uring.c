@@ -0,0 +1,400 @@
+/* Linux io_uring based ae.c module
+ *
+ * Readiness is still reported through aeFileProc: every registered fd has
+ * one oneshot IORING_OP_POLL_ADD in flight, re-armed after it fired. Mask
+ * changes only fill submission queue entries, they reach the kernel together
+ * with the wait in a single io_uring_enter() per loop iteration.
+ *
+ * On top of that aeSubmitRead() / aeSubmitWrite() offer completion based
+ * I/O, optionally on buffers registered with aeRegisterBuffers().
+ *
+ * The raw syscalls are used so no liburing is needed. Build with
+ * -DUSE_IO_URING to select this backend (see config.h).
+ */
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <endian.h>
+#include <linux/swab.h>
+
+#define AE_HAVE_COMPLETION_IO 1
+
+/* user_data tags. Poll requests are (gen << 32 | fd << 2 | 1), completion
+ * I/O carries its aeIoOp pointer, which is never 0 nor 2.
+ *
+ * Per fd state lives in the aeFileEvent: apiMask is the mask of the poll in
+ * flight (AE_NONE if none), apiFlags the generation, bumped on every re-arm
+ * so stale completions can be told apart. */
+#define AE_URING_UD_IGNORE 0
+#define AE_URING_UD_TIMEOUT 2
+
+typedef struct aeIoOp {
+    aeIoProc *proc;
+    void *clientData;
+    int fd;
+    struct aeIoOp *prev, *next; /* in flight list, freed with the loop */
+} aeIoOp;
+
+typedef struct aeApiState {
+    int ringfd;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned sqEntries;
+    unsigned toSubmit;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+    int extArg; /* IORING_FEAT_EXT_ARG: the wait takes a timeout */
+    struct __kernel_timespec ts;
+    int *rearm; /* fds fired in the last poll */
+    int rearmCount;
+    int rearmCap;
+    aeIoOp *ops;
+} aeApiState;
+
+static int aeUringEnter(aeApiState *state, unsigned submit, unsigned wait,
+        unsigned flags, struct __kernel_timespec *ts)
+{
+    struct io_uring_getevents_arg arg;
+    void *argp = NULL;
+    size_t argsz = 0;
+    int ret;
+
+    if (ts) {
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (uint64_t)(uintptr_t)ts;
+        argp = &arg;
+        argsz = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    ret = syscall(__NR_io_uring_enter, state->ringfd, submit, wait, flags, argp, argsz);
+    if (ret > 0) state->toSubmit -= ret;
+    return ret;
+}
+
+static struct io_uring_sqe *aeUringGetSqe(aeApiState *state) {
+    unsigned tail = *state->sqTail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(state->sqHead, __ATOMIC_ACQUIRE) == state->sqEntries) {
+        /* Queue full: hand the batch to the kernel now. */
+        if (aeUringEnter(state, state->toSubmit, 0, 0, NULL) < 0) return NULL;
+        if (tail - __atomic_load_n(state->sqHead, __ATOMIC_ACQUIRE) == state->sqEntries)
+            return NULL;
+    }
+    sqe = &state->sqes[tail & *state->sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    state->sqArray[tail & *state->sqMask] = tail & *state->sqMask;
+    return sqe;
+}
+
+/* Publish the sqe filled after the last aeUringGetSqe(). */
+static void aeUringCommit(aeApiState *state) {
+    __atomic_store_n(state->sqTail, *state->sqTail + 1, __ATOMIC_RELEASE);
+    state->toSubmit++;
+}
+
+static unsigned long long aeUringPollData(aeFileEvent *fe, int fd) {
+    return ((unsigned long long)fe->apiFlags << 32) | ((unsigned)fd << 2) | 1;
+}
+
+static int aeUringArm(aeApiState *state, aeFileEvent *fe, int fd, int mask) {
+    struct io_uring_sqe *sqe;
+
+    if (fe->apiMask != AE_NONE) {
+        if ((sqe = aeUringGetSqe(state)) == NULL) return -1;
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = aeUringPollData(fe, fd);
+        sqe->user_data = AE_URING_UD_IGNORE;
+        aeUringCommit(state);
+        fe->apiMask = AE_NONE;
+        fe->apiFlags++;
+    }
+    if (mask == AE_NONE) return 0;
+
+    if ((sqe = aeUringGetSqe(state)) == NULL) return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = 0;
+    if (mask & AE_READABLE) sqe->poll32_events |= POLLIN;
+    if (mask & AE_WRITABLE) sqe->poll32_events |= POLLOUT;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    sqe->poll32_events = __swahw32(sqe->poll32_events);
+#endif
+    sqe->user_data = aeUringPollData(fe, fd);
+    aeUringCommit(state);
+    fe->apiMask = mask;
+    return 0;
+}
+
+static int aeApiCreate(aeEventLoop *eventLoop) {
+    aeApiState *state = zmalloc(sizeof(aeApiState));
+    struct io_uring_params p;
+    unsigned entries = 1;
+
+    if (!state) return -1;
+    memset(state, 0, sizeof(*state));
+    state->ringfd = -1;
+    state->rearm = zmalloc(sizeof(int)*eventLoop->firedsize);
+    if (!state->rearm) goto err;
+    state->rearmCap = eventLoop->firedsize;
+
+    /* A mask change costs at most two entries, a full queue is flushed. */
+    while (entries < 256 && entries < (unsigned)eventLoop->firedsize) entries <<= 1;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+    state->ringfd = syscall(__NR_io_uring_setup, entries, &p);
+    if (state->ringfd == -1) goto err;
+    state->extArg = (p.features & IORING_FEAT_EXT_ARG) != 0;
+
+    state->sqRingSize = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    state->cqRingSize = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cqRingSize > state->sqRingSize) state->sqRingSize = state->cqRingSize;
+        state->cqRingSize = 0;
+    }
+    state->sqRing = mmap(NULL, state->sqRingSize, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, state->ringfd, IORING_OFF_SQ_RING);
+    if (state->sqRing == MAP_FAILED) goto err;
+    if (state->cqRingSize) {
+        state->cqRing = mmap(NULL, state->cqRingSize, PROT_READ|PROT_WRITE,
+                MAP_SHARED|MAP_POPULATE, state->ringfd, IORING_OFF_CQ_RING);
+        if (state->cqRing == MAP_FAILED) goto err;
+    } else {
+        state->cqRing = state->sqRing;
+    }
+    state->sqes = mmap(NULL, p.sq_entries*sizeof(struct io_uring_sqe),
+            PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, state->ringfd, IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) goto err;
+
+    state->sqHead = (unsigned *)((char *)state->sqRing + p.sq_off.head);
+    state->sqTail = (unsigned *)((char *)state->sqRing + p.sq_off.tail);
+    state->sqMask = (unsigned *)((char *)state->sqRing + p.sq_off.ring_mask);
+    state->sqArray = (unsigned *)((char *)state->sqRing + p.sq_off.array);
+    state->sqEntries = p.sq_entries;
+    state->cqHead = (unsigned *)((char *)state->cqRing + p.cq_off.head);
+    state->cqTail = (unsigned *)((char *)state->cqRing + p.cq_off.tail);
+    state->cqMask = (unsigned *)((char *)state->cqRing + p.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe *)((char *)state->cqRing + p.cq_off.cqes);
+    eventLoop->apidata = state;
+    return 0;
+
+err:
+    if (state->sqes && state->sqes != MAP_FAILED)
+        munmap(state->sqes, p.sq_entries*sizeof(struct io_uring_sqe));
+    if (state->cqRing && state->cqRing != MAP_FAILED && state->cqRing != state->sqRing)
+        munmap(state->cqRing, state->cqRingSize);
+    if (state->sqRing && state->sqRing != MAP_FAILED)
+        munmap(state->sqRing, state->sqRingSize);
+    if (state->ringfd != -1) close(state->ringfd);
+    zfree(state->rearm);
+    zfree(state);
+    return -1;
+}
+
+static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
+    aeApiState *state = eventLoop->apidata;
+    int *rearm;
+
+    /* Only grow: the list may still hold the fds of the last poll. */
+    if (aeFiredSize(setsize) <= state->rearmCap) return 0;
+    rearm = zrealloc(state->rearm, sizeof(int)*aeFiredSize(setsize));
+    if (rearm == NULL) return -1;
+    state->rearm = rearm;
+    state->rearmCap = aeFiredSize(setsize);
+    return 0;
+}
+
+static void aeApiFree(aeEventLoop *eventLoop) {
+    aeApiState *state = eventLoop->apidata;
+    aeIoOp *op, *next;
+
+    /* Closing the ring cancels whatever is still in flight. */
+    close(state->ringfd);
+    for (op = state->ops; op; op = next) {
+        next = op->next;
+        zfree(op);
+    }
+    munmap(state->sqes, state->sqEntries*sizeof(struct io_uring_sqe));
+    if (state->cqRing != state->sqRing) munmap(state->cqRing, state->cqRingSize);
+    munmap(state->sqRing, state->sqRingSize);
+    zfree(state->rearm);
+    zfree(state);
+}
+
+static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeApiState *state = eventLoop->apidata;
+    aeFileEvent *fe = aeFileEventGet(eventLoop, fd);
+
+    mask |= fe->mask; /* Merge old events */
+    if (fe->apiMask == mask) return 0;
+    return aeUringArm(state, fe, fd, mask);
+}
+
+static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
+    aeApiState *state = eventLoop->apidata;
+    aeFileEvent *fe = aeFileEventGet(eventLoop, fd);
+    int mask = fe->mask & (~delmask);
+
+    /* A poll that already fired is re-armed from the new mask later. */
+    if (fe->apiMask == AE_NONE || fe->apiMask == mask) return;
+    aeUringArm(state, fe, fd, mask);
+}
+
+static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeApiState *state = eventLoop->apidata;
+    unsigned head, tail, wait = 0, flags = 0;
+    struct __kernel_timespec *ts = NULL;
+    int j, numevents = 0;
+
+    /* Oneshot polls that fired last time and are still wanted. */
+    for (j = 0; j < state->rearmCount; j++) {
+        int fd = state->rearm[j];
+        aeFileEvent *fe;
+
+        if (fd < eventLoop->setsize && (fe = aeFileEventGet(eventLoop, fd)) &&
+            fe->apiMask == AE_NONE && fe->mask != AE_NONE)
+            aeUringArm(state, fe, fd, fe->mask);
+    }
+    state->rearmCount = 0;
+
+    /* Wait only if nothing is left over from the last call. */
+    if (*state->cqHead == __atomic_load_n(state->cqTail, __ATOMIC_ACQUIRE) &&
+        (tvp == NULL || tvp->tv_sec || tvp->tv_usec)) {
+        wait = 1;
+        flags = IORING_ENTER_GETEVENTS;
+        if (tvp) {
+            state->ts.tv_sec = tvp->tv_sec;
+            state->ts.tv_nsec = tvp->tv_usec*1000;
+            if (state->extArg) {
+                ts = &state->ts;
+            } else {
+                /* Old kernels: a timeout request that also completes
+                 * after any one other completion. */
+                struct io_uring_sqe *sqe = aeUringGetSqe(state);
+                if (sqe) {
+                    sqe->opcode = IORING_OP_TIMEOUT;
+                    sqe->fd = -1;
+                    sqe->addr = (uint64_t)(uintptr_t)&state->ts;
+                    sqe->len = 1;
+                    sqe->off = 1;
+                    sqe->user_data = AE_URING_UD_TIMEOUT;
+                    aeUringCommit(state);
+                }
+            }
+        }
+    }
+    if (state->toSubmit || wait)
+        aeUringEnter(state, state->toSubmit, wait, flags, ts);
+
+    head = *state->cqHead;
+    tail = __atomic_load_n(state->cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail && numevents < eventLoop->firedsize) {
+        struct io_uring_cqe *cqe = &state->cqes[head & *state->cqMask];
+        unsigned long long ud = cqe->user_data;
+        int res = cqe->res;
+
+        head++;
+        if (ud & 1) {
+            int fd = (ud & 0xffffffff) >> 2, mask = 0;
+            aeFileEvent *fe;
+
+            if (fd >= eventLoop->setsize || (fe = aeFileEventGet(eventLoop, fd)) == NULL ||
+                fe->apiMask == AE_NONE || fe->apiFlags != (unsigned int)(ud >> 32))
+                continue; /* removed or re-armed meanwhile */
+            fe->apiMask = AE_NONE;
+            state->rearm[state->rearmCount++] = fd;
+            if (res < 0) {
+                /* Bad fd and friends: let the handler find out. */
+                mask = AE_WRITABLE|AE_ERROR;
+            } else {
+                if (res & POLLIN) mask |= AE_READABLE;
+                if (res & POLLOUT) mask |= AE_WRITABLE;
+                /* ERR/HUP as WRITABLE, see the note in ae_epoll.c */
+                if (res & POLLERR) mask |= AE_WRITABLE|AE_ERROR;
+                if (res & POLLHUP) mask |= AE_WRITABLE;
+            }
+            eventLoop->fired[numevents].fd = fd;
+            eventLoop->fired[numevents].mask = mask;
+            numevents++;
+        } else if (ud != AE_URING_UD_IGNORE && ud != AE_URING_UD_TIMEOUT) {
+            aeIoOp *op = (aeIoOp *)(uintptr_t)ud;
+
+            if (op->prev) op->prev->next = op->next;
+            else state->ops = op->next;
+            if (op->next) op->next->prev = op->prev;
+            /* Release the entry first, the callback may queue more I/O. */
+            __atomic_store_n(state->cqHead, head, __ATOMIC_RELEASE);
+            op->proc(eventLoop, op->fd, op->clientData, res);
+            zfree(op);
+            tail = __atomic_load_n(state->cqTail, __ATOMIC_ACQUIRE);
+        }
+    }
+    __atomic_store_n(state->cqHead, head, __ATOMIC_RELEASE);
+    return numevents;
+}
+
+static char *aeApiName(void) {
+    return "io_uring";
+}
+
+static int aeApiSubmitIo(aeEventLoop *eventLoop, int opcode, int fd, void *buf,
+        size_t len, int bufIndex, aeIoProc *proc, void *clientData)
+{
+    aeApiState *state = eventLoop->apidata;
+    struct io_uring_sqe *sqe;
+    aeIoOp *op;
+
+    if ((op = zmalloc(sizeof(*op))) == NULL) return AE_ERR;
+    if ((sqe = aeUringGetSqe(state)) == NULL) {
+        zfree(op);
+        return AE_ERR;
+    }
+    op->proc = proc;
+    op->clientData = clientData;
+    op->fd = fd;
+    op->prev = NULL;
+    op->next = state->ops;
+    if (state->ops) state->ops->prev = op;
+    state->ops = op;
+
+    if (bufIndex >= 0) {
+        sqe->opcode = opcode == IORING_OP_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = bufIndex;
+    } else {
+        sqe->opcode = opcode;
+    }
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = (uint64_t)-1; /* current position, ignored for sockets */
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    aeUringCommit(state);
+    return AE_OK;
+}
+
+int aeRegisterBuffers(aeEventLoop *eventLoop, const struct iovec *iov, int n) {
+    aeApiState *state = eventLoop->apidata;
+
+    if (syscall(__NR_io_uring_register, state->ringfd, IORING_REGISTER_BUFFERS, iov, n) < 0)
+        return AE_ERR;
+    return AE_OK;
+}
+
+int aeSubmitRead(aeEventLoop *eventLoop, int fd, void *buf, size_t len,
+        int bufIndex, aeIoProc *proc, void *clientData)
+{
+    return aeApiSubmitIo(eventLoop, IORING_OP_READ, fd, buf, len, bufIndex, proc, clientData);
+}
+
+int aeSubmitWrite(aeEventLoop *eventLoop, int fd, const void *buf, size_t len,
+        int bufIndex, aeIoProc *proc, void *clientData)
+{
+    return aeApiSubmitIo(eventLoop, IORING_OP_WRITE, fd, (void *)buf, len, bufIndex, proc, clientData);
+}
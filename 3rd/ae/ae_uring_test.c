@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include "ae.h"
+
+// 后端无关的 readiness 测试, 加上 io_uring 才有的完成式 I/O
+// make ae_uring_test 用 io_uring; 去掉 -DUSE_IO_URING 即对照 epoll
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int rfired, wfired;
+
+static void on_read(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    rfired++;
+    if (ud)
+    {
+        char buf[64];
+        assert(read(fd, buf, sizeof(buf)) > 0);
+    }
+}
+
+static void on_write(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    wfired++;
+}
+
+static void pair(int sv[2])
+{
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+}
+
+// 水平触发: 不读走数据则每轮都触发; 读走后不再触发
+void test_readiness()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    int sv[2];
+    pair(sv);
+    rfired = 0;
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_read, NULL) == AE_OK);
+    aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    assert(rfired == 0);
+
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired == 2);
+
+    aeDeleteFileEvent(el, sv[0], AE_READABLE);
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_read, (void *)1) == AE_OK);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired == 3);
+    aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    assert(rfired == 3);
+
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+// 掩码增删: 先读后加写, 删掉写后只剩读
+void test_mask_change()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    int sv[2];
+    pair(sv);
+    rfired = wfired = 0;
+    assert(aeCreateFileEvent(el, sv[0], AE_READABLE, on_read, NULL) == AE_OK);
+    assert(aeCreateFileEvent(el, sv[0], AE_WRITABLE, on_write, NULL) == AE_OK);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(wfired == 1 && rfired == 0);
+
+    aeDeleteFileEvent(el, sv[0], AE_WRITABLE);
+    aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    assert(wfired == 1);
+    assert(aeGetFileEvents(el, sv[0]) == AE_READABLE);
+
+    assert(write(sv[1], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(wfired == 1 && rfired == 1);
+
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+// 删除后关闭, 同号 fd 复用, 旧的 poll 不能串到新 fd 上
+void test_fd_reuse()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    int a[2], b[2];
+    pair(a);
+    rfired = wfired = 0;
+    assert(aeCreateFileEvent(el, a[0], AE_READABLE, on_read, NULL) == AE_OK);
+    aeDeleteFileEvent(el, a[0], AE_READABLE);
+    int fd = a[0];
+    close(a[0]);
+    close(a[1]);
+
+    pair(b);
+    assert(b[0] == fd || b[1] == fd);
+    assert(aeCreateFileEvent(el, fd, AE_READABLE, on_read, (void *)1) == AE_OK);
+    aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    assert(rfired == 0);
+    assert(write(fd == b[0] ? b[1] : b[0], "x", 1) == 1);
+    aeProcessEvents(el, AE_FILE_EVENTS);
+    assert(rfired == 1);
+
+    close(b[0]);
+    close(b[1]);
+    aeDeleteEventLoop(el);
+}
+
+static int io_res[2];
+static int io_n;
+
+static void on_io(aeEventLoop *el, int fd, void *ud, int res)
+{
+    io_res[io_n++] = res;
+}
+
+// 完成式读写, 包括注册缓冲区
+void test_completion()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    static char fixed[4096];
+    char buf[16];
+    int sv[2];
+    pair(sv);
+
+    if (aeSubmitRead(el, sv[0], buf, sizeof(buf), -1, on_io, NULL) == AE_ERR)
+    {
+        // 非 io_uring 后端
+        struct iovec iov = {fixed, sizeof(fixed)};
+        assert(aeRegisterBuffers(el, &iov, 1) == AE_ERR);
+        close(sv[0]);
+        close(sv[1]);
+        aeDeleteEventLoop(el);
+        return;
+    }
+    io_n = 0;
+    assert(aeSubmitWrite(el, sv[1], "hello", 5, -1, on_io, NULL) == AE_OK);
+    while (io_n < 2)
+    {
+        aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    }
+    assert(io_res[0] == 5 && io_res[1] == 5);
+    assert(memcmp(buf, "hello", 5) == 0);
+
+    struct iovec iov = {fixed, sizeof(fixed)};
+    assert(aeRegisterBuffers(el, &iov, 1) == AE_OK);
+    memcpy(fixed + 100, "world", 5);
+    io_n = 0;
+    assert(aeSubmitWrite(el, sv[1], fixed + 100, 5, 0, on_io, NULL) == AE_OK);
+    assert(aeSubmitRead(el, sv[0], fixed + 200, 64, 0, on_io, NULL) == AE_OK);
+    while (io_n < 2)
+    {
+        aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    }
+    assert(io_res[0] == 5 && io_res[1] == 5);
+    assert(memcmp(fixed + 200, "world", 5) == 0);
+
+    // 未完成的读随 loop 释放
+    assert(aeSubmitRead(el, sv[0], buf, sizeof(buf), -1, on_io, NULL) == AE_OK);
+    close(sv[0]);
+    close(sv[1]);
+    aeDeleteEventLoop(el);
+}
+
+#define BENCH_CONN 64
+#define BENCH_ROUNDS 200000
+
+static int pingpong_left;
+
+static void on_pong(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[64];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+    {
+        return;
+    }
+    if (--pingpong_left <= 0)
+    {
+        aeStop(el);
+        return;
+    }
+    assert(write(fd, buf, n) == n);
+}
+
+// BENCH_CONN 对 socketpair 两端在同一个 loop 里互相回显
+void bench()
+{
+    aeEventLoop *el = aeCreateEventLoop(1024);
+    int sv[BENCH_CONN][2];
+    int i;
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        pair(sv[i]);
+        assert(aeCreateFileEvent(el, sv[i][0], AE_READABLE, on_pong, NULL) == AE_OK);
+        assert(aeCreateFileEvent(el, sv[i][1], AE_READABLE, on_pong, NULL) == AE_OK);
+    }
+    pingpong_left = BENCH_ROUNDS;
+    long long start = now_us();
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        assert(write(sv[i][0], "ping", 4) == 4);
+    }
+    aeMain(el);
+    long long cost = now_us() - start;
+    printf("%s: %d connections ping-pong, %.1f ns per message\n",
+           aeGetApiName(), BENCH_CONN, cost * 1000.0 / BENCH_ROUNDS);
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        close(sv[i][0]);
+        close(sv[i][1]);
+    }
+    aeDeleteEventLoop(el);
+}
+
+struct conn
+{
+    int fd;
+    char buf[64];
+};
+
+static void on_cread(aeEventLoop *el, int fd, void *ud, int res);
+
+static void on_cwrite(aeEventLoop *el, int fd, void *ud, int res)
+{
+}
+
+static void on_cread(aeEventLoop *el, int fd, void *ud, int res)
+{
+    struct conn *c = ud;
+    if (res <= 0)
+    {
+        return;
+    }
+    if (--pingpong_left <= 0)
+    {
+        aeStop(el);
+        return;
+    }
+    // 写和下一次读一起在下一轮 io_uring_enter 提交
+    assert(aeSubmitWrite(el, fd, c->buf, res, -1, on_cwrite, c) == AE_OK);
+    assert(aeSubmitRead(el, fd, c->buf, sizeof(c->buf), -1, on_cread, c) == AE_OK);
+}
+
+// 同样的回显, 用完成式读写, 省掉 readiness 之后的 read/write 系统调用
+void bench_completion()
+{
+    aeEventLoop *el = aeCreateEventLoop(1024);
+    static struct conn conns[BENCH_CONN * 2];
+    int i;
+    if (strcmp(aeGetApiName(), "io_uring") != 0)
+    {
+        aeDeleteEventLoop(el);
+        return;
+    }
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        int sv[2];
+        pair(sv);
+        conns[2 * i].fd = sv[0];
+        conns[2 * i + 1].fd = sv[1];
+    }
+    for (i = 0; i < BENCH_CONN * 2; i++)
+    {
+        assert(aeSubmitRead(el, conns[i].fd, conns[i].buf, sizeof(conns[i].buf), -1, on_cread, &conns[i]) == AE_OK);
+    }
+    pingpong_left = BENCH_ROUNDS;
+    long long start = now_us();
+    for (i = 0; i < BENCH_CONN; i++)
+    {
+        assert(write(conns[2 * i].fd, "ping", 4) == 4);
+    }
+    aeMain(el);
+    long long cost = now_us() - start;
+    printf("%s completion: %d connections ping-pong, %.1f ns per message\n",
+           aeGetApiName(), BENCH_CONN, cost * 1000.0 / BENCH_ROUNDS);
+    for (i = 0; i < BENCH_CONN * 2; i++)
+    {
+        close(conns[i].fd);
+    }
+    aeDeleteEventLoop(el);
+}
+
+int main(int argc, char **argv)
+{
+    test_readiness();
+    test_mask_change();
+    test_fd_reuse();
+    test_completion();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+        bench_completion();
+    }
+    return 0;
+}
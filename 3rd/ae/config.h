@@ -76,6 +76,12 @@
 #define HAVE_EPOLL 1
 #endif
 
+/* io_uring is opt-in: kernels before 5.1 or with it disabled by seccomp
+ * would fail aeCreateEventLoop(). Build with -DUSE_IO_URING. */
+#if defined(__linux__) && defined(USE_IO_URING)
+#define HAVE_IO_URING 1
+#endif
+
 #if (defined(__APPLE__) && defined(MAC_OS_X_VERSION_10_6)) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined (__NetBSD__)
 #define HAVE_KQUEUE 1
 #endif
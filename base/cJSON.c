@@ -215,13 +215,155 @@ typedef struct
 /* get a pointer to the buffer at the position */
 #define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
+/* exactly representable powers of ten, used by the fast number paths */
+static const double exact_powers_of_ten[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define is_digit(c) (((c) >= '0') && ((c) <= '9'))
+
+/* Parse a strict JSON number of exactly "length" bytes without strtod.
+ * Only succeeds when the result is guaranteed to be correctly rounded:
+ * the significand fits into 53 bits and the decimal exponent is within
+ * [-22, 22], so a single IEEE multiplication/division is exact (Clinger's fast path).
+ * Integers (the common case in RPC payloads) always take this path.
+ * Returns false if the caller has to fall back to strtod. */
+static cJSON_bool parse_number_fast(const unsigned char * const input, size_t length, double * const number)
+{
+    unsigned long long significand = 0;
+    int significant_digits = 0;
+    int exponent = 0;
+    cJSON_bool negative = false;
+    size_t i = 0;
+
+    if ((i < length) && (input[i] == '-'))
+    {
+        negative = true;
+        i++;
+    }
+
+    if (i >= length)
+    {
+        return false;
+    }
+
+    /* integer part, leading zeros are not allowed */
+    if (input[i] == '0')
+    {
+        i++;
+    }
+    else if (is_digit(input[i]))
+    {
+        while ((i < length) && is_digit(input[i]))
+        {
+            if (significant_digits >= 19)
+            {
+                return false;
+            }
+            significand = significand * 10 + (unsigned long long)(input[i] - '0');
+            significant_digits++;
+            i++;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    /* fraction part */
+    if ((i < length) && (input[i] == '.'))
+    {
+        i++;
+        if ((i >= length) || !is_digit(input[i]))
+        {
+            return false;
+        }
+        while ((i < length) && is_digit(input[i]))
+        {
+            if ((significand != 0) || (input[i] != '0'))
+            {
+                if (significant_digits >= 19)
+                {
+                    return false;
+                }
+                significand = significand * 10 + (unsigned long long)(input[i] - '0');
+                significant_digits++;
+            }
+            exponent--;
+            i++;
+        }
+    }
+
+    /* exponent part */
+    if ((i < length) && ((input[i] == 'e') || (input[i] == 'E')))
+    {
+        cJSON_bool negative_exponent = false;
+        int explicit_exponent = 0;
+
+        i++;
+        if ((i < length) && ((input[i] == '+') || (input[i] == '-')))
+        {
+            negative_exponent = (input[i] == '-');
+            i++;
+        }
+        if ((i >= length) || !is_digit(input[i]))
+        {
+            return false;
+        }
+        while ((i < length) && is_digit(input[i]))
+        {
+            if (explicit_exponent < 10000)
+            {
+                explicit_exponent = explicit_exponent * 10 + (input[i] - '0');
+            }
+            i++;
+        }
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+
+    if (i != length)
+    {
+        return false;
+    }
+
+    if (significand == 0)
+    {
+        *number = negative ? -0.0 : 0.0;
+        return true;
+    }
+
+    if ((significand > (1ULL << 53)) || (exponent < -22) || (exponent > 22))
+    {
+        return false;
+    }
+
+    *number = (double)significand;
+    if (exponent < 0)
+    {
+        *number /= exact_powers_of_ten[-exponent];
+    }
+    else
+    {
+        *number *= exact_powers_of_ten[exponent];
+    }
+    if (negative)
+    {
+        *number = -*number;
+    }
+
+    return true;
+}
+
 /* Parse the input text to generate a number, and populate the result into item. */
 static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
 {
     double number = 0;
     unsigned char *after_end = NULL;
     unsigned char number_c_string[64];
-    unsigned char decimal_point = get_decimal_point();
+    unsigned char decimal_point = 0;
+    size_t length = 0;
     size_t i = 0;
 
     if ((input_buffer == NULL) || (input_buffer->content == NULL))
@@ -229,12 +371,11 @@ static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_bu
         return false;
     }
 
-    /* copy the number into a temporary buffer and replace '.' with the decimal point
-     * of the current locale (for strtod)
+    /* find the end of the number
      * This also takes care of '\0' not necessarily being available for marking the end of the input */
-    for (i = 0; (i < (sizeof(number_c_string) - 1)) && can_access_at_index(input_buffer, i); i++)
+    for (length = 0; (length < (sizeof(number_c_string) - 1)) && can_access_at_index(input_buffer, length); length++)
     {
-        switch (buffer_at_offset(input_buffer)[i])
+        switch (buffer_at_offset(input_buffer)[length])
         {
             case '0':
             case '1':
@@ -250,11 +391,7 @@ static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_bu
             case '-':
             case 'e':
             case 'E':
-                number_c_string[i] = buffer_at_offset(input_buffer)[i];
-                break;
-
             case '.':
-                number_c_string[i] = decimal_point;
                 break;
 
             default:
@@ -262,12 +399,33 @@ static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_bu
         }
     }
 loop_end:
-    number_c_string[i] = '\0';
 
-    number = strtod((const char*)number_c_string, (char**)&after_end);
-    if (number_c_string == after_end)
+    if (parse_number_fast(buffer_at_offset(input_buffer), length, &number))
     {
-        return false; /* parse_error */
+        input_buffer->offset += length;
+    }
+    else
+    {
+        /* copy the number into a temporary buffer and replace '.' with the decimal point
+         * of the current locale (for strtod) */
+        decimal_point = get_decimal_point();
+        for (i = 0; i < length; i++)
+        {
+            number_c_string[i] = buffer_at_offset(input_buffer)[i];
+            if (number_c_string[i] == '.')
+            {
+                number_c_string[i] = decimal_point;
+            }
+        }
+        number_c_string[length] = '\0';
+
+        number = strtod((const char*)number_c_string, (char**)&after_end);
+        if (number_c_string == after_end)
+        {
+            return false; /* parse_error */
+        }
+
+        input_buffer->offset += (size_t)(after_end - number_c_string);
     }
 
     item->valuedouble = number;
@@ -288,7 +446,6 @@ loop_end:
 
     item->type = cJSON_Number;
 
-    input_buffer->offset += (size_t)(after_end - number_c_string);
     return true;
 }
 
@@ -423,16 +580,426 @@ static void update_offset(printbuffer * const buffer)
     buffer->offset += strlen((const char*)buffer_pointer);
 }
 
+/* Shortest round-trip double formatting, Grisu2 by Florian Loitsch
+ * ("Printing Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010),
+ * following the layout of Milo Yip's dtoa. The digits produced always parse back
+ * to the same double and are the shortest such representation in >99.9% of cases. */
+
+typedef struct
+{
+    unsigned long long f;
+    int e;
+} diy_fp;
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_MIN_EXPONENT (-DP_EXPONENT_BIAS)
+#define DP_EXPONENT_MASK 0x7FF0000000000000ULL
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+
+/* normalized 10^k, k = -348, -340, ..., 340 */
+static const unsigned long long grisu_cached_f[] =
+{
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const short grisu_cached_e[] =
+{
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static diy_fp diy_fp_from_double(double d)
+{
+    diy_fp fp;
+    unsigned long long bits = 0;
+    int biased_exponent = 0;
+    unsigned long long significand = 0;
+
+    memcpy(&bits, &d, sizeof(bits));
+    biased_exponent = (int)((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+    significand = bits & DP_SIGNIFICAND_MASK;
+    if (biased_exponent != 0)
+    {
+        fp.f = significand + DP_HIDDEN_BIT;
+        fp.e = biased_exponent - DP_EXPONENT_BIAS;
+    }
+    else
+    {
+        fp.f = significand;
+        fp.e = DP_MIN_EXPONENT + 1;
+    }
+
+    return fp;
+}
+
+/* upper 64 bits of the 128 bit product, rounded */
+static diy_fp diy_fp_multiply(diy_fp x, diy_fp y)
+{
+    const unsigned long long M32 = 0xFFFFFFFFULL;
+    unsigned long long a = x.f >> 32;
+    unsigned long long b = x.f & M32;
+    unsigned long long c = y.f >> 32;
+    unsigned long long d = y.f & M32;
+    unsigned long long ac = a * c;
+    unsigned long long bc = b * c;
+    unsigned long long ad = a * d;
+    unsigned long long bd = b * d;
+    unsigned long long tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    diy_fp r;
+
+    tmp += 1ULL << 31;
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+
+    return r;
+}
+
+static diy_fp diy_fp_normalize(diy_fp fp)
+{
+    while (!(fp.f & 0x8000000000000000ULL))
+    {
+        fp.f <<= 1;
+        fp.e--;
+    }
+
+    return fp;
+}
+
+/* the boundaries m- and m+ of the rounding interval of v, sharing m+'s normalized exponent */
+static void diy_fp_normalized_boundaries(diy_fp v, diy_fp * const minus, diy_fp * const plus)
+{
+    diy_fp pl;
+    diy_fp mi;
+
+    pl.f = (v.f << 1) + 1;
+    pl.e = v.e - 1;
+    while (!(pl.f & (DP_HIDDEN_BIT << 1)))
+    {
+        pl.f <<= 1;
+        pl.e--;
+    }
+    pl.f <<= 64 - DP_SIGNIFICAND_SIZE - 2;
+    pl.e -= 64 - DP_SIGNIFICAND_SIZE - 2;
+
+    if (v.f == DP_HIDDEN_BIT)
+    {
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    }
+    else
+    {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    *minus = mi;
+    *plus = pl;
+}
+
+/* cached power c = 10^-k such that the product with a number of binary exponent e lands in [-60, -32] */
+static diy_fp grisu_cached_power(int e, int * const k)
+{
+    diy_fp fp;
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    unsigned index = 0;
+
+    if (dk - ik > 0.0)
+    {
+        ik++;
+    }
+    index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+
+    fp.f = grisu_cached_f[index];
+    fp.e = grisu_cached_e[index];
+
+    return fp;
+}
+
+static void grisu_round(unsigned char * const buffer, int length, unsigned long long delta, unsigned long long rest, unsigned long long ten_kappa, unsigned long long wp_w)
+{
+    while ((rest < wp_w) && ((delta - rest) >= ten_kappa) &&
+           (((rest + ten_kappa) < wp_w) || ((wp_w - rest) > (rest + ten_kappa - wp_w))))
+    {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_decimal_digits32(unsigned n)
+{
+    int digits = 1;
+    while (n >= 10)
+    {
+        n /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+static void grisu_digit_gen(diy_fp w, diy_fp mp, unsigned long long delta, unsigned char * const buffer, int * const length, int * const k)
+{
+    static const unsigned long long powers_of_ten[] =
+    {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+        1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+        100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+        1000000000000000000ULL, 10000000000000000000ULL
+    };
+    const int shift = -mp.e;
+    const unsigned long long one = 1ULL << shift;
+    const unsigned long long wp_w = mp.f - w.f;
+    unsigned p1 = (unsigned)(mp.f >> shift);
+    unsigned long long p2 = mp.f & (one - 1);
+    int kappa = count_decimal_digits32(p1);
+
+    *length = 0;
+
+    while (kappa > 0)
+    {
+        unsigned long long rest = 0;
+        unsigned d = p1 / (unsigned)powers_of_ten[kappa - 1];
+
+        p1 %= (unsigned)powers_of_ten[kappa - 1];
+        if (d || *length)
+        {
+            buffer[(*length)++] = (unsigned char)('0' + d);
+        }
+        kappa--;
+
+        rest = ((unsigned long long)p1 << shift) + p2;
+        if (rest <= delta)
+        {
+            *k += kappa;
+            grisu_round(buffer, *length, delta, rest, powers_of_ten[kappa] << shift, wp_w);
+            return;
+        }
+    }
+
+    for (;;)
+    {
+        unsigned d = 0;
+
+        p2 *= 10;
+        delta *= 10;
+        d = (unsigned)(p2 >> shift);
+        if (d || *length)
+        {
+            buffer[(*length)++] = (unsigned char)('0' + d);
+        }
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta)
+        {
+            *k += kappa;
+            grisu_round(buffer, *length, delta, p2, one, (-kappa < 20) ? wp_w * powers_of_ten[-kappa] : 0);
+            return;
+        }
+    }
+}
+
+/* shortest digits of a positive finite d: d = digits * 10^k */
+static void grisu2(double d, unsigned char * const buffer, int * const length, int * const k)
+{
+    diy_fp v = diy_fp_from_double(d);
+    diy_fp w_m;
+    diy_fp w_p;
+    diy_fp c_mk;
+    diy_fp w;
+    diy_fp wp;
+    diy_fp wm;
+
+    diy_fp_normalized_boundaries(v, &w_m, &w_p);
+    c_mk = grisu_cached_power(w_p.e, k);
+    w = diy_fp_multiply(diy_fp_normalize(v), c_mk);
+    wp = diy_fp_multiply(w_p, c_mk);
+    wm = diy_fp_multiply(w_m, c_mk);
+    wm.f++;
+    wp.f--;
+    grisu_digit_gen(w, wp, wp.f - wm.f, buffer, length, k);
+}
+
+static unsigned char *write_exponent(int k, unsigned char *buffer)
+{
+    if (k < 0)
+    {
+        *buffer++ = '-';
+        k = -k;
+    }
+    else
+    {
+        *buffer++ = '+';
+    }
+
+    if (k >= 100)
+    {
+        *buffer++ = (unsigned char)('0' + k / 100);
+        k %= 100;
+        *buffer++ = (unsigned char)('0' + k / 10);
+        *buffer++ = (unsigned char)('0' + k % 10);
+    }
+    else if (k >= 10)
+    {
+        *buffer++ = (unsigned char)('0' + k / 10);
+        *buffer++ = (unsigned char)('0' + k % 10);
+    }
+    else
+    {
+        *buffer++ = (unsigned char)('0' + k);
+    }
+
+    return buffer;
+}
+
+/* place the decimal point / exponent for "length" digits scaled by 10^k, returns the end */
+static unsigned char *prettify_number(unsigned char * const buffer, int length, int k)
+{
+    const int kk = length + k; /* 10^(kk-1) <= v < 10^kk */
+    int i = 0;
+
+    if ((k >= 0) && (kk <= 21))
+    {
+        /* 1234e7 -> 12340000000 */
+        for (i = length; i < kk; i++)
+        {
+            buffer[i] = '0';
+        }
+        return &buffer[kk];
+    }
+    else if ((kk > 0) && (kk <= 21))
+    {
+        /* 1234e-2 -> 12.34 */
+        memmove(&buffer[kk + 1], &buffer[kk], (size_t)(length - kk));
+        buffer[kk] = '.';
+        return &buffer[length + 1];
+    }
+    else if ((kk > -6) && (kk <= 0))
+    {
+        /* 1234e-6 -> 0.001234 */
+        const int offset = 2 - kk;
+        memmove(&buffer[offset], &buffer[0], (size_t)length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for (i = 2; i < offset; i++)
+        {
+            buffer[i] = '0';
+        }
+        return &buffer[length + offset];
+    }
+    else if (length == 1)
+    {
+        /* 1e30 */
+        buffer[1] = 'e';
+        return write_exponent(kk - 1, &buffer[2]);
+    }
+    else
+    {
+        /* 1234e30 -> 1.234e+33 */
+        memmove(&buffer[2], &buffer[1], (size_t)(length - 1));
+        buffer[1] = '.';
+        buffer[length + 1] = 'e';
+        return write_exponent(kk - 1, &buffer[length + 2]);
+    }
+}
+
+/* integers up to 2^53 are printed directly, without going through grisu */
+static int print_integer(long long integer, unsigned char * const buffer)
+{
+    unsigned char digits[24];
+    unsigned long long magnitude = (integer < 0) ? (unsigned long long)(-integer) : (unsigned long long)integer;
+    int count = 0;
+    int length = 0;
+
+    do
+    {
+        digits[count++] = (unsigned char)('0' + (magnitude % 10));
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (integer < 0)
+    {
+        buffer[length++] = '-';
+    }
+    while (count > 0)
+    {
+        buffer[length++] = digits[--count];
+    }
+    buffer[length] = '\0';
+
+    return length;
+}
+
+/* shortest representation of d that parses back to exactly d, returns the length */
+static int print_double(double d, unsigned char * const buffer)
+{
+    unsigned char *end = buffer;
+    int length = 0;
+    int k = 0;
+
+    if ((d > -9007199254740992.0) && (d < 9007199254740992.0) && (d == (double)(long long)d))
+    {
+        unsigned long long bits = 0;
+        memcpy(&bits, &d, sizeof(bits));
+        if ((d == 0) && (bits >> 63))
+        {
+            /* keep the sign of negative zero */
+            memcpy(buffer, "-0", sizeof("-0"));
+            return 2;
+        }
+        return print_integer((long long)d, buffer);
+    }
+
+    if (d < 0)
+    {
+        *end++ = '-';
+        d = -d;
+    }
+    grisu2(d, end, &length, &k);
+    end = prettify_number(end, length, k);
+    *end = '\0';
+
+    return (int)(end - buffer);
+}
+
 /* Render the number nicely from the given item into a string. */
 static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
 {
     unsigned char *output_pointer = NULL;
     double d = item->valuedouble;
     int length = 0;
-    size_t i = 0;
-    unsigned char number_buffer[26]; /* temporary buffer to print the number into */
-    unsigned char decimal_point = get_decimal_point();
-    double test;
+    unsigned char number_buffer[32]; /* temporary buffer to print the number into */
 
     if (output_buffer == NULL)
     {
@@ -442,22 +1009,16 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     /* This checks for NaN and Infinity */
     if ((d * 0) != 0)
     {
-        length = sprintf((char*)number_buffer, "null");
+        memcpy(number_buffer, "null", sizeof("null"));
+        length = sizeof("null") - 1;
     }
     else
     {
-        /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
-        length = sprintf((char*)number_buffer, "%1.15g", d);
-
-        /* Check whether the original double can be recovered */
-        if ((sscanf((char*)number_buffer, "%lg", &test) != 1) || ((double)test != d))
-        {
-            /* If not, print with 17 decimal places of precision */
-            length = sprintf((char*)number_buffer, "%1.17g", d);
-        }
+        /* shortest representation that round-trips, independent of the locale */
+        length = print_double(d, number_buffer);
     }
 
-    /* sprintf failed or buffer overrun occured */
+    /* buffer overrun occured */
     if ((length < 0) || (length > (int)(sizeof(number_buffer) - 1)))
     {
         return false;
@@ -470,20 +1031,7 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
         return false;
     }
 
-    /* copy the printed number to the output and replace locale
-     * dependent decimal point with '.' */
-    for (i = 0; i < ((size_t)length); i++)
-    {
-        if (number_buffer[i] == decimal_point)
-        {
-            output_pointer[i] = '.';
-            continue;
-        }
-
-        output_pointer[i] = number_buffer[i];
-    }
-    output_pointer[i] = '\0';
-
+    memcpy(output_pointer, number_buffer, (size_t)length + 1);
     output_buffer->offset += (size_t)length;
 
     return true;
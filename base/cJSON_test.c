@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/time.h>
+#include "cJSON.h"
+
+// 数字 print/parse 正确性测试 + microbenchmark
+
+static uint64_t rand64()
+{
+    return ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+}
+
+static double rand_double()
+{
+    double d;
+    uint64_t bits;
+    do
+    {
+        bits = rand64();
+        memcpy(&d, &bits, sizeof(d));
+    } while ((d * 0) != 0); // 跳过 NaN Inf
+    return d;
+}
+
+static int64_t now_ns()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+static char *print_num(double d)
+{
+    cJSON *n = cJSON_CreateNumber(d);
+    char *s = cJSON_PrintUnformatted(n);
+    cJSON_Delete(n);
+    return s;
+}
+
+static double parse_num(const char *s)
+{
+    cJSON *n = cJSON_Parse(s);
+    assert(n && cJSON_IsNumber(n));
+    double d = n->valuedouble;
+    cJSON_Delete(n);
+    return d;
+}
+
+static void expect_print(double d, const char *expect)
+{
+    char *s = print_num(d);
+    if (strcmp(s, expect) != 0)
+    {
+        fprintf(stderr, "print %.17g: expect %s, got %s\n", d, expect, s);
+        assert(false);
+    }
+    free(s);
+}
+
+void test_print()
+{
+    expect_print(0, "0");
+    expect_print(-0.0, "-0");
+    expect_print(1, "1");
+    expect_print(-42, "-42");
+    expect_print(9007199254740991.0, "9007199254740991");
+    expect_print(1e15, "1000000000000000");
+    expect_print(3.14, "3.14");
+    expect_print(0.1, "0.1");
+    expect_print(-0.5, "-0.5");
+    expect_print(1.5e-7, "1.5e-7");
+    expect_print(0.000001, "0.000001");
+    expect_print(1e20, "100000000000000000000");
+    expect_print(1e21, "1e+21");
+    expect_print(1.7976931348623157e308, "1.7976931348623157e+308");
+    expect_print(5e-324, "5e-324");
+    expect_print(3.1400000000000001, "3.14");
+    expect_print(0.30000000000000004, "0.30000000000000004");
+}
+
+void test_parse()
+{
+    assert(parse_num("0") == 0);
+    assert(parse_num("-1") == -1);
+    assert(parse_num("123456789012345678") == 123456789012345678.0);
+    assert(parse_num("3.14") == 3.14);
+    assert(parse_num("1e22") == 1e22);
+    assert(parse_num("1E-22") == 1e-22);
+    assert(parse_num("1e300") == 1e300);
+    assert(parse_num("0.000123") == 0.000123);
+    assert(parse_num("12345678901234567890123") == 12345678901234567890123.0);
+
+    cJSON *arr = cJSON_Parse("[1,-2.5,3e2]");
+    assert(arr && cJSON_GetArraySize(arr) == 3);
+    assert(cJSON_GetArrayItem(arr, 0)->valueint == 1);
+    assert(cJSON_GetArrayItem(arr, 1)->valuedouble == -2.5);
+    assert(cJSON_GetArrayItem(arr, 2)->valueint == 300);
+    cJSON_Delete(arr);
+}
+
+void test_roundtrip()
+{
+    int i;
+    char buf[64];
+    for (i = 0; i < 1000000; i++)
+    {
+        double d = rand_double();
+        if (i & 1)
+        {
+            d = (double)(rand64() % 100000000) / 1000; // 短小数
+        }
+        char *s = print_num(d);
+        assert(strtod(s, NULL) == d);
+        assert(parse_num(s) == d);
+        free(s);
+
+        // 与 strtod 逐位一致
+        snprintf(buf, sizeof(buf), "%.17g", d);
+        assert(parse_num(buf) == strtod(buf, NULL));
+    }
+}
+
+#define BENCH_N 1000000
+
+static void bench()
+{
+    int i;
+    double *nums = malloc(sizeof(double) * BENCH_N);
+    char **strs = malloc(sizeof(char *) * BENCH_N);
+    assert(nums && strs);
+
+    for (i = 0; i < BENCH_N; i++)
+    {
+        switch (i % 3)
+        {
+        case 0:
+            nums[i] = (double)(rand64() % 10000000000ULL); // 整数 id
+            break;
+        case 1:
+            nums[i] = (double)(rand64() % 1000000) / 100; // 金额
+            break;
+        default:
+            nums[i] = rand_double();
+            break;
+        }
+    }
+
+    char buf[32];
+    double test;
+    int64_t start = now_ns();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        // 原实现: %1.15g 不能还原再 %1.17g
+        sprintf(buf, "%1.15g", nums[i]);
+        if (sscanf(buf, "%lg", &test) != 1 || test != nums[i])
+        {
+            sprintf(buf, "%1.17g", nums[i]);
+        }
+    }
+    int64_t sprintf_ns = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        strs[i] = print_num(nums[i]);
+    }
+    int64_t print_ns = now_ns() - start;
+
+    volatile double sink = 0;
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        sink += strtod(strs[i], NULL);
+    }
+    int64_t strtod_ns = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        sink += parse_num(strs[i]);
+    }
+    int64_t parse_ns = now_ns() - start;
+
+    printf("print  sprintf+sscanf %6.1f ns/op, cJSON %6.1f ns/op\n", (double)sprintf_ns / BENCH_N, (double)print_ns / BENCH_N);
+    printf("parse  strtod         %6.1f ns/op, cJSON %6.1f ns/op\n", (double)strtod_ns / BENCH_N, (double)parse_ns / BENCH_N);
+
+    for (i = 0; i < BENCH_N; i++)
+    {
+        free(strs[i]);
+    }
+    free(strs);
+    free(nums);
+}
+
+int main(int argc, char **argv)
+{
+    srand(time(NULL));
+
+    test_print();
+    test_parse();
+    test_roundtrip();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
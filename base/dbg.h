@@ -19,11 +19,23 @@ void bin2hex(const char *bin, size_t sz);
 
 #define UNUSED(x) ((void)(x))
 
+// cc -DDBG_BINARY_TRACE 并链接 base/trace.c: LOG_INFO/LOG_ERROR 改写二进制 trace
+// 环境变量 TRACE_FILE 指定文件, 用 tracedump 还原; 未指定时输出同下
+#ifdef DBG_BINARY_TRACE
+#include "trace.h"
+
+#define LOG_INFO(fmt, ...) \
+    TRACE_INFO(fmt, ##__VA_ARGS__);
+
+#define LOG_ERROR(fmt, ...) \
+    TRACE_ERROR(fmt, ##__VA_ARGS__);
+#else
 #define LOG_INFO(fmt, ...) \
     fprintf(stderr, "\x1B[1;32m[INFO] " fmt "\x1B[0m in function %s %s:%d\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
 
 #define LOG_ERROR(fmt, ...) \
     fprintf(stderr, "\x1B[1;31m[ERROR] " fmt "\x1B[0m in function %s %s:%d\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
+#endif
 
 #define PANIC(fmt, ...)                                                                                                     \
     fprintf(stderr, "\x1B[1;31m[PANIC] " fmt "\x1B[0m in function %s %s:%d\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__); \
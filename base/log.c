@@ -1,16 +1,417 @@
 #include <time.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sched.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "thread.h"
 #include "log.h"
 
 static int log_level = 0;
 
-static const char *level_names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
-static const char *level_colors[] = {"\x1b[94m", "\x1b[36m", "\x1b[32m", "\x1b[33m", "\x1b[31m", "\x1b[35m"};
+// 级别前缀预先拼好, 热路径只做 memcpy
+static const char *level_tags[] = {
+    " \x1b[94mTRACE]\x1b[0m ",
+    " \x1b[36mDEBUG]\x1b[0m ",
+    " \x1b[32m INFO]\x1b[0m ",
+    " \x1b[33m WARN]\x1b[0m ",
+    " \x1b[31mERROR]\x1b[0m ",
+    " \x1b[35mFATAL]\x1b[0m ",
+};
+
+// 每线程 ring 大小, 必须是 2 的幂
+#define LOG_RING_SZ (64 * 1024)
+#define LOG_RING_MASK (LOG_RING_SZ - 1)
+#define CACHELINE 64
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// 单生产者 (所属线程) 单消费者 (flusher), head/tail 为累计字节数
+struct log_ring
+{
+    uint64_t head;
+    char pad1[CACHELINE - sizeof(uint64_t)];
+    uint64_t tail;
+    char pad2[CACHELINE - sizeof(uint64_t)];
+    int dead; // 所属线程已退出, 刷完后由 flusher / log_async_stop 释放
+    struct log_ring *next;
+    char data[LOG_RING_SZ];
+};
+
+static struct
+{
+    int fd;
+    bool running;
+    bool draining; // 从 start 到 stop 最后一次刷完, 期间 ring 归 flusher 释放
+    int producers; // 正在 ring_push 的线程数, flusher 要等它们都写完才退出
+    pthread_t tid;
+    pthread_key_t key;
+    pthread_mutex_t mutex; // 保护 rings 链表, 及 cond
+    pthread_cond_t cond;
+    struct log_ring *rings;
+    uint64_t gen; // flusher 完成的轮数
+    bool flush_req;
+    int sleeping; // flusher 在 timedwait 中
+} L = {
+    .fd = STDERR_FILENO,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread struct log_ring *tl_ring;
+
+// 每线程缓存当前秒的时间字符串, 一秒只 localtime_r 一次
+static __thread time_t tl_sec = -1;
+static __thread char tl_ts[16];
 
 void log_setlevel(int level)
 {
-    level = level;
+    log_level = level;
+}
+
+static int format_line(char *buf, int level, const char *func, const char *file, int line, const char *fmt, va_list args)
+{
+    time_t t = time(NULL);
+    if (t != tl_sec)
+    {
+        struct tm lt;
+        localtime_r(&t, &lt);
+        strftime(tl_ts, sizeof(tl_ts), "%H:%M:%S", &lt);
+        tl_sec = t;
+    }
+
+    char *p = buf;
+    char *end = buf + LOG_LINE_MAX;
+    *p++ = '[';
+    memcpy(p, tl_ts, 8);
+    p += 8;
+    size_t n = strlen(level_tags[level]);
+    memcpy(p, level_tags[level], n);
+    p += n;
+
+    int r = vsnprintf(p, end - p, fmt, args);
+    if (r > 0)
+    {
+        p += r < end - p ? r : end - p - 1;
+    }
+    r = snprintf(p, end - p, " \x1b[2;90min func %s %s:%d\x1b[0m\n", func, file, line);
+    if (r > 0)
+    {
+        p += r < end - p ? r : end - p - 1;
+    }
+    // 截断时保证以换行结尾
+    if (p[-1] != '\n')
+    {
+        p[-1] = '\n';
+    }
+    return p - buf;
+}
+
+static void write_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+static void ring_destructor(void *ud)
+{
+    struct log_ring *r = ud;
+    RETCHECK(pthread_mutex_lock(&L.mutex));
+    // stop 之后没人再刷, 空的直接释放; 否则交给 flusher
+    if (!L.draining && r->head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+    {
+        struct log_ring **pp = &L.rings;
+        while (*pp != r)
+        {
+            pp = &(*pp)->next;
+        }
+        *pp = r->next;
+        free(r);
+    }
+    else
+    {
+        __atomic_store_n(&r->dead, 1, __ATOMIC_RELEASE);
+    }
+    RETCHECK(pthread_mutex_unlock(&L.mutex));
+}
+
+static struct log_ring *ring_get()
+{
+    if (tl_ring)
+    {
+        return tl_ring;
+    }
+    struct log_ring *r = malloc(sizeof(*r));
+    assert(r);
+    r->head = 0;
+    r->tail = 0;
+    r->dead = 0;
+
+    RETCHECK(pthread_mutex_lock(&L.mutex));
+    r->next = L.rings;
+    L.rings = r;
+    RETCHECK(pthread_mutex_unlock(&L.mutex));
+
+    pthread_setspecific(L.key, r);
+    tl_ring = r;
+    return r;
+}
+
+// 调用方已计入 L.producers, flusher 不会在此期间退出
+static void ring_push(struct log_ring *r, const char *line, int n)
+{
+    uint64_t head = r->head;
+    uint64_t used = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    while (used + n > LOG_RING_SZ)
+    {
+        // ring 满, 等 flusher 腾出空间; 不能绕过 ring 同步写, 否则乱序
+        pthread_cond_signal(&L.cond);
+        sched_yield();
+        used = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    }
+
+    size_t off = head & LOG_RING_MASK;
+    size_t first = LOG_RING_SZ - off;
+    if (first >= (size_t)n)
+    {
+        memcpy(r->data + off, line, n);
+    }
+    else
+    {
+        memcpy(r->data + off, line, first);
+        memcpy(r->data, line + first, n - first);
+    }
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+
+    // 超过半满且 flusher 在睡才唤醒, 平时不进内核
+    if (used + n > LOG_RING_SZ / 2 && __atomic_load_n(&L.sleeping, __ATOMIC_RELAXED))
+    {
+        pthread_cond_signal(&L.cond);
+    }
+}
+
+// 把所有 ring 当前可读部分一次 writev 出去, 返回刷出字节数
+static size_t flush_once()
+{
+    struct iovec iov[IOV_MAX];
+    struct log_ring *rs[IOV_MAX / 2];
+    uint64_t heads[IOV_MAX / 2];
+    size_t total = 0;
+
+    RETCHECK(pthread_mutex_lock(&L.mutex));
+    struct log_ring **pp = &L.rings;
+    for (;;)
+    {
+        int nr = 0, niov = 0;
+        struct log_ring *r;
+        while ((r = *pp) != NULL && nr < IOV_MAX / 2)
+        {
+            // 先读 dead 再读 head: 线程退出前的写入此时都可见
+            int dead = __atomic_load_n(&r->dead, __ATOMIC_ACQUIRE);
+            uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+            uint64_t tail = r->tail;
+            if (head == tail)
+            {
+                if (dead)
+                {
+                    *pp = r->next;
+                    free(r);
+                }
+                else
+                {
+                    pp = &r->next;
+                }
+                continue;
+            }
+
+            size_t off = tail & LOG_RING_MASK;
+            size_t len = head - tail;
+            size_t first = LOG_RING_SZ - off;
+            if (first >= len)
+            {
+                iov[niov].iov_base = r->data + off;
+                iov[niov++].iov_len = len;
+            }
+            else
+            {
+                iov[niov].iov_base = r->data + off;
+                iov[niov++].iov_len = first;
+                iov[niov].iov_base = r->data;
+                iov[niov++].iov_len = len - first;
+            }
+            rs[nr] = r;
+            heads[nr++] = head;
+            total += len;
+            pp = &r->next;
+        }
+
+        if (niov > 0)
+        {
+            // 生产者只在注册时拿锁, writev 期间放锁
+            RETCHECK(pthread_mutex_unlock(&L.mutex));
+            write_all(L.fd, iov, niov);
+            int i;
+            for (i = 0; i < nr; i++)
+            {
+                __atomic_store_n(&rs[i]->tail, heads[i], __ATOMIC_RELEASE);
+            }
+            RETCHECK(pthread_mutex_lock(&L.mutex));
+        }
+        if (*pp == NULL)
+        {
+            break;
+        }
+    }
+    RETCHECK(pthread_mutex_unlock(&L.mutex));
+    return total;
+}
+
+static void *flusher(void *ud)
+{
+    for (;;)
+    {
+        size_t n = flush_once();
+
+        RETCHECK(pthread_mutex_lock(&L.mutex));
+        L.gen++;
+        pthread_cond_broadcast(&L.cond);
+        // 停止后还要等手上正在 push 的写完, 它们可能在等 ring 腾空间
+        if (!L.running && n == 0 && __atomic_load_n(&L.producers, __ATOMIC_SEQ_CST) == 0)
+        {
+            RETCHECK(pthread_mutex_unlock(&L.mutex));
+            break;
+        }
+        if (n == 0 && !L.flush_req)
+        {
+            // 空闲时最多睡 1ms, 生产者只在 ring 过半时唤醒
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 1000000;
+            if (ts.tv_nsec >= 1000000000)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            __atomic_store_n(&L.sleeping, 1, __ATOMIC_RELAXED);
+            pthread_cond_timedwait(&L.cond, &L.mutex, &ts);
+            __atomic_store_n(&L.sleeping, 0, __ATOMIC_RELAXED);
+        }
+        L.flush_req = false;
+        RETCHECK(pthread_mutex_unlock(&L.mutex));
+    }
+    return NULL;
+}
+
+int log_async_start(int fd)
+{
+    RETCHECK(pthread_mutex_lock(&L.mutex));
+    if (L.running)
+    {
+        RETCHECK(pthread_mutex_unlock(&L.mutex));
+        return -1;
+    }
+    static bool key_created = false;
+    if (!key_created)
+    {
+        RETCHECK(pthread_key_create(&L.key, ring_destructor));
+        key_created = true;
+    }
+    __atomic_store_n(&L.fd, fd, __ATOMIC_RELAXED);
+    L.draining = true;
+    __atomic_store_n(&L.running, true, __ATOMIC_RELEASE);
+    RETCHECK(pthread_mutex_unlock(&L.mutex));
+
+    RETCHECK(pthread_create(&L.tid, NULL, flusher, NULL));
+    return 0;
+}
+
+void log_flush()
+{
+    RETCHECK(pthread_mutex_lock(&L.mutex));
+    if (!L.running)
+    {
+        RETCHECK(pthread_mutex_unlock(&L.mutex));
+        return;
+    }
+    // 调用前写入的数据最迟在下一整轮被刷出
+    uint64_t target = L.gen + 2;
+    while (L.running && L.gen < target)
+    {
+        L.flush_req = true;
+        pthread_cond_broadcast(&L.cond);
+        pthread_cond_wait(&L.cond, &L.mutex);
+    }
+    RETCHECK(pthread_mutex_unlock(&L.mutex));
+}
+
+void log_async_stop()
+{
+    RETCHECK(pthread_mutex_lock(&L.mutex));
+    if (!L.running)
+    {
+        RETCHECK(pthread_mutex_unlock(&L.mutex));
+        return;
+    }
+    __atomic_store_n(&L.running, false, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&L.cond);
+    RETCHECK(pthread_mutex_unlock(&L.mutex));
+
+    RETCHECK(pthread_join(L.tid, NULL));
+    // flusher 最后一轮空扫之后仍可能有 push 完成, 这里再刷到底;
+    // 之后新的 log_log 都看到 running 为 false, 不会再写 ring
+    while (flush_once() > 0)
+    {
+    }
+    // 已退出线程的 ring 都空了, 释放掉; 之后退出的由 ring_destructor 自己释放
+    RETCHECK(pthread_mutex_lock(&L.mutex));
+    L.draining = false;
+    struct log_ring **pp = &L.rings;
+    while (*pp)
+    {
+        struct log_ring *r = *pp;
+        if (__atomic_load_n(&r->dead, __ATOMIC_ACQUIRE))
+        {
+            *pp = r->next;
+            free(r);
+        }
+        else
+        {
+            pp = &r->next;
+        }
+    }
+    RETCHECK(pthread_mutex_unlock(&L.mutex));
+    __atomic_store_n(&L.fd, STDERR_FILENO, __ATOMIC_RELAXED);
 }
 
 void log_log(int level, const char *func, const char *file, int line, const char *fmt, ...)
@@ -20,17 +421,31 @@ void log_log(int level, const char *func, const char *file, int line, const char
         return;
     }
 
-    time_t t = time(NULL);
-    struct tm *lt = localtime(&t);
-    char buf[16];
-    buf[strftime(buf, sizeof(buf), "%H:%M:%S", lt)] = '\0';
-    
-    fprintf(stderr, "[%s %s%5s]\x1b[0m ", buf, level_colors[level], level_names[level]);
-    
+    char buf[LOG_LINE_MAX];
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    int n = format_line(buf, level, func, file, line, fmt, args);
     va_end(args);
-    
-    fprintf(stderr, " \x1b[2;90min func %s %s:%d\x1b[0m\n", func, file, line);
-}
\ No newline at end of file
+
+    // 先计数再读 running, 与 stop 先清 running, flusher 再读计数配对
+    __atomic_fetch_add(&L.producers, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&L.running, __ATOMIC_SEQ_CST))
+    {
+        __atomic_fetch_sub(&L.producers, 1, __ATOMIC_RELEASE);
+        // 正在 stop: 本线程 ring 里还没刷出的先出去, 再同步写, 保证顺序
+        while (tl_ring && __atomic_load_n(&tl_ring->tail, __ATOMIC_ACQUIRE) != tl_ring->head)
+        {
+            sched_yield();
+        }
+        struct iovec iov = {buf, n};
+        write_all(__atomic_load_n(&L.fd, __ATOMIC_RELAXED), &iov, 1);
+        return;
+    }
+    ring_push(ring_get(), buf, n);
+    __atomic_fetch_sub(&L.producers, 1, __ATOMIC_RELEASE);
+
+    if (level == LOG_FATAL)
+    {
+        log_flush();
+    }
+}
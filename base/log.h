@@ -13,15 +13,41 @@ enum
     LOG_FATAL
 };
 
+// 编译期过滤: cc -DLOG_MIN_LEVEL=2 低于 INFO 的 log_xxx 调用直接被编译器消除
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// 单条日志最大长度, 超出截断
+#define LOG_LINE_MAX 1024
+
 void log_setlevel(int level);
 void log_log(int level, const char *func, const char *file, int line, const char *fmt, ...);
 
-#define log_trace(...) log_log(LOG_TRACE, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_debug(...) log_log(LOG_DEBUG, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_info(...) log_log(LOG_INFO, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_warn(...) log_log(LOG_WARN, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_error(...) log_log(LOG_ERROR, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_fatal(...) log_log(LOG_FATAL, __func__, __FILE__, __LINE__, __VA_ARGS__)
+// 异步模式: 日志格式化后写入线程私有的 ring buffer (无锁, 单生产者单消费者),
+// 后台线程用 writev 批量刷到 fd; ring 满时生产者让出 CPU 等待
+// 未 start 时 log_log 同步 write(2) 到 stderr
+int log_async_start(int fd);
+// 刷完所有 ring 后退出后台线程
+void log_async_stop();
+// 阻塞直到调用前写入的日志都已刷出
+void log_flush();
+
+#define LOG_LOG(level, ...)                                              \
+    do                                                                   \
+    {                                                                    \
+        if ((level) >= LOG_MIN_LEVEL)                                    \
+        {                                                                \
+            log_log((level), __func__, __FILE__, __LINE__, __VA_ARGS__); \
+        }                                                                \
+    } while (0)
+
+#define log_trace(...) LOG_LOG(LOG_TRACE, __VA_ARGS__)
+#define log_debug(...) LOG_LOG(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...) LOG_LOG(LOG_INFO, __VA_ARGS__)
+#define log_warn(...) LOG_LOG(LOG_WARN, __VA_ARGS__)
+#define log_error(...) LOG_LOG(LOG_ERROR, __VA_ARGS__)
+#define log_fatal(...) LOG_LOG(LOG_FATAL, __VA_ARGS__)
 
 #define LOG_TRACE(fmt, ...) fprintf(stderr, "\x1B[1;94m[TRACE]\x1B[0m " fmt " \x1b[2;90min func %s %s:%d\x1b[0m\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
 #define LOG_DEBUG(fmt, ...) fprintf(stderr, "\x1B[1;36m[DEBUG]\x1B[0m " fmt " \x1b[2;90min func %s %s:%d\x1b[0m\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "log.h"
+
+#define N_THREAD 4
+#define N_LINE 20000
+
+static int64_t now_ns()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+static char *read_file(const char *path, size_t *sz)
+{
+    FILE *f = fopen(path, "r");
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    *sz = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *s = malloc(*sz + 1);
+    assert(fread(s, 1, *sz, f) == *sz);
+    s[*sz] = 0;
+    fclose(f);
+    return s;
+}
+
+static int count_lines(const char *s)
+{
+    int n = 0;
+    for (; *s; s++)
+    {
+        n += *s == '\n';
+    }
+    return n;
+}
+
+void test_level()
+{
+    char path[] = "/tmp/log_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+
+    // 未 start: 同步写 stderr, 这里 dup 过去检查内容
+    int saved = dup(STDERR_FILENO);
+    dup2(fd, STDERR_FILENO);
+    log_setlevel(LOG_WARN);
+    log_info("hidden %d", 1);
+    log_warn("shown %d", 2);
+    log_error("shown %s", "3");
+    log_setlevel(LOG_TRACE);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    size_t sz;
+    char *s = read_file(path, &sz);
+    assert(strstr(s, "hidden") == NULL);
+    assert(strstr(s, "shown 2") && strstr(s, "shown 3"));
+    assert(strstr(s, " WARN]") && strstr(s, "ERROR]"));
+    assert(count_lines(s) == 2);
+    free(s);
+
+    // 超长截断, 仍以换行结尾
+    ftruncate(fd, 0);
+    lseek(fd, 0, SEEK_SET);
+    assert(log_async_start(fd) == 0);
+    char *big = malloc(LOG_LINE_MAX * 2);
+    memset(big, 'x', LOG_LINE_MAX * 2 - 1);
+    big[LOG_LINE_MAX * 2 - 1] = 0;
+    log_info("%s", big);
+    free(big);
+    log_async_stop();
+    s = read_file(path, &sz);
+    assert(sz == LOG_LINE_MAX - 1 && s[sz - 1] == '\n');
+    free(s);
+
+    close(fd);
+    unlink(path);
+}
+
+static void *writer(void *ud)
+{
+    long id = (long)ud;
+    int i;
+    for (i = 0; i < N_LINE; i++)
+    {
+        log_info("thread-%ld seq-%d", id, i);
+    }
+    return NULL;
+}
+
+// 多线程写, 每个线程的行完整且有序
+void test_async()
+{
+    char path[] = "/tmp/log_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(log_async_start(fd) == 0);
+
+    pthread_t threads[N_THREAD];
+    long i;
+    for (i = 0; i < N_THREAD; i++)
+    {
+        pthread_create(&threads[i], NULL, writer, (void *)i);
+    }
+    for (i = 0; i < N_THREAD; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    log_info("main");
+    log_flush();
+    log_async_stop();
+
+    size_t sz;
+    char *s = read_file(path, &sz);
+    assert(count_lines(s) == N_THREAD * N_LINE + 1);
+
+    int next[N_THREAD] = {0};
+    char *line = s;
+    while (*line)
+    {
+        char *nl = strchr(line, '\n');
+        assert(nl);
+        *nl = 0;
+        long id;
+        int seq;
+        char *p = strstr(line, "thread-");
+        if (p)
+        {
+            assert(sscanf(p, "thread-%ld seq-%d", &id, &seq) == 2);
+            assert(seq == next[id]);
+            next[id]++;
+        }
+        line = nl + 1;
+    }
+    for (i = 0; i < N_THREAD; i++)
+    {
+        assert(next[i] == N_LINE);
+    }
+    free(s);
+    close(fd);
+    unlink(path);
+}
+
+static void check_order(const char *path, int nthread, int nline)
+{
+    size_t sz;
+    char *s = read_file(path, &sz);
+    int next[N_THREAD] = {0};
+    char *line = s;
+    long i;
+    while (*line)
+    {
+        char *nl = strchr(line, '\n');
+        assert(nl);
+        *nl = 0;
+        long id;
+        int seq;
+        char *p = strstr(line, "thread-");
+        assert(p && sscanf(p, "thread-%ld seq-%d", &id, &seq) == 2);
+        assert(id < nthread && seq == next[id]);
+        next[id]++;
+        line = nl + 1;
+    }
+    for (i = 0; i < nthread; i++)
+    {
+        assert(next[i] == nline);
+    }
+    free(s);
+}
+
+// 写的过程中 stop: 不丢行, ring 满时和 stop 之后的同步写都不乱序
+void test_stop_while_writing()
+{
+    char path[] = "/tmp/log_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    // stop 之后同步写到 stderr, 指向同一个文件
+    int saved = dup(STDERR_FILENO);
+    dup2(fd, STDERR_FILENO);
+
+    int round;
+    for (round = 0; round < 20; round++)
+    {
+        ftruncate(fd, 0);
+        lseek(fd, 0, SEEK_SET);
+        assert(log_async_start(fd) == 0);
+        pthread_t threads[N_THREAD];
+        long i;
+        for (i = 0; i < N_THREAD; i++)
+        {
+            pthread_create(&threads[i], NULL, writer, (void *)i);
+        }
+        usleep(round * 500);
+        log_async_stop();
+        for (i = 0; i < N_THREAD; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        check_order(path, N_THREAD, N_LINE);
+    }
+
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    close(fd);
+    unlink(path);
+}
+
+// 原实现: localtime + strftime + 3 次 fprintf
+static void log_stdio(int level, const char *func, const char *file, int line, const char *fmt, ...)
+{
+    static const char *level_names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+    static const char *level_colors[] = {"\x1b[94m", "\x1b[36m", "\x1b[32m", "\x1b[33m", "\x1b[31m", "\x1b[35m"};
+    time_t t = time(NULL);
+    struct tm *lt = localtime(&t);
+    char buf[16];
+    buf[strftime(buf, sizeof(buf), "%H:%M:%S", lt)] = '\0';
+    fprintf(stderr, "[%s %s%5s]\x1b[0m ", buf, level_colors[level], level_names[level]);
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, " \x1b[2;90min func %s %s:%d\x1b[0m\n", func, file, line);
+}
+
+#define BENCH_N 200000
+
+static int bench_mode;
+
+static void *bench_writer(void *ud)
+{
+    long id = (long)ud;
+    int i;
+    for (i = 0; i < BENCH_N; i++)
+    {
+        if (bench_mode == 0)
+        {
+            log_stdio(LOG_INFO, __func__, __FILE__, __LINE__, "req %d from thread %ld done in %dus", i, id, 42);
+        }
+        else
+        {
+            log_info("req %d from thread %ld done in %dus", i, id, 42);
+        }
+    }
+    return NULL;
+}
+
+static double bench_run(int mode, int nthread)
+{
+    pthread_t threads[64];
+    long i;
+    bench_mode = mode;
+    int64_t start = now_ns();
+    for (i = 0; i < nthread; i++)
+    {
+        pthread_create(&threads[i], NULL, bench_writer, (void *)i);
+    }
+    for (i = 0; i < nthread; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    int64_t ns = now_ns() - start;
+    // 总耗时 / 总调用数
+    return (double)ns / ((double)nthread * BENCH_N);
+}
+
+void bench()
+{
+    int fd = open("/dev/null", O_WRONLY);
+    assert(fd >= 0);
+    int saved = dup(STDERR_FILENO);
+    int nthreads[] = {1, 2, 4, 8};
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        int n = nthreads[i];
+
+        dup2(fd, STDERR_FILENO);
+        double stdio_ns = bench_run(0, n);
+        double sync_ns = bench_run(1, n);
+        assert(log_async_start(fd) == 0);
+        double async_ns = bench_run(1, n);
+        log_async_stop();
+        dup2(saved, STDERR_FILENO);
+
+        printf("threads %d: stdio %7.1f ns/call, sync %7.1f ns/call, async %7.1f ns/call\n", n, stdio_ns, sync_ns, async_ns);
+    }
+    close(saved);
+    close(fd);
+}
+
+int main(int argc, char **argv)
+{
+    test_level();
+    test_async();
+    test_stop_while_writing();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
@@ -0,0 +1,831 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+/*
+文件格式 (本机字节序):
+    header 64 字节: magic "WTRC", version, cap, used, dropped
+    record 8 字节对齐:
+        u32 len   整条记录长度 (含头和 padding), 内容写完后最后写入, 0 表示未写完或文件结尾
+        u32 id    TRACE_ID_SITE: 调用点定义, 其他: 事件对应的调用点 id
+    调用点定义: u32 site_id, u32 line, level\0 fmt\0 file\0 func\0
+    事件: u64 ns (CLOCK_REALTIME), 参数依次紧密排列
+        int 4 字节, 64 位整数/指针/double 8 字节, 字符串 u16 长度 + 字节
+*/
+
+#define TRACE_MAGIC "WTRC"
+#define TRACE_VERSION 1
+#define TRACE_HDR_SZ 64
+#define TRACE_ID_SITE 0xffffffffu
+#define TRACE_STR_MAX 0xffff
+
+enum
+{
+    T_INT,  // int, short, char
+    T_I64,  // long (LP64), long long, size_t, intmax_t, ptrdiff_t
+    T_DBL,  // double, float
+    T_LDBL, // long double, 按 double 存
+    T_STR,
+    T_PTR,
+};
+
+struct trace_hdr
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t cap;
+    uint64_t used;
+    uint64_t dropped;
+};
+
+static struct
+{
+    pthread_mutex_t mutex; // 保护 open/close 与调用点登记
+    char *base;
+    int fd;
+    size_t cap;
+    uint32_t epoch; // 每次 open 递增, 调用点需在新文件里重新登记
+    uint32_t nsites;
+    bool env_checked; // 读过 TRACE_FILE, 之后未打开就直接走 stderr, 不再加锁
+    int writers;      // 正在往 base 写的 trace_log 个数, close 等它归零再 munmap
+} T = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+// 格式串中的一个转换说明 %[flags][width][.prec][len]conv
+struct fmt_spec
+{
+    const char *begin; // '%'
+    const char *body;  // flags/width/prec 起始
+    const char *body_end;
+    const char *end; // conv 之后
+    char len;        // 0 h H(hh) l q(ll) j z t L
+    char conv;
+};
+
+static const char *next_spec(const char *p, struct fmt_spec *s)
+{
+    p = strchr(p, '%');
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    s->begin = p++;
+    s->body = p;
+    while (*p && strchr("-+ #0'", *p))
+    {
+        p++;
+    }
+    if (*p == '*')
+    {
+        p++;
+    }
+    else
+    {
+        while (isdigit((unsigned char)*p))
+        {
+            p++;
+        }
+    }
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+        {
+            p++;
+        }
+        else
+        {
+            while (isdigit((unsigned char)*p))
+            {
+                p++;
+            }
+        }
+    }
+    s->body_end = p;
+
+    s->len = 0;
+    switch (*p)
+    {
+    case 'h':
+        s->len = p[1] == 'h' ? 'H' : 'h';
+        p += p[1] == 'h' ? 2 : 1;
+        break;
+    case 'l':
+        s->len = p[1] == 'l' ? 'q' : 'l';
+        p += p[1] == 'l' ? 2 : 1;
+        break;
+    case 'q':
+    case 'j':
+    case 'z':
+    case 't':
+    case 'L':
+        s->len = *p++;
+        break;
+    }
+    s->conv = *p;
+    if (*p)
+    {
+        p++;
+    }
+    s->end = p;
+    return s->begin;
+}
+
+static int int_type(size_t sz)
+{
+    return sz > sizeof(int) ? T_I64 : T_INT;
+}
+
+// 返回参数类型, 不支持返回 -1
+static int spec_type(const struct fmt_spec *s)
+{
+    switch (s->conv)
+    {
+    case 'd':
+    case 'i':
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+        switch (s->len)
+        {
+        case 'l':
+            return int_type(sizeof(long));
+        case 'q':
+            return int_type(sizeof(long long));
+        case 'j':
+            return int_type(sizeof(intmax_t));
+        case 'z':
+            return int_type(sizeof(size_t));
+        case 't':
+            return int_type(sizeof(ptrdiff_t));
+        case 'L':
+            return -1;
+        }
+        return T_INT;
+    case 'c':
+        return s->len == 0 ? T_INT : -1;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        return s->len == 'L' ? T_LDBL : T_DBL;
+    case 's':
+        return s->len == 0 ? T_STR : -1;
+    case 'p':
+        return T_PTR;
+    default:
+        // %n 及未知转换
+        return -1;
+    }
+}
+
+static int count_stars(const struct fmt_spec *s)
+{
+    int n = 0;
+    const char *p;
+    for (p = s->body; p < s->body_end; p++)
+    {
+        n += *p == '*';
+    }
+    return n;
+}
+
+static void parse_site(struct trace_site *site)
+{
+    struct fmt_spec s;
+    const char *p = site->fmt;
+    site->nargs = 0;
+    while ((p = next_spec(p, &s)) != NULL)
+    {
+        p = s.end;
+        if (s.conv == '%')
+        {
+            continue;
+        }
+        int type = spec_type(&s);
+        int stars = count_stars(&s);
+        if (type < 0 || site->nargs + stars + 1 > TRACE_MAX_ARGS)
+        {
+            // 之后的参数不记录, 解码时原样输出格式串剩余部分
+            fprintf(stderr, "trace: unsupported format \"%s\" at %s:%d\n", site->fmt, site->file, site->line);
+            break;
+        }
+        while (stars--)
+        {
+            site->types[site->nargs++] = T_INT;
+        }
+        site->types[site->nargs++] = type;
+    }
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 预留 sz 字节, 满了返回 NULL
+// base 用调用方读到的, trace_close 会先把 T.base 置空再等写者
+static char *reserve(char *base, uint32_t sz)
+{
+    struct trace_hdr *hdr = (struct trace_hdr *)base;
+    uint64_t off = __atomic_fetch_add(&hdr->used, sz, __ATOMIC_RELAXED);
+    if (off + sz > T.cap)
+    {
+        __atomic_fetch_add(&hdr->dropped, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return base + off;
+}
+
+// 内容写完后才写 len, 读到 len 就能看到完整记录
+static void commit(char *rec, uint32_t sz, uint32_t id)
+{
+    memcpy(rec + 4, &id, 4);
+    __atomic_store_n((uint32_t *)rec, sz, __ATOMIC_RELEASE);
+}
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+static int open_locked(const char *path, size_t cap)
+{
+    if (T.base || cap < TRACE_HDR_SZ)
+    {
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (ftruncate(fd, cap) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    // 预先缺页, 避免写入时每 4K 一次 page fault
+    char *base = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    struct trace_hdr *hdr = (struct trace_hdr *)base;
+    memcpy(hdr->magic, TRACE_MAGIC, 4);
+    hdr->version = TRACE_VERSION;
+    hdr->cap = cap;
+    hdr->used = TRACE_HDR_SZ;
+    hdr->dropped = 0;
+
+    T.fd = fd;
+    T.cap = cap;
+    T.nsites = 0;
+    T.epoch++;
+    __atomic_store_n(&T.base, base, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int trace_open(const char *path, size_t cap)
+{
+    pthread_mutex_lock(&T.mutex);
+    __atomic_store_n(&T.env_checked, true, __ATOMIC_RELEASE);
+    int ret = open_locked(path, cap);
+    pthread_mutex_unlock(&T.mutex);
+    return ret;
+}
+
+void trace_close()
+{
+    pthread_mutex_lock(&T.mutex);
+    char *base = T.base;
+    if (base)
+    {
+        // 先摘掉 base, 新来的写者看到 NULL 就不写了; 再等已经在写的写完
+        __atomic_store_n(&T.base, NULL, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&T.writers, __ATOMIC_SEQ_CST) > 0)
+        {
+            sched_yield();
+        }
+        struct trace_hdr *hdr = (struct trace_hdr *)base;
+        uint64_t used = hdr->used < T.cap ? hdr->used : T.cap;
+        hdr->used = used;
+        msync(base, T.cap, MS_SYNC);
+        munmap(base, T.cap);
+        ftruncate(T.fd, used);
+        close(T.fd);
+        T.fd = -1;
+    }
+    pthread_mutex_unlock(&T.mutex);
+}
+
+// 登记调用点, 写定义记录; 未打开文件返回 false
+static bool site_register(struct trace_site *site)
+{
+    // 没配置 TRACE_FILE 时每次 TRACE 都会走到这里, 不能每次加锁 getenv
+    if (!__atomic_load_n(&T.base, __ATOMIC_ACQUIRE) && __atomic_load_n(&T.env_checked, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+    pthread_mutex_lock(&T.mutex);
+    if (!T.base && !T.env_checked)
+    {
+        __atomic_store_n(&T.env_checked, true, __ATOMIC_RELEASE);
+        const char *path = getenv("TRACE_FILE");
+        if (path && *path)
+        {
+            open_locked(path, 64 << 20);
+        }
+    }
+    if (!T.base)
+    {
+        pthread_mutex_unlock(&T.mutex);
+        return false;
+    }
+    if (site->epoch == T.epoch)
+    {
+        // 其他线程已登记
+        pthread_mutex_unlock(&T.mutex);
+        return true;
+    }
+
+    parse_site(site);
+    uint32_t id = ++T.nsites;
+
+    size_t n_level = strlen(site->level) + 1;
+    size_t n_fmt = strlen(site->fmt) + 1;
+    size_t n_file = strlen(site->file) + 1;
+    size_t n_func = strlen(site->func) + 1;
+    size_t sz = ALIGN8(8 + 8 + n_level + n_fmt + n_file + n_func);
+    char *rec = sz <= UINT32_MAX ? reserve(T.base, sz) : NULL;
+    if (rec)
+    {
+        char *p = rec + 8;
+        uint32_t line = site->line;
+        memcpy(p, &id, 4);
+        memcpy(p + 4, &line, 4);
+        p += 8;
+        memcpy(p, site->level, n_level);
+        p += n_level;
+        memcpy(p, site->fmt, n_fmt);
+        p += n_fmt;
+        memcpy(p, site->file, n_file);
+        p += n_file;
+        memcpy(p, site->func, n_func);
+        commit(rec, sz, TRACE_ID_SITE);
+    }
+    site->id = id;
+    __atomic_store_n(&site->epoch, T.epoch, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&T.mutex);
+    return true;
+}
+
+static void log_text(struct trace_site *site, va_list args)
+{
+    bool err = strcmp(site->level, "ERROR") == 0;
+    fprintf(stderr, "%s[%s] ", err ? "\x1B[1;31m" : "\x1B[1;32m", site->level);
+    vfprintf(stderr, site->fmt, args);
+    fprintf(stderr, "\x1B[0m in function %s %s:%d\n", site->func, site->file, site->line);
+}
+
+void trace_log(struct trace_site *site, ...)
+{
+    va_list args;
+    char *base;
+    for (;;)
+    {
+        // 先计数再读 base, 与 trace_close 先置空 base 再读计数配对 (都是 seq_cst)
+        __atomic_fetch_add(&T.writers, 1, __ATOMIC_SEQ_CST);
+        base = __atomic_load_n(&T.base, __ATOMIC_SEQ_CST);
+        if (base && __atomic_load_n(&site->epoch, __ATOMIC_ACQUIRE) == T.epoch)
+        {
+            break;
+        }
+        // 登记要拿锁, trace_close 拿着锁等写者, 不能带着计数去登记
+        __atomic_fetch_sub(&T.writers, 1, __ATOMIC_RELEASE);
+        if (!site_register(site))
+        {
+            va_start(args, site);
+            log_text(site, args);
+            va_end(args);
+            return;
+        }
+    }
+
+    // 第一遍算长度, 字符串长度留着第二遍用
+    int i;
+    size_t sz = 16;
+    uint16_t slen[TRACE_MAX_ARGS];
+    const char *sval[TRACE_MAX_ARGS];
+    va_start(args, site);
+    for (i = 0; i < site->nargs; i++)
+    {
+        switch (site->types[i])
+        {
+        case T_INT:
+            (void)va_arg(args, int);
+            sz += 4;
+            break;
+        case T_I64:
+            (void)va_arg(args, int64_t);
+            sz += 8;
+            break;
+        case T_DBL:
+            (void)va_arg(args, double);
+            sz += 8;
+            break;
+        case T_LDBL:
+            (void)va_arg(args, long double);
+            sz += 8;
+            break;
+        case T_STR:
+        {
+            const char *s = va_arg(args, const char *);
+            size_t n;
+            if (s == NULL)
+            {
+                s = "(null)";
+            }
+            n = strlen(s);
+            sval[i] = s;
+            slen[i] = n > TRACE_STR_MAX ? TRACE_STR_MAX : n;
+            sz += 2 + slen[i];
+            break;
+        }
+        case T_PTR:
+            (void)va_arg(args, void *);
+            sz += 8;
+            break;
+        }
+    }
+    va_end(args);
+
+    sz = ALIGN8(sz);
+    char *rec = reserve(base, sz);
+    if (rec == NULL)
+    {
+        __atomic_fetch_sub(&T.writers, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    char *p = rec + 8;
+    uint64_t ns = now_ns();
+    memcpy(p, &ns, 8);
+    p += 8;
+
+    va_start(args, site);
+    for (i = 0; i < site->nargs; i++)
+    {
+        switch (site->types[i])
+        {
+        case T_INT:
+        {
+            int32_t v = va_arg(args, int);
+            memcpy(p, &v, 4);
+            p += 4;
+            break;
+        }
+        case T_I64:
+        {
+            int64_t v = va_arg(args, int64_t);
+            memcpy(p, &v, 8);
+            p += 8;
+            break;
+        }
+        case T_DBL:
+        case T_LDBL:
+        {
+            double v = site->types[i] == T_DBL ? va_arg(args, double) : (double)va_arg(args, long double);
+            memcpy(p, &v, 8);
+            p += 8;
+            break;
+        }
+        case T_STR:
+            (void)va_arg(args, const char *);
+            memcpy(p, &slen[i], 2);
+            memcpy(p + 2, sval[i], slen[i]);
+            p += 2 + slen[i];
+            break;
+        case T_PTR:
+        {
+            uint64_t v = (uintptr_t)va_arg(args, void *);
+            memcpy(p, &v, 8);
+            p += 8;
+            break;
+        }
+        }
+    }
+    va_end(args);
+    commit(rec, sz, site->id);
+    __atomic_fetch_sub(&T.writers, 1, __ATOMIC_RELEASE);
+}
+
+// ----------------------------------------------------------------------------
+// 解码
+
+struct site_def
+{
+    const char *level;
+    const char *fmt;
+    const char *file;
+    const char *func;
+    uint32_t line;
+    struct trace_site parsed;
+};
+
+// 把 spec 中的 '*' 换成实际值, 去掉长度修饰; 64 位整数统一加 ll
+static void build_spec(char *out, size_t cap, const struct fmt_spec *s, int type, const int *stars)
+{
+    size_t n = 0;
+    const char *p;
+    int si = 0;
+    out[n++] = '%';
+    for (p = s->body; p < s->body_end && n + 16 < cap; p++)
+    {
+        if (*p == '.')
+        {
+            // 负精度等同于未指定
+            if (p[1] == '*' && stars[si] < 0)
+            {
+                si++;
+                p++;
+                continue;
+            }
+        }
+        if (*p == '*')
+        {
+            n += snprintf(out + n, cap - n, "%d", stars[si++]);
+            continue;
+        }
+        out[n++] = *p;
+    }
+    if (type == T_I64)
+    {
+        out[n++] = 'l';
+        out[n++] = 'l';
+    }
+    out[n++] = s->conv;
+    out[n] = 0;
+}
+
+// 渲染一条事件, 参数不足 (文件损坏) 返回 false
+static bool render(FILE *out, const struct site_def *def, const char *p, const char *end, char *strbuf)
+{
+    const struct trace_site *site = &def->parsed;
+    struct fmt_spec s;
+    const char *f = def->fmt;
+    const char *lit = f;
+    int ai = 0;
+    char spec[64];
+
+#define NEED(n)               \
+    if (end - p < (long)(n))  \
+    {                         \
+        return false;         \
+    }
+
+    while ((f = next_spec(f, &s)) != NULL)
+    {
+        fwrite(lit, 1, s.begin - lit, out);
+        lit = f = s.end;
+        if (s.conv == '%')
+        {
+            fputc('%', out);
+            continue;
+        }
+        int stars_n = count_stars(&s);
+        if (ai + stars_n >= site->nargs)
+        {
+            // 未记录的参数, 原样输出
+            lit = s.begin;
+            break;
+        }
+
+        int stars[2] = {0, 0};
+        int k;
+        for (k = 0; k < stars_n && k < 2; k++)
+        {
+            NEED(4);
+            memcpy(&stars[k], p, 4);
+            p += 4;
+            ai++;
+        }
+        int type = site->types[ai++];
+        build_spec(spec, sizeof(spec), &s, type, stars);
+
+        switch (type)
+        {
+        case T_INT:
+        {
+            int32_t v;
+            NEED(4);
+            memcpy(&v, p, 4);
+            p += 4;
+            fprintf(out, spec, v);
+            break;
+        }
+        case T_I64:
+        {
+            long long v;
+            NEED(8);
+            memcpy(&v, p, 8);
+            p += 8;
+            fprintf(out, spec, v);
+            break;
+        }
+        case T_DBL:
+        case T_LDBL:
+        {
+            double v;
+            NEED(8);
+            memcpy(&v, p, 8);
+            p += 8;
+            fprintf(out, spec, v);
+            break;
+        }
+        case T_STR:
+        {
+            uint16_t n;
+            NEED(2);
+            memcpy(&n, p, 2);
+            NEED(2 + n);
+            memcpy(strbuf, p + 2, n);
+            strbuf[n] = 0;
+            p += 2 + n;
+            fprintf(out, spec, strbuf);
+            break;
+        }
+        case T_PTR:
+        {
+            uint64_t v;
+            NEED(8);
+            memcpy(&v, p, 8);
+            p += 8;
+            fprintf(out, spec, (void *)(uintptr_t)v);
+            break;
+        }
+        }
+    }
+    fputs(lit, out);
+    return true;
+#undef NEED
+}
+
+int trace_dump(const char *path, FILE *out)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < TRACE_HDR_SZ)
+    {
+        close(fd);
+        return -1;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    struct trace_hdr hdr;
+    memcpy(&hdr, base, sizeof(hdr));
+    if (memcmp(hdr.magic, TRACE_MAGIC, 4) != 0 || hdr.version != TRACE_VERSION)
+    {
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    // 进程崩溃时 used 可能超过 cap 或文件长度
+    uint64_t used = hdr.used;
+    if (used > (uint64_t)st.st_size)
+    {
+        used = st.st_size;
+    }
+
+    struct site_def *defs = NULL;
+    uint32_t ndefs = 0;
+    char *strbuf = malloc(TRACE_STR_MAX + 1);
+    int nrec = 0;
+    uint64_t off = TRACE_HDR_SZ;
+    assert(strbuf);
+
+    while (off + 16 <= used)
+    {
+        const char *rec = base + off;
+        uint32_t len, id;
+        memcpy(&len, rec, 4);
+        memcpy(&id, rec + 4, 4);
+        if (len < 16 || len % 8 != 0 || off + len > used)
+        {
+            break;
+        }
+        off += len;
+        const char *p = rec + 8;
+        const char *end = rec + len;
+
+        if (id == TRACE_ID_SITE)
+        {
+            uint32_t sid, line;
+            memcpy(&sid, p, 4);
+            memcpy(&line, p + 4, 4);
+            p += 8;
+            const char *strs[4];
+            int k;
+            for (k = 0; k < 4; k++)
+            {
+                const char *z = memchr(p, 0, end - p);
+                if (z == NULL)
+                {
+                    break;
+                }
+                strs[k] = p;
+                p = z + 1;
+            }
+            if (k < 4 || sid == 0)
+            {
+                continue;
+            }
+            if (sid > ndefs)
+            {
+                defs = realloc(defs, sizeof(*defs) * sid);
+                assert(defs);
+                memset(defs + ndefs, 0, sizeof(*defs) * (sid - ndefs));
+                ndefs = sid;
+            }
+            struct site_def *d = &defs[sid - 1];
+            d->level = strs[0];
+            d->fmt = strs[1];
+            d->file = strs[2];
+            d->func = strs[3];
+            d->line = line;
+            memset(&d->parsed, 0, sizeof(d->parsed));
+            d->parsed.fmt = d->fmt;
+            d->parsed.file = d->file;
+            d->parsed.line = line;
+            parse_site(&d->parsed);
+            continue;
+        }
+
+        if (id == 0 || id > ndefs || defs[id - 1].fmt == NULL)
+        {
+            fprintf(out, "<unknown site %u>\n", id);
+            continue;
+        }
+
+        const struct site_def *d = &defs[id - 1];
+        uint64_t ns;
+        memcpy(&ns, p, 8);
+        p += 8;
+        time_t sec = ns / 1000000000;
+        struct tm lt;
+        char ts[16];
+        localtime_r(&sec, &lt);
+        strftime(ts, sizeof(ts), "%H:%M:%S", &lt);
+        fprintf(out, "[%s.%06u %s] ", ts, (unsigned)(ns % 1000000000 / 1000), d->level);
+        if (!render(out, d, p, end, strbuf))
+        {
+            fputs(" <truncated>", out);
+        }
+        fprintf(out, " in function %s %s:%u\n", d->func, d->file, d->line);
+        nrec++;
+    }
+
+    if (hdr.dropped)
+    {
+        fprintf(out, "<%llu records dropped, trace file full>\n", (unsigned long long)hdr.dropped);
+    }
+
+    free(strbuf);
+    free(defs);
+    munmap(base, st.st_size);
+    return nrec;
+}
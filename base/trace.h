@@ -0,0 +1,50 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// 二进制 trace 日志
+// 运行时只写 调用点 id + 时间戳 + 原始参数 到 mmap 文件, 不做格式化
+// 调用点 (格式串/文件/行号) 第一次执行时登记, 定义记录同样写入文件, 文件自描述
+// 离线用 tracedump 还原成文本
+
+#define TRACE_MAX_ARGS 16
+
+struct trace_site
+{
+    uint32_t id;
+    uint32_t epoch; // 登记时所在文件, 与当前文件不同需重新登记
+    const char *level;
+    const char *fmt;
+    const char *file;
+    const char *func;
+    int line;
+    uint8_t nargs;
+    uint8_t types[TRACE_MAX_ARGS];
+};
+
+// 打开 (截断) 文件并预分配 cap 字节; 写满后丢弃并计数
+// 未打开时 TRACE 退化为 fprintf(stderr)
+// 若进程未显式打开, 第一次 TRACE 时读取环境变量 TRACE_FILE 自动打开
+int trace_open(const char *path, size_t cap);
+// 文件截断到实际长度
+void trace_close();
+void trace_log(struct trace_site *site, ...);
+
+// 解码 path 输出文本到 out, 返回记录数, 文件非法返回 -1
+int trace_dump(const char *path, FILE *out);
+
+// fmt 须为字面量, 参数按 printf 规则 (不支持 %n, %ls)
+#define TRACE(lv, fmt, ...)                                                                     \
+    do                                                                                          \
+    {                                                                                           \
+        static struct trace_site __trace_site = {0, 0, lv, fmt, __FILE__, __func__, __LINE__}; \
+        trace_log(&__trace_site, ##__VA_ARGS__);                                                \
+    } while (0)
+
+#define TRACE_INFO(fmt, ...) TRACE("INFO", fmt, ##__VA_ARGS__)
+#define TRACE_ERROR(fmt, ...) TRACE("ERROR", fmt, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "trace.h"
+
+#define N_THREAD 4
+#define N_EVENT 10000
+
+static int64_t now_ns()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+static char *dump(const char *path, int *nrec)
+{
+    char *out;
+    size_t sz;
+    FILE *f = open_memstream(&out, &sz);
+    *nrec = trace_dump(path, f);
+    fclose(f);
+    return out;
+}
+
+void test_format()
+{
+    char path[] = "/tmp/trace_test_XXXXXX";
+    close(mkstemp(path));
+    assert(trace_open(path, 1 << 20) == 0);
+
+    TRACE_INFO("no args");
+    TRACE_INFO("int %d %u %x %05d %-3d|", -1, 42u, 255, 7, 8);
+    TRACE_INFO("wide %ld %lld %zu %llx", -1234567890123L, 1LL << 40, (size_t)99, 0xdeadbeefcafeULL);
+    TRACE_INFO("char %c str %s %.3s [%8s] null %s", 'x', "hello", "abcdef", "r", (char *)NULL);
+    TRACE_INFO("float %.2f %g %e %Lf", 3.14159, 1e-5, 12345.678, (long double)0.5);
+    TRACE_INFO("star [%*d] [%-*d] [%.*s] 100%%", 5, 42, 4, 1, 2, "xyz");
+    TRACE_ERROR("ptr %p", (void *)0x1234);
+    trace_close();
+
+    int n;
+    char *s = dump(path, &n);
+    assert(n == 7);
+    assert(strstr(s, "INFO] no args in function test_format"));
+    assert(strstr(s, "int -1 42 ff 00007 8  |"));
+    assert(strstr(s, "wide -1234567890123 1099511627776 99 deadbeefcafe"));
+    assert(strstr(s, "char x str hello abc [       r] null (null)"));
+    assert(strstr(s, "float 3.14 1e-05 1.234568e+04 0.500000"));
+    assert(strstr(s, "star [   42] [1   ] [xy] 100%"));
+    assert(strstr(s, "ERROR] ptr 0x1234"));
+    free(s);
+    unlink(path);
+}
+
+static void *writer(void *ud)
+{
+    long id = (long)ud;
+    int i;
+    for (i = 0; i < N_EVENT; i++)
+    {
+        TRACE_INFO("thread-%ld seq-%d", id, i);
+    }
+    return NULL;
+}
+
+// 多线程并发写, 文件满后丢弃并计数
+void test_concurrent()
+{
+    char path[] = "/tmp/trace_test_XXXXXX";
+    close(mkstemp(path));
+    assert(trace_open(path, 16 << 20) == 0);
+
+    pthread_t threads[N_THREAD];
+    long i;
+    for (i = 0; i < N_THREAD; i++)
+    {
+        pthread_create(&threads[i], NULL, writer, (void *)i);
+    }
+    for (i = 0; i < N_THREAD; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    trace_close();
+
+    int n;
+    char *s = dump(path, &n);
+    assert(n == N_THREAD * N_EVENT);
+    free(s);
+
+    // 重新打开后调用点重新登记, 小文件写满
+    assert(trace_open(path, 4096) == 0);
+    writer((void *)0);
+    trace_close();
+    s = dump(path, &n);
+    assert(n > 0 && n < N_EVENT);
+    assert(strstr(s, "records dropped"));
+    free(s);
+    unlink(path);
+}
+
+static int stop_writing;
+
+static void *busy_writer(void *ud)
+{
+    int i = 0;
+    while (!__atomic_load_n(&stop_writing, __ATOMIC_RELAXED))
+    {
+        TRACE_INFO("busy seq-%d %s", i++, "payload");
+    }
+    return NULL;
+}
+
+// 写者还在写时 close / 重新 open, 不能写到已经 munmap 的内存
+void test_close_while_writing()
+{
+    char path[] = "/tmp/trace_test_XXXXXX";
+    close(mkstemp(path));
+    // 关闭期间写者退回 stderr 文本
+    int saved = dup(2);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, 2);
+    close(devnull);
+
+    pthread_t threads[N_THREAD];
+    long i;
+    __atomic_store_n(&stop_writing, 0, __ATOMIC_RELAXED);
+    assert(trace_open(path, 1 << 20) == 0);
+    for (i = 0; i < N_THREAD; i++)
+    {
+        pthread_create(&threads[i], NULL, busy_writer, NULL);
+    }
+    int round;
+    for (round = 0; round < 50; round++)
+    {
+        usleep(1000);
+        trace_close();
+        assert(trace_open(path, 1 << 20) == 0);
+    }
+    trace_close();
+    __atomic_store_n(&stop_writing, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < N_THREAD; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    dup2(saved, 2);
+    close(saved);
+
+    // 最后一个文件里的记录都是完整的
+    int n;
+    char *s = dump(path, &n);
+    assert(n >= 0 && strstr(s, "<unknown site") == NULL);
+    free(s);
+    unlink(path);
+}
+
+#define BENCH_N 1000000
+
+void bench()
+{
+    char path[] = "/tmp/trace_test_XXXXXX";
+    close(mkstemp(path));
+    int i;
+
+    FILE *devnull = fopen("/dev/null", "w");
+    int64_t start = now_ns();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        fprintf(devnull, "\x1B[1;32m[INFO] req %d cost %.3fms peer %s\x1B[0m in function %s %s:%d\n", i, 1.5, "10.0.0.1:8080", __func__, __FILE__, __LINE__);
+    }
+    int64_t text_ns = now_ns() - start;
+    fclose(devnull);
+
+    assert(trace_open(path, 256 << 20) == 0);
+    start = now_ns();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        TRACE_INFO("req %d cost %.3fms peer %s", i, 1.5, "10.0.0.1:8080");
+    }
+    int64_t bin_ns = now_ns() - start;
+    trace_close();
+
+    start = now_ns();
+    FILE *f = fopen("/dev/null", "w");
+    int n = trace_dump(path, f);
+    fclose(f);
+    int64_t dump_ns = now_ns() - start;
+    assert(n == BENCH_N);
+
+    printf("fprintf %.1f ns/call, binary trace %.1f ns/call, offline decode %.1f ns/record\n",
+           (double)text_ns / BENCH_N, (double)bin_ns / BENCH_N, (double)dump_ns / BENCH_N);
+    unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+    test_format();
+    test_concurrent();
+    test_close_while_writing();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
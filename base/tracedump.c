@@ -0,0 +1,18 @@
+#include <stdio.h>
+#include "trace.h"
+
+// 把 trace_open 写出的二进制 trace 文件还原成文本
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <TRACE_FILE>\n", argv[0]);
+        return 1;
+    }
+    if (trace_dump(argv[1], stdout) < 0)
+    {
+        fprintf(stderr, "invalid trace file %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
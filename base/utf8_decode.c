@@ -26,6 +26,12 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "utf8_decode.h"
 
 /*
@@ -52,23 +58,16 @@ SOFTWARE.
 */
 
 
-static int  the_index = 0;
-static int  the_length = 0;
-static int  the_char = 0;
-static int  the_byte = 0;
-static char* the_input;
-
-
 /*
     Get the next byte. It returns UTF8_END if there are no more bytes.
 */
-static int get() {
+static int get(struct utf8_decoder *d) {
     int c;
-    if (the_index >= the_length) {
+    if (d->index >= d->length) {
         return UTF8_END;
     }
-    c = the_input[the_index] & 0xFF;
-    the_index += 1;
+    c = d->input[d->index] & 0xFF;
+    d->index += 1;
     return c;
 }
 
@@ -77,8 +76,8 @@ static int get() {
     Get the 6-bit payload of the next continuation byte.
     Return UTF8_ERROR if it is not a contination byte.
 */
-static int cont() {
-    int c = get();
+static int cont(struct utf8_decoder *d) {
+    int c = get(d);
     return ((c & 0xC0) == 0x80)
         ? (c & 0x3F)
         : UTF8_ERROR;
@@ -86,22 +85,23 @@ static int cont() {
 
 
 /*
-    Initialize the UTF-8 decoder. The decoder is not reentrant,
+    Initialize the UTF-8 decoder. All state lives in *d, so any number of
+    decoders can run at the same time.
 */
-void utf8_decode_init(char p[], int length) {
-    the_index = 0;
-    the_input = p;
-    the_length = length;
-    the_char = 0;
-    the_byte = 0;
+void utf8_decoder_init(struct utf8_decoder *d, const char p[], int length) {
+    d->index = 0;
+    d->input = p;
+    d->length = length;
+    d->ch = 0;
+    d->byte = 0;
 }
 
 
 /*
     Get the current byte offset. This is generally used in error reporting.
 */
-int utf8_decode_at_byte() {
-    return the_byte;
+int utf8_decoder_at_byte(const struct utf8_decoder *d) {
+    return d->byte;
 }
 
 
@@ -109,9 +109,9 @@ int utf8_decode_at_byte() {
     Get the current character offset. This is generally used in error reporting.
     The character offset matches the byte offset if the text is strictly ASCII.
 */
-int utf8_decode_at_character() {
-    return (the_char > 0)
-        ? the_char - 1
+int utf8_decoder_at_character(const struct utf8_decoder *d) {
+    return (d->ch > 0)
+        ? d->ch - 1
         : 0;
 }
 
@@ -122,19 +122,19 @@ int utf8_decode_at_character() {
          or  UTF8_END   (the end)
          or  UTF8_ERROR (error)
 */
-int utf8_decode_next() {
+int utf8_decoder_next(struct utf8_decoder *d) {
     int c;  /* the first byte of the character */
     int c1; /* the first continuation character */
     int c2; /* the second continuation character */
     int c3; /* the third continuation character */
     int r;  /* the result */
 
-    if (the_index >= the_length) {
-        return the_index == the_length ? UTF8_END : UTF8_ERROR;
+    if (d->index >= d->length) {
+        return d->index == d->length ? UTF8_END : UTF8_ERROR;
     }
-    the_byte = the_index;
-    the_char += 1;
-    c = get();
+    d->byte = d->index;
+    d->ch += 1;
+    c = get(d);
 /*
     Zero continuation (0 to 127)
 */
@@ -145,7 +145,7 @@ int utf8_decode_next() {
     One continuation (128 to 2047)
 */
     if ((c & 0xE0) == 0xC0) {
-        c1 = cont();
+        c1 = cont(d);
         if (c1 >= 0) {
             r = ((c & 0x1F) << 6) | c1;
             if (r >= 128) {
@@ -157,8 +157,8 @@ int utf8_decode_next() {
     Two continuations (2048 to 55295 and 57344 to 65535)
 */
     } else if ((c & 0xF0) == 0xE0) {
-        c1 = cont();
-        c2 = cont();
+        c1 = cont(d);
+        c2 = cont(d);
         if ((c1 | c2) >= 0) {
             r = ((c & 0x0F) << 12) | (c1 << 6) | c2;
             if (r >= 2048 && (r < 55296 || r > 57343)) {
@@ -170,9 +170,9 @@ int utf8_decode_next() {
     Three continuations (65536 to 1114111)
 */
     } else if ((c & 0xF8) == 0xF0) {
-        c1 = cont();
-        c2 = cont();
-        c3 = cont();
+        c1 = cont(d);
+        c2 = cont(d);
+        c3 = cont(d);
         if ((c1 | c2 | c3) >= 0) {
             r = ((c & 0x07) << 18) | (c1 << 12) | (c2 << 6) | c3;
             if (r >= 65536 && r <= 1114111) {
@@ -181,4 +181,56 @@ int utf8_decode_next() {
         }
     }
     return UTF8_ERROR;
-}
\ No newline at end of file
+}
+
+
+/*
+    Count the leading 7-bit bytes of p. 16 bytes per step with SSE2
+    (movemask picks up the high bits), 8 bytes per step otherwise.
+*/
+int utf8_ascii_prefix(const char p[], int length) {
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        int mask = _mm_movemask_epi8(v);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i + 8 <= length; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        if (v & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+    while (i < length && (p[i] & 0x80) == 0) {
+        i += 1;
+    }
+    return i;
+}
+
+
+/*
+    The old interface, kept for existing callers. It shares one global
+    decoder and is not reentrant.
+*/
+static struct utf8_decoder the_decoder;
+
+void utf8_decode_init(char p[], int length) {
+    utf8_decoder_init(&the_decoder, p, length);
+}
+
+int utf8_decode_at_byte() {
+    return utf8_decoder_at_byte(&the_decoder);
+}
+
+int utf8_decode_at_character() {
+    return utf8_decoder_at_character(&the_decoder);
+}
+
+int utf8_decode_next() {
+    return utf8_decoder_next(&the_decoder);
+}
@@ -1,9 +1,32 @@
 /* utf8_decode.h */
 
+#ifndef UTF8_DECODE_H
+#define UTF8_DECODE_H
+
 #define UTF8_END   -1
 #define UTF8_ERROR -2
 
+/* 可重入解码上下文, 栈上分配即可 */
+struct utf8_decoder {
+    const char *input;
+    int index;
+    int length;
+    int ch;
+    int byte;
+};
+
+extern void utf8_decoder_init(struct utf8_decoder *d, const char p[], int length);
+extern int  utf8_decoder_next(struct utf8_decoder *d);
+extern int  utf8_decoder_at_byte(const struct utf8_decoder *d);
+extern int  utf8_decoder_at_character(const struct utf8_decoder *d);
+
+/* 返回 p 开头连续 7-bit ascii 字节数, SSE2 / 8 字节一组批量检查 */
+extern int  utf8_ascii_prefix(const char p[], int length);
+
+/* 旧接口, 共享全局状态, 不可重入 */
 extern int  utf8_decode_at_byte();
 extern int  utf8_decode_at_character();
 extern void utf8_decode_init(char p[], int length);
 extern int  utf8_decode_next();
+
+#endif
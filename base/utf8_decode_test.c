@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "utf8_decode.h"
+
+static int decode_all(const char *s, int *out, int max)
+{
+    struct utf8_decoder d;
+    int n = 0, c;
+    utf8_decoder_init(&d, s, strlen(s));
+    while ((c = utf8_decoder_next(&d)) != UTF8_END)
+    {
+        if (c == UTF8_ERROR || n >= max)
+        {
+            return -1;
+        }
+        out[n++] = c;
+    }
+    return n;
+}
+
+void test_decode()
+{
+    int cps[8];
+    assert(decode_all("a\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80", cps, 8) == 4);
+    assert(cps[0] == 'a' && cps[1] == 0xe9 && cps[2] == 0x4e2d && cps[3] == 0x1f600);
+
+    assert(decode_all("\xc0\xaf", cps, 8) == -1);         // overlong
+    assert(decode_all("\xed\xa0\x80", cps, 8) == -1);     // surrogate
+    assert(decode_all("\xe4\xb8", cps, 8) == -1);         // 截断
+    assert(decode_all("\x80", cps, 8) == -1);             // 孤立 continuation
+    assert(decode_all("\xf4\x90\x80\x80", cps, 8) == -1); // > 0x10ffff
+
+    struct utf8_decoder d;
+    utf8_decoder_init(&d, "ab\xe4\xb8\xad", 5);
+    utf8_decoder_next(&d);
+    utf8_decoder_next(&d);
+    utf8_decoder_next(&d);
+    assert(utf8_decoder_at_byte(&d) == 2);
+    assert(utf8_decoder_at_character(&d) == 2);
+    assert(utf8_decoder_next(&d) == UTF8_END);
+}
+
+void test_ascii_prefix()
+{
+    char tpl[128], buf[128];
+    int i, j;
+    for (i = 0; i < 128; i++)
+    {
+        tpl[i] = 'a' + i % 26;
+    }
+    assert(utf8_ascii_prefix(tpl, 0) == 0);
+    assert(utf8_ascii_prefix(tpl, 128) == 128);
+
+    // 每个位置放一个高位字节, 覆盖 SSE2 / 8 字节 / 逐字节三段
+    for (i = 0; i < 128; i++)
+    {
+        memcpy(buf, tpl, sizeof(buf));
+        buf[i] = (char)0xe4;
+        for (j = 0; j <= 128; j++)
+        {
+            int expect = i < j ? i : j;
+            assert(utf8_ascii_prefix(buf, j) == expect);
+        }
+    }
+}
+
+// 多线程同时解码, 各自的上下文互不干扰
+static void *decode_worker(void *ud)
+{
+    const char *s = ud;
+    int cps[64];
+    int i, n = decode_all(s, cps, 64);
+    for (i = 0; i < 100000; i++)
+    {
+        int cps2[64];
+        assert(decode_all(s, cps2, 64) == n);
+        assert(memcmp(cps, cps2, sizeof(int) * n) == 0);
+    }
+    return NULL;
+}
+
+void test_reentrant()
+{
+    const char *inputs[] = {
+        "hello world",
+        "\xe4\xbd\xa0\xe5\xa5\xbd\xe4\xb8\x96\xe7\x95\x8c",
+        "\xf0\x9f\x98\x80\xf0\x9f\x98\x81x",
+        "caf\xc3\xa9 cr\xc3\xa8me",
+    };
+    pthread_t threads[4];
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        pthread_create(&threads[i], NULL, decode_worker, (void *)inputs[i]);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    test_decode();
+    test_ascii_prefix();
+    test_reentrant();
+    puts("ok");
+    return 0;
+}
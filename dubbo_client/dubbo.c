@@ -14,7 +14,7 @@
 #include "ae.h"
 
 extern char *optarg;
-static const char *optString = "h:p:m:a:e:t:c:n:v?";
+static const char *optString = "h:p:m:a:e:t:c:k:n:v?";
 
 #define ASSERT_OPT(assert, reason, ...)                                  \
     if (!(assert))                                                       \
@@ -29,7 +29,7 @@ usage()
 {
     static const char *usage =
         "\nUsage:\n"
-        "   dubbo_test -h<HOST> -p<PORT> -m<METHOD> -a<JSON_ARGUMENTS> [-e<JSON_ATTACHMENT='{}'> -t<TIMEOUT_SEC=5> -c<CONCURRENCY> -n<REQUESTS> -v<VERBOS>]\n\n"
+        "   dubbo_test -h<HOST> -p<PORT> -m<METHOD> -a<JSON_ARGUMENTS> [-e<JSON_ATTACHMENT='{}'> -t<TIMEOUT_SEC=5> -c<CONCURRENCY> -k<CONNECTIONS=1> -n<REQUESTS> -v<VERBOS>]\n\n"
         "Example:\n"
         "   dubbo_test -h10.9.172.41  -p 20983  -mcom.youzan.generic.service.DemoService.complexMethod -a '[true,1,3.1400000000000001,\"hello\",{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},[{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}],[{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}],{\"hello\":{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}},\"WARN\"]'\n";
     puts(usage);
@@ -68,6 +68,7 @@ int main(int argc, char **argv)
     memset(&async_args, 0, sizeof(async_args));
     async_args.req_n = 0;
     async_args.pipe_n = 0;
+    async_args.conn_n = 1;
     async_args.verbos = false;
 
     struct dubbo_args args;
@@ -110,6 +111,9 @@ int main(int argc, char **argv)
         case 'c':
             async_args.pipe_n = atoi(optarg);
             break;
+        case 'k':
+            async_args.conn_n = atoi(optarg);
+            break;
         case 'n':
             async_args.req_n = atoi(optarg);
             break;
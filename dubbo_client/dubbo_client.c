@@ -17,11 +17,14 @@
 #include "ae.h"
 #include "socket.h"
 #include "sa.h"
+#include "connpool.h"
 #include "buffer.h"
 #include "cJSON.h"
 #include "dbg.h"
 
 #define CLI_INIT_BUF_SZ 1024
+#define CLI_RETRY_MS 100
+#define CLI_MAX_ERRORS 3
 
 static struct dubbo_client *g_cli;
 
@@ -29,29 +32,32 @@ struct dubbo_client
 {
     struct aeEventLoop *el;
     struct dubbo_args *args;
-    union sockaddr_all addr;
-    long timeout_ms;
-    long long timerid;
+    struct connpool *pool;
+    struct connpool_upstream *up;
 
-    struct buffer *rcv_buf;
-    struct buffer *snd_buf;
+    int conn_n;
     int pipe_n;
-    int pipe_left;
+    int pipe_left; // 所有连接合计还能发出的请求数
     int req_n;
     int req_left;
     int ok_n;
     int ko_n;
 
-    int fd;
-    bool connected;
     bool run;
     bool verbos;
 
-    struct timeval start;
-    struct timeval end;
+    long long start_ms; // aeNow
+    long long end_ms;
+};
+
+// 每条连接自己的收发缓冲区, 挂在 connpool_conn->ud, 连接关闭时释放
+struct cli_conn
+{
+    struct dubbo_client *cli;
+    struct buffer *rcv_buf;
+    struct buffer *snd_buf;
 };
 
-static void cli_on_connect(struct aeEventLoop *el, int fd, void *ud, int mask);
 static void cli_on_read(struct aeEventLoop *el, int fd, void *ud, int mask);
 static void cli_on_write(struct aeEventLoop *el, int fd, void *ud, int mask);
 
@@ -59,40 +65,59 @@ static void cli_pipe_send(struct dubbo_client *cli);
 static bool cli_start(struct dubbo_client *cli);
 static void cli_end(struct dubbo_client *cli);
 
-static bool cli_decode_resp(struct dubbo_client *cli);
-static void cli_reconnect(struct dubbo_client *cli);
+static bool cli_decode_resp(struct dubbo_client *cli, struct buffer *buf);
 
 static struct buffer *cli_encode_req(struct dubbo_client *cli)
 {
     struct dubbo_req *req = dubbo_req_create(cli->args->service, cli->args->method, cli->args->args, cli->args->attach);
     if (req == NULL)
     {
-        return false;
+        return NULL;
     }
     if (cli->verbos)
     {
         printf("<req>[seq=%" PRId64 "]\n", dubbo_req_getid(req));
     }
-    return dubbo_encode(req);
+    struct buffer *buf = dubbo_encode(req);
+    dubbo_req_release(req);
+    return buf;
 }
 
-static void cli_clear_timer(struct dubbo_client *cli)
+static void cli_on_open(struct connpool_conn *c, void *ud)
 {
-    if (cli->timerid != AE_NOMORE)
+    struct dubbo_client *cli = (struct dubbo_client *)ud;
+    struct cli_conn *conn = calloc(1, sizeof(*conn));
+    assert(conn);
+    conn->cli = cli;
+    conn->rcv_buf = buf_create(CLI_INIT_BUF_SZ);
+    conn->snd_buf = buf_create(CLI_INIT_BUF_SZ);
+    c->ud = conn;
+
+    if (AE_ERR == aeCreateFileEvent(cli->el, c->fd, AE_READABLE, cli_on_read, c))
+    {
+        connpool_close(c);
+        return;
+    }
+    if (cli->run)
     {
-        aeDeleteTimeEvent(cli->el, cli->timerid);
-        cli->timerid = AE_NOMORE;
+        cli_pipe_send(cli);
     }
 }
 
-static void cli_reset(struct dubbo_client *cli)
+// 连接上未完成的请求作废, 额度还回去, 连接池稍后重连
+static void cli_on_close(struct connpool_conn *c, void *ud)
 {
-    cli->connected = false;
-    cli_clear_timer(cli);
-    cli->fd = -1;
-    cli->pipe_left = cli->pipe_n;
-    buf_retrieveAll(cli->rcv_buf);
-    buf_retrieveAll(cli->snd_buf);
+    struct dubbo_client *cli = (struct dubbo_client *)ud;
+    struct cli_conn *conn = c->ud;
+    if (cli->run)
+    {
+        LOG_INFO("连接关闭, 稍后重连...");
+    }
+    cli->pipe_left += c->inflight;
+    buf_release(conn->rcv_buf);
+    buf_release(conn->snd_buf);
+    free(conn);
+    c->ud = NULL;
 }
 
 static struct dubbo_client *cli_create(struct dubbo_args *args, struct dubbo_async_args *async_args)
@@ -104,9 +129,6 @@ static struct dubbo_client *cli_create(struct dubbo_args *args, struct dubbo_asy
 
     cli->verbos = async_args->verbos;
 
-    cli->rcv_buf = buf_create(CLI_INIT_BUF_SZ);
-    cli->snd_buf = buf_create(CLI_INIT_BUF_SZ);
-
     cli->req_n = async_args->req_n;
     cli->req_left = async_args->req_n;
 
@@ -115,103 +137,40 @@ static struct dubbo_client *cli_create(struct dubbo_args *args, struct dubbo_asy
     {
         cli->pipe_n = cli->req_n;
     }
-    cli->pipe_left = async_args->pipe_n;
+    cli->pipe_left = cli->pipe_n;
+
+    cli->conn_n = async_args->conn_n;
+    if (cli->conn_n < 1)
+    {
+        cli->conn_n = 1;
+    }
 
     cli->run = false;
     cli->ok_n = 0;
     cli->ko_n = 0;
 
-    cli->timeout_ms = args->timeout.tv_sec * 1000;
-    cli->timerid = AE_NOMORE;
-
     cli->args = args;
-    cli_reset(cli);
 
-    if (!sa_resolve(cli->args->host, &cli->addr))
+    struct connpool_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.size = cli->conn_n;
+    opts.connect_timeout_ms = args->timeout.tv_sec * 1000;
+    opts.retry_ms = CLI_RETRY_MS;
+    opts.max_errors = CLI_MAX_ERRORS;
+    opts.on_open = cli_on_open;
+    opts.on_close = cli_on_close;
+    opts.ud = cli;
+    cli->pool = connpool_create(cli->el, &opts);
+    if (cli->pool == NULL)
     {
-        PANIC("%s DNS解析失败", cli->args->host);
+        PANIC("创建连接池失败");
     }
-
-    cli->addr.v4.sin_port = htons(atoi(cli->args->port));
     return cli;
 }
 
-static bool cli_connected(struct dubbo_client *cli)
-{
-    cli->connected = true;
-    cli_clear_timer(cli);
-    if (AE_ERR == aeCreateFileEvent(cli->el, cli->fd, AE_READABLE, cli_on_read, cli))
-    {
-        return false;
-    }
-    cli_pipe_send(cli);
-    return true;
-}
-
-int cli_connect_timeout(struct aeEventLoop *el, long long id, void *ud)
-{
-    struct dubbo_client *cli = (struct dubbo_client *)ud;
-    LOG_ERROR("连接超时");
-    cli_reconnect(cli);
-    return AE_NOMORE;
-}
-
-bool cli_connect(struct dubbo_client *cli)
-{
-    int fd = socket_create();
-    if (fd < 0)
-    {
-        return false;
-    }
-    cli->fd = fd;
-
-    int status = socket_connect(fd, &cli->addr, sizeof(cli->addr.s));
-    if (status == 0)
-    {
-        if (!cli_connected(cli))
-        {
-            goto close;
-        }
-    }
-    else
-    {
-        if (errno == EINPROGRESS)
-        {
-            // 这里 貌似应该 read + write
-            if (AE_ERR == aeCreateFileEvent(cli->el, fd, AE_WRITABLE, cli_on_connect, cli))
-            {
-                goto close;
-            }
-            cli->timerid = aeCreateTimeEvent(cli->el, cli->timeout_ms, cli_connect_timeout, cli, NULL);
-            if (AE_ERR == cli->timerid)
-            {
-                cli->timerid = AE_NOMORE;
-                goto close;
-            }
-        }
-        else
-        {
-            goto close;
-        }
-    }
-    return true;
-
-close:
-    close(fd);
-    return false;
-}
-
-static void cli_close(struct dubbo_client *cli)
-{
-    aeDeleteFileEvent(cli->el, cli->fd, AE_READABLE | AE_WRITABLE);
-    close(cli->fd);
-    cli_reset(cli);
-}
-
 static void cli_release(struct dubbo_client *cli)
 {
-    buf_release(cli->rcv_buf);
-    buf_release(cli->snd_buf);
+    connpool_release(cli->pool);
     free(cli);
 }
 
@@ -242,28 +201,29 @@ static bool cli_start(struct dubbo_client *cli)
     atexit(exit_handler);
     signal(SIGINT, sig_handler);
     signal(SIGTERM, sig_handler);
-    gettimeofday(&cli->start, NULL);
+    aeUpdateTime(cli->el);
+    cli->start_ms = aeNow(cli->el);
 
     g_cli = cli;
     cli->run = true;
 
-    return cli_connect(cli);
+    // 预热 conn_n 条连接, 连上一条就开始发请求
+    cli->up = connpool_get(cli->pool, cli->args->host, cli->args->port);
+    return cli->up != NULL;
 }
 
 static void cli_end(struct dubbo_client *cli)
 {
     if (cli->run)
     {
-        cli_close(cli);
-        cli_clear_timer(cli);
-
-        gettimeofday(&cli->end, NULL);
+        // 可能从信号处理中调用, 此时缓存的时间停在上次 poll 之前
+        aeUpdateTime(cli->el);
+        cli->end_ms = aeNow(cli->el);
         g_cli = NULL;
         cli->run = false;
         aeStop(cli->el);
 
-        double elapsed_sec = ((double)cli->end.tv_sec + 1.0e-6 * cli->end.tv_usec) -
-                             ((double)cli->start.tv_sec + 1.0e-6 * cli->start.tv_usec);
+        double elapsed_sec = (cli->end_ms - cli->start_ms) / 1000.0;
         int reqs = cli->req_n - cli->req_left;
         double qps = elapsed_sec < 0.001 ? 0 : reqs / elapsed_sec;
         fprintf(stderr, "\x1B[1;32m[SUMMARY]\x1B[0m COST %.2fs, REQ %d, SUCC %d, FAIL %d, QPS %.f\n", elapsed_sec, reqs, cli->ok_n, cli->ko_n, qps);
@@ -272,29 +232,20 @@ static void cli_end(struct dubbo_client *cli)
     }
 }
 
-static void cli_reconnect(struct dubbo_client *cli)
-{
-    LOG_INFO("重新连接...");
-    cli_close(cli);
-    if (!cli_connect(cli))
-    {
-        LOG_ERROR("重连失败");
-    }
-}
-
-static bool cli_write(struct dubbo_client *cli)
+static bool cli_write(struct dubbo_client *cli, struct connpool_conn *c)
 {
-    struct buffer *buf = cli->snd_buf;
+    struct cli_conn *conn = c->ud;
+    struct buffer *buf = conn->snd_buf;
     if (!buf_readable(buf))
     {
-        aeDeleteFileEvent(cli->el, cli->fd, AE_WRITABLE);
+        aeDeleteFileEvent(cli->el, c->fd, AE_WRITABLE);
         return true;
     }
 
     int nwritten = 0;
     while (buf_readable(buf))
     {
-        nwritten = write(cli->fd, buf_peek(buf), buf_readable(buf));
+        nwritten = write(c->fd, buf_peek(buf), buf_readable(buf));
         if (nwritten <= 0)
         {
             if (errno == EINTR)
@@ -310,7 +261,7 @@ static bool cli_write(struct dubbo_client *cli)
     {
         if (errno == EAGAIN)
         {
-            if (AE_ERR == aeCreateFileEvent(cli->el, cli->fd, AE_WRITABLE, cli_on_write, cli))
+            if (AE_ERR == aeCreateFileEvent(cli->el, c->fd, AE_WRITABLE, cli_on_write, c))
             {
                 LOG_ERROR("Dubbo 请求失败: 创建可写事件失败");
                 return false;
@@ -326,51 +277,37 @@ static bool cli_write(struct dubbo_client *cli)
 
     if (!buf_readable(buf))
     {
-        aeDeleteFileEvent(cli->el, cli->fd, AE_WRITABLE);
+        aeDeleteFileEvent(cli->el, c->fd, AE_WRITABLE);
     }
     return true;
 }
 
-static void cli_send_req(struct dubbo_client *cli)
+static bool cli_send_req(struct dubbo_client *cli, struct connpool_conn *c)
 {
+    struct cli_conn *conn = c->ud;
     struct buffer *buf = cli_encode_req(cli);
     if (buf == NULL)
     {
         PANIC("Dubbo 请求失败: 编码失败");
-        return;
+        return false;
     }
 
-    buf_append(cli->snd_buf, buf_peek(buf), buf_readable(buf));
+    buf_append(conn->snd_buf, buf_peek(buf), buf_readable(buf));
     buf_release(buf);
-    if (!cli_write(cli))
-    {
-        cli_reconnect(cli);
-    }
+    return cli_write(cli, c);
 }
 
+// 额度内每个请求都发给当前在途最少的连接
 static void cli_pipe_send(struct dubbo_client *cli)
 {
-    while (cli->pipe_left--)
-    {
-        cli_send_req(cli);
-    }
-    cli->pipe_left++;
-}
-
-static void cli_on_connect(struct aeEventLoop *el, int fd, void *ud, int mask)
-{
-    struct dubbo_client *cli = (struct dubbo_client *)ud;
-    // 注意: ae 将 err 与 hup 转换成 write 事件
-    if ((mask & AE_WRITABLE) /* && !(mask & AE_READABLE)*/)
+    struct connpool_conn *c;
+    while (cli->pipe_left > 0 && (c = connpool_acquire(cli->up)) != NULL)
     {
-        aeDeleteFileEvent(el, fd, AE_WRITABLE /* | AE_READABLE*/);
-        // 所以, 可能出错 !!!
-        cli_connected(cli);
-    }
-    else
-    {
-        LOG_ERROR("连接失败: %s", strerror(errno));
-        cli_reconnect(cli);
+        cli->pipe_left--;
+        if (!cli_send_req(cli, c))
+        {
+            connpool_close(c);
+        }
     }
 }
 
@@ -380,12 +317,13 @@ static void cli_on_write(struct aeEventLoop *el, int fd, void *ud, int mask)
     UNUSED(fd);
     UNUSED(mask);
 
-    struct dubbo_client *cli = (struct dubbo_client *)ud;
-    assert(cli->connected);
+    struct connpool_conn *c = (struct connpool_conn *)ud;
+    struct cli_conn *conn = c->ud;
+    assert(c->connected);
 
-    if (!cli_write(cli))
+    if (!cli_write(conn->cli, c))
     {
-        cli_reconnect(cli);
+        connpool_close(c);
     }
 }
 
@@ -394,13 +332,16 @@ static void cli_on_read(struct aeEventLoop *el, int fd, void *ud, int mask)
     UNUSED(el);
     UNUSED(mask);
 
-    struct dubbo_client *cli = (struct dubbo_client *)ud;
-    assert(cli->connected);
+    struct connpool_conn *c = (struct connpool_conn *)ud;
+    struct cli_conn *conn = c->ud;
+    struct dubbo_client *cli = conn->cli;
+    struct buffer *buf = conn->rcv_buf;
+    assert(c->connected);
 
     for (;;)
     {
         int errno_ = 0;
-        ssize_t recv_n = buf_readFd(cli->rcv_buf, fd, &errno_);
+        ssize_t recv_n = buf_readFd(buf, fd, &errno_);
         if (recv_n < 0)
         {
             if (errno_ == EINTR)
@@ -413,60 +354,70 @@ static void cli_on_read(struct aeEventLoop *el, int fd, void *ud, int mask)
             else
             {
                 LOG_ERROR("从 Dubbo 服务端读取数据: %s", strerror(errno));
-                cli_reconnect(cli);
+                connpool_close(c);
                 return;
             }
         }
         else if (recv_n == 0)
         {
             LOG_ERROR("Dubbo 服务端断开连接");
-            cli_reconnect(cli);
+            connpool_close(c);
             return;
         }
         break;
     }
 
-    if (!is_dubbo_pkt(cli->rcv_buf))
-    {
-        LOG_ERROR("接收到非 dubbo 数据包");
-        cli_reconnect(cli);
-    }
-
-    if (!is_completed_dubbo_pkt(cli->rcv_buf, NULL))
+    // 一次可能读到多个响应
+    while (buf_readable(buf) >= DUBBO_HDR_LEN)
     {
-        return;
-    }
+        int remaining = 0;
+        if (!is_completed_dubbo_pkt(buf, &remaining))
+        {
+            LOG_ERROR("接收到非 dubbo 数据包");
+            connpool_close(c);
+            return;
+        }
+        if (remaining > 0)
+        {
+            break;
+        }
+        size_t pkt_sz = buf_readable(buf) + remaining;
+        size_t readable = buf_readable(buf);
 
-    cli->pipe_left++;
-    cli->req_left--;
+        cli->pipe_left++;
+        cli->req_left--;
 
-    if (((cli->req_n - cli->req_left) % 1000) == 0)
-    {
-        fprintf(stderr, "已发送请求 %d\n", cli->req_n - cli->req_left);
-    }
+        if (((cli->req_n - cli->req_left) % 1000) == 0)
+        {
+            fprintf(stderr, "已发送请求 %d\n", cli->req_n - cli->req_left);
+        }
 
-    bool ok = cli_decode_resp(cli);
+        bool ok = cli_decode_resp(cli, buf);
+        // 解码失败时跳过这个包剩下的部分, 保持帧边界
+        size_t used = readable - buf_readable(buf);
+        if (used < pkt_sz)
+        {
+            buf_retrieve(buf, pkt_sz - used);
+        }
 
-    if (cli->req_left <= 0)
-    {
-        cli_end(cli);
-    }
-    else
-    {
-        if (ok)
+        if (cli->req_left <= 0)
         {
-            cli_pipe_send(cli);
+            cli_end(cli);
+            return;
         }
-        else
+
+        // 连续解码失败的连接由连接池剔除重连
+        connpool_done(c, ok);
+        if (!c->connected)
         {
-            cli_reconnect(cli);
+            return;
         }
     }
+    cli_pipe_send(cli);
 }
 
-static bool cli_decode_resp(struct dubbo_client *cli)
+static bool cli_decode_resp(struct dubbo_client *cli, struct buffer *buf)
 {
-    struct buffer *buf = cli->rcv_buf;
     struct dubbo_res *res = dubbo_decode(buf);
     if (res == NULL)
     {
@@ -18,6 +18,7 @@ struct dubbo_args
 struct dubbo_async_args
 {
     struct aeEventLoop *el;
+    int conn_n; /* 连接数 */
     int pipe_n;
     int req_n;
     bool verbos;
@@ -7,7 +7,6 @@
 
 #include "endian.h"
 #include "buffer.h"
-#include "cJSON.h"
 #include "dbg.h"
 
 #include "dubbo_codec.h"
@@ -15,7 +14,6 @@
 
 #define DUBBO_BUF_LEN 8192
 #define DUBBO_MAX_PKT_SZ (1024 * 1024 * 4)
-#define DUBBO_HDR_LEN 16
 #define DUBBO_MAGIC 0xdabb
 #define DUBBO_VER "3.1.0-RELEASE"
 
@@ -35,10 +33,6 @@ public interface GenericService {
 #define DUBBO_GENERIC_METHOD_NAME "$invokeWithJsonArgs"
 #define DUBBO_GENERIC_METHOD_VER "0.0.0"
 #define DUBBO_GENERIC_METHOD_PARA_TYPES "Ljava/lang/String;[Ljava/lang/String;Ljava/lang/String;"
-#define DUBBO_GENERIC_METHOD_ARGC 3
-#define DUBBO_GENERIC_METHOD_ARGV_METHOD_IDX 0
-#define DUBBO_GENERIC_METHOD_ARGV_TYPES_IDX 1
-#define DUBBO_GENERIC_METHOD_ARGV_ARGS_IDX 2
 
 #define DUBBO_HESSIAN2_SERI_ID 2
 
@@ -66,8 +60,8 @@ struct dubbo_req
 
     char *service; // java string -> hessian string
     char *method;  // java string -> hessian string
-    char **argv;   // java string[] -> hessian string[]
-    int argc;
+    // java string -> hessian string, 引用调用方 JSON, 编码时直接转成 hessian, 不做拷贝
+    const char *json_args;
     char *attach; // java map<string, string> -> hessian map<string, string>
 
     // for evt
@@ -120,34 +114,6 @@ static int64_t next_reqid()
     return id;
 }
 
-static char *rebuild_json_args(const char *json_str)
-{
-    cJSON *root = cJSON_Parse(json_str);
-    if (root == NULL)
-    {
-        return NULL;
-    }
-    if (!cJSON_IsArray(root) && !cJSON_IsObject(root))
-    {
-        cJSON_Delete(root);
-        return NULL;
-    }
-
-    cJSON *arr = cJSON_CreateArray();
-    cJSON *el;
-    cJSON_ArrayForEach(el, root)
-    {
-        cJSON_AddItemToArray(arr, cJSON_Duplicate(el, true));
-    }
-    cJSON_Delete(root);
-
-    // fixme 消除内存 copy
-    char *utf8_json = cJSON_PrintUnformatted(arr);
-    char *ascii_s = utf82ascii(utf8_json);
-    free(utf8_json);
-    return ascii_s;
-}
-
 // fixme
 // static char *rebuild_json_attach(char *json_str)
 // {
@@ -227,9 +193,13 @@ static bool encode_req_data(struct buffer *buf, const struct dubbo_req *req)
     write_hs_str(buf, DUBBO_GENERIC_METHOD_PARA_TYPES);
 
     // args
-    write_hs_str(buf, req->argv[DUBBO_GENERIC_METHOD_ARGV_METHOD_IDX]);
+    write_hs_str(buf, req->method);
     buf_has_written(buf, hs_encode_null((uint8_t *)buf_beginWrite(buf))); // 方法类型提示 NULL, 不支持重载方法
-    write_hs_str(buf, req->argv[DUBBO_GENERIC_METHOD_ARGV_ARGS_IDX]);
+    if (!hs_encode_json_args(buf, req->json_args, strlen(req->json_args)))
+    {
+        LOG_ERROR("invalid json args %s", req->json_args);
+        return false;
+    }
 
     // fixme :  attach NULL
     buf_has_written(buf, hs_encode_null((uint8_t *)buf_beginWrite(buf)));
@@ -364,6 +334,7 @@ static bool decode_res(struct buffer *buf, const struct dubbo_hdr *hdr, struct d
     return true;
 }
 
+// json_args 需保持有效直到 dubbo_encode 完成
 struct dubbo_req *dubbo_req_create(const char *service, const char *method, const char *json_args, const char *json_attach)
 {
     struct dubbo_req *req = calloc(1, sizeof(*req));
@@ -373,20 +344,7 @@ struct dubbo_req *dubbo_req_create(const char *service, const char *method, cons
     req->is_evt = false;
     req->service = strdup(service);
     req->method = strdup(method);
-
-    char *args = rebuild_json_args(json_args);
-    if (args == NULL)
-    {
-        LOG_ERROR("invalid json args %s", json_args);
-        return NULL;
-    }
-
-    req->argc = DUBBO_GENERIC_METHOD_ARGC;
-    req->argv = calloc(3, sizeof(void *));
-    assert(req->argv);
-    req->argv[DUBBO_GENERIC_METHOD_ARGV_METHOD_IDX] = strdup(method);
-    req->argv[DUBBO_GENERIC_METHOD_ARGV_TYPES_IDX] = NULL;
-    req->argv[DUBBO_GENERIC_METHOD_ARGV_ARGS_IDX] = args;
+    req->json_args = json_args;
 
     // fixme 要处理成 hessian map
     if (json_attach)
@@ -399,10 +357,8 @@ struct dubbo_req *dubbo_req_create(const char *service, const char *method, cons
 
 void dubbo_req_release(struct dubbo_req *req)
 {
-    free(req->argv[DUBBO_GENERIC_METHOD_ARGV_METHOD_IDX]);
-    // free(req->argv[DUBBO_GENERIC_METHOD_ARGV_TYPES_IDX]);
-    free(req->argv[DUBBO_GENERIC_METHOD_ARGV_ARGS_IDX]);
-    free(req->argv);
+    free(req->service);
+    free(req->method);
     if (req->attach)
     {
         free(req->attach);
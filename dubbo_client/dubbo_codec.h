@@ -65,6 +65,8 @@ void dubbo_res_release(struct dubbo_res *);
 struct buffer *dubbo_encode(const struct dubbo_req *);
 struct dubbo_res *dubbo_decode(struct buffer *);
 
+#define DUBBO_HDR_LEN 16
+
 bool is_dubbo_pkt(const struct buffer *);
 
 // remaining   0: completed,  < 0, not completed, > 0 overflow
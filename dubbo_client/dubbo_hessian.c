@@ -12,56 +12,67 @@
 
 static const char digits[] = "0123456789abcdef";
 
-// 非法 utf8 返回 null, 正常返回 null 结尾 char*
-char *utf82ascii(char *s)
+static inline char *put_u16(char *p, int c)
 {
-    struct buffer *buf = buf_create(strlen(s) * 2);
+    p[0] = '\\';
+    p[1] = 'u';
+    p[2] = digits[(c & 0xf000) >> 12];
+    p[3] = digits[(c & 0xf00) >> 8];
+    p[4] = digits[(c & 0xf0) >> 4];
+    p[5] = digits[(c & 0xf)];
+    return p + 6;
+}
 
-    utf8_decode_init(s, strlen(s));
-    int c = utf8_decode_next();
-    while (c != UTF8_END)
+int utf82ascii_to(char *dst, const char *s, int sz)
+{
+    char *p = dst;
+    struct utf8_decoder d;
+    utf8_decoder_init(&d, s, sz);
+
+    for (;;)
     {
-        if (c == UTF8_ERROR)
-        {
-            buf_release(buf);
-            return NULL;
-        }
+        // ascii 片段整段拷贝
+        int n = utf8_ascii_prefix(s + d.index, sz - d.index);
+        memcpy(p, s + d.index, n);
+        p += n;
+        d.index += n;
 
-        if (c >= 0 && c <= 127)
+        int c = utf8_decoder_next(&d);
+        if (c == UTF8_END)
         {
-            buf_appendInt8(buf, c);
+            break;
         }
-        else
+        if (c == UTF8_ERROR)
         {
-            /* From http://en.wikipedia.org/wiki/UTF16 */
-            if (c >= 0x10000)
-            {
-                unsigned int next_c;
-                c -= 0x10000;
-                next_c = (unsigned short)((c & 0x3ff) | 0xdc00);
-                c = (unsigned short)((c >> 10) | 0xd800);
-
-                buf_append(buf, "\\u", 2);
-                buf_appendInt8(buf, digits[(c & 0xf000) >> 12]);
-                buf_appendInt8(buf, digits[(c & 0xf00) >> 8]);
-                buf_appendInt8(buf, digits[(c & 0xf0) >> 4]);
-                buf_appendInt8(buf, digits[(c & 0xf)]);
-                c = next_c;
-            }
+            return -1;
+        }
 
-            buf_append(buf, "\\u", 2);
-            buf_appendInt8(buf, digits[(c & 0xf000) >> 12]);
-            buf_appendInt8(buf, digits[(c & 0xf00) >> 8]);
-            buf_appendInt8(buf, digits[(c & 0xf0) >> 4]);
-            buf_appendInt8(buf, digits[(c & 0xf)]);
+        /* From http://en.wikipedia.org/wiki/UTF16 */
+        if (c >= 0x10000)
+        {
+            c -= 0x10000;
+            p = put_u16(p, (c >> 10) | 0xd800);
+            c = (c & 0x3ff) | 0xdc00;
         }
-        c = utf8_decode_next();
+        p = put_u16(p, c);
     }
+    return p - dst;
+}
 
-    char *ret = malloc(buf_readable(buf) + 1);
+// 非法 utf8 返回 null, 正常返回 null 结尾 char*
+char *utf82ascii(char *s)
+{
+    int sz = strlen(s);
+    char *ret = malloc(UTF82ASCII_MAX_SZ(sz) + 1);
     assert(ret);
-    buf_retrieveAsString(buf, buf_readable(buf), ret);
-    buf_release(buf);
+
+    int n = utf82ascii_to(ret, s, sz);
+    if (n < 0)
+    {
+        free(ret);
+        return NULL;
+    }
+    ret[n] = 0;
     return ret;
 }
 
@@ -350,6 +361,441 @@ int hs_encode_string(const char *str, uint8_t *out)
     return index + length;
 }
 
+/* -=-=-=-=-=--=-=-=-=-=--=-=-=-=-= JSON -> hessian string =-=-=-=--=-=-=-=-=--=-=-=-=-=- */
+
+// 单个 chunk 最多字符数, 与 hessian java 实现 Hessian2Output.writeString 一致
+#define HS_STR_CHUNK_SZ 0x8000
+// chunk 头最大长度, 'S'/'R' + 2 字节长度
+#define HS_STR_HDR_SZ 3
+// 与 cJSON 一致
+#define HS_JSON_NESTING_LIMIT 1000
+
+// 输出全部为 ascii, 所以 hessian 的字符长度与字节长度相同
+struct json2hs
+{
+    const uint8_t *s;   // 读位置
+    const uint8_t *end; // 输入结尾
+    uint8_t *out;       // 写位置
+    uint8_t *chunk;     // 当前 chunk 数据起始, 之前预留 HS_STR_HDR_SZ 字节头
+    int depth;
+};
+
+static bool j2h_value(struct json2hs *j);
+
+// 当前 chunk 写满: 回填非最后 chunk 'R' 头, 为下一个 chunk 预留头部
+static void j2h_next_chunk(struct json2hs *j)
+{
+    uint8_t *hdr = j->chunk - HS_STR_HDR_SZ;
+    hdr[0] = 'R';
+    hdr[1] = (uint8_t)(HS_STR_CHUNK_SZ >> 8);
+    hdr[2] = (uint8_t)(HS_STR_CHUNK_SZ);
+    j->out += HS_STR_HDR_SZ;
+    j->chunk = j->out;
+}
+
+static inline void j2h_put(struct json2hs *j, uint8_t c)
+{
+    if (j->out - j->chunk == HS_STR_CHUNK_SZ)
+    {
+        j2h_next_chunk(j);
+    }
+    *j->out++ = c;
+}
+
+static void j2h_write(struct json2hs *j, const uint8_t *s, size_t n)
+{
+    while (n)
+    {
+        size_t room = HS_STR_CHUNK_SZ - (j->out - j->chunk);
+        if (room == 0)
+        {
+            j2h_next_chunk(j);
+            continue;
+        }
+        size_t m = n < room ? n : room;
+        memcpy(j->out, s, m);
+        j->out += m;
+        s += m;
+        n -= m;
+    }
+}
+
+static void j2h_put_u16(struct json2hs *j, int c)
+{
+    uint8_t esc[6] = {'\\', 'u', digits[(c >> 12) & 0xf], digits[(c >> 8) & 0xf], digits[(c >> 4) & 0xf], digits[c & 0xf]};
+    j2h_write(j, esc, sizeof(esc));
+}
+
+// 回填最后一个 chunk 的头, 尽量使用短格式, 返回 hessian string 结尾
+static uint8_t *j2h_finish(struct json2hs *j)
+{
+    size_t len = j->out - j->chunk;
+    uint8_t *hdr = j->chunk - HS_STR_HDR_SZ;
+    size_t hdr_sz;
+
+    if (len <= 31)
+    {
+        hdr_sz = 1;
+    }
+    else if (len <= 1023)
+    {
+        hdr_sz = 2;
+    }
+    else
+    {
+        hdr_sz = 3;
+    }
+
+    if (hdr_sz != HS_STR_HDR_SZ)
+    {
+        // 最多挪动 1023 字节
+        memmove(hdr + hdr_sz, j->chunk, len);
+    }
+
+    if (hdr_sz == 1)
+    {
+        hdr[0] = (uint8_t)len;
+    }
+    else if (hdr_sz == 2)
+    {
+        hdr[0] = (uint8_t)(0x30 + (len >> 8));
+        hdr[1] = (uint8_t)len;
+    }
+    else
+    {
+        hdr[0] = 'S';
+        hdr[1] = (uint8_t)(len >> 8);
+        hdr[2] = (uint8_t)len;
+    }
+    return hdr + hdr_sz + len;
+}
+
+static void j2h_skip_ws(struct json2hs *j)
+{
+    // 与 cJSON buffer_skip_whitespace 一致
+    while (j->s < j->end && *j->s <= 32)
+    {
+        j->s++;
+    }
+}
+
+static inline bool j2h_is_hex(uint8_t c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// 用 utf8_decoder 严格解码一个字符, 返回字节数, 非法返回 0
+static int j2h_utf8(const uint8_t *s, const uint8_t *end, int *cp)
+{
+    struct utf8_decoder d;
+    utf8_decoder_init(&d, (const char *)s, end - s < 4 ? (int)(end - s) : 4);
+    int c = utf8_decoder_next(&d);
+    if (c < 0)
+    {
+        return 0;
+    }
+    *cp = c;
+    return d.index;
+}
+
+// emit = false 时只校验, 用于丢弃对象 key
+static bool j2h_string(struct json2hs *j, bool emit)
+{
+    const uint8_t *s = j->s + 1;
+    const uint8_t *run = s;
+    const uint8_t *end = j->end;
+
+    if (emit)
+    {
+        j2h_put(j, '"');
+    }
+
+    while (s < end)
+    {
+        uint8_t c = *s;
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+        {
+            s++;
+            continue;
+        }
+
+        // ascii 片段整段拷贝
+        if (emit && s > run)
+        {
+            j2h_write(j, run, s - run);
+        }
+        run = s;
+
+        if (c == '"')
+        {
+            if (emit)
+            {
+                j2h_put(j, '"');
+            }
+            j->s = s + 1;
+            return true;
+        }
+        else if (c == '\\')
+        {
+            // 合法转义原样保留
+            if (end - s < 2)
+            {
+                return false;
+            }
+            switch (s[1])
+            {
+            case '"':
+            case '\\':
+            case '/':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                s += 2;
+                break;
+            case 'u':
+                if (end - s < 6 || !j2h_is_hex(s[2]) || !j2h_is_hex(s[3]) || !j2h_is_hex(s[4]) || !j2h_is_hex(s[5]))
+                {
+                    return false;
+                }
+                s += 6;
+                break;
+            default:
+                return false;
+            }
+            if (emit)
+            {
+                j2h_write(j, run, s - run);
+            }
+        }
+        else if (c < 0x20)
+        {
+            // 未转义控制字符, cJSON 能接受并转义输出, 这里保持一致
+            if (emit)
+            {
+                j2h_put_u16(j, c);
+            }
+            s++;
+        }
+        else
+        {
+            int cp;
+            int n = j2h_utf8(s, end, &cp);
+            if (n == 0)
+            {
+                return false;
+            }
+            if (emit)
+            {
+                /* From http://en.wikipedia.org/wiki/UTF16 */
+                if (cp >= 0x10000)
+                {
+                    cp -= 0x10000;
+                    j2h_put_u16(j, (cp >> 10) | 0xd800);
+                    cp = (cp & 0x3ff) | 0xdc00;
+                }
+                j2h_put_u16(j, cp);
+            }
+            s += n;
+        }
+        run = s;
+    }
+    return false;
+}
+
+static bool j2h_number(struct json2hs *j)
+{
+    const uint8_t *s = j->s;
+    const uint8_t *end = j->end;
+
+#define J2H_DIGITS()                          \
+    if (s >= end || *s < '0' || *s > '9')     \
+    {                                         \
+        return false;                         \
+    }                                         \
+    while (s < end && *s >= '0' && *s <= '9') \
+    {                                         \
+        s++;                                  \
+    }
+
+    if (*s == '-')
+    {
+        s++;
+    }
+    if (s < end && *s == '0')
+    {
+        s++;
+    }
+    else
+    {
+        J2H_DIGITS();
+    }
+    if (s < end && *s == '.')
+    {
+        s++;
+        J2H_DIGITS();
+    }
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        s++;
+        if (s < end && (*s == '+' || *s == '-'))
+        {
+            s++;
+        }
+        J2H_DIGITS();
+    }
+#undef J2H_DIGITS
+
+    j2h_write(j, j->s, s - j->s);
+    j->s = s;
+    return true;
+}
+
+static bool j2h_literal(struct json2hs *j, const char *lit, size_t n)
+{
+    if ((size_t)(j->end - j->s) < n || memcmp(j->s, lit, n) != 0)
+    {
+        return false;
+    }
+    j2h_write(j, (const uint8_t *)lit, n);
+    j->s += n;
+    return true;
+}
+
+// 当前位置为 '[' 或 '{', keep_key = false 时对象只输出值, 作为数组元素
+static bool j2h_container(struct json2hs *j, bool keep_key)
+{
+    bool is_obj = *j->s == '{';
+    uint8_t close = is_obj ? '}' : ']';
+
+    if (++j->depth > HS_JSON_NESTING_LIMIT)
+    {
+        return false;
+    }
+
+    j2h_put(j, (is_obj && keep_key) ? '{' : '[');
+    j->s++;
+    j2h_skip_ws(j);
+
+    if (j->s < j->end && *j->s == close)
+    {
+        j->s++;
+        j2h_put(j, (is_obj && keep_key) ? '}' : ']');
+        j->depth--;
+        return true;
+    }
+
+    for (;;)
+    {
+        if (is_obj)
+        {
+            if (j->s >= j->end || *j->s != '"' || !j2h_string(j, keep_key))
+            {
+                return false;
+            }
+            j2h_skip_ws(j);
+            if (j->s >= j->end || *j->s != ':')
+            {
+                return false;
+            }
+            j->s++;
+            if (keep_key)
+            {
+                j2h_put(j, ':');
+            }
+            j2h_skip_ws(j);
+        }
+
+        if (!j2h_value(j))
+        {
+            return false;
+        }
+        j2h_skip_ws(j);
+
+        if (j->s >= j->end)
+        {
+            return false;
+        }
+        if (*j->s == ',')
+        {
+            j2h_put(j, ',');
+            j->s++;
+            j2h_skip_ws(j);
+        }
+        else if (*j->s == close)
+        {
+            j2h_put(j, (is_obj && keep_key) ? '}' : ']');
+            j->s++;
+            j->depth--;
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+}
+
+static bool j2h_value(struct json2hs *j)
+{
+    if (j->s >= j->end)
+    {
+        return false;
+    }
+
+    switch (*j->s)
+    {
+    case '"':
+        return j2h_string(j, true);
+    case '[':
+    case '{':
+        return j2h_container(j, true);
+    case 't':
+        return j2h_literal(j, "true", 4);
+    case 'f':
+        return j2h_literal(j, "false", 5);
+    case 'n':
+        return j2h_literal(j, "null", 4);
+    default:
+        return j2h_number(j);
+    }
+}
+
+bool hs_encode_json_args(struct buffer *buf, const char *json, size_t sz)
+{
+    // 最坏情况: 未转义的控制字符 1 字节 -> \u00XX 6 字节 (utf8 最多 3 倍), 加上每个 chunk 的头
+    size_t max_data = sz * 6 + 2;
+    size_t max_sz = max_data + (max_data / HS_STR_CHUNK_SZ + 1) * HS_STR_HDR_SZ;
+    buf_ensureWritable(buf, max_sz);
+
+    uint8_t *begin = (uint8_t *)buf_beginWrite(buf);
+    struct json2hs j;
+    j.s = (const uint8_t *)json;
+    j.end = j.s + sz;
+    j.chunk = begin + HS_STR_HDR_SZ;
+    j.out = j.chunk;
+    j.depth = 0;
+
+    j2h_skip_ws(&j);
+    if (j.s >= j.end || (*j.s != '[' && *j.s != '{'))
+    {
+        return false;
+    }
+    if (!j2h_container(&j, false))
+    {
+        return false;
+    }
+    j2h_skip_ws(&j);
+    if (j.s != j.end)
+    {
+        return false;
+    }
+
+    buf_has_written(buf, j2h_finish(&j) - begin);
+    return true;
+}
+
 // !! FREE
 bool hs_decode_string(const uint8_t *buf, size_t sz, char **out, size_t *out_sz)
 {
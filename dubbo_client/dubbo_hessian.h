@@ -5,6 +5,14 @@
 #include <stdbool.h>
 #include <unistd.h>
 
+struct buffer;
+
+// 最坏情况: 2 字节 utf8 -> \uXXXX, 4 字节 utf8 -> 两个 \uXXXX
+#define UTF82ASCII_MAX_SZ(sz) ((sz) * 3)
+
+// 写入 dst (至少 UTF82ASCII_MAX_SZ(sz) 字节, 不补 \0), 返回写入字节数, 非法 utf8 返回 -1
+// 可重入
+int utf82ascii_to(char *dst, const char *s, int sz);
 char *utf82ascii(char *s);
 size_t utf8len(const char *s, size_t sz);
 int utf8cpy(uint8_t *dst, const uint8_t *src, size_t sz);
@@ -17,4 +25,9 @@ bool hs_decode_int(const uint8_t *buf, size_t sz, int32_t *out);
 
 int hs_encode_string(const char *str, uint8_t *out);
 bool hs_decode_string(const uint8_t *buf, size_t sz, char **out, size_t *out_sz);
+
+// dubbo 泛化调用参数: JSON 数组或对象 (对象按成员顺序取值) 单趟转成 ascii JSON 数组,
+// 以 hessian string 直接写入 buf, 非 ascii 字符转义为 \uXXXX
+// 非法 JSON / utf8 返回 false, buf 不变
+bool hs_encode_json_args(struct buffer *buf, const char *json, size_t sz);
 #endif
\ No newline at end of file
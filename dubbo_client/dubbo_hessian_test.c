@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include "buffer.h"
+#include "cJSON.h"
+#include "dubbo_hessian.h"
+#include "utf8_decode.h"
+
+// 原实现: cJSON 解析 -> 复制成数组 -> print -> utf82ascii -> hs_encode_string
+static struct buffer *encode_by_cjson(const char *json)
+{
+    cJSON *root = cJSON_Parse(json);
+    assert(root);
+    cJSON *arr = cJSON_CreateArray();
+    cJSON *el;
+    cJSON_ArrayForEach(el, root)
+    {
+        cJSON_AddItemToArray(arr, cJSON_Duplicate(el, true));
+    }
+    cJSON_Delete(root);
+
+    char *utf8_json = cJSON_PrintUnformatted(arr);
+    cJSON_Delete(arr);
+    char *ascii_s = utf82ascii(utf8_json);
+    free(utf8_json);
+
+    struct buffer *buf = buf_create(strlen(ascii_s) + 8);
+    int n = hs_encode_string(ascii_s, (uint8_t *)buf_beginWrite(buf));
+    assert(n > 0);
+    buf_has_written(buf, n);
+    free(ascii_s);
+    return buf;
+}
+
+static char *decode_hs_str(struct buffer *buf)
+{
+    char *out;
+    size_t out_sz;
+    assert(hs_decode_string((const uint8_t *)buf_peek(buf), buf_readable(buf), &out, &out_sz));
+    char *s = malloc(out_sz + 1);
+    memcpy(s, out, out_sz);
+    s[out_sz] = 0;
+    free(out);
+    return s;
+}
+
+static void expect(const char *json, const char *expect_str)
+{
+    struct buffer *buf = buf_create(16);
+    assert(hs_encode_json_args(buf, json, strlen(json)));
+    char *s = decode_hs_str(buf);
+    if (strcmp(s, expect_str) != 0)
+    {
+        fprintf(stderr, "%s: expect %s, got %s\n", json, expect_str, s);
+        assert(false);
+    }
+    free(s);
+    buf_release(buf);
+}
+
+static void expect_fail(const char *json)
+{
+    struct buffer *buf = buf_create(16);
+    assert(!hs_encode_json_args(buf, json, strlen(json)));
+    assert(buf_readable(buf) == 0);
+    buf_release(buf);
+}
+
+// 与原实现语义一致
+static void expect_same_as_cjson(const char *json)
+{
+    struct buffer *a = buf_create(16);
+    assert(hs_encode_json_args(a, json, strlen(json)));
+    struct buffer *b = encode_by_cjson(json);
+
+    char *sa = decode_hs_str(a);
+    char *sb = decode_hs_str(b);
+    cJSON *ja = cJSON_Parse(sa);
+    cJSON *jb = cJSON_Parse(sb);
+    assert(ja && jb);
+    assert(cJSON_Compare(ja, jb, true));
+
+    cJSON_Delete(ja);
+    cJSON_Delete(jb);
+    free(sa);
+    free(sb);
+    buf_release(a);
+    buf_release(b);
+}
+
+void test_encode_json_args()
+{
+    expect("[]", "[]");
+    expect("{}", "[]");
+    expect(" [ 1 , \"a\" , true , false , null ] ", "[1,\"a\",true,false,null]");
+    expect("{\"a\": 1, \"b\": [1, {\"c\": -2.5e+3}]}", "[1,[1,{\"c\":-2.5e+3}]]");
+    expect("[\"\xe4\xb8\xad\xe6\x96\x87\"]", "[\"\\u4e2d\\u6587\"]");
+    expect("[\"\xf0\x9f\x98\x80\"]", "[\"\\ud83d\\ude00\"]");
+    expect("[\"a\\\"b\\\\c\\u00e9\\n\"]", "[\"a\\\"b\\\\c\\u00e9\\n\"]");
+    expect("[\"\t\"]", "[\"\\u0009\"]");
+
+    expect_fail("");
+    expect_fail("1");
+    expect_fail("\"abc\"");
+    expect_fail("[1,]");
+    expect_fail("[01]");
+    expect_fail("[1 2]");
+    expect_fail("{\"a\" 1}");
+    expect_fail("[\"abc]");
+    expect_fail("[\"\\x\"]");
+    expect_fail("[\"\xc0\xaf\"]");     // overlong
+    expect_fail("[\"\xed\xa0\x80\"]"); // surrogate
+    expect_fail("[tru]");
+    expect_fail("[1] x");
+
+    expect_same_as_cjson("[true,1,3.1400000000000001,\"hello\",{\"propBool\":null,\"propString\":\"\xe4\xbd\xa0\xe5\xa5\xbd\"},[{\"x\":1}],\"WARN\"]");
+    expect_same_as_cjson("{\"arg0\": {\"k\": [1, 2, 3]}, \"arg1\": \"\xe2\x82\xac\"}");
+}
+
+// hs_decode_string 暂不支持 'R' 分块, 这里手工拼接
+static char *decode_hs_chunks(struct buffer *buf)
+{
+    const uint8_t *p = (const uint8_t *)buf_peek(buf);
+    const uint8_t *end = p + buf_readable(buf);
+    char *s = malloc(buf_readable(buf) + 1);
+    size_t n = 0;
+    while (*p == 'R')
+    {
+        size_t len = (p[1] << 8) | p[2];
+        memcpy(s + n, p + 3, len);
+        n += len;
+        p += 3 + len;
+    }
+    // 最后一块可能是短格式
+    size_t len, hdr;
+    if (*p < 0x20)
+    {
+        len = *p;
+        hdr = 1;
+    }
+    else if (*p >= 0x30 && *p <= 0x33)
+    {
+        len = ((*p - 0x30) << 8) | p[1];
+        hdr = 2;
+    }
+    else
+    {
+        assert(*p == 'S');
+        len = (p[1] << 8) | p[2];
+        hdr = 3;
+    }
+    memcpy(s + n, p + hdr, len);
+    n += len;
+    assert(p + hdr + len == end);
+    s[n] = 0;
+    return s;
+}
+
+void test_encode_json_args_chunk()
+{
+    // 超过一个 hessian chunk 的大字符串, 原实现直接失败
+    size_t n = 0x8000 * 2 + 100;
+    char *json = malloc(n + 16);
+    size_t i = 0;
+    json[i++] = '[';
+    json[i++] = '"';
+    for (; i < n; i++)
+    {
+        json[i] = 'a' + i % 26;
+    }
+    json[i++] = '"';
+    json[i++] = ']';
+    json[i] = 0;
+
+    struct buffer *buf = buf_create(16);
+    assert(hs_encode_json_args(buf, json, strlen(json)));
+    assert(buf_peek(buf)[0] == 'R');
+    char *s = decode_hs_chunks(buf);
+    assert(strcmp(s, json) == 0);
+    free(s);
+    buf_release(buf);
+    free(json);
+}
+
+// 未转义控制字符 1 字节展开成 \u00XX 6 字节, 缓冲区要按最坏情况预留
+void test_encode_json_args_ctrl()
+{
+    size_t n = 5000, i;
+    char *json = malloc(n + 8);
+    char *want = malloc(n * 6 + 8);
+    size_t j = 0, k = 0;
+    json[j++] = '[';
+    json[j++] = '"';
+    want[k++] = '[';
+    want[k++] = '"';
+    for (i = 0; i < n; i++)
+    {
+        json[j++] = 0x01;
+        memcpy(want + k, "\\u0001", 6);
+        k += 6;
+    }
+    json[j++] = '"';
+    json[j++] = ']';
+    json[j] = 0;
+    want[k++] = '"';
+    want[k++] = ']';
+    want[k] = 0;
+
+    struct buffer *buf = buf_create(16);
+    assert(hs_encode_json_args(buf, json, strlen(json)));
+    char *s = decode_hs_chunks(buf);
+    assert(strcmp(s, want) == 0);
+    free(s);
+    buf_release(buf);
+    free(want);
+    free(json);
+}
+
+// 原 utf82ascii: 全局解码状态 + 逐字节 buf_appendInt8
+static char *utf82ascii_by_buf(char *s)
+{
+    static const char digits[] = "0123456789abcdef";
+    struct buffer *buf = buf_create(strlen(s) * 2);
+    utf8_decode_init(s, strlen(s));
+    int c = utf8_decode_next();
+    while (c != UTF8_END)
+    {
+        if (c == UTF8_ERROR)
+        {
+            buf_release(buf);
+            return NULL;
+        }
+        if (c <= 127)
+        {
+            buf_appendInt8(buf, c);
+        }
+        else
+        {
+            if (c >= 0x10000)
+            {
+                unsigned int next_c;
+                c -= 0x10000;
+                next_c = (unsigned short)((c & 0x3ff) | 0xdc00);
+                c = (unsigned short)((c >> 10) | 0xd800);
+                buf_append(buf, "\\u", 2);
+                buf_appendInt8(buf, digits[(c & 0xf000) >> 12]);
+                buf_appendInt8(buf, digits[(c & 0xf00) >> 8]);
+                buf_appendInt8(buf, digits[(c & 0xf0) >> 4]);
+                buf_appendInt8(buf, digits[(c & 0xf)]);
+                c = next_c;
+            }
+            buf_append(buf, "\\u", 2);
+            buf_appendInt8(buf, digits[(c & 0xf000) >> 12]);
+            buf_appendInt8(buf, digits[(c & 0xf00) >> 8]);
+            buf_appendInt8(buf, digits[(c & 0xf0) >> 4]);
+            buf_appendInt8(buf, digits[(c & 0xf)]);
+        }
+        c = utf8_decode_next();
+    }
+    char *ret = malloc(buf_readable(buf) + 1);
+    buf_retrieveAsString(buf, buf_readable(buf), ret);
+    buf_release(buf);
+    return ret;
+}
+
+static void expect_utf82ascii(const char *in, const char *expect_str)
+{
+    char *s = utf82ascii((char *)in);
+    if (expect_str == NULL)
+    {
+        assert(s == NULL);
+        return;
+    }
+    assert(s && strcmp(s, expect_str) == 0);
+    free(s);
+}
+
+void test_utf82ascii()
+{
+    expect_utf82ascii("", "");
+    expect_utf82ascii("hello, world! 0123456789 abcdefghijklmn", "hello, world! 0123456789 abcdefghijklmn");
+    expect_utf82ascii("caf\xc3\xa9", "caf\\u00e9");
+    expect_utf82ascii("\xe4\xb8\xad\xe6\x96\x87" "abc", "\\u4e2d\\u6587abc");
+    expect_utf82ascii("x\xf0\x9f\x98\x80", "x\\ud83d\\ude00");
+    expect_utf82ascii("0123456789abcdef0123456789abcdef\xc0\xaf", NULL);
+    expect_utf82ascii("0123456789abcdef\xe4\xb8", NULL);
+
+    // 与原实现逐字节一致
+    const char *cases[] = {
+        "{\"k\":\"\xe4\xbd\xa0\xe5\xa5\xbd\",\"long ascii run over sixteen bytes\":1}",
+        "\xf0\x9f\x98\x80\xf0\x9f\x98\x81 mixed \xc3\xa9\xc3\xa8" " text",
+    };
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        char *a = utf82ascii((char *)cases[i]);
+        char *b = utf82ascii_by_buf((char *)cases[i]);
+        assert(strcmp(a, b) == 0);
+        free(a);
+        free(b);
+    }
+}
+
+static int64_t now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void bench()
+{
+    const char *json = "{\"arg0\":[true,1,3.1400000000000001,\"hello \xe4\xbd\xa0\xe5\xa5\xbd\",{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":123456,\"propI64\":9007199254740991,\"propDouble\":null,\"propString\":\"\xe4\xb8\xad\xe6\x96\x87\",\"errorLevel\":null},[{\"propBool\":null,\"propByte\":null},{\"propI16\":null,\"propI32\":null}]],\"arg1\":\"WARN\"}";
+    int i, n = 200000;
+
+    int64_t start = now_us();
+    for (i = 0; i < n; i++)
+    {
+        buf_release(encode_by_cjson(json));
+    }
+    int64_t cjson_us = now_us() - start;
+
+    struct buffer *buf = buf_create(1024);
+    start = now_us();
+    for (i = 0; i < n; i++)
+    {
+        buf_retrieveAll(buf);
+        hs_encode_json_args(buf, json, strlen(json));
+    }
+    int64_t direct_us = now_us() - start;
+    buf_release(buf);
+
+    printf("cJSON+utf82ascii %.1f ns/req, direct %.1f ns/req\n", cjson_us * 1000.0 / n, direct_us * 1000.0 / n);
+
+    // utf82ascii: 以 ascii 为主的 JSON 与中文为主的文本
+    const char *texts[] = {
+        "{\"service\":\"com.example.demo.DemoService\",\"method\":\"sayHello\",\"args\":[\"hello \xe4\xbd\xa0\xe5\xa5\xbd\",123456,true,null]}",
+        "\xe4\xb8\xad\xe6\x96\x87\xe6\xb5\x8b\xe8\xaf\x95\xe6\x96\x87\xe6\x9c\xac\xe4\xb8\xad\xe6\x96\x87\xe6\xb5\x8b\xe8\xaf\x95\xe6\x96\x87\xe6\x9c\xac",
+    };
+    for (int t = 0; t < 2; t++)
+    {
+        start = now_us();
+        for (i = 0; i < n; i++)
+        {
+            free(utf82ascii_by_buf((char *)texts[t]));
+        }
+        int64_t old_us = now_us() - start;
+
+        start = now_us();
+        for (i = 0; i < n; i++)
+        {
+            free(utf82ascii((char *)texts[t]));
+        }
+        int64_t new_us = now_us() - start;
+        printf("utf82ascii[%s] buf_appendInt8 %.1f ns, direct %.1f ns\n", t == 0 ? "ascii" : "cjk", old_us * 1000.0 / n, new_us * 1000.0 / n);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    test_utf82ascii();
+    test_encode_json_args();
+    test_encode_json_args_chunk();
+    test_encode_json_args_ctrl();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
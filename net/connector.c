@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "ae.h"
+#include "socket.h"
+#include "connector.h"
+
+struct connector;
+
+struct attempt
+{
+    struct connector *c;
+    union sockaddr_all addr;
+    int fd;            // -1 未发起或已结束
+    long long timerid; // 单次超时
+};
+
+struct connector
+{
+    aeEventLoop *el;
+    struct connector_opts opts;
+    connector_proc proc;
+    void *ud;
+
+    int n;
+    int next; // 下一个要发起的
+    int inflight;
+    int err;  // 最后一个错误
+    long long stagger_timer;
+    long long total_timer;
+    long long fail_timer; // 全部失败后延到 loop 里回调
+    struct attempt attempts[CONNECTOR_MAX_ADDRS];
+};
+
+static int connector_launch(struct connector *c);
+
+// RFC 8305 4: 按 family 交替, 以第一个地址的 family 开头, 同 family 内保持原有顺序
+static void connector_order(struct connector *c, const union sockaddr_all *addrs, int n)
+{
+    int i, k = 0, a = 0, b = 0, np = 0, ns = 0;
+    int first = addrs[0].s.sa_family;
+    const union sockaddr_all *primary[CONNECTOR_MAX_ADDRS];
+    const union sockaddr_all *secondary[CONNECTOR_MAX_ADDRS];
+    for (i = 0; i < n; i++)
+    {
+        if (addrs[i].s.sa_family == first)
+        {
+            primary[np++] = &addrs[i];
+        }
+        else
+        {
+            secondary[ns++] = &addrs[i];
+        }
+    }
+    while (a < np || b < ns)
+    {
+        if (a < np)
+        {
+            c->attempts[k++].addr = *primary[a++];
+        }
+        if (b < ns)
+        {
+            c->attempts[k++].addr = *secondary[b++];
+        }
+    }
+}
+
+static void timer_clear(struct connector *c, long long *id)
+{
+    if (*id != AE_NOMORE)
+    {
+        aeDeleteTimeEvent(c->el, *id);
+        *id = AE_NOMORE;
+    }
+}
+
+static void attempt_close(struct attempt *at)
+{
+    struct connector *c = at->c;
+    timer_clear(c, &at->timerid);
+    if (at->fd >= 0)
+    {
+        aeDeleteFileEvent(c->el, at->fd, AE_WRITABLE);
+        close(at->fd);
+        at->fd = -1;
+        c->inflight--;
+    }
+}
+
+static void connector_free(struct connector *c)
+{
+    int i;
+    for (i = 0; i < c->n; i++)
+    {
+        attempt_close(&c->attempts[i]);
+    }
+    timer_clear(c, &c->stagger_timer);
+    timer_clear(c, &c->total_timer);
+    timer_clear(c, &c->fail_timer);
+    free(c);
+}
+
+static void connector_done(struct connector *c, int fd, const union sockaddr_all *addr, int err)
+{
+    connector_proc proc = c->proc;
+    void *ud = c->ud;
+    union sockaddr_all a;
+    if (addr)
+    {
+        a = *addr;
+    }
+    connector_free(c);
+    proc(ud, fd, addr ? &a : NULL, err);
+}
+
+static int connector_on_fail(aeEventLoop *el, long long id, void *ud)
+{
+    struct connector *c = ud;
+    c->fail_timer = AE_NOMORE;
+    connector_done(c, -1, NULL, c->err);
+    return AE_NOMORE;
+}
+
+// 没有在途的也没有剩下的地址: 失败, 延到下一轮 loop 回调, 保证不在 connector_start 里回调
+// 返回 0 还没失败, 1 已失败并安排了回调, -1 已失败但没能安排回调, 由调用方回调或释放
+static int connector_check_fail(struct connector *c)
+{
+    if (c->inflight > 0 || c->next < c->n)
+    {
+        return 0;
+    }
+    if (c->fail_timer == AE_NOMORE)
+    {
+        timer_clear(c, &c->stagger_timer);
+        c->fail_timer = aeCreateTimeEvent(c->el, 0, connector_on_fail, c, NULL);
+        if (c->fail_timer == AE_ERR)
+        {
+            c->fail_timer = AE_NOMORE;
+            return -1;
+        }
+    }
+    return 1;
+}
+
+// 一次尝试失败, 立即发起下一个, 不等 stagger
+static void attempt_fail(struct attempt *at, int err)
+{
+    struct connector *c = at->c;
+    attempt_close(at);
+    c->err = err;
+    int ret = connector_check_fail(c);
+    if (ret == 0)
+    {
+        ret = connector_launch(c);
+    }
+    if (ret < 0)
+    {
+        // 已经在 loop 里了, 直接回调
+        connector_done(c, -1, NULL, c->err);
+    }
+}
+
+static void attempt_on_writable(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    struct attempt *at = ud;
+    int err = socket_getError(fd);
+    if (err != 0)
+    {
+        attempt_fail(at, err);
+        return;
+    }
+    // 赢了: fd 交给调用方, 其余关闭
+    aeDeleteFileEvent(el, fd, AE_WRITABLE);
+    at->fd = -1;
+    at->c->inflight--;
+    connector_done(at->c, fd, &at->addr, 0);
+}
+
+static int attempt_on_timeout(aeEventLoop *el, long long id, void *ud)
+{
+    struct attempt *at = ud;
+    at->timerid = AE_NOMORE;
+    attempt_fail(at, ETIMEDOUT);
+    return AE_NOMORE;
+}
+
+static int connector_on_stagger(aeEventLoop *el, long long id, void *ud)
+{
+    struct connector *c = ud;
+    c->stagger_timer = AE_NOMORE;
+    if (connector_launch(c) < 0)
+    {
+        connector_done(c, -1, NULL, c->err);
+    }
+    return AE_NOMORE;
+}
+
+static int connector_on_timeout(aeEventLoop *el, long long id, void *ud)
+{
+    struct connector *c = ud;
+    c->total_timer = AE_NOMORE;
+    connector_done(c, -1, NULL, ETIMEDOUT);
+    return AE_NOMORE;
+}
+
+// 发起下一个地址; 立即失败的直接跳过, 直到有一个在途或地址用完
+// 返回 -1 表示全部失败且没能安排回调, 同 connector_check_fail
+static int connector_launch(struct connector *c)
+{
+    timer_clear(c, &c->stagger_timer);
+    while (c->next < c->n)
+    {
+        struct attempt *at = &c->attempts[c->next++];
+        int fd = socket_createFamily(at->addr.s.sa_family);
+        if (fd < 0)
+        {
+            c->err = errno;
+            continue;
+        }
+        if (socket_connect(fd, &at->addr, sa_socklen(&at->addr)) < 0 && errno != EINPROGRESS)
+        {
+            c->err = errno;
+            close(fd);
+            continue;
+        }
+        // 立即连上的也等可写事件, 统一在 loop 里回调
+        if (aeCreateFileEvent(c->el, fd, AE_WRITABLE, attempt_on_writable, at) == AE_ERR)
+        {
+            c->err = ENOMEM;
+            close(fd);
+            continue;
+        }
+        at->fd = fd;
+        c->inflight++;
+        if (c->opts.attempt_timeout_ms > 0)
+        {
+            at->timerid = aeCreateTimeEvent(c->el, c->opts.attempt_timeout_ms, attempt_on_timeout, at, NULL);
+            if (at->timerid == AE_ERR)
+            {
+                at->timerid = AE_NOMORE;
+            }
+        }
+        if (c->next < c->n)
+        {
+            c->stagger_timer = aeCreateTimeEvent(c->el, c->opts.stagger_ms, connector_on_stagger, c, NULL);
+            if (c->stagger_timer == AE_ERR)
+            {
+                c->stagger_timer = AE_NOMORE;
+            }
+        }
+        return 0;
+    }
+    return connector_check_fail(c) < 0 ? -1 : 0;
+}
+
+struct connector *connector_start(struct aeEventLoop *el, const union sockaddr_all *addrs, int n,
+                                  const struct connector_opts *opts, connector_proc proc, void *ud)
+{
+    if (n <= 0)
+    {
+        return NULL;
+    }
+    struct connector *c = calloc(1, sizeof(*c));
+    if (c == NULL)
+    {
+        return NULL;
+    }
+    if (n > CONNECTOR_MAX_ADDRS)
+    {
+        n = CONNECTOR_MAX_ADDRS;
+    }
+    c->el = el;
+    if (opts)
+    {
+        c->opts = *opts;
+    }
+    if (c->opts.stagger_ms <= 0)
+    {
+        c->opts.stagger_ms = CONNECTOR_DEFAULT_STAGGER_MS;
+    }
+    c->proc = proc;
+    c->ud = ud;
+    c->n = n;
+    c->err = ECONNREFUSED;
+    c->stagger_timer = AE_NOMORE;
+    c->total_timer = AE_NOMORE;
+    c->fail_timer = AE_NOMORE;
+
+    int i;
+    connector_order(c, addrs, n);
+    for (i = 0; i < n; i++)
+    {
+        c->attempts[i].c = c;
+        c->attempts[i].fd = -1;
+        c->attempts[i].timerid = AE_NOMORE;
+    }
+
+    if (c->opts.timeout_ms > 0)
+    {
+        c->total_timer = aeCreateTimeEvent(el, c->opts.timeout_ms, connector_on_timeout, c, NULL);
+        if (c->total_timer == AE_ERR)
+        {
+            free(c);
+            return NULL;
+        }
+    }
+    if (connector_launch(c) < 0)
+    {
+        connector_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void connector_cancel(struct connector *c)
+{
+    connector_free(c);
+}
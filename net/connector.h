@@ -0,0 +1,33 @@
+#ifndef CONNECTOR_H
+#define CONNECTOR_H
+
+#include "sa.h"
+
+// 异步连接, Happy Eyeballs (RFC 8305): 候选地址按 family 交替排序
+// 先连第一个, 每隔 stagger_ms 或上一个失败时立即再发起下一个, 多个连接同时在途, 谁先连上用谁, 其余关闭
+// 每次尝试单独超时, 避免第一个地址被黑洞时整体卡在 SYN 重传上
+
+#define CONNECTOR_MAX_ADDRS 16
+#define CONNECTOR_DEFAULT_STAGGER_MS 250
+
+struct aeEventLoop;
+struct connector;
+
+struct connector_opts
+{
+    int stagger_ms;         // 两次发起之间的间隔, 0 用默认值
+    int attempt_timeout_ms; // 单个地址的超时, 0 不限
+    int timeout_ms;         // 整体超时, 0 不限
+};
+
+// 成功 fd >= 0 (非阻塞, 归调用方), addr 为连上的地址; 失败 fd 为 -1, err 为最后一个错误
+// 总是在 loop 里回调, 回调之后 connector 已释放
+typedef void (*connector_proc)(void *ud, int fd, const union sockaddr_all *addr, int err);
+
+// addrs 端口要填好, 最多用前 CONNECTOR_MAX_ADDRS 个; opts 可为 NULL; 失败返回 NULL, 不会回调
+struct connector *connector_start(struct aeEventLoop *el, const union sockaddr_all *addrs, int n,
+                                  const struct connector_opts *opts, connector_proc proc, void *ud);
+// 回调前取消, 关闭所有在途连接, 不再回调
+void connector_cancel(struct connector *c);
+
+#endif
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "ae.h"
+#include "socket.h"
+#include "connector.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int listen_on(union sockaddr_all *addr, int backlog)
+{
+    int fd = socket(addr->s.sa_family, SOCK_STREAM, 0);
+    socklen_t len = sa_socklen(addr);
+    assert(fd >= 0);
+    assert(bind(fd, &addr->s, len) == 0);
+    assert(listen(fd, backlog) == 0);
+    assert(getsockname(fd, &addr->s, &len) == 0);
+    return fd;
+}
+
+// 黑洞: backlog 0 的 listen socket 被一个不 accept 的连接占满, 之后的 SYN 都被丢掉
+struct blackhole
+{
+    int lfd;
+    int filler;
+    union sockaddr_all addr;
+};
+
+static void blackhole_open(struct blackhole *b)
+{
+    b->addr = sa_fromip("127.0.0.1", 0);
+    b->lfd = listen_on(&b->addr, 0);
+    b->filler = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(b->filler, &b->addr.s, sizeof(b->addr.v4)) == 0);
+}
+
+static void blackhole_close(struct blackhole *b)
+{
+    close(b->filler);
+    close(b->lfd);
+}
+
+// 监听后马上关掉, 得到一个会被拒绝的端口
+static union sockaddr_all refused_addr()
+{
+    union sockaddr_all addr = sa_fromip("127.0.0.1", 0);
+    close(listen_on(&addr, 1));
+    return addr;
+}
+
+struct result
+{
+    bool done;
+    int fd;
+    int err;
+    union sockaddr_all addr;
+    long long us;
+};
+
+static long long start_us;
+
+static void on_connected(void *ud, int fd, const union sockaddr_all *addr, int err)
+{
+    struct result *r = ud;
+    assert(!r->done);
+    r->done = true;
+    r->fd = fd;
+    r->err = err;
+    r->us = now_us() - start_us;
+    if (fd >= 0)
+    {
+        r->addr = *addr;
+    }
+}
+
+static void run(aeEventLoop *el, const union sockaddr_all *addrs, int n, int stagger, int attempt_timeout, int timeout, struct result *r)
+{
+    struct connector_opts opts = {stagger, attempt_timeout, timeout};
+    memset(r, 0, sizeof(*r));
+    start_us = now_us();
+    assert(connector_start(el, addrs, n, &opts, on_connected, r));
+    assert(!r->done);
+    while (!r->done)
+    {
+        aeProcessEvents(el, AE_ALL_EVENTS);
+    }
+}
+
+// 第一个地址黑洞, stagger 后第二个 (IPv6) 先连上
+void test_race()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct blackhole b;
+    struct result r;
+    blackhole_open(&b);
+    union sockaddr_all good = sa_fromipV6("::1", 0);
+    int lfd = listen_on(&good, 16);
+
+    union sockaddr_all addrs[2] = {b.addr, good};
+    run(el, addrs, 2, 50, 0, 0, &r);
+    assert(r.fd >= 0 && r.err == 0);
+    assert(r.addr.s.sa_family == AF_INET6 && r.addr.v6.sin6_port == good.v6.sin6_port);
+    assert(r.us >= 40000 && r.us < 1000000);
+    close(r.fd);
+
+    // 交替排序: v4 v4 v6 实际按 v4 v6 v4 发起, 第二次就连上
+    union sockaddr_all addrs3[3] = {b.addr, b.addr, good};
+    run(el, addrs3, 3, 200, 0, 0, &r);
+    assert(r.fd >= 0 && r.addr.s.sa_family == AF_INET6);
+    assert(r.us < 350000);
+    close(r.fd);
+
+    close(lfd);
+    blackhole_close(&b);
+    aeDeleteEventLoop(el);
+}
+
+// 被拒绝的地址立即换下一个, 不等 stagger; 全部拒绝回调失败
+void test_refused()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct result r;
+    union sockaddr_all good = sa_fromip("127.0.0.1", 0);
+    int lfd = listen_on(&good, 16);
+
+    union sockaddr_all addrs[2] = {refused_addr(), good};
+    run(el, addrs, 2, 1000, 0, 0, &r);
+    assert(r.fd >= 0 && r.us < 500000);
+    assert(r.addr.v4.sin_port == good.v4.sin_port);
+    close(r.fd);
+
+    union sockaddr_all bad[2] = {refused_addr(), refused_addr()};
+    run(el, bad, 2, 1000, 0, 0, &r);
+    assert(r.fd == -1 && r.err == ECONNREFUSED && r.us < 500000);
+
+    close(lfd);
+    aeDeleteEventLoop(el);
+}
+
+// 单次超时与整体超时
+void test_timeout()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct blackhole b;
+    struct result r;
+    blackhole_open(&b);
+
+    union sockaddr_all addrs[2] = {b.addr, b.addr};
+    run(el, addrs, 2, 1000, 50, 0, &r);
+    assert(r.fd == -1 && r.err == ETIMEDOUT);
+    assert(r.us >= 90000 && r.us < 500000);
+
+    run(el, addrs, 2, 20, 0, 60, &r);
+    assert(r.fd == -1 && r.err == ETIMEDOUT);
+    assert(r.us >= 50000 && r.us < 500000);
+
+    blackhole_close(&b);
+    aeDeleteEventLoop(el);
+}
+
+// 取消后不回调, 在途 fd 都关掉
+void test_cancel()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct blackhole b;
+    struct result r;
+    blackhole_open(&b);
+    memset(&r, 0, sizeof(r));
+
+    union sockaddr_all addrs[2] = {b.addr, b.addr};
+    struct connector_opts opts = {10, 0, 0};
+    struct connector *c = connector_start(el, addrs, 2, &opts, on_connected, &r);
+    assert(c);
+    long long start = now_us();
+    while (now_us() - start < 30000)
+    {
+        aeProcessEvents(el, AE_ALL_EVENTS | AE_DONT_WAIT);
+    }
+    connector_cancel(c);
+    start = now_us();
+    while (now_us() - start < 30000)
+    {
+        aeProcessEvents(el, AE_ALL_EVENTS | AE_DONT_WAIT);
+    }
+    assert(!r.done);
+
+    blackhole_close(&b);
+    aeDeleteEventLoop(el);
+}
+
+// 首个地址黑洞时的建连耗时: 串行 (等单次超时) vs 交错并发
+void bench()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct blackhole b;
+    struct result r;
+    blackhole_open(&b);
+    union sockaddr_all good = sa_fromipV6("::1", 0);
+    int lfd = listen_on(&good, 16);
+    union sockaddr_all addrs[2] = {b.addr, good};
+    int staggers[] = {1000, 250, 50};
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        // stagger 等于单次超时即串行
+        run(el, addrs, 2, staggers[i], 1000, 0, &r);
+        assert(r.fd >= 0);
+        close(r.fd);
+        printf("first address blackholed, stagger %4d ms: connected in %lld ms\n", staggers[i], r.us / 1000);
+    }
+    close(lfd);
+    blackhole_close(&b);
+    aeDeleteEventLoop(el);
+}
+
+int main(int argc, char **argv)
+{
+    test_race();
+    test_refused();
+    test_timeout();
+    test_cancel();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
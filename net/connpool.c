@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ae.h"
+#include "resolver.h"
+#include "connector.h"
+#include "connpool.h"
+
+#define CONNPOOL_DNS_TTL_MS 30000
+#define CONNPOOL_DNS_NEGATIVE_TTL_MS 1000
+#define CONNPOOL_MAX_BACKOFF_SHIFT 5
+
+enum
+{
+    CONN_WAITING,    // 等重连定时器
+    CONN_RESOLVING,
+    CONN_CONNECTING,
+    CONN_CONNECTED,
+    CONN_CLOSING,    // on_close 回调中
+};
+
+struct pool_conn
+{
+    struct connpool_conn c; // 必须在第一个, 对外只给这个
+    int state;
+    int fails; // 连续连接失败次数, 算退避
+    long long timerid;
+    struct connector *connecting;
+    union sockaddr_all addr;
+};
+
+struct connpool_upstream
+{
+    struct connpool_upstream *next;
+    struct connpool *pool;
+    char *host;
+    char *port;
+    unsigned int rr; // 负载相同时轮着选
+    int n;
+    struct pool_conn *conns;
+};
+
+struct connpool
+{
+    aeEventLoop *el;
+    struct connpool_opts opts;
+    struct resolver *resolver;
+    struct connpool_upstream *ups;
+    struct connpool_stats stats;
+};
+
+static void conn_connect(struct pool_conn *pc);
+
+static int conn_on_retry(aeEventLoop *el, long long id, void *ud)
+{
+    struct pool_conn *pc = ud;
+    pc->timerid = AE_NOMORE;
+    conn_connect(pc);
+    return AE_NOMORE;
+}
+
+static void conn_schedule(struct pool_conn *pc, int delay)
+{
+    struct connpool *p = pc->c.up->pool;
+    pc->state = CONN_WAITING;
+    pc->timerid = aeCreateTimeEvent(p->el, delay, conn_on_retry, pc, NULL);
+    if (pc->timerid == AE_ERR)
+    {
+        pc->timerid = AE_NOMORE;
+        fprintf(stderr, "ERROR connpool: create retry timer for %s:%s\n", pc->c.up->host, pc->c.up->port);
+    }
+}
+
+static void conn_clear_timer(struct pool_conn *pc)
+{
+    if (pc->timerid != AE_NOMORE)
+    {
+        aeDeleteTimeEvent(pc->c.up->pool->el, pc->timerid);
+        pc->timerid = AE_NOMORE;
+    }
+}
+
+// 还没连上就失败了, 退避重连
+static void conn_fail(struct pool_conn *pc)
+{
+    struct connpool *p = pc->c.up->pool;
+    conn_clear_timer(pc);
+    p->stats.failed++;
+    int shift = pc->fails < CONNPOOL_MAX_BACKOFF_SHIFT ? pc->fails : CONNPOOL_MAX_BACKOFF_SHIFT;
+    pc->fails++;
+    conn_schedule(pc, p->opts.retry_ms << shift);
+}
+
+static void conn_opened(struct pool_conn *pc)
+{
+    struct connpool *p = pc->c.up->pool;
+    conn_clear_timer(pc);
+    pc->state = CONN_CONNECTED;
+    pc->fails = 0;
+    pc->c.connected = true;
+    pc->c.inflight = 0;
+    pc->c.errors = 0;
+    p->stats.opened++;
+    if (p->opts.on_open)
+    {
+        p->opts.on_open(&pc->c, p->opts.ud);
+    }
+}
+
+static void conn_on_connect(void *ud, int fd, const union sockaddr_all *addr, int err)
+{
+    struct pool_conn *pc = ud;
+    pc->connecting = NULL;
+    if (fd < 0)
+    {
+        conn_fail(pc);
+        return;
+    }
+    pc->c.fd = fd;
+    pc->addr = *addr;
+    conn_opened(pc);
+}
+
+// v4 / v6 地址一起交给 connector 交错并发连接, 单个地址超时 connect_timeout_ms
+static void conn_on_resolved(void *ud, const union sockaddr_all *addrs, int n)
+{
+    struct pool_conn *pc = ud;
+    struct connpool *p = pc->c.up->pool;
+    union sockaddr_all cands[RESOLVER_MAX_ADDRS];
+    uint16_t port = htons(atoi(pc->c.up->port));
+    int i;
+    if (n == 0)
+    {
+        conn_fail(pc);
+        return;
+    }
+    for (i = 0; i < n; i++)
+    {
+        // v4 / v6 的端口在同一偏移
+        cands[i] = addrs[i];
+        cands[i].v4.sin_port = port;
+    }
+
+    struct connector_opts opts = {p->opts.stagger_ms, p->opts.connect_timeout_ms, 0};
+    pc->state = CONN_CONNECTING;
+    pc->connecting = connector_start(p->el, cands, n, &opts, conn_on_connect, pc);
+    if (pc->connecting == NULL)
+    {
+        conn_fail(pc);
+    }
+}
+
+static void conn_connect(struct pool_conn *pc)
+{
+    struct connpool *p = pc->c.up->pool;
+    p->stats.connects++;
+    pc->state = CONN_RESOLVING;
+    // 缓存命中时同步回调
+    if (!resolver_resolve(p->resolver, pc->c.up->host, AF_UNSPEC, conn_on_resolved, pc))
+    {
+        conn_fail(pc);
+    }
+}
+
+// 关闭已连接的连接, 不重连
+static void conn_shutdown(struct pool_conn *pc)
+{
+    struct connpool *p = pc->c.up->pool;
+    pc->state = CONN_CLOSING;
+    if (p->opts.on_close)
+    {
+        p->opts.on_close(&pc->c, p->opts.ud);
+    }
+    aeDeleteFileEvent(p->el, pc->c.fd, AE_READABLE | AE_WRITABLE);
+    close(pc->c.fd);
+    pc->c.fd = -1;
+    pc->c.connected = false;
+    pc->c.inflight = 0;
+    pc->c.errors = 0;
+    p->stats.closed++;
+}
+
+struct connpool *connpool_create(struct aeEventLoop *el, const struct connpool_opts *opts)
+{
+    struct connpool *p = calloc(1, sizeof(*p));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    p->el = el;
+    p->opts = *opts;
+    if (p->opts.size < 1)
+    {
+        p->opts.size = 1;
+    }
+    if (p->opts.retry_ms < 1)
+    {
+        p->opts.retry_ms = 1;
+    }
+    p->resolver = resolver_create(el, 1, CONNPOOL_DNS_TTL_MS, CONNPOOL_DNS_NEGATIVE_TTL_MS);
+    if (p->resolver == NULL)
+    {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void connpool_release(struct connpool *p)
+{
+    struct connpool_upstream *u = p->ups;
+    while (u)
+    {
+        struct connpool_upstream *next = u->next;
+        int i;
+        for (i = 0; i < u->n; i++)
+        {
+            struct pool_conn *pc = &u->conns[i];
+            conn_clear_timer(pc);
+            resolver_cancel(p->resolver, pc);
+            if (pc->connecting)
+            {
+                connector_cancel(pc->connecting);
+            }
+            if (pc->state == CONN_CONNECTED)
+            {
+                conn_shutdown(pc);
+            }
+        }
+        free(u->conns);
+        free(u->host);
+        free(u->port);
+        free(u);
+        u = next;
+    }
+    resolver_release(p->resolver);
+    free(p);
+}
+
+struct connpool_upstream *connpool_get(struct connpool *p, const char *host, const char *port)
+{
+    struct connpool_upstream *u;
+    for (u = p->ups; u; u = u->next)
+    {
+        if (strcmp(u->host, host) == 0 && strcmp(u->port, port) == 0)
+        {
+            return u;
+        }
+    }
+
+    u = calloc(1, sizeof(*u));
+    if (u == NULL)
+    {
+        return NULL;
+    }
+    u->pool = p;
+    u->n = p->opts.size;
+    u->host = strdup(host);
+    u->port = strdup(port);
+    u->conns = calloc(u->n, sizeof(*u->conns));
+    if (u->host == NULL || u->port == NULL || u->conns == NULL)
+    {
+        free(u->host);
+        free(u->port);
+        free(u->conns);
+        free(u);
+        return NULL;
+    }
+    u->next = p->ups;
+    p->ups = u;
+
+    int i;
+    for (i = 0; i < u->n; i++)
+    {
+        struct pool_conn *pc = &u->conns[i];
+        pc->c.up = u;
+        pc->c.fd = -1;
+        pc->timerid = AE_NOMORE;
+    }
+    // 预热, on_open 都在 loop 里回调
+    for (i = 0; i < u->n; i++)
+    {
+        conn_connect(&u->conns[i]);
+    }
+    return u;
+}
+
+int connpool_connected(struct connpool_upstream *u)
+{
+    int i, n = 0;
+    for (i = 0; i < u->n; i++)
+    {
+        n += u->conns[i].state == CONN_CONNECTED;
+    }
+    return n;
+}
+
+struct connpool_conn *connpool_acquire(struct connpool_upstream *u)
+{
+    int max_inflight = u->pool->opts.max_inflight;
+    struct pool_conn *best = NULL;
+    unsigned int start = u->rr++;
+    int i;
+    for (i = 0; i < u->n; i++)
+    {
+        struct pool_conn *pc = &u->conns[(start + i) % u->n];
+        if (pc->state != CONN_CONNECTED || (max_inflight > 0 && pc->c.inflight >= max_inflight))
+        {
+            continue;
+        }
+        if (best == NULL || pc->c.inflight < best->c.inflight)
+        {
+            best = pc;
+        }
+    }
+    if (best == NULL)
+    {
+        return NULL;
+    }
+    best->c.inflight++;
+    return &best->c;
+}
+
+void connpool_done(struct connpool_conn *c, bool ok)
+{
+    struct pool_conn *pc = (struct pool_conn *)c;
+    struct connpool *p = c->up->pool;
+    if (c->inflight > 0)
+    {
+        c->inflight--;
+    }
+    if (ok)
+    {
+        c->errors = 0;
+        return;
+    }
+    c->errors++;
+    if (p->opts.max_errors > 0 && c->errors >= p->opts.max_errors && pc->state == CONN_CONNECTED)
+    {
+        p->stats.evicted++;
+        connpool_close(c);
+    }
+}
+
+void connpool_close(struct connpool_conn *c)
+{
+    struct pool_conn *pc = (struct pool_conn *)c;
+    if (pc->state != CONN_CONNECTED)
+    {
+        return;
+    }
+    conn_shutdown(pc);
+    conn_schedule(pc, c->up->pool->opts.retry_ms);
+}
+
+const struct connpool_stats *connpool_getStats(struct connpool *p)
+{
+    return &p->stats;
+}
@@ -0,0 +1,66 @@
+#ifndef CONNPOOL_H
+#define CONNPOOL_H
+
+#include <stdbool.h>
+#include "sa.h"
+
+// 客户端连接池, 跑在 ae 上, 按 host:port 分组, 与协议无关
+// 池只负责 解析 / 非阻塞连接 / 超时 / 退避重连 / 负载与健康统计
+// 连接建立后由 on_open 让使用方挂自己的读写事件 (clientData 自定), 编解码与缓冲区在 conn->ud 里
+// 第一次 connpool_get 某个 host:port 时预热 size 条连接
+
+struct aeEventLoop;
+struct connpool;
+struct connpool_upstream;
+
+struct connpool_conn
+{
+    struct connpool_upstream *up;
+    int fd;         // 未连接时 -1
+    int inflight;   // acquire 加, done 减
+    int errors;     // 连续失败的请求数
+    bool connected;
+    void *ud;       // 使用方的连接状态, on_open 里设置
+};
+
+struct connpool_opts
+{
+    int size;               // 每个 host:port 的连接数
+    int connect_timeout_ms; // 单个地址的连接超时
+    int stagger_ms;         // 多个地址 (v4 / v6) 交错发起的间隔, 0 默认 250
+    int retry_ms;           // 重连间隔, 连续连不上时翻倍, 最多 32 倍
+    int max_errors;         // 连续失败这么多个请求判为不健康, 关掉重连; 0 不检查
+    int max_inflight;       // 单连接并发上限, 0 不限
+    // 连接可用; 可以在这里 acquire 发请求
+    void (*on_open)(struct connpool_conn *c, void *ud);
+    // 已连接的连接要关闭 (使用方 close / 不健康被剔除 / 池释放), inflight 还是关闭前的值
+    // 池随后删掉 fd 上所有 ae 事件并 close
+    void (*on_close)(struct connpool_conn *c, void *ud);
+    void *ud;
+};
+
+struct connpool_stats
+{
+    unsigned long connects; // 发起连接
+    unsigned long opened;   // 连接成功
+    unsigned long failed;   // 连接失败 (解析失败 / 拒绝 / 超时)
+    unsigned long evicted;  // 因不健康被剔除
+    unsigned long closed;   // 已连接后被关闭 (含剔除)
+};
+
+struct connpool *connpool_create(struct aeEventLoop *el, const struct connpool_opts *opts);
+// 关闭所有连接 (已连接的回调 on_close); 不能在池的回调里调用
+void connpool_release(struct connpool *p);
+// 取 host:port 的分组, 没有则创建并开始预热; 失败返回 NULL
+struct connpool_upstream *connpool_get(struct connpool *p, const char *host, const char *port);
+// 已连接的连接数
+int connpool_connected(struct connpool_upstream *u);
+// 已连接且未达并发上限里 inflight 最少的, inflight++; 没有返回 NULL
+struct connpool_conn *connpool_acquire(struct connpool_upstream *u);
+// 一个请求结束; 连续失败达到 max_errors 时剔除连接 (回调 on_close)
+void connpool_done(struct connpool_conn *c, bool ok);
+// 使用方发现连接坏了 (对端关闭 / 读写出错 / 协议错误), 关闭后 retry_ms 后重连
+void connpool_close(struct connpool_conn *c);
+const struct connpool_stats *connpool_getStats(struct connpool *p);
+
+#endif
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "ae.h"
+#include "socket.h"
+#include "connpool.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// 同一个 loop 里的 echo 服务端
+#define SRV_MAX_CONN 64
+
+static int srv_accepted;
+static int srv_fds[SRV_MAX_CONN];
+
+static void srv_on_read(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n == 0 || (n < 0 && errno != EAGAIN))
+    {
+        aeDeleteFileEvent(el, fd, AE_READABLE);
+        close(fd);
+        return;
+    }
+    if (n > 0)
+    {
+        assert(write(fd, buf, n) == n);
+    }
+}
+
+static void srv_on_accept(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    int connfd;
+    while ((connfd = socket_accept(fd, NULL, NULL)) >= 0)
+    {
+        assert(srv_accepted < SRV_MAX_CONN);
+        srv_fds[srv_accepted++] = connfd;
+        assert(aeCreateFileEvent(el, connfd, AE_READABLE, srv_on_read, NULL) == AE_OK);
+    }
+}
+
+static int srv_listen(aeEventLoop *el, char *port, int size)
+{
+    int fd = socket_server("0");
+    union sockaddr_all addr;
+    socklen_t len = sizeof(addr);
+    assert(fd >= 0 && socket_listen(fd));
+    assert(getsockname(fd, &addr.s, &len) == 0);
+    snprintf(port, size, "%u", ntohs(addr.v4.sin_port));
+    assert(aeCreateFileEvent(el, fd, AE_READABLE, srv_on_accept, NULL) == AE_OK);
+    return fd;
+}
+
+static void srv_close(aeEventLoop *el, int fd)
+{
+    aeDeleteFileEvent(el, fd, AE_READABLE);
+    close(fd);
+}
+
+// 客户端: 连接建立后挂读事件, 收到 echo 算一个请求结束
+static int opened, closed;
+static long replies;
+
+static void cli_on_read(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    struct connpool_conn *c = ud;
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n == 0 || (n < 0 && errno != EAGAIN))
+    {
+        connpool_close(c);
+        return;
+    }
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        replies++;
+        connpool_done(c, true);
+    }
+}
+
+static void on_open(struct connpool_conn *c, void *ud)
+{
+    opened++;
+    assert(c->connected && c->fd >= 0 && c->inflight == 0);
+    assert(aeCreateFileEvent(ud, c->fd, AE_READABLE, cli_on_read, c) == AE_OK);
+}
+
+static void on_close(struct connpool_conn *c, void *ud)
+{
+    closed++;
+    assert(c->connected);
+}
+
+static void run_until(aeEventLoop *el, bool (*cond)(void *), void *arg)
+{
+    long long deadline = now_us() + 3000000;
+    while (!cond(arg))
+    {
+        assert(now_us() < deadline);
+        aeProcessEvents(el, AE_ALL_EVENTS);
+    }
+}
+
+static int want_connected;
+
+static bool all_connected(void *u)
+{
+    return connpool_connected(u) == want_connected;
+}
+
+static void reset_counters()
+{
+    opened = closed = 0;
+    replies = 0;
+    srv_accepted = 0;
+}
+
+static struct connpool_opts make_opts(aeEventLoop *el, int size)
+{
+    struct connpool_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.size = size;
+    opts.connect_timeout_ms = 1000;
+    opts.retry_ms = 10;
+    opts.max_errors = 3;
+    opts.on_open = on_open;
+    opts.on_close = on_close;
+    opts.ud = el;
+    return opts;
+}
+
+// 预热, 同一 host:port 共用一组, 最小负载选择, 单连接并发上限
+void test_acquire()
+{
+    aeEventLoop *el = aeCreateEventLoop(1024);
+    char port[8];
+    int lfd = srv_listen(el, port, sizeof(port));
+    struct connpool_opts opts = make_opts(el, 4);
+    opts.max_inflight = 2;
+    struct connpool *p = connpool_create(el, &opts);
+    reset_counters();
+
+    struct connpool_upstream *u = connpool_get(p, "localhost", port);
+    assert(u && connpool_get(p, "localhost", port) == u);
+    assert(connpool_acquire(u) == NULL);
+    want_connected = 4;
+    run_until(el, all_connected, u);
+    assert(opened == 4);
+
+    struct connpool_conn *cs[8];
+    int i, j;
+    for (i = 0; i < 8; i++)
+    {
+        cs[i] = connpool_acquire(u);
+        assert(cs[i]);
+        // 前 4 个各不相同
+        for (j = 0; j < i && i < 4; j++)
+        {
+            assert(cs[i] != cs[j]);
+        }
+    }
+    assert(connpool_acquire(u) == NULL);
+    for (i = 0; i < 8; i++)
+    {
+        assert(cs[i]->inflight == 2);
+    }
+    connpool_done(cs[5], true);
+    assert(connpool_acquire(u) == cs[5]);
+
+    connpool_release(p);
+    assert(closed == 4);
+    srv_close(el, lfd);
+    aeDeleteEventLoop(el);
+}
+
+// 连续失败剔除, 对端关闭由使用方 close, 都会重连
+void test_evict()
+{
+    aeEventLoop *el = aeCreateEventLoop(1024);
+    char port[8];
+    int lfd = srv_listen(el, port, sizeof(port));
+    struct connpool_opts opts = make_opts(el, 2);
+    struct connpool *p = connpool_create(el, &opts);
+    const struct connpool_stats *st = connpool_getStats(p);
+    reset_counters();
+
+    struct connpool_upstream *u = connpool_get(p, "127.0.0.1", port);
+    want_connected = 2;
+    run_until(el, all_connected, u);
+
+    struct connpool_conn *c = connpool_acquire(u);
+    connpool_done(c, false);
+    c->inflight++;
+    connpool_done(c, true);
+    assert(c->errors == 0 && c->connected);
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        c->inflight++;
+        connpool_done(c, false);
+    }
+    assert(!c->connected && closed == 1 && st->evicted == 1);
+    assert(connpool_connected(u) == 1);
+    run_until(el, all_connected, u);
+    assert(opened == 3 && st->opened == 3);
+
+    // 服务端关掉全部连接: 客户端读到 EOF 后 connpool_close, 再重连回来
+    for (i = 0; i < srv_accepted; i++)
+    {
+        shutdown(srv_fds[i], SHUT_RDWR);
+    }
+    closed = 0;
+    want_connected = 0;
+    run_until(el, all_connected, u);
+    assert(closed == 2);
+    want_connected = 2;
+    run_until(el, all_connected, u);
+    assert(opened == 5);
+
+    connpool_release(p);
+    srv_close(el, lfd);
+    aeDeleteEventLoop(el);
+}
+
+// 连不上: 失败计数, 退避重试, 不会回调 on_open
+void test_refused()
+{
+    aeEventLoop *el = aeCreateEventLoop(1024);
+    char port[8];
+    int lfd = srv_listen(el, port, sizeof(port));
+    srv_close(el, lfd);
+    struct connpool_opts opts = make_opts(el, 2);
+    struct connpool *p = connpool_create(el, &opts);
+    const struct connpool_stats *st = connpool_getStats(p);
+    reset_counters();
+
+    struct connpool_upstream *u = connpool_get(p, "127.0.0.1", port);
+    long long start = now_us();
+    while (now_us() - start < 100000)
+    {
+        aeProcessEvents(el, AE_ALL_EVENTS);
+    }
+    assert(opened == 0 && connpool_connected(u) == 0);
+    // 10ms 起步翻倍: 100ms 内每条连接最多试 1 + 10 + 20 + 40 这几次
+    assert(st->failed >= 4 && st->failed <= 2 * 4);
+    assert(st->connects == st->failed + 2);
+
+    connpool_release(p);
+    assert(closed == 0);
+    aeDeleteEventLoop(el);
+}
+
+#define BENCH_ROUNDS 200000
+#define BENCH_PIPE 64
+
+static struct connpool_upstream *bench_u;
+
+static bool bench_done(void *arg)
+{
+    struct connpool_conn *c;
+    while (replies < BENCH_ROUNDS && (c = connpool_acquire(bench_u)) != NULL)
+    {
+        assert(write(c->fd, "x", 1) == 1);
+    }
+    return replies >= BENCH_ROUNDS;
+}
+
+// 同 loop echo, 每条连接最多 BENCH_PIPE 个在途请求
+static void bench_size(int size)
+{
+    aeEventLoop *el = aeCreateEventLoop(1024);
+    char port[8];
+    int lfd = srv_listen(el, port, sizeof(port));
+    struct connpool_opts opts = make_opts(el, size);
+    opts.max_inflight = BENCH_PIPE;
+    struct connpool *p = connpool_create(el, &opts);
+    reset_counters();
+    bench_u = connpool_get(p, "127.0.0.1", port);
+    want_connected = size;
+    run_until(el, all_connected, bench_u);
+
+    long long start = now_us();
+    run_until(el, bench_done, NULL);
+    long long cost = now_us() - start;
+    printf("connpool %d connections: %.0f requests/sec\n", size, BENCH_ROUNDS * 1e6 / cost);
+    connpool_release(p);
+    srv_close(el, lfd);
+    aeDeleteEventLoop(el);
+}
+
+void bench()
+{
+    bench_size(1);
+    bench_size(4);
+}
+
+int main(int argc, char **argv)
+{
+    test_acquire();
+    test_evict();
+    test_refused();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../base/buffer.h"
+#include "flowtable.h"
+
+#define FLOWTABLE_INIT_SLOTS 1024
+#define FLOWTABLE_CHUNK_BITS 10
+#define FLOWTABLE_CHUNK_SIZE (1 << FLOWTABLE_CHUNK_BITS)
+#define FLOWTABLE_WHEEL_MASK (FLOWTABLE_WHEEL_SLOTS - 1)
+
+struct slot
+{
+    uint32_t hash;
+    uint32_t idx; // flow 下标 + 1, 0 为空
+};
+
+struct flowtable
+{
+    struct slot *slots;
+    uint32_t mask;
+    size_t count;
+
+    struct flow **chunks; // 每块 FLOWTABLE_CHUNK_SIZE 个 flow
+    uint32_t nchunks;
+    uint32_t used; // 分配出去过的 flow 个数
+    QUEUE free;
+
+    // idle_timeout 跨 WHEEL_SLOTS / 4 个 tick, 轮转一圈是 4 倍超时
+    QUEUE wheel[FLOWTABLE_WHEEL_SLOTS];
+    uint64_t tick_ms;
+    uint64_t cur_tick;
+    bool started;
+
+    uint64_t timeout_ms;
+    size_t buf_size;
+    flowtable_evict_proc on_evict;
+    void *ud;
+};
+
+static uint32_t flow_hash(const struct flow_key *k)
+{
+    uint64_t a = ((uint64_t)k->sip << 32) | k->dip;
+    uint64_t b = ((uint64_t)k->sport << 16) | k->dport;
+    uint64_t h = a * 0x9E3779B97F4A7C15ULL ^ (b + 0x632BE59BD9B4E019ULL);
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    h ^= h >> 32;
+    return (uint32_t)h;
+}
+
+static inline bool key_eq(const struct flow_key *a, const struct flow_key *b)
+{
+    return a->sip == b->sip && a->dip == b->dip && a->sport == b->sport && a->dport == b->dport;
+}
+
+static inline struct flow *flow_at(struct flowtable *ft, uint32_t idx)
+{
+    return &ft->chunks[idx >> FLOWTABLE_CHUNK_BITS][idx & (FLOWTABLE_CHUNK_SIZE - 1)];
+}
+
+// 命中返回槽下标, 否则返回 -1, *empty 为可插入的空槽
+static long slot_find(struct flowtable *ft, const struct flow_key *key, uint32_t hash, uint32_t *empty)
+{
+    uint32_t i = hash & ft->mask;
+    while (ft->slots[i].idx)
+    {
+        if (ft->slots[i].hash == hash && key_eq(&flow_at(ft, ft->slots[i].idx - 1)->key, key))
+        {
+            return i;
+        }
+        i = (i + 1) & ft->mask;
+    }
+    if (empty)
+    {
+        *empty = i;
+    }
+    return -1;
+}
+
+// backward shift: 把后面探测链上能挪的槽往前挪, 保证查找遇到空槽即可停止
+static void slot_delete(struct flowtable *ft, uint32_t i)
+{
+    uint32_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & ft->mask;
+        if (ft->slots[j].idx == 0)
+        {
+            break;
+        }
+        uint32_t home = ft->slots[j].hash & ft->mask;
+        // home 在 (i, j] 之间 (环形) 的不能挪到 i
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+        {
+            continue;
+        }
+        ft->slots[i] = ft->slots[j];
+        i = j;
+    }
+    ft->slots[i].idx = 0;
+}
+
+static bool slot_grow(struct flowtable *ft)
+{
+    uint32_t n = (ft->mask + 1) * 2, i;
+    struct slot *slots = calloc(n, sizeof(*slots));
+    if (slots == NULL)
+    {
+        return false;
+    }
+    for (i = 0; i <= ft->mask; i++)
+    {
+        if (ft->slots[i].idx)
+        {
+            uint32_t j = ft->slots[i].hash & (n - 1);
+            while (slots[j].idx)
+            {
+                j = (j + 1) & (n - 1);
+            }
+            slots[j] = ft->slots[i];
+        }
+    }
+    free(ft->slots);
+    ft->slots = slots;
+    ft->mask = n - 1;
+    return true;
+}
+
+static struct flow *flow_alloc(struct flowtable *ft)
+{
+    if (!QUEUE_EMPTY(&ft->free))
+    {
+        QUEUE *q = QUEUE_HEAD(&ft->free);
+        QUEUE_REMOVE(q);
+        return QUEUE_DATA(q, struct flow, node);
+    }
+    if (ft->used == ft->nchunks * FLOWTABLE_CHUNK_SIZE)
+    {
+        struct flow **chunks = realloc(ft->chunks, (ft->nchunks + 1) * sizeof(*chunks));
+        if (chunks == NULL)
+        {
+            return NULL;
+        }
+        ft->chunks = chunks;
+        ft->chunks[ft->nchunks] = calloc(FLOWTABLE_CHUNK_SIZE, sizeof(struct flow));
+        if (ft->chunks[ft->nchunks] == NULL)
+        {
+            return NULL;
+        }
+        ft->nchunks++;
+    }
+    struct flow *f = flow_at(ft, ft->used);
+    f->idx = ft->used++;
+    return f;
+}
+
+static void flow_free(struct flowtable *ft, struct flow *f, int reason)
+{
+    if (ft->on_evict)
+    {
+        ft->on_evict(ft->ud, f, reason);
+    }
+    if (f->buf)
+    {
+        buf_release(f->buf);
+    }
+    uint32_t idx = f->idx;
+    memset(f, 0, sizeof(*f));
+    f->idx = idx;
+    QUEUE_INSERT_TAIL(&ft->free, &f->node);
+}
+
+// 按 last_ms 挂到到期的槽上; 超过一圈的先挂在最远的槽, 轮到时再看
+static void wheel_add(struct flowtable *ft, struct flow *f)
+{
+    uint64_t tick = (f->last_ms + ft->timeout_ms + ft->tick_ms - 1) / ft->tick_ms;
+    if (tick <= ft->cur_tick)
+    {
+        tick = ft->cur_tick + 1;
+    }
+    if (tick - ft->cur_tick >= FLOWTABLE_WHEEL_SLOTS)
+    {
+        tick = ft->cur_tick + FLOWTABLE_WHEEL_SLOTS - 1;
+    }
+    QUEUE_INSERT_TAIL(&ft->wheel[tick & FLOWTABLE_WHEEL_MASK], &f->node);
+}
+
+static void wheel_start(struct flowtable *ft, uint64_t now_ms)
+{
+    if (!ft->started)
+    {
+        ft->started = true;
+        ft->cur_tick = now_ms / ft->tick_ms;
+    }
+}
+
+// 从槽表与时间轮摘下并释放
+static void flow_evict(struct flowtable *ft, uint32_t slot, struct flow *f, int reason)
+{
+    slot_delete(ft, slot);
+    ft->count--;
+    QUEUE_REMOVE(&f->node);
+    flow_free(ft, f, reason);
+}
+
+struct flowtable *flowtable_create(int idle_timeout_ms, size_t buf_size, flowtable_evict_proc on_evict, void *ud)
+{
+    struct flowtable *ft = calloc(1, sizeof(*ft));
+    if (ft == NULL)
+    {
+        return NULL;
+    }
+    ft->slots = calloc(FLOWTABLE_INIT_SLOTS, sizeof(*ft->slots));
+    if (ft->slots == NULL)
+    {
+        free(ft);
+        return NULL;
+    }
+    ft->mask = FLOWTABLE_INIT_SLOTS - 1;
+    QUEUE_INIT(&ft->free);
+    int i;
+    for (i = 0; i < FLOWTABLE_WHEEL_SLOTS; i++)
+    {
+        QUEUE_INIT(&ft->wheel[i]);
+    }
+    ft->timeout_ms = idle_timeout_ms > 0 ? idle_timeout_ms : 1;
+    ft->tick_ms = ft->timeout_ms / (FLOWTABLE_WHEEL_SLOTS / 4);
+    if (ft->tick_ms == 0)
+    {
+        ft->tick_ms = 1;
+    }
+    ft->buf_size = buf_size > 0 ? buf_size : 1024;
+    ft->on_evict = on_evict;
+    ft->ud = ud;
+    return ft;
+}
+
+void flowtable_release(struct flowtable *ft)
+{
+    uint32_t i;
+    for (i = 0; i <= ft->mask; i++)
+    {
+        if (ft->slots[i].idx)
+        {
+            struct flow *f = flow_at(ft, ft->slots[i].idx - 1);
+            if (ft->on_evict)
+            {
+                ft->on_evict(ft->ud, f, FLOW_RELEASED);
+            }
+            if (f->buf)
+            {
+                buf_release(f->buf);
+            }
+        }
+    }
+    for (i = 0; i < ft->nchunks; i++)
+    {
+        free(ft->chunks[i]);
+    }
+    free(ft->chunks);
+    free(ft->slots);
+    free(ft);
+}
+
+struct flow *flowtable_find(struct flowtable *ft, const struct flow_key *key)
+{
+    long i = slot_find(ft, key, flow_hash(key), NULL);
+    return i < 0 ? NULL : flow_at(ft, ft->slots[i].idx - 1);
+}
+
+struct flow *flowtable_get(struct flowtable *ft, const struct flow_key *key, uint64_t now_ms, bool create)
+{
+    uint32_t hash = flow_hash(key), empty;
+    long i = slot_find(ft, key, hash, &empty);
+    if (i >= 0)
+    {
+        struct flow *f = flow_at(ft, ft->slots[i].idx - 1);
+        // 多线程 / 多网卡抓的包时间戳可能有一点乱序
+        if (now_ms > f->last_ms)
+        {
+            f->last_ms = now_ms;
+        }
+        return f;
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+
+    // 负载因子不超过 1/2
+    if ((ft->count + 1) * 2 > (size_t)ft->mask + 1)
+    {
+        if (!slot_grow(ft))
+        {
+            return NULL;
+        }
+        slot_find(ft, key, hash, &empty);
+    }
+    struct flow *f = flow_alloc(ft);
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    f->key = *key;
+    f->last_ms = now_ms;
+    ft->slots[empty].hash = hash;
+    ft->slots[empty].idx = f->idx + 1;
+    ft->count++;
+    wheel_start(ft, now_ms);
+    wheel_add(ft, f);
+    return f;
+}
+
+struct buffer *flowtable_buffer(struct flowtable *ft, struct flow *f)
+{
+    if (f->buf == NULL)
+    {
+        f->buf = buf_create(ft->buf_size);
+    }
+    return f->buf;
+}
+
+bool flowtable_remove(struct flowtable *ft, const struct flow_key *key)
+{
+    long i = slot_find(ft, key, flow_hash(key), NULL);
+    if (i < 0)
+    {
+        return false;
+    }
+    flow_evict(ft, i, flow_at(ft, ft->slots[i].idx - 1), FLOW_REMOVED);
+    return true;
+}
+
+int flowtable_expire(struct flowtable *ft, uint64_t now_ms)
+{
+    wheel_start(ft, now_ms);
+    uint64_t target = now_ms / ft->tick_ms;
+    if (target <= ft->cur_tick)
+    {
+        return 0;
+    }
+    // 跳得比一圈还远时每个槽看一次就够了
+    if (target - ft->cur_tick > FLOWTABLE_WHEEL_SLOTS)
+    {
+        ft->cur_tick = target - FLOWTABLE_WHEEL_SLOTS;
+    }
+
+    int n = 0;
+    QUEUE pending;
+    while (ft->cur_tick < target)
+    {
+        ft->cur_tick++;
+        QUEUE *slot = &ft->wheel[ft->cur_tick & FLOWTABLE_WHEEL_MASK];
+        QUEUE_MOVE(slot, &pending);
+        while (!QUEUE_EMPTY(&pending))
+        {
+            QUEUE *q = QUEUE_HEAD(&pending);
+            QUEUE_REMOVE(q);
+            struct flow *f = QUEUE_DATA(q, struct flow, node);
+            if (f->last_ms + ft->timeout_ms <= now_ms)
+            {
+                QUEUE_INIT(&f->node);
+                flow_evict(ft, slot_find(ft, &f->key, flow_hash(&f->key), NULL), f, FLOW_IDLE);
+                n++;
+            }
+            else
+            {
+                wheel_add(ft, f);
+            }
+        }
+    }
+    return n;
+}
+
+size_t flowtable_count(struct flowtable *ft)
+{
+    return ft->count;
+}
@@ -0,0 +1,73 @@
+#ifndef FLOWTABLE_H
+#define FLOWTABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../base/queue.h"
+
+// 抓包用的单向 TCP 流表, key 为完整 4-tuple
+// 开放寻址 + 线性探测, 槽里只有 哈希 + 下标 (8 字节), 探测先比哈希, 命中才去读 flow; 删除用 backward shift, 没有墓碑
+// flow 按块分配, 地址不变, 可以一直拿着指针直到被删除
+// 空闲超时用时间轮, 时间由调用方传入 (抓包时间戳, 离线回放也一样), touch 只改 last_ms, 轮到时发现没到期再挂回去
+// 缓冲区懒分配, 没有 payload 的流 (握手 / 纯 ack) 不占缓冲区
+
+#define FLOWTABLE_WHEEL_SLOTS 256
+
+struct buffer;
+struct flowtable;
+
+// 网络字节序, 直接从 ip / tcp 头拷贝
+struct flow_key
+{
+    uint32_t sip;
+    uint32_t dip;
+    uint16_t sport;
+    uint16_t dport;
+};
+
+struct flow
+{
+    struct flow_key key;
+    uint64_t last_ms;   // 最近一次 flowtable_get 的时间
+    struct buffer *buf; // flowtable_buffer 第一次调用时创建
+    void *ud;           // 使用方的流状态
+
+    // 私有
+    uint32_t idx;
+    QUEUE node; // 时间轮槽 / 空闲链表
+};
+
+enum
+{
+    FLOW_IDLE,     // 超时
+    FLOW_REMOVED,  // flowtable_remove (FIN / RST)
+    FLOW_RELEASED, // flowtable_release
+};
+
+// flow 被删除前回调, 之后 buf 被释放, ud 由使用方自己释放; 回调里不能操作流表
+typedef void (*flowtable_evict_proc)(void *ud, struct flow *f, int reason);
+
+// idle_timeout_ms 多久没有包算空闲; buf_size 缓冲区初始大小; on_evict 可为 NULL
+struct flowtable *flowtable_create(int idle_timeout_ms, size_t buf_size, flowtable_evict_proc on_evict, void *ud);
+// 删除所有 flow (回调 FLOW_RELEASED)
+void flowtable_release(struct flowtable *ft);
+// 查找并把 last_ms 更新为 now_ms; 不存在时 create 为 true 则创建 (buf 为 NULL); 没有或内存不够返回 NULL
+struct flow *flowtable_get(struct flowtable *ft, const struct flow_key *key, uint64_t now_ms, bool create);
+// 只查找, 不更新时间
+struct flow *flowtable_find(struct flowtable *ft, const struct flow_key *key);
+// 懒创建缓冲区
+struct buffer *flowtable_buffer(struct flowtable *ft, struct flow *f);
+// 删除一个方向, 不存在返回 false
+bool flowtable_remove(struct flowtable *ft, const struct flow_key *key);
+// 推进时间轮到 now_ms, 删除 last_ms + idle_timeout_ms <= now_ms 的 flow, 返回删除个数
+int flowtable_expire(struct flowtable *ft, uint64_t now_ms);
+size_t flowtable_count(struct flowtable *ft);
+
+static inline struct flow_key flow_keyReverse(const struct flow_key *key)
+{
+    struct flow_key r = {key->dip, key->sip, key->dport, key->sport};
+    return r;
+}
+
+#endif
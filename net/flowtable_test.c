@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sys/time.h>
+#include "../base/buffer.h"
+#include "../base/queue.h"
+#include "flowtable.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static struct flow_key make_key(uint32_t i)
+{
+    // 模拟很多客户端连同一个服务端端口
+    struct flow_key k = {0x0a000000 | (i >> 8), 0x0a0000fe, (uint16_t)(10000 + (i & 0xff)), 3306};
+    return k;
+}
+
+static int evicted[3];
+
+static void on_evict(void *ud, struct flow *f, int reason)
+{
+    evicted[reason]++;
+    if (f->ud)
+    {
+        free(f->ud);
+    }
+}
+
+// 大量插入, 删掉一半后剩下的都还能找到 (backward shift 没有弄断探测链)
+void test_get_remove()
+{
+    const int n = 100000;
+    int i;
+    memset(evicted, 0, sizeof(evicted));
+    struct flowtable *ft = flowtable_create(60000, 0, on_evict, NULL);
+    for (i = 0; i < n; i++)
+    {
+        struct flow_key k = make_key(i);
+        struct flow *f = flowtable_get(ft, &k, 0, true);
+        assert(f && f->buf == NULL && f->ud == NULL);
+        f->ud = malloc(4);
+        *(int *)f->ud = i;
+    }
+    assert(flowtable_count(ft) == n);
+    struct flow_key missing = make_key(n);
+    assert(flowtable_get(ft, &missing, 0, false) == NULL);
+
+    for (i = 0; i < n; i += 2)
+    {
+        struct flow_key k = make_key(i);
+        assert(flowtable_remove(ft, &k));
+        assert(!flowtable_remove(ft, &k));
+    }
+    assert(flowtable_count(ft) == n / 2 && evicted[FLOW_REMOVED] == n / 2);
+    for (i = 0; i < n; i++)
+    {
+        struct flow_key k = make_key(i);
+        struct flow *f = flowtable_find(ft, &k);
+        if (i % 2)
+        {
+            assert(f && *(int *)f->ud == i && f->key.sport == k.sport);
+        }
+        else
+        {
+            assert(f == NULL);
+        }
+    }
+
+    // 删掉的 flow 被复用, 地址不变
+    struct flow_key k1 = make_key(1);
+    struct flow *f1 = flowtable_find(ft, &k1);
+    struct flow_key k0 = make_key(0);
+    assert(flowtable_get(ft, &k0, 0, true) != f1);
+    assert(flowtable_find(ft, &k1) == f1);
+
+    flowtable_release(ft);
+    assert(evicted[FLOW_RELEASED] == n / 2 + 1);
+}
+
+// 有 payload 才分配缓冲区; 反方向是另一条流
+void test_buffer()
+{
+    struct flowtable *ft = flowtable_create(1000, 64, NULL, NULL);
+    struct flow_key k = make_key(7);
+    struct flow_key r = flow_keyReverse(&k);
+    struct flow *f = flowtable_get(ft, &k, 0, true);
+    assert(f->buf == NULL);
+    struct buffer *buf = flowtable_buffer(ft, f);
+    assert(buf && f->buf == buf && flowtable_buffer(ft, f) == buf);
+    buf_append(buf, "hello", 5);
+    assert(flowtable_find(ft, &r) == NULL);
+    assert(flowtable_get(ft, &r, 0, true) != f);
+    struct flow_key rr = flow_keyReverse(&r);
+    assert(flowtable_find(ft, &rr) == f && buf_readable(f->buf) == 5);
+    flowtable_release(ft);
+}
+
+// 空闲超时: 一直有包的不删, 没包的超时后删; 时间大跳跃也能一次清完
+void test_expire()
+{
+    memset(evicted, 0, sizeof(evicted));
+    struct flowtable *ft = flowtable_create(1000, 0, on_evict, NULL);
+    struct flow_key a = make_key(1), b = make_key(2);
+    uint64_t t = 1000000;
+    flowtable_get(ft, &a, t, true);
+    flowtable_get(ft, &b, t, true);
+
+    uint64_t ms;
+    for (ms = t; ms <= t + 2500; ms += 10)
+    {
+        flowtable_get(ft, &a, ms, false);
+        flowtable_expire(ft, ms);
+        if (ms < t + 1000)
+        {
+            assert(flowtable_find(ft, &b));
+        }
+    }
+    assert(flowtable_find(ft, &a) && flowtable_find(ft, &b) == NULL);
+    assert(evicted[FLOW_IDLE] == 1);
+
+    // 刚好超时之后最多一个 tick 内被删
+    assert(flowtable_expire(ft, t + 2500 + 999) == 0);
+    assert(flowtable_expire(ft, t + 2500 + 1000 + 1000 / (FLOWTABLE_WHEEL_SLOTS / 4)) == 1);
+    assert(flowtable_count(ft) == 0);
+
+    int i;
+    for (i = 0; i < 1000; i++)
+    {
+        struct flow_key k = make_key(i);
+        flowtable_get(ft, &k, t + 10000 + i, true);
+    }
+    assert(flowtable_expire(ft, t + 10000 + 1000 * 1000) == 1000);
+    assert(flowtable_count(ft) == 0);
+    flowtable_release(ft);
+}
+
+// 旧实现: 按端口挂链表, 同端口线性比 ip
+struct pq_conn
+{
+    uint32_t ip;
+    uint16_t port;
+    QUEUE node;
+};
+
+static QUEUE PORT_QUEUE[65536];
+
+static struct pq_conn *pq_get(uint32_t ip, uint16_t port)
+{
+    QUEUE *q;
+    QUEUE_FOREACH(q, &PORT_QUEUE[port])
+    {
+        struct pq_conn *c = QUEUE_DATA(q, struct pq_conn, node);
+        if (c->ip == ip)
+        {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+// 服务端应答方向: 源端口都是 3306, 旧实现退化成一条长链表
+void bench()
+{
+    const int clients[] = {100, 1000, 10000};
+    const int lookups = 500000;
+    int c;
+    for (c = 0; c < 3; c++)
+    {
+        int n = clients[c], i;
+        struct pq_conn *conns = calloc(n, sizeof(*conns));
+        for (i = 0; i < 65536; i++)
+        {
+            QUEUE_INIT(&PORT_QUEUE[i]);
+        }
+        for (i = 0; i < n; i++)
+        {
+            conns[i].ip = 0x0a000000 | i;
+            conns[i].port = 3306;
+            QUEUE_INSERT_TAIL(&PORT_QUEUE[3306], &conns[i].node);
+        }
+        long long start = now_us();
+        unsigned int seed = 1;
+        for (i = 0; i < lookups; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            assert(pq_get(0x0a000000 | (seed >> 8) % n, 3306));
+        }
+        long long pq_us = now_us() - start;
+
+        struct flowtable *ft = flowtable_create(60000, 0, NULL, NULL);
+        for (i = 0; i < n; i++)
+        {
+            struct flow_key k = {0x0a000000 | i, 0x0a0000fe, 3306, 40000};
+            flowtable_get(ft, &k, 0, true);
+        }
+        start = now_us();
+        seed = 1;
+        for (i = 0; i < lookups; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            struct flow_key k = {0x0a000000 | (seed >> 8) % n, 0x0a0000fe, 3306, 40000};
+            assert(flowtable_get(ft, &k, i >> 10, false));
+        }
+        long long ft_us = now_us() - start;
+        flowtable_release(ft);
+        free(conns);
+
+        printf("%5d flows on one port, %d lookups: port list %lld ms (%.0f ns/op), flowtable %lld ms (%.0f ns/op)\n",
+               n, lookups, pq_us / 1000, (double)pq_us * 1000 / lookups, ft_us / 1000, (double)ft_us * 1000 / lookups);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    test_get_remove();
+    test_buffer();
+    test_expire();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "ae.h"
+#include "forward.h"
+
+// 每次事件每个方向最多读这么多次, 避免一个方向一直有数据饿死另一个方向
+#define FORWARD_MAX_ROUNDS 16
+
+struct forward_dir
+{
+    int src;
+    int dst;
+    int pipefd[2]; // SPLICE
+    size_t cap;    // pipe 或缓冲区容量
+    char *buf;     // COPY
+    size_t off;
+    size_t pending; // 已读进来还没写出去的字节数
+    bool blocked;   // dst 写不进去, 等可写
+    bool eof;
+    bool done;      // 已 shutdown dst 的写
+    unsigned long long bytes;
+};
+
+struct forward
+{
+    aeEventLoop *el;
+    int mode;
+    int fds[2];
+    int masks[2]; // fds 上当前注册的事件
+    struct forward_dir dirs[2];
+    bool finished;
+    forward_proc proc;
+    void *ud;
+};
+
+static void forward_on_event(aeEventLoop *el, int fd, void *ud, int mask);
+
+static ssize_t dir_in(struct forward *f, struct forward_dir *d)
+{
+#ifdef __linux__
+    if (f->mode == FORWARD_SPLICE)
+    {
+        return splice(d->src, NULL, d->pipefd[1], NULL, d->cap - d->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+#endif
+    d->off = 0;
+    return read(d->src, d->buf, d->cap);
+}
+
+static ssize_t dir_out(struct forward *f, struct forward_dir *d)
+{
+#ifdef __linux__
+    if (f->mode == FORWARD_SPLICE)
+    {
+        return splice(d->pipefd[0], NULL, d->dst, NULL, d->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+#endif
+    ssize_t n = send(d->dst, d->buf + d->off, d->pending, MSG_NOSIGNAL);
+    if (n > 0)
+    {
+        d->off += n;
+    }
+    return n;
+}
+
+// 先把手上的写完, 再读; 返回 0 或 errno
+static int dir_pump(struct forward *f, struct forward_dir *d)
+{
+    int rounds = 0;
+    while (!d->done)
+    {
+        while (d->pending > 0)
+        {
+            ssize_t n = dir_out(f, d);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    d->blocked = true;
+                    return 0;
+                }
+                return errno;
+            }
+            d->pending -= n;
+            d->bytes += n;
+        }
+        d->blocked = false;
+
+        if (d->eof)
+        {
+            shutdown(d->dst, SHUT_WR);
+            d->done = true;
+            return 0;
+        }
+        if (rounds++ >= FORWARD_MAX_ROUNDS)
+        {
+            return 0;
+        }
+
+        ssize_t n = dir_in(f, d);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+            return errno;
+        }
+        if (n == 0)
+        {
+            d->eof = true;
+            continue;
+        }
+        d->pending += n;
+    }
+    return 0;
+}
+
+static int fd_index(struct forward *f, int fd)
+{
+    return f->fds[0] == fd ? 0 : 1;
+}
+
+// 按两个方向的状态重新算 a, b 上要关注的事件
+static int forward_update(struct forward *f)
+{
+    int want[2] = {0, 0};
+    int i;
+    if (!f->finished)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            struct forward_dir *d = &f->dirs[i];
+            if (!d->eof && !d->blocked)
+            {
+                want[fd_index(f, d->src)] |= AE_READABLE;
+            }
+            if (d->blocked)
+            {
+                want[fd_index(f, d->dst)] |= AE_WRITABLE;
+            }
+        }
+    }
+    for (i = 0; i < 2; i++)
+    {
+        int del = f->masks[i] & ~want[i];
+        int add = want[i] & ~f->masks[i];
+        if (del)
+        {
+            aeDeleteFileEvent(f->el, f->fds[i], del);
+        }
+        if (add && aeCreateFileEvent(f->el, f->fds[i], add, forward_on_event, f) == AE_ERR)
+        {
+            f->masks[i] = want[i] & ~add;
+            return ENOMEM;
+        }
+        f->masks[i] = want[i];
+    }
+    return 0;
+}
+
+static void forward_finish(struct forward *f, int err)
+{
+    f->finished = true;
+    forward_update(f);
+    f->proc(f, f->ud, err);
+}
+
+static void forward_on_event(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    struct forward *f = ud;
+    int err = 0, i;
+    if (f->finished)
+    {
+        return;
+    }
+    for (i = 0; i < 2 && err == 0; i++)
+    {
+        struct forward_dir *d = &f->dirs[i];
+        // ERR / HUP 交给 read / write 去发现
+        if ((d->src == fd && (mask & (AE_READABLE | AE_ERROR))) || (d->dst == fd && (mask & (AE_WRITABLE | AE_ERROR)) && d->blocked))
+        {
+            err = dir_pump(f, d);
+        }
+    }
+    if (err == 0)
+    {
+        err = forward_update(f);
+    }
+    if (err != 0 || (f->dirs[0].done && f->dirs[1].done))
+    {
+        forward_finish(f, err);
+    }
+}
+
+static bool dir_init(struct forward *f, struct forward_dir *d, int src, int dst)
+{
+    d->src = src;
+    d->dst = dst;
+    d->pipefd[0] = d->pipefd[1] = -1;
+#ifdef __linux__
+    if (f->mode == FORWARD_SPLICE)
+    {
+        if (pipe2(d->pipefd, O_NONBLOCK | O_CLOEXEC) < 0)
+        {
+            return false;
+        }
+        // 调大失败 (超过 /proc/sys/fs/pipe-max-size) 就用默认的
+        fcntl(d->pipefd[1], F_SETPIPE_SZ, FORWARD_PIPE_SIZE);
+        int sz = fcntl(d->pipefd[1], F_GETPIPE_SZ);
+        d->cap = sz > 0 ? sz : 65536;
+        return true;
+    }
+#endif
+    d->cap = FORWARD_BUF_SIZE;
+    d->buf = malloc(d->cap);
+    return d->buf != NULL;
+}
+
+static void dir_release(struct forward_dir *d)
+{
+    if (d->pipefd[0] >= 0)
+    {
+        close(d->pipefd[0]);
+        close(d->pipefd[1]);
+    }
+    free(d->buf);
+}
+
+struct forward *forward_start(struct aeEventLoop *el, int a, int b, int mode, forward_proc proc, void *ud)
+{
+    struct forward *f = calloc(1, sizeof(*f));
+    if (f == NULL)
+    {
+        return NULL;
+    }
+#ifndef __linux__
+    mode = FORWARD_COPY;
+#endif
+    f->el = el;
+    f->mode = mode;
+    f->fds[0] = a;
+    f->fds[1] = b;
+    f->proc = proc;
+    f->ud = ud;
+    // dirs[0] 失败时 dirs[1] 还没 init, 释放时不能 close 到 fd 0
+    f->dirs[0].pipefd[0] = f->dirs[0].pipefd[1] = -1;
+    f->dirs[1].pipefd[0] = f->dirs[1].pipefd[1] = -1;
+
+    if (!dir_init(f, &f->dirs[0], a, b) || !dir_init(f, &f->dirs[1], b, a) || forward_update(f) != 0)
+    {
+        forward_release(f);
+        return NULL;
+    }
+    return f;
+}
+
+void forward_release(struct forward *f)
+{
+    f->finished = true;
+    forward_update(f);
+    dir_release(&f->dirs[0]);
+    dir_release(&f->dirs[1]);
+    free(f);
+}
+
+int forward_mode(struct forward *f)
+{
+    return f->mode;
+}
+
+void forward_bytes(struct forward *f, unsigned long long *ab, unsigned long long *ba)
+{
+    *ab = f->dirs[0].bytes;
+    *ba = f->dirs[1].bytes;
+}
@@ -0,0 +1,34 @@
+#ifndef FORWARD_H
+#define FORWARD_H
+
+#include <stdbool.h>
+
+// 两个非阻塞 socket 之间双向转发, 由 ae 驱动, 单线程
+// FORWARD_SPLICE: socket -> pipe -> socket, 数据不经过用户态 (linux splice), 其他平台退回 FORWARD_COPY
+// FORWARD_COPY: read 到每个方向自己的缓冲区再 write
+// 对端写完 (EOF) 后把缓冲 / pipe 里剩下的发完, 再 shutdown 另一端的写, 两个方向都结束才回调
+
+#define FORWARD_COPY 0
+#define FORWARD_SPLICE 1
+
+#define FORWARD_BUF_SIZE (64 * 1024)  // COPY 每个方向的缓冲区
+#define FORWARD_PIPE_SIZE (256 * 1024) // SPLICE 每个方向的 pipe 容量, 设置失败用系统默认
+
+struct aeEventLoop;
+struct forward;
+
+// err 为 0 表示两个方向都正常结束, 否则为出错的 errno; 回调里可以 forward_release
+typedef void (*forward_proc)(struct forward *f, void *ud, int err);
+
+// a, b 需为非阻塞; fd 仍归调用方, forward_release 后自己 close
+// FORWARD_SPLICE 往已关闭的 socket splice 会收到 SIGPIPE, 调用方需先 signal(SIGPIPE, SIG_IGN)
+// 失败返回 NULL
+struct forward *forward_start(struct aeEventLoop *el, int a, int b, int mode, forward_proc proc, void *ud);
+// 停止转发, 删掉 a, b 上的 ae 事件
+void forward_release(struct forward *f);
+// 实际使用的模式
+int forward_mode(struct forward *f);
+// a -> b 与 b -> a 已转发的字节数
+void forward_bytes(struct forward *f, unsigned long long *ab, unsigned long long *ba);
+
+#endif
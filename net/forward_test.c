@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ae.h"
+#include "forward.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void set_nonblock(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// 一对 loopback tcp 连接
+static void tcp_pair(int sv[2])
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(lfd >= 0);
+    assert(bind(lfd, (struct sockaddr *)&addr, len) == 0);
+    assert(listen(lfd, 1) == 0);
+    assert(getsockname(lfd, (struct sockaddr *)&addr, &len) == 0);
+    sv[0] = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(sv[0], (struct sockaddr *)&addr, len) == 0);
+    sv[1] = accept(lfd, NULL, NULL);
+    assert(sv[1] >= 0);
+    close(lfd);
+}
+
+struct result
+{
+    bool done;
+    int err;
+};
+
+static void on_done(struct forward *f, void *ud, int err)
+{
+    struct result *r = ud;
+    assert(!r->done);
+    r->done = true;
+    r->err = err;
+}
+
+// client <-> fa [forward] fb <-> server
+struct fixture
+{
+    aeEventLoop *el;
+    int client;
+    int server;
+    int fa;
+    int fb;
+    struct forward *f;
+    struct result r;
+};
+
+static void fixture_open(struct fixture *x, int mode)
+{
+    int p1[2], p2[2];
+    memset(x, 0, sizeof(*x));
+    x->el = aeCreateEventLoop(64);
+    tcp_pair(p1);
+    tcp_pair(p2);
+    x->client = p1[0];
+    x->fa = p1[1];
+    x->fb = p2[0];
+    x->server = p2[1];
+    set_nonblock(x->client);
+    set_nonblock(x->server);
+    set_nonblock(x->fa);
+    set_nonblock(x->fb);
+    x->f = forward_start(x->el, x->fa, x->fb, mode, on_done, &x->r);
+    assert(x->f);
+}
+
+static void fixture_close(struct fixture *x)
+{
+    forward_release(x->f);
+    close(x->client);
+    close(x->server);
+    close(x->fa);
+    close(x->fb);
+    aeDeleteEventLoop(x->el);
+}
+
+// 边写边转发边收, 校验内容
+static void transfer(struct fixture *x, int src, int dst, size_t total)
+{
+    static char out[65536], in[65536];
+    size_t sent = 0, rcvd = 0;
+    while (rcvd < total)
+    {
+        if (sent < total)
+        {
+            size_t n = total - sent < sizeof(out) ? total - sent : sizeof(out);
+            size_t i;
+            for (i = 0; i < n; i++)
+            {
+                out[i] = (char)((sent + i) * 31);
+            }
+            ssize_t w = write(src, out, n);
+            assert(w > 0 || errno == EAGAIN);
+            if (w > 0)
+            {
+                sent += w;
+            }
+        }
+        aeProcessEvents(x->el, AE_ALL_EVENTS | AE_DONT_WAIT);
+        ssize_t r = read(dst, in, sizeof(in));
+        assert(r > 0 || errno == EAGAIN);
+        if (r > 0)
+        {
+            ssize_t i;
+            for (i = 0; i < r; i++)
+            {
+                assert(in[i] == (char)((rcvd + i) * 31));
+            }
+            rcvd += r;
+        }
+    }
+    assert(rcvd == total);
+}
+
+// 收到 EOF
+static void wait_eof(struct fixture *x, int fd)
+{
+    char c;
+    for (;;)
+    {
+        aeProcessEvents(x->el, AE_ALL_EVENTS | AE_DONT_WAIT);
+        ssize_t r = read(fd, &c, 1);
+        if (r == 0)
+        {
+            return;
+        }
+        assert(r < 0 && errno == EAGAIN);
+    }
+}
+
+// 双向大块数据, 半关闭逐个方向传过去, 都关了才回调
+void test_forward(int mode)
+{
+    struct fixture x;
+    unsigned long long ab, ba;
+    fixture_open(&x, mode);
+#ifdef __linux__
+    assert(forward_mode(x.f) == mode);
+#endif
+
+    transfer(&x, x.client, x.server, 3 * 1024 * 1024 + 7);
+    transfer(&x, x.server, x.client, 100);
+    forward_bytes(x.f, &ab, &ba);
+    assert(ab == 3 * 1024 * 1024 + 7 && ba == 100);
+
+    shutdown(x.client, SHUT_WR);
+    wait_eof(&x, x.server);
+    assert(!x.r.done);
+    // 半关闭后反方向还能转发
+    transfer(&x, x.server, x.client, 5000);
+    shutdown(x.server, SHUT_WR);
+    wait_eof(&x, x.client);
+    assert(x.r.done && x.r.err == 0);
+    forward_bytes(x.f, &ab, &ba);
+    assert(ba == 5100);
+
+    fixture_close(&x);
+}
+
+// 一端被 RST, 回调错误
+void test_reset(int mode)
+{
+    struct fixture x;
+    fixture_open(&x, mode);
+    transfer(&x, x.client, x.server, 10);
+
+    struct linger lg = {1, 0};
+    setsockopt(x.server, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(x.server);
+    x.server = socket(AF_INET, SOCK_STREAM, 0);
+
+    char buf[4096];
+    memset(buf, 'x', sizeof(buf));
+    long long start = now_us();
+    while (!x.r.done && now_us() - start < 2000000)
+    {
+        write(x.client, buf, sizeof(buf));
+        aeProcessEvents(x.el, AE_ALL_EVENTS | AE_DONT_WAIT);
+    }
+    assert(x.r.done && x.r.err != 0);
+    fixture_close(&x);
+}
+
+#define BENCH_BYTES (1024LL * 1024 * 1024)
+
+static void *bench_send(void *arg)
+{
+    int fd = (int)(long)arg;
+    static char buf[256 * 1024];
+    long long left = BENCH_BYTES;
+    memset(buf, 'b', sizeof(buf));
+    while (left > 0)
+    {
+        ssize_t n = write(fd, buf, left < (long long)sizeof(buf) ? left : (long long)sizeof(buf));
+        assert(n > 0);
+        left -= n;
+    }
+    shutdown(fd, SHUT_WR);
+    return NULL;
+}
+
+static void *bench_recv(void *arg)
+{
+    int fd = (int)(long)arg;
+    static char buf[256 * 1024];
+    long long total = 0;
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        total += n;
+    }
+    assert(total == BENCH_BYTES);
+    return NULL;
+}
+
+static long long thread_cpu_us()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000LL + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+// 发送线程 -> 转发 (本线程跑 ae) -> 接收线程, 统计吞吐与转发线程每 GB 的 CPU
+void bench()
+{
+    const char *names[] = {"copy", "splice"};
+    int mode;
+    for (mode = FORWARD_COPY; mode <= FORWARD_SPLICE; mode++)
+    {
+        int p1[2], p2[2];
+        pthread_t ts, tr;
+        struct result r = {false, 0};
+        aeEventLoop *el = aeCreateEventLoop(64);
+        tcp_pair(p1);
+        tcp_pair(p2);
+        set_nonblock(p1[1]);
+        set_nonblock(p2[0]);
+        struct forward *f = forward_start(el, p1[1], p2[0], mode, on_done, &r);
+        assert(f);
+
+        long long start = now_us(), cpu = thread_cpu_us();
+        pthread_create(&ts, NULL, bench_send, (void *)(long)p1[0]);
+        pthread_create(&tr, NULL, bench_recv, (void *)(long)p2[1]);
+        // 接收方不回写, 等 a -> b 方向结束
+        unsigned long long ab = 0, ba;
+        while (ab < BENCH_BYTES)
+        {
+            aeProcessEvents(el, AE_ALL_EVENTS);
+            forward_bytes(f, &ab, &ba);
+        }
+        cpu = thread_cpu_us() - cpu;
+        pthread_join(ts, NULL);
+        shutdown(p2[1], SHUT_WR);
+        pthread_join(tr, NULL);
+        long long us = now_us() - start;
+        while (!r.done)
+        {
+            aeProcessEvents(el, AE_ALL_EVENTS);
+        }
+        assert(r.err == 0);
+
+        printf("%-6s (mode %d): %lld MB in %lld ms, %.1f MB/s, forwarder cpu %.1f ms/GB\n",
+               names[mode], forward_mode(f), BENCH_BYTES >> 20, us / 1000,
+               (double)BENCH_BYTES / (1 << 20) / ((double)us / 1000000),
+               (double)cpu / 1000 / ((double)BENCH_BYTES / (1 << 30)));
+
+        forward_release(f);
+        close(p1[0]);
+        close(p1[1]);
+        close(p2[0]);
+        close(p2[1]);
+        aeDeleteEventLoop(el);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // SPLICE 模式要求忽略 SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    test_forward(FORWARD_COPY);
+    test_forward(FORWARD_SPLICE);
+    test_reset(FORWARD_COPY);
+    test_reset(FORWARD_SPLICE);
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include "ae.h"
+#include "poller.h"
+
+#define POLLER_MAX_SETSIZE (1 << 20)
+
+struct poller
+{
+    aeEventLoop *loop;
+};
+
+// 事件不经 ae 分发, 只为满足 aeCreateFileEvent 的参数
+static void poller_noop(aeEventLoop *el, int fd, void *ud, int mask)
+{
+}
+
+static int poller_setsize()
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1 || rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > POLLER_MAX_SETSIZE)
+    {
+        return POLLER_MAX_SETSIZE;
+    }
+    return (int)rl.rlim_cur;
+}
+
+poll_fd poller_create()
+{
+    struct poller *p = malloc(sizeof(*p));
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    // ae 的 fd 表按页分配, setsize 大也只占页指针
+    p->loop = aeCreateEventLoop(poller_setsize());
+    if (p->loop == NULL)
+    {
+        perror("ERROR poller_create");
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void poller_release(poll_fd p)
+{
+    aeDeleteEventLoop(p->loop);
+    free(p);
+}
+
+bool poller_add(poll_fd p, int sock, void *ud, int flags)
+{
+    int aeflags = 0;
+    if (flags & POLLER_ET)
+    {
+        aeflags |= AE_EDGE_TRIGGERED;
+    }
+    if (flags & POLLER_ONESHOT)
+    {
+        aeflags |= AE_ONESHOT;
+    }
+    if (flags & POLLER_EXCLUSIVE)
+    {
+        aeflags |= AE_EXCLUSIVE;
+    }
+    return aeCreateFileEventFlags(p->loop, sock, AE_READABLE, aeflags, poller_noop, ud) == AE_OK;
+}
+
+void poller_del(poll_fd p, int sock)
+{
+    aeDeleteFileEvent(p->loop, sock, AE_READABLE | AE_WRITABLE);
+}
+
+bool poller_write(poll_fd p, int sock, void *ud, bool enable)
+{
+    if (enable)
+    {
+        return aeCreateFileEvent(p->loop, sock, AE_WRITABLE, poller_noop, ud) == AE_OK;
+    }
+    aeDeleteFileEvent(p->loop, sock, AE_WRITABLE);
+    return true;
+}
+
+int poller_wait(poll_fd p, struct event *e, int max, int timeout)
+{
+    aeEventLoop *el = p->loop;
+    int n = aePoll(el, timeout, max);
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        int mask = el->fired[i].mask;
+        e[i].s = aeGetClientData(el, el->fired[i].fd);
+        // 对端关闭 (HUP/EOF) 随 EPOLLIN 报可读, 由 read 返回 0 判断; 只有 EPOLLERR/EV_ERROR 报 error
+        // ae 把 ERR 也报成可写, 这里去掉
+        e[i].read = (mask & AE_READABLE) != 0;
+        e[i].write = (mask & AE_WRITABLE) && !(mask & AE_ERROR);
+        e[i].error = (mask & AE_ERROR) != 0;
+    }
+    return n;
+}
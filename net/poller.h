@@ -3,7 +3,13 @@
 
 #include <stdbool.h>
 
-typedef int poll_fd;
+// 与 ae 共用后端 (epoll / kqueue / io_uring), 只返回就绪事件不做回调分发
+typedef struct poller *poll_fd;
+
+// poller_add 的 flags
+#define POLLER_ET 1        // 边沿触发, 需要读写到 EAGAIN; 仅 epoll
+#define POLLER_ONESHOT 2   // 触发一次后自动移除, 再次 poller_add 重新加入
+#define POLLER_EXCLUSIVE 4 // EPOLLEXCLUSIVE: 多个 poller (线程) 监听同一 listen fd 时只唤醒其中一部分, 之后不能 poller_write; 仅 epoll
 
 struct event
 {
@@ -13,18 +19,14 @@ struct event
     bool error;
 };
 
-// -1 poller_invalid
+// NULL 失败, fd 上限为 RLIMIT_NOFILE
 poll_fd poller_create();
-void poller_release(poll_fd fd);
-bool poller_add(poll_fd fd, int sock, void *ud);
-void poller_del(poll_fd fd, int sock);
-void poller_write(poll_fd fd, int sock, void *ud, bool enable);
-int poller_wait(poll_fd fd, struct event *e, int max);
+void poller_release(poll_fd p);
+bool poller_add(poll_fd p, int sock, void *ud, int flags);
+void poller_del(poll_fd p, int sock);
+bool poller_write(poll_fd p, int sock, void *ud, bool enable);
+// timeout 毫秒, -1 一直等; 返回事件数, 超时或 EINTR 返回 0
+// 事件数组由 poller 复用, 每次最多返回 max 个
+int poller_wait(poll_fd p, struct event *e, int max, int timeout);
 
-#ifdef __APPLE__
-#include "kqueue.h"
-#else
-#include "epoll.h"
 #endif
-
-#endif
\ No newline at end of file
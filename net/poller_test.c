@@ -1,10 +1,220 @@
 #include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "poller.h"
 
-int main(void)
+static long long now_us()
 {
-    poll_fd fd = poller_create();
-    printf("%d\n", fd);
-    poller_release(fd);
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void pair(int sv[2])
+{
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+    fcntl(sv[1], F_SETFL, O_NONBLOCK);
+}
+
+// 超时返回 0
+void test_timeout()
+{
+    poll_fd p = poller_create();
+    struct event e[4];
+    assert(p);
+    long long start = now_us();
+    assert(poller_wait(p, e, 4, 50) == 0);
+    assert(now_us() - start >= 40000);
+    assert(poller_wait(p, e, 4, 0) == 0);
+    poller_release(p);
+}
+
+// 读写事件与 ud
+void test_rw()
+{
+    poll_fd p = poller_create();
+    struct event e[4];
+    int sv[2], ud;
+    pair(sv);
+    assert(poller_add(p, sv[0], &ud, 0));
+    assert(poller_wait(p, e, 4, 0) == 0);
+
+    assert(write(sv[1], "x", 1) == 1);
+    assert(poller_wait(p, e, 4, -1) == 1);
+    assert(e[0].s == &ud && e[0].read && !e[0].write && !e[0].error);
+
+    char c;
+    assert(read(sv[0], &c, 1) == 1);
+    assert(poller_write(p, sv[0], &ud, true));
+    assert(poller_wait(p, e, 4, -1) == 1);
+    assert(e[0].write && !e[0].read);
+    assert(poller_write(p, sv[0], &ud, false));
+    assert(poller_wait(p, e, 4, 0) == 0);
+
+    // 对端关闭: 可读, 不是 error
+    close(sv[1]);
+    assert(poller_wait(p, e, 4, -1) == 1);
+    assert(e[0].read && !e[0].error);
+    assert(read(sv[0], &c, 1) == 0);
+
+    poller_del(p, sv[0]);
+    close(sv[0]);
+    poller_release(p);
+}
+
+// oneshot: 数据没读走也只通知一次, 重新 add 后再通知
+void test_oneshot()
+{
+    poll_fd p = poller_create();
+    struct event e[4];
+    int sv[2];
+    pair(sv);
+    assert(poller_add(p, sv[0], NULL, POLLER_ONESHOT));
+    assert(write(sv[1], "x", 1) == 1);
+    assert(poller_wait(p, e, 4, -1) == 1);
+    assert(poller_wait(p, e, 4, 0) == 0);
+    assert(poller_add(p, sv[0], NULL, POLLER_ONESHOT));
+    assert(poller_wait(p, e, 4, -1) == 1);
+    close(sv[0]);
+    close(sv[1]);
+    poller_release(p);
+}
+
+// 边沿触发: 只有新数据到达才通知
+void test_et()
+{
+    poll_fd p = poller_create();
+    struct event e[4];
+    int sv[2];
+    pair(sv);
+    if (!poller_add(p, sv[0], NULL, POLLER_ET))
+    {
+        // 非 epoll 后端
+        close(sv[0]);
+        close(sv[1]);
+        poller_release(p);
+        return;
+    }
+    assert(write(sv[1], "x", 1) == 1);
+    assert(poller_wait(p, e, 4, -1) == 1);
+    assert(poller_wait(p, e, 4, 0) == 0);
+    assert(write(sv[1], "y", 1) == 1);
+    assert(poller_wait(p, e, 4, -1) == 1);
+    close(sv[0]);
+    close(sv[1]);
+    poller_release(p);
+}
+
+// 每次最多返回 max 个, 剩下的下次取
+void test_max()
+{
+    poll_fd p = poller_create();
+    struct event e[8];
+    int sv[8][2], i;
+    for (i = 0; i < 8; i++)
+    {
+        pair(sv[i]);
+        assert(poller_add(p, sv[i][0], NULL, POLLER_ONESHOT));
+        assert(write(sv[i][1], "x", 1) == 1);
+    }
+    assert(poller_wait(p, e, 3, -1) == 3);
+    assert(poller_wait(p, e, 3, -1) == 3);
+    assert(poller_wait(p, e, 8, -1) == 2);
+    assert(poller_wait(p, e, 8, 0) == 0);
+    for (i = 0; i < 8; i++)
+    {
+        close(sv[i][0]);
+        close(sv[i][1]);
+    }
+    poller_release(p);
+}
+
+// 两个 poller 以 EXCLUSIVE 监听同一个 listen fd
+void test_exclusive()
+{
+    poll_fd p1 = poller_create();
+    poll_fd p2 = poller_create();
+    struct event e[4];
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(lfd, 16) == 0);
+    assert(getsockname(lfd, (struct sockaddr *)&addr, &len) == 0);
+
+    if (!poller_add(p1, lfd, NULL, POLLER_EXCLUSIVE))
+    {
+        close(lfd);
+        poller_release(p1);
+        poller_release(p2);
+        return;
+    }
+    assert(poller_add(p2, lfd, NULL, POLLER_EXCLUSIVE));
+    // EPOLLEXCLUSIVE 不能修改
+    assert(!poller_write(p1, lfd, NULL, true));
+
+    int cfd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(cfd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    int n = poller_wait(p1, e, 4, 1000) + poller_wait(p2, e, 4, 0);
+    assert(n >= 1);
+    close(cfd);
+    close(lfd);
+    poller_release(p1);
+    poller_release(p2);
+}
+
+#define BENCH_FDS 64
+#define BENCH_ROUNDS 200000
+
+// 64 个 fd 一直可读, 测 poller_wait 的单次开销
+void bench()
+{
+    poll_fd p = poller_create();
+    struct event e[BENCH_FDS];
+    int sv[BENCH_FDS][2], i;
+    for (i = 0; i < BENCH_FDS; i++)
+    {
+        pair(sv[i]);
+        assert(poller_add(p, sv[i][0], NULL, 0));
+        assert(write(sv[i][1], "x", 1) == 1);
+    }
+    long long start = now_us();
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        assert(poller_wait(p, e, BENCH_FDS, -1) == BENCH_FDS);
+    }
+    long long cost = now_us() - start;
+    printf("poller_wait %d ready fds: %.1f ns per call\n", BENCH_FDS, cost * 1000.0 / BENCH_ROUNDS);
+    for (i = 0; i < BENCH_FDS; i++)
+    {
+        close(sv[i][0]);
+        close(sv[i][1]);
+    }
+    poller_release(p);
+}
+
+int main(int argc, char **argv)
+{
+    test_timeout();
+    test_rw();
+    test_oneshot();
+    test_et();
+    test_max();
+    test_exclusive();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,289 @@
+// TH_SYN / TH_FIN 是 bsd 的定义, 同 sniff.c
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#ifndef _BSD_SOURCE
+#define _BSD_SOURCE
+#endif
+#ifndef __FAVOR_BSD
+#define __FAVOR_BSD
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/tcp.h>
+#include "reasm.h"
+
+#define SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+
+struct seg
+{
+    uint32_t seq;
+    uint32_t len;
+    QUEUE node;
+    uint8_t data[];
+};
+
+static inline struct seg *seg_first(struct reasm *r)
+{
+    return QUEUE_DATA(QUEUE_HEAD(&r->segs), struct seg, node);
+}
+
+static inline struct seg *seg_last(struct reasm *r)
+{
+    return QUEUE_DATA(QUEUE_PREV(&r->segs), struct seg, node);
+}
+
+// 插到 pos 之前
+static bool seg_insert(struct reasm *r, QUEUE *pos, uint32_t seq, const uint8_t *data, uint32_t len)
+{
+    struct seg *s = malloc(sizeof(*s) + len);
+    if (s == NULL)
+    {
+        return false;
+    }
+    s->seq = seq;
+    s->len = len;
+    memcpy(s->data, data, len);
+    QUEUE_INSERT_TAIL(pos, &s->node);
+    r->ooo_bytes += len;
+    return true;
+}
+
+static void seg_free(struct reasm *r, struct seg *s)
+{
+    QUEUE_REMOVE(&s->node);
+    r->ooo_bytes -= s->len;
+    free(s);
+}
+
+static int deliver(struct reasm *r, const uint8_t *data, uint32_t len, reasm_proc proc, void *ud)
+{
+    r->next += len;
+    r->delivered += len;
+    proc(ud, data, len);
+    return len;
+}
+
+// 交付从 next 开始已经连上的乱序段; 数据都交付完后 FIN 占一个 seq
+static int drain(struct reasm *r, reasm_proc proc, void *ud)
+{
+    int n = 0;
+    while (!QUEUE_EMPTY(&r->segs))
+    {
+        struct seg *s = seg_first(r);
+        if (SEQ_LT(r->next, s->seq))
+        {
+            break;
+        }
+        uint32_t skip = r->next - s->seq;
+        if (skip < s->len)
+        {
+            n += deliver(r, s->data + skip, s->len - skip, proc, ud);
+        }
+        else
+        {
+            r->dup_bytes += s->len;
+        }
+        seg_free(r, s);
+    }
+    if (r->fin && SEQ_LEQ(r->fin_seq, r->next))
+    {
+        // FIN 之后不该有数据, 真有 (对端乱发或 seq 错乱) 也就此结束
+        if (r->next == r->fin_seq)
+        {
+            r->next++;
+        }
+        r->fin = false;
+        r->finished = true;
+    }
+    return n;
+}
+
+static void skip_to(struct reasm *r, uint32_t seq, reasm_proc proc, void *ud)
+{
+    uint32_t len = seq - r->next;
+    r->gaps++;
+    r->gap_bytes += len;
+    r->next = seq;
+    proc(ud, NULL, len);
+}
+
+// [seq, seq + len) 在 next 之后; 只存还没被已有区间覆盖的部分
+static void ooo_insert(struct reasm *r, uint32_t seq, const uint8_t *data, uint32_t len)
+{
+    r->ooo_segs++;
+
+    // 常见情况: 比所有已缓存的都靠后
+    if (QUEUE_EMPTY(&r->segs) || SEQ_LEQ(seg_last(r)->seq + seg_last(r)->len, seq))
+    {
+        seg_insert(r, &r->segs, seq, data, len);
+        return;
+    }
+
+    QUEUE *q = QUEUE_NEXT(&r->segs);
+    while (q != &r->segs && len > 0)
+    {
+        struct seg *s = QUEUE_DATA(q, struct seg, node);
+        uint32_t s_end = s->seq + s->len;
+        if (SEQ_LEQ(s_end, seq))
+        {
+            q = QUEUE_NEXT(q);
+            continue;
+        }
+        if (SEQ_LT(seq, s->seq))
+        {
+            uint32_t piece = s->seq - seq;
+            if (piece > len)
+            {
+                piece = len;
+            }
+            if (!seg_insert(r, q, seq, data, piece))
+            {
+                return;
+            }
+            seq += piece;
+            data += piece;
+            len -= piece;
+            if (len == 0)
+            {
+                break;
+            }
+        }
+        // 与 s 重叠的部分以 s 为准
+        uint32_t overlap = s_end - seq;
+        if (overlap > len)
+        {
+            overlap = len;
+        }
+        r->dup_bytes += overlap;
+        seq += overlap;
+        data += overlap;
+        len -= overlap;
+        q = QUEUE_NEXT(q);
+    }
+    if (len > 0)
+    {
+        seg_insert(r, q, seq, data, len);
+    }
+}
+
+void reasm_init(struct reasm *r, uint32_t max_bytes)
+{
+    memset(r, 0, sizeof(*r));
+    r->max_bytes = max_bytes ? max_bytes : REASM_MAX_OOO_BYTES;
+    QUEUE_INIT(&r->segs);
+}
+
+void reasm_release(struct reasm *r)
+{
+    while (!QUEUE_EMPTY(&r->segs))
+    {
+        seg_free(r, seg_first(r));
+    }
+}
+
+int reasm_push(struct reasm *r, uint32_t seq, uint8_t flags, const uint8_t *data, uint32_t len, reasm_proc proc, void *ud)
+{
+    // SYN 占一个 seq; 重传的 SYN 不能把 next 拉回去
+    if (flags & TH_SYN)
+    {
+        if (!r->started)
+        {
+            r->started = true;
+            r->next = seq + 1;
+        }
+        seq++;
+    }
+    if (len == 0 && !(flags & TH_FIN))
+    {
+        return 0;
+    }
+    // 没看到握手 (抓包时连接已经建立), 从第一个数据段开始
+    if (!r->started)
+    {
+        if (len == 0)
+        {
+            return 0;
+        }
+        r->started = true;
+        r->next = seq;
+    }
+    // FIN 在数据之后, 可能先于前面的数据到达, 记下位置; 已经交付过的重传 FIN 不算
+    if (flags & TH_FIN && SEQ_LEQ(r->next, seq + len))
+    {
+        r->fin = true;
+        r->fin_seq = seq + len;
+    }
+    if (len == 0)
+    {
+        return drain(r, proc, ud);
+    }
+
+    int n = 0;
+    for (;;)
+    {
+        if (SEQ_LEQ(seq + len, r->next))
+        {
+            r->dup_bytes += len;
+            return n;
+        }
+        if (SEQ_LT(seq, r->next))
+        {
+            uint32_t skip = r->next - seq;
+            r->dup_bytes += skip;
+            seq += skip;
+            data += skip;
+            len -= skip;
+        }
+        if (seq == r->next)
+        {
+            n += deliver(r, data, len, proc, ud);
+            return n + drain(r, proc, ud);
+        }
+        if (r->ooo_bytes + len <= r->max_bytes)
+        {
+            ooo_insert(r, seq, data, len);
+            return n;
+        }
+
+        // 缓存满了, 最前面的空洞多半是抓包丢的, 跳过去
+        uint32_t to = seq;
+        if (!QUEUE_EMPTY(&r->segs) && SEQ_LT(seg_first(r)->seq, to))
+        {
+            to = seg_first(r)->seq;
+        }
+        skip_to(r, to, proc, ud);
+        n += drain(r, proc, ud);
+    }
+}
+
+int reasm_ack(struct reasm *r, uint32_t ack, reasm_proc proc, void *ud)
+{
+    int n = 0;
+    if (!r->started)
+    {
+        return 0;
+    }
+    while (SEQ_LT(r->next, ack))
+    {
+        // 乱序缓存的段都在 next 之后, 跳到 ack 与第一个段中靠前的那个
+        uint32_t to = ack;
+        if (!QUEUE_EMPTY(&r->segs) && SEQ_LT(seg_first(r)->seq, ack))
+        {
+            to = seg_first(r)->seq;
+        }
+        // 空洞只跳到 FIN 为止, FIN 本身由 drain 交付, 不算空洞
+        if (r->fin && SEQ_LT(r->fin_seq, to))
+        {
+            to = r->fin_seq;
+        }
+        if (SEQ_LT(r->next, to))
+        {
+            skip_to(r, to, proc, ud);
+        }
+        n += drain(r, proc, ud);
+    }
+    return n;
+}
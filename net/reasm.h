@@ -0,0 +1,51 @@
+#ifndef REASM_H
+#define REASM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../base/queue.h"
+
+// 单向 TCP 流重组: 按 seq 把乱序 / 重传的段还原成有序字节流再交给协议解析
+// 已交付过的字节 (重传 / 重叠) 直接丢掉, 乱序段按 [seq, seq + len) 区间有序挂链表, 区间之间不重叠, 重叠部分以先到的为准
+// 抓包会丢包, 空洞可能永远补不上: 对端 ack 越过空洞 (对端已收到, 不会再重传) 或乱序缓存超过上限时跳过空洞, 回调通知 gap
+// seq 比较按 32 位回绕处理
+
+#define REASM_MAX_OOO_BYTES (256 * 1024)
+
+// data 为 NULL 表示跳过了 len 字节的空洞, 之前未解析完的数据已无法继续, 解析状态应当重置
+typedef void (*reasm_proc)(void *ud, const uint8_t *data, uint32_t len);
+
+struct reasm
+{
+    bool started;       // 见过 SYN 或第一个数据段后才知道起始 seq
+    uint32_t next;      // 下一个待交付字节的 seq
+    uint32_t max_bytes; // 乱序缓存上限
+    uint32_t ooo_bytes; // 当前乱序缓存字节数
+    QUEUE segs;         // 乱序段, 按 seq 升序
+    bool fin;           // 见过 FIN, 还没交付到
+    uint32_t fin_seq;   // FIN 占用的 seq
+    bool finished;      // FIN 之前的数据都已交付 (或跳过), 本方向结束
+
+    // 累计统计
+    uint64_t delivered; // 交付的字节
+    uint64_t dup_bytes; // 重复 / 重叠丢掉的字节
+    uint64_t ooo_segs;  // 进过乱序缓存的段
+    uint64_t gaps;      // 跳过空洞的次数
+    uint64_t gap_bytes; // 跳过的字节
+};
+
+// max_bytes 为 0 用 REASM_MAX_OOO_BYTES
+void reasm_init(struct reasm *r, uint32_t max_bytes);
+// 释放乱序缓存, 之后可以重新 reasm_init
+void reasm_release(struct reasm *r);
+// 收到本方向一个段; flags 为 tcp 头 th_flags (SYN / FIN 各占一个 seq), 返回本次交付的字节数
+int reasm_push(struct reasm *r, uint32_t seq, uint8_t flags, const uint8_t *data, uint32_t len, reasm_proc proc, void *ud);
+// 收到反方向的 ack, ack 之前的空洞跳过, 返回本次交付的字节数
+int reasm_ack(struct reasm *r, uint32_t ack, reasm_proc proc, void *ud);
+// 本方向已经交付到 FIN, 之后不会再有数据
+static inline bool reasm_finished(const struct reasm *r)
+{
+    return r->finished;
+}
+
+#endif
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <netinet/tcp.h>
+#include <sys/time.h>
+#include "reasm.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+struct sink
+{
+    uint8_t *data;
+    size_t size;
+    size_t cap;
+    int gaps;
+    size_t gap_bytes;
+};
+
+static void on_data(void *ud, const uint8_t *data, uint32_t len)
+{
+    struct sink *s = ud;
+    if (data == NULL)
+    {
+        // 空洞按 0 填, 方便和原始流按位置对比
+        s->gaps++;
+        s->gap_bytes += len;
+    }
+    assert(s->size + len <= s->cap);
+    if (data)
+    {
+        memcpy(s->data + s->size, data, len);
+    }
+    else
+    {
+        memset(s->data + s->size, 0, len);
+    }
+    s->size += len;
+}
+
+static void sink_init(struct sink *s, size_t cap)
+{
+    memset(s, 0, sizeof(*s));
+    s->data = malloc(cap);
+    s->cap = cap;
+}
+
+static uint8_t *make_stream(size_t n)
+{
+    uint8_t *p = malloc(n);
+    size_t i;
+    for (i = 0; i < n; i++)
+    {
+        p[i] = (uint8_t)(i * 131 + (i >> 8));
+    }
+    return p;
+}
+
+static void push(struct reasm *r, struct sink *s, uint32_t isn, const uint8_t *stream, size_t off, size_t len)
+{
+    reasm_push(r, isn + 1 + off, 0, stream + off, len, on_data, s);
+}
+
+// SYN 定起点, 重传的 SYN 不影响; 完全重复的段丢掉
+void test_inorder()
+{
+    const uint8_t *msg = (const uint8_t *)"hello world";
+    struct reasm r;
+    struct sink s;
+    reasm_init(&r, 0);
+    sink_init(&s, 64);
+    uint32_t isn = 1000;
+    assert(reasm_push(&r, isn, TH_SYN, NULL, 0, on_data, &s) == 0);
+    assert(reasm_push(&r, isn + 1, 0, msg, 5, on_data, &s) == 5);
+    assert(reasm_push(&r, isn, TH_SYN, NULL, 0, on_data, &s) == 0);
+    assert(reasm_push(&r, isn + 1, 0, msg, 5, on_data, &s) == 0);
+    assert(reasm_push(&r, isn + 4, 0, msg + 3, 8, on_data, &s) == 6);
+    assert(s.size == 11 && memcmp(s.data, msg, 11) == 0);
+    assert(r.dup_bytes == 7 && r.delivered == 11 && s.gaps == 0);
+    reasm_release(&r);
+    free(s.data);
+}
+
+// 乱序 + 重复 + 重叠重传, seq 跨过 2^32 回绕, 输出与原始流一致
+void test_reorder()
+{
+    const size_t n = 200000;
+    uint8_t *stream = make_stream(n);
+    struct reasm r;
+    struct sink s;
+    reasm_init(&r, n);
+    sink_init(&s, n);
+    uint32_t isn = 0xFFFFFFFF - 50000;
+    srand(1);
+
+    // 切成随机大小的段, 相邻的局部打乱
+    size_t offs[4096], lens[4096];
+    int segs = 0;
+    size_t off = 0;
+    while (off < n)
+    {
+        size_t len = 1 + rand() % 1460;
+        if (off + len > n)
+        {
+            len = n - off;
+        }
+        offs[segs] = off;
+        lens[segs] = len;
+        segs++;
+        off += len;
+    }
+    int i;
+    for (i = 0; i < segs; i++)
+    {
+        int j = i + rand() % 8;
+        if (j < segs)
+        {
+            size_t o = offs[i], l = lens[i];
+            offs[i] = offs[j], lens[i] = lens[j];
+            offs[j] = o, lens[j] = l;
+        }
+    }
+
+    reasm_push(&r, isn, TH_SYN, NULL, 0, on_data, &s);
+    for (i = 0; i < segs; i++)
+    {
+        push(&r, &s, isn, stream, offs[i], lens[i]);
+        // 随机重传一段跨越多个段的区间
+        if (rand() % 4 == 0)
+        {
+            size_t o = rand() % n;
+            size_t l = 1 + rand() % 4000;
+            push(&r, &s, isn, stream, o, o + l > n ? n - o : l);
+        }
+    }
+    assert(s.gaps == 0 && s.size == n && memcmp(s.data, stream, n) == 0);
+    assert(r.ooo_bytes == 0 && QUEUE_EMPTY(&r.segs) && r.dup_bytes > 0);
+    assert(r.next == (uint32_t)(isn + 1 + n));
+    reasm_release(&r);
+    free(s.data);
+    free(stream);
+}
+
+// 乱序缓存超过上限, 跳过最前面的空洞
+void test_cap()
+{
+    const size_t n = 10000;
+    uint8_t *stream = make_stream(n);
+    struct reasm r;
+    struct sink s;
+    reasm_init(&r, 2000);
+    sink_init(&s, n);
+    uint32_t isn = 7;
+    reasm_push(&r, isn, TH_SYN, NULL, 0, on_data, &s);
+
+    // [1000, 1500) 丢了
+    size_t off;
+    for (off = 0; off < n; off += 500)
+    {
+        if (off != 1000)
+        {
+            push(&r, &s, isn, stream, off, 500);
+            assert(r.ooo_bytes <= 2000);
+        }
+    }
+    // 缓存不下之后跳过空洞, 后面的都交付了
+    assert(s.gaps == 1 && s.gap_bytes == 500 && r.gap_bytes == 500);
+    assert(s.size == n && r.ooo_bytes == 0);
+    assert(memcmp(s.data, stream, 1000) == 0 && memcmp(s.data + 1500, stream + 1500, n - 1500) == 0);
+
+    // 空洞后来才到, 已经是重复数据
+    push(&r, &s, isn, stream, 1000, 500);
+    assert(s.size == n);
+    reasm_release(&r);
+    free(s.data);
+    free(stream);
+}
+
+// 对端 ack 越过空洞: 对端已经收到, 不会再重传
+void test_ack()
+{
+    const size_t n = 3000;
+    uint8_t *stream = make_stream(n);
+    struct reasm r;
+    struct sink s;
+    reasm_init(&r, 0);
+    sink_init(&s, n + 100);
+    uint32_t isn = 0xFFFFFF00;
+
+    // 没看到握手, 从第一个数据段开始
+    assert(reasm_ack(&r, isn + 500, on_data, &s) == 0);
+    push(&r, &s, isn, stream, 0, 1000);
+    push(&r, &s, isn, stream, 2000, 1000);
+    assert(s.size == 1000);
+    // ack 还没越过空洞
+    assert(reasm_ack(&r, isn + 1 + 1000, on_data, &s) == 0 && s.gaps == 0);
+    assert(reasm_ack(&r, isn + 1 + 1500, on_data, &s) == 0 && s.gap_bytes == 500);
+    assert(reasm_ack(&r, isn + 1 + 2000, on_data, &s) == 1000);
+    assert(s.gaps == 2 && s.gap_bytes == 1000 && s.size == n);
+    assert(memcmp(s.data + 2000, stream + 2000, 1000) == 0);
+    // ack 越过所有数据: 尾部丢的包也跳过
+    assert(reasm_ack(&r, isn + 1 + n + 100, on_data, &s) == 0);
+    assert(s.gaps == 3 && r.next == (uint32_t)(isn + 1 + n + 100));
+    reasm_release(&r);
+    free(s.data);
+    free(stream);
+}
+
+// FIN 占一个 seq, 对端 ack FIN + 1 不算空洞; FIN 先于前面的数据到达, 补齐后才算结束
+void test_fin()
+{
+    const uint8_t *msg = (const uint8_t *)"hello world";
+    struct reasm r;
+    struct sink s;
+    reasm_init(&r, 0);
+    sink_init(&s, 64);
+    uint32_t isn = 0xFFFFFFF8;
+    reasm_push(&r, isn, TH_SYN, NULL, 0, on_data, &s);
+    assert(reasm_push(&r, isn + 1, 0, msg, 5, on_data, &s) == 5);
+    assert(!reasm_finished(&r));
+    assert(reasm_push(&r, isn + 1 + 5, TH_FIN, NULL, 0, on_data, &s) == 0);
+    assert(r.next == isn + 1 + 5 + 1 && reasm_finished(&r));
+    assert(reasm_ack(&r, isn + 1 + 5 + 1, on_data, &s) == 0 && s.gaps == 0);
+    // 重传的 FIN
+    assert(reasm_push(&r, isn + 1 + 5, TH_FIN, NULL, 0, on_data, &s) == 0);
+    assert(r.next == isn + 1 + 5 + 1 && !r.fin);
+    reasm_release(&r);
+
+    // 带数据的 FIN 先到
+    reasm_init(&r, 0);
+    s.size = 0;
+    reasm_push(&r, isn, TH_SYN, NULL, 0, on_data, &s);
+    assert(reasm_push(&r, isn + 1 + 5, TH_FIN, msg + 5, 6, on_data, &s) == 0);
+    assert(r.next == isn + 1 && !reasm_finished(&r));
+    assert(reasm_push(&r, isn + 1, 0, msg, 5, on_data, &s) == 11);
+    assert(r.next == isn + 1 + 11 + 1 && reasm_finished(&r));
+    assert(reasm_ack(&r, isn + 1 + 11 + 1, on_data, &s) == 0 && s.gaps == 0);
+    assert(s.size == 11 && memcmp(s.data, msg, 11) == 0);
+    reasm_release(&r);
+
+    // 后一段先到, 然后单独的 FIN, 最后才是前一段
+    reasm_init(&r, 0);
+    s.size = 0;
+    reasm_push(&r, isn, TH_SYN, NULL, 0, on_data, &s);
+    assert(reasm_push(&r, isn + 1 + 5, 0, msg + 5, 6, on_data, &s) == 0);
+    assert(reasm_push(&r, isn + 1 + 11, TH_FIN, NULL, 0, on_data, &s) == 0);
+    assert(!reasm_finished(&r));
+    assert(reasm_push(&r, isn + 1, 0, msg, 5, on_data, &s) == 11);
+    assert(reasm_finished(&r) && s.size == 11 && memcmp(s.data, msg, 11) == 0);
+    reasm_release(&r);
+
+    // FIN 前面的数据丢了, 对端 ack 了 FIN: 空洞不含 FIN 自己
+    reasm_init(&r, 0);
+    s.size = 0;
+    s.gaps = 0;
+    s.gap_bytes = 0;
+    reasm_push(&r, isn, TH_SYN, NULL, 0, on_data, &s);
+    assert(reasm_push(&r, isn + 1 + 11, TH_FIN, NULL, 0, on_data, &s) == 0);
+    assert(reasm_ack(&r, isn + 1 + 11 + 1, on_data, &s) == 0);
+    assert(s.gaps == 1 && s.gap_bytes == 11 && reasm_finished(&r));
+    assert(r.next == isn + 1 + 11 + 1);
+    reasm_release(&r);
+    free(s.data);
+}
+
+static void on_bench(void *ud, const uint8_t *data, uint32_t len)
+{
+    *(size_t *)ud += len;
+}
+
+// 1460 字节一段, 顺序 / 每 8 段打乱 / 每段重传一次
+void bench()
+{
+    const size_t n = 256 << 20;
+    const size_t mss = 1460;
+    uint8_t *stream = make_stream(n);
+    const char *names[] = {"in order", "reordered", "duplicated"};
+    int mode;
+    for (mode = 0; mode < 3; mode++)
+    {
+        struct reasm r;
+        size_t got = 0;
+        reasm_init(&r, 0);
+        uint32_t isn = 1;
+        size_t segs = (n + mss - 1) / mss, i;
+        long long start = now_us();
+        reasm_push(&r, isn - 1, TH_SYN, NULL, 0, on_bench, &got);
+        for (i = 0; i < segs; i += 8)
+        {
+            int k;
+            for (k = 0; k < 8; k++)
+            {
+                // reordered: 每组 8 段倒序
+                size_t seg = mode == 1 ? i + 7 - k : i + k;
+                if (seg >= segs)
+                {
+                    continue;
+                }
+                size_t off = seg * mss;
+                size_t len = off + mss > n ? n - off : mss;
+                reasm_push(&r, isn + off, 0, stream + off, len, on_bench, &got);
+                if (mode == 2)
+                {
+                    reasm_push(&r, isn + off, 0, stream + off, len, on_bench, &got);
+                }
+            }
+        }
+        long long us = now_us() - start;
+        assert(got == n && r.gaps == 0);
+        printf("%-10s %zu MB: %lld ms, %.0f MB/s, %.0f ns/seg\n",
+               names[mode], n >> 20, us / 1000, (double)n / us, (double)us * 1000 / segs);
+        reasm_release(&r);
+    }
+    free(stream);
+}
+
+int main(int argc, char **argv)
+{
+    test_inorder();
+    test_reorder();
+    test_cap();
+    test_ack();
+    test_fin();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
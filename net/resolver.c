@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "ae.h"
+#include "resolver.h"
+
+#define RESOLVER_BUCKETS 256
+#define RESOLVER_MAX_THREADS 32
+
+enum
+{
+    ENTRY_DONE,
+    ENTRY_RESOLVING,
+};
+
+struct resolver_waiter
+{
+    struct resolver_waiter *next;
+    int family;
+    resolver_proc proc; // NULL 表示已取消
+    void *ud;
+};
+
+struct resolver_entry
+{
+    struct resolver_entry *next;     // 哈希链
+    struct resolver_entry *job_next; // 任务队列
+    char *host;
+    int state;
+    long long expire; // 毫秒, 单调时钟
+    int n;
+    union sockaddr_all addrs[RESOLVER_MAX_ADDRS];
+    struct resolver_waiter *waiters;
+    struct resolver_waiter **waiters_tail;
+
+    // 工作线程写, 经 pipe 交给 ae 线程后才读
+    int result_n;
+    union sockaddr_all result[RESOLVER_MAX_ADDRS];
+};
+
+struct resolver
+{
+    aeEventLoop *el;
+    int ttl;
+    int negative_ttl;
+    struct resolver_entry *buckets[RESOLVER_BUCKETS];
+    struct resolver_stats stats;
+    struct resolver_waiter *firing; // 正在回调的等待者, 回调里 cancel 也要能找到
+
+    int pipefd[2];
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct resolver_entry *job_head;
+    struct resolver_entry *job_tail;
+    bool stop;
+    int nthreads;
+    pthread_t threads[RESOLVER_MAX_THREADS];
+};
+
+static long long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned int hash_str(const char *s)
+{
+    unsigned int h = 5381;
+    while (*s)
+    {
+        h = h * 33 + (unsigned char)*s++;
+    }
+    return h;
+}
+
+static void entry_free(struct resolver_entry *e)
+{
+    struct resolver_waiter *w = e->waiters;
+    while (w)
+    {
+        struct resolver_waiter *next = w->next;
+        free(w);
+        w = next;
+    }
+    free(e->host);
+    free(e);
+}
+
+static void lookup(struct resolver_entry *e)
+{
+    struct addrinfo hints, *res, *p;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    e->result_n = 0;
+    int status = getaddrinfo(e->host, NULL, &hints, &res);
+    if (status != 0)
+    {
+        return;
+    }
+    for (p = res; p != NULL && e->result_n < RESOLVER_MAX_ADDRS; p = p->ai_next)
+    {
+        if ((p->ai_family == AF_INET || p->ai_family == AF_INET6) && p->ai_addrlen <= sizeof(union sockaddr_all))
+        {
+            memset(&e->result[e->result_n], 0, sizeof(union sockaddr_all));
+            memcpy(&e->result[e->result_n], p->ai_addr, p->ai_addrlen);
+            e->result_n++;
+        }
+    }
+    freeaddrinfo(res);
+}
+
+static void *worker(void *arg)
+{
+    struct resolver *r = arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&r->mutex);
+        while (r->job_head == NULL && !r->stop)
+        {
+            pthread_cond_wait(&r->cond, &r->mutex);
+        }
+        if (r->stop)
+        {
+            pthread_mutex_unlock(&r->mutex);
+            break;
+        }
+        struct resolver_entry *e = r->job_head;
+        r->job_head = e->job_next;
+        if (r->job_head == NULL)
+        {
+            r->job_tail = NULL;
+        }
+        pthread_mutex_unlock(&r->mutex);
+
+        lookup(e);
+
+        // 指针小于 PIPE_BUF, 写入是原子的
+        while (write(r->pipefd[1], &e, sizeof(e)) < 0 && errno == EINTR)
+        {
+        }
+    }
+    return NULL;
+}
+
+static void deliver(struct resolver_waiter *w, const union sockaddr_all *all, int total)
+{
+    union sockaddr_all addrs[RESOLVER_MAX_ADDRS];
+    int i, n = 0;
+    for (i = 0; i < total; i++)
+    {
+        if (w->family == AF_UNSPEC || w->family == all[i].s.sa_family)
+        {
+            addrs[n++] = all[i];
+        }
+    }
+    w->proc(w->ud, addrs, n);
+}
+
+// ae 线程: 取回结果, 写缓存, 回调所有等待者
+static void on_done(aeEventLoop *el, int fd, void *ud, int mask)
+{
+    struct resolver *r = ud;
+    struct resolver_entry *e;
+    union sockaddr_all addrs[RESOLVER_MAX_ADDRS];
+    while (read(fd, &e, sizeof(e)) == sizeof(e))
+    {
+        e->n = e->result_n;
+        memcpy(e->addrs, e->result, sizeof(e->addrs[0]) * e->n);
+        e->expire = now_ms() + (e->n ? r->ttl : r->negative_ttl);
+        e->state = ENTRY_DONE;
+        if (e->n == 0)
+        {
+            r->stats.failures++;
+        }
+
+        // 先摘下来, 回调里可能再次 resolve 同一 host
+        // 回调里 forget 或 find 清理过期项都可能释放 e, 之后只用栈上的拷贝
+        int n = e->n;
+        memcpy(addrs, e->addrs, sizeof(addrs[0]) * n);
+        r->firing = e->waiters;
+        e->waiters = NULL;
+        e->waiters_tail = &e->waiters;
+        e = NULL;
+        while (r->firing)
+        {
+            struct resolver_waiter *w = r->firing;
+            r->firing = w->next;
+            if (w->proc)
+            {
+                deliver(w, addrs, n);
+            }
+            free(w);
+        }
+    }
+}
+
+static struct resolver_entry *find(struct resolver *r, const char *host, struct resolver_entry ***link)
+{
+    struct resolver_entry **pp = &r->buckets[hash_str(host) % RESOLVER_BUCKETS];
+    long long now = now_ms();
+    while (*pp)
+    {
+        struct resolver_entry *e = *pp;
+        if (strcmp(e->host, host) == 0)
+        {
+            *link = pp;
+            return e;
+        }
+        // 顺手清掉同一链上过期的
+        if (e->state == ENTRY_DONE && e->expire <= now)
+        {
+            *pp = e->next;
+            entry_free(e);
+            continue;
+        }
+        pp = &e->next;
+    }
+    *link = pp;
+    return NULL;
+}
+
+struct resolver *resolver_create(struct aeEventLoop *el, int nthreads, int ttl_ms, int negative_ttl_ms)
+{
+    struct resolver *r = calloc(1, sizeof(*r));
+    if (r == NULL)
+    {
+        return NULL;
+    }
+    r->el = el;
+    r->ttl = ttl_ms;
+    r->negative_ttl = negative_ttl_ms;
+    if (nthreads < 1)
+    {
+        nthreads = 1;
+    }
+    if (nthreads > RESOLVER_MAX_THREADS)
+    {
+        nthreads = RESOLVER_MAX_THREADS;
+    }
+
+    if (pipe(r->pipefd) < 0)
+    {
+        perror("ERROR pipe");
+        free(r);
+        return NULL;
+    }
+    fcntl(r->pipefd[0], F_SETFL, O_NONBLOCK);
+    fcntl(r->pipefd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(r->pipefd[1], F_SETFD, FD_CLOEXEC);
+    if (aeCreateFileEvent(el, r->pipefd[0], AE_READABLE, on_done, r) == AE_ERR)
+    {
+        goto fail;
+    }
+
+    pthread_mutex_init(&r->mutex, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    for (r->nthreads = 0; r->nthreads < nthreads; r->nthreads++)
+    {
+        if (pthread_create(&r->threads[r->nthreads], NULL, worker, r) != 0)
+        {
+            break;
+        }
+    }
+    if (r->nthreads == 0)
+    {
+        aeDeleteFileEvent(el, r->pipefd[0], AE_READABLE);
+        pthread_mutex_destroy(&r->mutex);
+        pthread_cond_destroy(&r->cond);
+        goto fail;
+    }
+    return r;
+
+fail:
+    close(r->pipefd[0]);
+    close(r->pipefd[1]);
+    free(r);
+    return NULL;
+}
+
+void resolver_release(struct resolver *r)
+{
+    int i;
+    pthread_mutex_lock(&r->mutex);
+    r->stop = true;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->mutex);
+    // 正在 getaddrinfo 的线程要等它返回
+    for (i = 0; i < r->nthreads; i++)
+    {
+        pthread_join(r->threads[i], NULL);
+    }
+
+    aeDeleteFileEvent(r->el, r->pipefd[0], AE_READABLE);
+    close(r->pipefd[0]);
+    close(r->pipefd[1]);
+    pthread_mutex_destroy(&r->mutex);
+    pthread_cond_destroy(&r->cond);
+
+    for (i = 0; i < RESOLVER_BUCKETS; i++)
+    {
+        struct resolver_entry *e = r->buckets[i];
+        while (e)
+        {
+            struct resolver_entry *next = e->next;
+            entry_free(e);
+            e = next;
+        }
+    }
+    free(r);
+}
+
+bool resolver_resolve(struct resolver *r, const char *host, int family, resolver_proc proc, void *ud)
+{
+    struct resolver_entry **link;
+    struct resolver_entry *e = find(r, host, &link);
+
+    if (e && e->state == ENTRY_DONE && e->expire > now_ms())
+    {
+        struct resolver_waiter w = {NULL, family, proc, ud};
+        r->stats.hits++;
+        deliver(&w, e->addrs, e->n);
+        return true;
+    }
+
+    struct resolver_waiter *w = malloc(sizeof(*w));
+    if (w == NULL)
+    {
+        return false;
+    }
+    w->next = NULL;
+    w->family = family;
+    w->proc = proc;
+    w->ud = ud;
+
+    if (e && e->state == ENTRY_RESOLVING)
+    {
+        r->stats.coalesced++;
+        *e->waiters_tail = w;
+        e->waiters_tail = &w->next;
+        return true;
+    }
+
+    if (e == NULL)
+    {
+        e = calloc(1, sizeof(*e));
+        if (e == NULL || (e->host = strdup(host)) == NULL)
+        {
+            free(e);
+            free(w);
+            return false;
+        }
+        e->waiters_tail = &e->waiters;
+        *link = e;
+    }
+    // 新建或已过期, 重新解析
+    e->state = ENTRY_RESOLVING;
+    *e->waiters_tail = w;
+    e->waiters_tail = &w->next;
+    r->stats.lookups++;
+
+    e->job_next = NULL;
+    pthread_mutex_lock(&r->mutex);
+    if (r->job_tail)
+    {
+        r->job_tail->job_next = e;
+    }
+    else
+    {
+        r->job_head = e;
+    }
+    r->job_tail = e;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->mutex);
+    return true;
+}
+
+void resolver_cancel(struct resolver *r, void *ud)
+{
+    int i;
+    struct resolver_waiter *w;
+    for (w = r->firing; w; w = w->next)
+    {
+        if (w->ud == ud)
+        {
+            w->proc = NULL;
+        }
+    }
+    for (i = 0; i < RESOLVER_BUCKETS; i++)
+    {
+        struct resolver_entry *e;
+        for (e = r->buckets[i]; e; e = e->next)
+        {
+            for (w = e->waiters; w; w = w->next)
+            {
+                if (w->ud == ud)
+                {
+                    w->proc = NULL;
+                }
+            }
+        }
+    }
+}
+
+void resolver_forget(struct resolver *r, const char *host)
+{
+    struct resolver_entry **link;
+    struct resolver_entry *e = find(r, host, &link);
+    // 解析中的结果本来就是新的, 不动
+    if (e && e->state == ENTRY_DONE)
+    {
+        *link = e->next;
+        entry_free(e);
+    }
+}
+
+const struct resolver_stats *resolver_getStats(struct resolver *r)
+{
+    return &r->stats;
+}
@@ -0,0 +1,42 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdbool.h>
+#include "sa.h"
+
+// 异步 DNS: getaddrinfo 在工作线程跑, 结果经 pipe 投递回 ae 线程回调
+// 按 host 缓存, 同一 host 并发的解析合并成一次 getaddrinfo
+// getaddrinfo 拿不到记录的 TTL, 缓存时间用创建时给的 ttl
+
+#define RESOLVER_MAX_ADDRS 8
+
+struct aeEventLoop;
+struct resolver;
+
+// n 为 0 表示解析失败; addrs 端口为 0, 由调用方填写; 只在回调内有效
+typedef void (*resolver_proc)(void *ud, const union sockaddr_all *addrs, int n);
+
+struct resolver_stats
+{
+    unsigned long hits;      // 命中缓存
+    unsigned long coalesced; // 合并到进行中的解析
+    unsigned long lookups;   // 实际调用 getaddrinfo
+    unsigned long failures;
+};
+
+// ttl_ms 成功结果的缓存时间, negative_ttl_ms 失败结果的缓存时间 (0 不缓存失败)
+struct resolver *resolver_create(struct aeEventLoop *el, int nthreads, int ttl_ms, int negative_ttl_ms);
+// 等待工作线程退出, 未完成的回调不再调用; 不能在回调里调用
+void resolver_release(struct resolver *r);
+
+// family: AF_UNSPEC / AF_INET / AF_INET6, 只回调该族的地址
+// 缓存命中时在本次调用内回调; 否则在 ae 线程里回调
+// 返回 false 表示没能提交, 不会回调
+bool resolver_resolve(struct resolver *r, const char *host, int family, resolver_proc proc, void *ud);
+// 取消 ud 所有未完成的回调, 释放 ud 前调用
+void resolver_cancel(struct resolver *r, void *ud);
+// 丢掉 host 的缓存, 如连接失败后强制下次重新解析
+void resolver_forget(struct resolver *r, const char *host);
+const struct resolver_stats *resolver_getStats(struct resolver *r);
+
+#endif
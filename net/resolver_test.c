@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "ae.h"
+#include "sa.h"
+#include "resolver.h"
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+struct result
+{
+    int called;
+    int n;
+    union sockaddr_all addr;
+};
+
+static void on_resolved(void *ud, const union sockaddr_all *addrs, int n)
+{
+    struct result *res = ud;
+    res->called++;
+    res->n = n;
+    if (n > 0)
+    {
+        res->addr = addrs[0];
+    }
+}
+
+// 跑 loop 直到回调次数够了
+static void wait_for(aeEventLoop *el, int *called, int want)
+{
+    while (*called < want)
+    {
+        aeProcessEvents(el, AE_FILE_EVENTS);
+    }
+}
+
+// 异步回调, 命中缓存同步回调, 并发合并
+void test_resolve()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct resolver *r = resolver_create(el, 2, 60000, 0);
+    struct result a, b, c;
+    char buf[SA_BUF_SIZE];
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    memset(&c, 0, sizeof(c));
+
+    assert(resolver_resolve(r, "localhost", AF_INET, on_resolved, &a));
+    assert(resolver_resolve(r, "localhost", AF_INET, on_resolved, &b));
+    assert(a.called == 0 && b.called == 0);
+    wait_for(el, &b.called, 1);
+    assert(a.called == 1 && a.n >= 1);
+    sa_toip(&a.addr, buf, sizeof(buf));
+    assert(strcmp(buf, "127.0.0.1") == 0);
+    assert(b.n == a.n);
+
+    assert(resolver_resolve(r, "localhost", AF_INET, on_resolved, &c));
+    assert(c.called == 1 && c.n == a.n);
+
+    const struct resolver_stats *st = resolver_getStats(r);
+    assert(st->lookups == 1 && st->coalesced == 1 && st->hits == 1 && st->failures == 0);
+
+    resolver_release(r);
+    aeDeleteEventLoop(el);
+}
+
+// 过期重新解析, forget 丢缓存, 失败结果
+void test_ttl()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct resolver *r = resolver_create(el, 1, 30, 0);
+    const struct resolver_stats *st = resolver_getStats(r);
+    struct result a;
+    memset(&a, 0, sizeof(a));
+
+    assert(resolver_resolve(r, "127.0.0.1", AF_UNSPEC, on_resolved, &a));
+    wait_for(el, &a.called, 1);
+    assert(a.n == 1 && st->lookups == 1);
+    usleep(40000);
+    assert(resolver_resolve(r, "127.0.0.1", AF_UNSPEC, on_resolved, &a));
+    assert(a.called == 1);
+    wait_for(el, &a.called, 2);
+    assert(st->lookups == 2);
+
+    resolver_forget(r, "127.0.0.1");
+    assert(resolver_resolve(r, "127.0.0.1", AF_UNSPEC, on_resolved, &a));
+    wait_for(el, &a.called, 3);
+    assert(st->lookups == 3 && st->hits == 0);
+
+    // 只要 v6 地址, 过滤后为空
+    assert(resolver_resolve(r, "127.0.0.1", AF_INET6, on_resolved, &a));
+    assert(a.called == 4 && a.n == 0);
+
+    // 失败不缓存
+    assert(resolver_resolve(r, "nonexistent.invalid", AF_UNSPEC, on_resolved, &a));
+    wait_for(el, &a.called, 5);
+    assert(a.n == 0 && st->failures == 1);
+    assert(resolver_resolve(r, "nonexistent.invalid", AF_UNSPEC, on_resolved, &a));
+    wait_for(el, &a.called, 6);
+    assert(st->failures == 2);
+
+    resolver_release(r);
+    aeDeleteEventLoop(el);
+}
+
+static struct resolver *cancel_r;
+
+static void on_resolved_cancel(void *ud, const union sockaddr_all *addrs, int n)
+{
+    struct result *res = ud;
+    res->called++;
+    // 回调里取消同一批里后面的等待者
+    resolver_cancel(cancel_r, res + 1);
+}
+
+// 取消后不再回调
+void test_cancel()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct resolver *r = resolver_create(el, 1, 60000, 0);
+    struct result res[3];
+    memset(res, 0, sizeof(res));
+    cancel_r = r;
+
+    assert(resolver_resolve(r, "localhost", AF_UNSPEC, on_resolved_cancel, &res[0]));
+    assert(resolver_resolve(r, "localhost", AF_UNSPEC, on_resolved, &res[1]));
+    assert(resolver_resolve(r, "localhost", AF_UNSPEC, on_resolved, &res[2]));
+    resolver_cancel(r, &res[2]);
+    wait_for(el, &res[0].called, 1);
+    aeProcessEvents(el, AE_FILE_EVENTS | AE_DONT_WAIT);
+    assert(res[1].called == 0 && res[2].called == 0);
+
+    // 未完成就释放
+    assert(resolver_resolve(r, "127.0.0.2", AF_UNSPEC, on_resolved, &res[1]));
+    resolver_release(r);
+    assert(res[1].called == 0);
+    aeDeleteEventLoop(el);
+}
+
+static void on_resolved_forget(void *ud, const union sockaddr_all *addrs, int n)
+{
+    struct result *res = ud;
+    res->called++;
+    res->n = n;
+    // 回调里丢掉正在回调的这条缓存, 后面的等待者照常回调
+    resolver_forget(cancel_r, "localhost");
+}
+
+// 回调里 forget 同一 host
+void test_forget_in_callback()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct resolver *r = resolver_create(el, 1, 60000, 0);
+    const struct resolver_stats *st = resolver_getStats(r);
+    struct result res[3];
+    memset(res, 0, sizeof(res));
+    cancel_r = r;
+
+    assert(resolver_resolve(r, "localhost", AF_INET, on_resolved_forget, &res[0]));
+    assert(resolver_resolve(r, "localhost", AF_INET, on_resolved_forget, &res[1]));
+    assert(resolver_resolve(r, "localhost", AF_INET, on_resolved, &res[2]));
+    wait_for(el, &res[2].called, 1);
+    assert(res[0].called == 1 && res[1].called == 1);
+    assert(res[0].n >= 1 && res[1].n == res[0].n && res[2].n == res[0].n);
+
+    // 缓存已经丢了, 重新解析
+    assert(resolver_resolve(r, "localhost", AF_INET, on_resolved, &res[2]));
+    assert(res[2].called == 1);
+    wait_for(el, &res[2].called, 2);
+    assert(st->lookups == 2 && st->hits == 0);
+
+    resolver_release(r);
+    aeDeleteEventLoop(el);
+}
+
+#define BENCH_N 10000
+
+// 重连风暴: 每次重连都解析一次 vs 走缓存
+void bench()
+{
+    aeEventLoop *el = aeCreateEventLoop(64);
+    struct resolver *r = resolver_create(el, 1, 60000, 0);
+    struct result a;
+    union sockaddr_all u;
+    int i;
+    memset(&a, 0, sizeof(a));
+
+    long long start = now_us();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        assert(sa_resolve("localhost", &u));
+    }
+    double sync_us = (double)(now_us() - start) / BENCH_N;
+
+    start = now_us();
+    for (i = 0; i < BENCH_N; i++)
+    {
+        assert(resolver_resolve(r, "localhost", AF_INET, on_resolved, &a));
+        wait_for(el, &a.called, i + 1);
+    }
+    double cached_us = (double)(now_us() - start) / BENCH_N;
+
+    printf("localhost x %d: sa_resolve %.2f us, resolver %.2f us per call (%lu lookups)\n",
+           BENCH_N, sync_us, cached_us, resolver_getStats(r)->lookups);
+    resolver_release(r);
+    aeDeleteEventLoop(el);
+}
+
+int main(int argc, char **argv)
+{
+    test_resolve();
+    test_ttl();
+    test_cancel();
+    test_forget_in_callback();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
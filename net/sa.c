@@ -100,6 +100,11 @@ sa_family_t sa_family(union sockaddr_all *u)
     return u->s.sa_family;
 }
 
+socklen_t sa_socklen(const union sockaddr_all *u)
+{
+    return u->s.sa_family == AF_INET6 ? sizeof(u->v6) : sizeof(u->v4);
+}
+
 bool sa_resolve(char *hostname, union sockaddr_all *u)
 {
     assert(u);
@@ -121,7 +126,7 @@ bool sa_resolve(char *hostname, union sockaddr_all *u)
     if (res == NULL)
     {
         freeaddrinfo(res);
-        false;
+        return false;
     }
 
     u->v4.sin_family = res->ai_family;
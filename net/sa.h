@@ -22,7 +22,10 @@ void sa_toipport(union sockaddr_all *u, char *buf, int size);
 uint16_t sa_toport(union sockaddr_all *u);
 uint32_t sa_iplong(union sockaddr_all *u);
 sa_family_t sa_family(union sockaddr_all *u);
+// 按 family 给 bind / connect 用的长度
+socklen_t sa_socklen(const union sockaddr_all *u);
 
+// 阻塞, 只取第一个 IPv4 地址; 双栈异步见 resolver.h + connector.h
 bool sa_resolve(char *hostname, union sockaddr_all *u);
 
 #endif
\ No newline at end of file
@@ -4,8 +4,13 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include "socket.h"
 #include "sa.h"
+#include "poller.h"
 
 void sigchld_handler(int s)
 {
@@ -84,8 +89,125 @@ void server()
     }
 }
 
-int main(void)
+#define BENCH_MAX_LISTENERS 8
+#define BENCH_CLIENTS 4
+#define BENCH_MS 500
+
+static volatile bool bench_stop;
+static uint16_t bench_port;
+
+#define BENCH_ACCEPT_BATCH 64
+
+struct acceptor
+{
+    struct socket_acceptor a;
+    pthread_t tid;
+};
+
+// 每个 listener 一个线程一个 poller, 每次可读批量 accept
+static void *bench_accept(void *arg)
+{
+    struct socket_acceptor *a = arg;
+    poll_fd p = poller_create();
+    struct event e[1];
+    int fds[BENCH_ACCEPT_BATCH];
+    assert(p && poller_add(p, a->fd, NULL, 0));
+    while (!bench_stop)
+    {
+        if (poller_wait(p, e, 1, 10) <= 0)
+        {
+            continue;
+        }
+        int i, n = socket_acceptBatch(a, fds, NULL, BENCH_ACCEPT_BATCH);
+        for (i = 0; i < n; i++)
+        {
+            close(fds[i]);
+        }
+    }
+    poller_release(p);
+    return NULL;
+}
+
+// 连上即 RST 关闭, 不留 TIME_WAIT 耗尽本地端口
+static void *bench_connect(void *arg)
+{
+    union sockaddr_all addr = sa_fromip("127.0.0.1", bench_port);
+    struct linger lg = {1, 0};
+    while (!bench_stop)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, &addr.s, sizeof(addr.v4)) == 0)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+static void bench_group(int n, bool byCpu)
+{
+    int fds[BENCH_MAX_LISTENERS];
+    struct acceptor acceptors[BENCH_MAX_LISTENERS];
+    pthread_t clients[BENCH_CLIENTS];
+    union sockaddr_all addr;
+    socklen_t addrlen = sizeof(addr);
+    int i;
+
+    assert(socket_serverGroup("0", n, fds, byCpu) == n);
+    getsockname(fds[0], &addr.s, &addrlen);
+    bench_port = sa_toport(&addr);
+    bench_stop = false;
+    for (i = 0; i < n; i++)
+    {
+        assert(socket_acceptorInit(&acceptors[i].a, fds[i]));
+        pthread_create(&acceptors[i].tid, NULL, bench_accept, &acceptors[i].a);
+    }
+    for (i = 0; i < BENCH_CLIENTS; i++)
+    {
+        pthread_create(&clients[i], NULL, bench_connect, NULL);
+    }
+    usleep(BENCH_MS * 1000);
+    bench_stop = true;
+    for (i = 0; i < BENCH_CLIENTS; i++)
+    {
+        pthread_join(clients[i], NULL);
+    }
+
+    long total = 0;
+    printf("%d listener%s%s:", n, n > 1 ? "s" : "", byCpu ? " cbpf" : "");
+    for (i = 0; i < n; i++)
+    {
+        pthread_join(acceptors[i].tid, NULL);
+        total += acceptors[i].a.accepted;
+        printf(" %lu", acceptors[i].a.accepted);
+        socket_acceptorRelease(&acceptors[i].a);
+        close(fds[i]);
+    }
+    printf(" -> %ld accepts/sec\n", total * 1000 / BENCH_MS);
+}
+
+// 用法: server_test bench [最多 listener 数]
+void bench(int max)
 {
+    int n;
+    for (n = 1; n <= max && n <= BENCH_MAX_LISTENERS; n *= 2)
+    {
+        bench_group(n, false);
+        if (n > 1)
+        {
+            bench_group(n, true);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench(argc > 2 ? atoi(argv[2]) : 4);
+        return 0;
+    }
     server();
     return 0;
 }
\ No newline at end of file
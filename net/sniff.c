@@ -15,6 +15,7 @@
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <string.h>
@@ -24,7 +25,12 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <assert.h>
+#include <pthread.h>
 #include "sniff.h"
+#ifdef __linux__
+#include <linux/filter.h>
+#include "sniff_ring.h"
+#endif
 
 
 static bool tcp_parse_recv_options(const struct tcphdr *th, struct tcpopt *opt);
@@ -40,8 +46,14 @@ struct tcpsniff_t
     char *device;      /* 网卡                      */
     char *filter_exp;  /* bpf 表达式                */
     void *ud;
+    int ring_block_nr; /* >0 用 TPACKET_V3 ring */
+    char *pcap_file;   /* 回放文件 */
+    int replay_fast;   /* 尽快回放 */
     /* }}} */
 
+    struct timeval replay_ts;   /* 回放的第一个包的时间戳 */
+    struct timeval replay_wall; /* 回放开始的时间 */
+
     int dl_type;             /* data link type           */
     int dl_hdr_offset;       /* dlhdr大小 决定iphdr偏移    */
     bpf_u_int32 ip;          /* 网卡 ip                   */
@@ -50,6 +62,7 @@ struct tcpsniff_t
     tcpsniff_pkt_handler pkt_handler;
 };
 
+// 所有抓包线程共用, tcpsniff_exit 可能在信号处理函数里调用
 static bool sniffing = 0;
 
 static void pcap_pkt_handler(struct tcpsniff_t *sniff, const struct pcap_pkthdr *pkt_hdr, const u_char *pkt)
@@ -125,11 +138,13 @@ static void pcap_pkt_handler(struct tcpsniff_t *sniff, const struct pcap_pkthdr
 
     struct ip *ip_hdr = (struct ip *)(pkt + sniff->dl_hdr_offset);
 
-    if (IPV4_IS_BROADCAST_ADDR(ip_hdr->ip_dst.s_addr))
+    // IPV4_ADDR 是按数值写的, 先转成本机字节序再比, 否则小端机器上 x.x.x.224~255 会被当成组播
+    uint32_t ip_dst = ntohl(ip_hdr->ip_dst.s_addr);
+    if (IPV4_IS_BROADCAST_ADDR(ip_dst))
     {
         return;
     }
-    if (IPV4_IS_MULTICAST_ADDR(ip_hdr->ip_dst.s_addr))
+    if (IPV4_IS_MULTICAST_ADDR(ip_dst))
     {
         return;
     }
@@ -161,39 +176,254 @@ static void pcap_pkt_handler(struct tcpsniff_t *sniff, const struct pcap_pkthdr
     sniff->pkt_handler(sniff->ud, pkt_hdr, ip_hdr, tcp_hdr, &tcp_opt, payload, payload_sz);
 }
 
-bool tcpsniff(struct tcpsniff_opt *opt, tcpsniff_pkt_handler pkt_handler)
+#ifdef __linux__
+static void ring_pkt_handler(void *ud, const struct timeval *ts, const uint8_t *pkt, uint32_t caplen, uint32_t len)
+{
+    struct pcap_pkthdr pkt_hdr;
+    pkt_hdr.ts = *ts;
+    pkt_hdr.caplen = caplen;
+    pkt_hdr.len = len;
+    pcap_pkt_handler(ud, &pkt_hdr, pkt);
+}
+
+// pcap 只用来编译过滤器; ring 收到的包从 ip 头开始, 按 DLT_RAW 编译与解析
+static struct sniff_ring *tcpsniff_ringOpen(struct tcpsniff_t *sniff, int fanout_group)
+{
+    pcap_t *dead = pcap_open_dead(DLT_RAW, sniff->snaplen);
+    if (dead == NULL)
+    {
+        fprintf(stderr, "ERROR in pcap_open_dead\n");
+        return NULL;
+    }
+    struct bpf_program filter;
+    if (pcap_compile(dead, &filter, sniff->filter_exp, 1, sniff->subnet_mask) == -1)
+    {
+        fprintf(stderr, "ERROR in pcap_compile: %s\n", pcap_geterr(dead));
+        pcap_close(dead);
+        return NULL;
+    }
+
+    // struct bpf_insn 与 struct sock_filter 布局相同
+    struct sock_fprog prog = {filter.bf_len, (struct sock_filter *)filter.bf_insns};
+    struct sniff_ring_opts ring_opts = {sniff->device, 0, sniff->ring_block_nr, sniff->timeout_limit, &prog, fanout_group};
+    struct sniff_ring *ring = sniff_ringOpen(&ring_opts);
+    pcap_freecode(&filter);
+    pcap_close(dead);
+
+    sniff->dl_type = DLT_RAW;
+    sniff->dl_hdr_offset = 0;
+    return ring;
+}
+
+static bool tcpsniff_ringLoop(struct tcpsniff_t *sniff, struct sniff_ring *ring)
+{
+    bool ok = true;
+    while (__atomic_load_n(&sniffing, __ATOMIC_RELAXED))
+    {
+        if (sniff_ringDispatch(ring, sniff->timeout_limit, ring_pkt_handler, sniff) < 0)
+        {
+            ok = false;
+            break;
+        }
+    }
+
+    struct sniff_ring_stats st;
+    if (sniff_ringStats(ring, &st))
+    {
+        fprintf(stderr, "ring: %llu packets, %llu dropped, %llu blocks\n", st.packets, st.drops, st.blocks);
+    }
+    return ok;
+}
+
+static bool tcpsniff_ring(struct tcpsniff_t *sniff)
+{
+    struct sniff_ring *ring = tcpsniff_ringOpen(sniff, 0);
+    if (ring == NULL)
+    {
+        return false;
+    }
+    __atomic_store_n(&sniffing, true, __ATOMIC_RELAXED);
+    bool ok = tcpsniff_ringLoop(sniff, ring);
+    sniff_ringClose(ring);
+    return ok;
+}
+
+struct tcpsniff_worker
 {
-    char errbuf[PCAP_ERRBUF_SIZE];
     struct tcpsniff_t sniff;
-    memset(&sniff, 0, sizeof(sniff));
-    memcpy(&sniff, opt, sizeof(*opt));
-    sniff.pkt_handler = pkt_handler;
+    struct sniff_ring *ring;
+    pthread_t tid;
+    bool ok;
+};
+
+static void *tcpsniff_workerRun(void *arg)
+{
+    struct tcpsniff_worker *w = arg;
+    w->ok = tcpsniff_ringLoop(&w->sniff, w->ring);
+    if (!w->ok)
+    {
+        // 一个线程出错整体退出
+        tcpsniff_exit();
+    }
+    return NULL;
+}
+#endif
+
+// 拷贝选项, 查网卡地址
+static void tcpsniff_init(struct tcpsniff_t *sniff, struct tcpsniff_opt *opt, tcpsniff_pkt_handler pkt_handler)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    memset(sniff, 0, sizeof(*sniff));
+    memcpy(sniff, opt, sizeof(*opt));
+    sniff->pkt_handler = pkt_handler;
+    if (sniff->pcap_file)
+    {
+        return;
+    }
 
     // Get information for device 查询网卡IP地址与子网掩码
     // device = any ip与mask 均为0.0.0.0
-    if (pcap_lookupnet(sniff.device, &sniff.ip, &sniff.subnet_mask, errbuf) == -1)
+    if (pcap_lookupnet(sniff->device, &sniff->ip, &sniff->subnet_mask, errbuf) == -1)
     {
         fprintf(stderr, "ERROR in pcap_lookupnet, cound not get info for device: %s\n", errbuf);
-        sniff.ip = 0;
-        sniff.subnet_mask = 0;
+        sniff->ip = 0;
+        sniff->subnet_mask = 0;
     }
 
-    if (sniff.ip)
+    if (sniff->ip)
     {
         // FIXME INET6
         char ip_buf[INET_ADDRSTRLEN];
         char mask_buf[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &sniff.ip, ip_buf, INET_ADDRSTRLEN);
-        inet_ntop(AF_INET, &sniff.subnet_mask, mask_buf, INET_ADDRSTRLEN);
-        // printf("%s ip=%s mask=%s\n", sniff.device, ip_buf, mask_buf);
+        inet_ntop(AF_INET, &sniff->ip, ip_buf, INET_ADDRSTRLEN);
+        inet_ntop(AF_INET, &sniff->subnet_mask, mask_buf, INET_ADDRSTRLEN);
+        // printf("%s ip=%s mask=%s\n", sniff->device, ip_buf, mask_buf);
     }
+}
 
-    sniff.handle = pcap_open_live(sniff.device, sniff.snaplen, sniff.pkt_cnt_limit, sniff.timeout_limit, errbuf);
-    if (sniff.handle == NULL)
+bool tcpsniff_fanout(struct tcpsniff_opt *opt, int threads, void **uds, tcpsniff_pkt_handler pkt_handler)
+{
+    if (opt->pcap_file)
+    {
+        opt->ud = uds[0];
+        return tcpsniff(opt, pkt_handler);
+    }
+#ifdef __linux__
+    struct tcpsniff_worker *workers = calloc(threads, sizeof(*workers));
+    if (workers == NULL)
     {
-        fprintf(stderr, "ERROR in pcap_open_live, cound not open %s: %s\n", sniff.device, errbuf);
         return false;
     }
+    // 组 id 在 net namespace 内唯一, 用 pid 区分同机的多个进程
+    int group = getpid() & 0xffff;
+    if (group == 0)
+    {
+        group = 1;
+    }
+
+    int i, started = 0;
+    bool ok = true;
+    __atomic_store_n(&sniffing, true, __ATOMIC_RELAXED);
+    for (i = 0; i < threads; i++)
+    {
+        struct tcpsniff_worker *w = &workers[i];
+        tcpsniff_init(&w->sniff, opt, pkt_handler);
+        w->sniff.ud = uds[i];
+        w->ring = tcpsniff_ringOpen(&w->sniff, group);
+        if (w->ring == NULL)
+        {
+            ok = false;
+            break;
+        }
+    }
+    // 所有 socket 都进组之后再开始收, 避免先进组的线程收到所有流
+    for (i = 0; ok && i < threads; i++)
+    {
+        if (pthread_create(&workers[i].tid, NULL, tcpsniff_workerRun, &workers[i]) != 0)
+        {
+            fprintf(stderr, "ERROR pthread_create sniff worker\n");
+            ok = false;
+            break;
+        }
+        started++;
+    }
+    if (!ok)
+    {
+        tcpsniff_exit();
+    }
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(workers[i].tid, NULL);
+        ok = ok && workers[i].ok;
+    }
+    for (i = 0; i < threads; i++)
+    {
+        if (workers[i].ring)
+        {
+            sniff_ringClose(workers[i].ring);
+        }
+    }
+    free(workers);
+    return ok;
+#else
+    fprintf(stderr, "PACKET_FANOUT only on linux, sniff in one thread\n");
+    opt->ud = uds[0];
+    return tcpsniff(opt, pkt_handler);
+#endif
+}
+
+// 按第一个包起算, 包的时间戳还没到就等
+static void tcpsniff_pace(struct tcpsniff_t *sniff, const struct timeval *ts)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    if (!timerisset(&sniff->replay_wall))
+    {
+        sniff->replay_ts = *ts;
+        sniff->replay_wall = now;
+        return;
+    }
+    long long due_us = (long long)(ts->tv_sec - sniff->replay_ts.tv_sec) * 1000000 + (ts->tv_usec - sniff->replay_ts.tv_usec);
+    long long elapsed_us = (long long)(now.tv_sec - sniff->replay_wall.tv_sec) * 1000000 + (now.tv_usec - sniff->replay_wall.tv_usec);
+    if (due_us > elapsed_us)
+    {
+        usleep(due_us - elapsed_us);
+    }
+}
+
+bool tcpsniff(struct tcpsniff_opt *opt, tcpsniff_pkt_handler pkt_handler)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    struct tcpsniff_t sniff;
+    tcpsniff_init(&sniff, opt, pkt_handler);
+
+    if (sniff.ring_block_nr > 0 && sniff.pcap_file == NULL)
+    {
+#ifdef __linux__
+        return tcpsniff_ring(&sniff);
+#else
+        fprintf(stderr, "TPACKET_V3 ring only on linux, fall back to pcap\n");
+#endif
+    }
+
+    if (sniff.pcap_file)
+    {
+        sniff.handle = pcap_open_offline(sniff.pcap_file, errbuf);
+        if (sniff.handle == NULL)
+        {
+            fprintf(stderr, "ERROR in pcap_open_offline, cound not open %s: %s\n", sniff.pcap_file, errbuf);
+            return false;
+        }
+    }
+    else
+    {
+        sniff.handle = pcap_open_live(sniff.device, sniff.snaplen, sniff.pkt_cnt_limit, sniff.timeout_limit, errbuf);
+        if (sniff.handle == NULL)
+        {
+            fprintf(stderr, "ERROR in pcap_open_live, cound not open %s: %s\n", sniff.device, errbuf);
+            return false;
+        }
+    }
 
     // data link type 参见 #include <pcap/bpf.h>
     sniff.dl_type = pcap_datalink(sniff.handle);
@@ -238,8 +468,8 @@ bool tcpsniff(struct tcpsniff_opt *opt, tcpsniff_pkt_handler pkt_handler)
     struct pcap_pkthdr *pkt_hdr = NULL;
     const u_char *pkt = NULL;
     int ret = 0;
-    sniffing = true;
-    while (sniffing)
+    __atomic_store_n(&sniffing, true, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&sniffing, __ATOMIC_RELAXED))
     {
         ret = pcap_next_ex(sniff.handle, &pkt_hdr, &pkt);
         if (ret == 0)
@@ -252,16 +482,25 @@ bool tcpsniff(struct tcpsniff_opt *opt, tcpsniff_pkt_handler pkt_handler)
             pcap_close(sniff.handle);
             return false;
         }
+        if (ret == -2)
+        {
+            break; // 回放文件读完
+        }
 
+        if (sniff.pcap_file && !sniff.replay_fast)
+        {
+            tcpsniff_pace(&sniff, &pkt_hdr->ts);
+        }
         pcap_pkt_handler(&sniff, pkt_hdr, pkt);
     }
 
+    pcap_close(sniff.handle);
     return true;
 }
 
 void tcpsniff_exit()
 {
-    sniffing = false;
+    __atomic_store_n(&sniffing, false, __ATOMIC_RELAXED);
 }
 
 /********************** parser tcp options **********************************/
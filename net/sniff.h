@@ -31,6 +31,9 @@ struct tcpsniff_opt
     char *device;      /* 网卡                      */
     char *filter_exp;  /* bpf 表达式                */
     void *ud;          /* 回调第一个参数              */
+    int ring_block_nr; /* >0 (linux) 用 TPACKET_V3 mmap ring 整块收包, 见 sniff_ring.h; 0 用 pcap_next_ex */
+    char *pcap_file;   /* 非 NULL 从 pcap 文件回放 (pcap_open_offline), 忽略 device 与 ring, 不需要 root */
+    int replay_fast;   /* 回放时 1: 尽快回放 (压测); 0: 按抓包时间戳间隔回放 */
 };
 
 struct tcpopt
@@ -51,7 +54,12 @@ typedef void (*tcpsniff_pkt_handler)(void *ud,
                                      const struct tcpopt *,
                                      const u_char *payload,
                                      size_t payload_size);
+// 抓包直到 tcpsniff_exit; 回放文件时读完返回
 bool tcpsniff(struct tcpsniff_opt *, tcpsniff_pkt_handler);
+// 多线程按流分片: threads 个 TPACKET_V3 ring 组成 PACKET_FANOUT_HASH 组, 每个线程一个 (linux); opt->ring_block_nr 为每个 ring 的 block 数, 0 用默认
+// 一条连接两个方向的包总在同一个线程, 线程之间不共享流状态; 第 i 个线程回调的第一个参数为 uds[i], 不用 opt->ud
+// 阻塞到 tcpsniff_exit 后所有线程结束; 回放文件时只用 uds[0] 单线程回放
+bool tcpsniff_fanout(struct tcpsniff_opt *, int threads, void **uds, tcpsniff_pkt_handler);
 void tcpsniff_exit();
 
 
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "sniff_mysql.h"
+#include "flowtable.h"
+#include "reasm.h"
+#include "../base/buffer.h"
+#include "../base/endian.h"
+#include "../base/log.h"
+
+struct sniff_mysql
+{
+    struct flowtable *flows; // 单向连接, key 为 4-tuple, flow->ud 为 struct conn
+    uint16_t server_port;    // 网络字节序
+    sniff_mysql_proc proc;
+    void *ud;
+    struct sniff_mysql_stats stats;
+};
+
+// flow->ud, 有数据或 SYN 才分配
+struct conn
+{
+    struct reasm reasm;
+    struct sniff_mysql *m;
+};
+
+static void on_evict(void *ud, struct flow *f, int reason)
+{
+    struct conn *c = f->ud;
+    if (c)
+    {
+        reasm_release(&c->reasm);
+        free(c);
+    }
+}
+
+static struct conn *conn_get(struct sniff_mysql *m, struct flow *f)
+{
+    if (f->ud == NULL)
+    {
+        struct conn *c = malloc(sizeof(*c));
+        if (c == NULL)
+        {
+            return NULL;
+        }
+        reasm_init(&c->reasm, 0);
+        c->m = m;
+        f->ud = c;
+    }
+    return f->ud;
+}
+
+// TOOD 未处理 compressed header
+static bool is_completed_mysql_pdu(struct sniff_mysql *m, struct buffer *buf)
+{
+    if (buf_readable(buf) < 4) /* regular header 3+1 (len+id) */
+    {
+        return false;
+    }
+    int32_t sz = buf_peekInt32LE24(buf);
+    if (sz <= 0 || sz >= MYSQL_MAX_PACKET_LEN)
+    {
+        // 不是 mysql 或者没对齐到包头, 丢掉已缓存的数据
+        LOG_ERROR("malformed mysql packet(size=%d)\n", sz);
+        m->stats.malformed++;
+        buf_retrieveAll(buf);
+        return false;
+    }
+    return buf_readable(buf) >= sz + 4;
+}
+
+// 解析缓冲区里所有完整的 mysql 包
+static void conn_parse(struct sniff_mysql *m, struct flow *f, struct buffer *buf)
+{
+    bool is_response = f->key.sport == m->server_port;
+    while (is_completed_mysql_pdu(m, buf))
+    {
+        int32_t pkt_sz = buf_readInt32LE24(buf);
+        uint8_t pkt_id = buf_readInt8(buf);
+        m->stats.pdus++;
+        if (m->proc)
+        {
+            m->proc(m->ud, f, is_response, pkt_id, buf_peek(buf), pkt_sz);
+        }
+        buf_retrieve(buf, pkt_sz);
+    }
+
+    if (buf_internalCapacity(buf) > 1024 * 1024)
+    {
+        buf_shrink(buf, 0);
+    }
+}
+
+// 重组后的有序数据
+static void on_data(void *ud, const uint8_t *data, uint32_t len)
+{
+    struct flow *f = ud;
+    struct sniff_mysql *m = ((struct conn *)f->ud)->m;
+    struct buffer *buf = flowtable_buffer(m->flows, f);
+    if (buf == NULL)
+    {
+        return;
+    }
+    if (data == NULL)
+    {
+        // 抓包丢了数据, 没解析完的包接不上了
+        m->stats.gaps++;
+        buf_retrieveAll(buf);
+        return;
+    }
+    m->stats.delivered += len;
+    buf_append(buf, (const char *)data, len);
+    conn_parse(m, f, buf);
+}
+
+struct sniff_mysql *sniff_mysql_create(uint16_t server_port, int idle_timeout_ms, size_t buf_size, sniff_mysql_proc proc, void *ud)
+{
+    struct sniff_mysql *m = calloc(1, sizeof(*m));
+    if (m == NULL)
+    {
+        return NULL;
+    }
+    m->flows = flowtable_create(idle_timeout_ms, buf_size, on_evict, m);
+    if (m->flows == NULL)
+    {
+        free(m);
+        return NULL;
+    }
+    m->server_port = htons(server_port);
+    m->proc = proc;
+    m->ud = ud;
+    return m;
+}
+
+void sniff_mysql_release(struct sniff_mysql *m)
+{
+    flowtable_release(m->flows);
+    free(m);
+}
+
+void sniff_mysql_handle(void *ud, const struct pcap_pkthdr *pkt_hdr, const struct ip *ip_hdr, const struct tcphdr *tcp_hdr,
+                        const struct tcpopt *tcp_opt, const u_char *payload, size_t payload_size)
+{
+    struct sniff_mysql *m = ud;
+    struct flow_key key = {ip_hdr->ip_src.s_addr, ip_hdr->ip_dst.s_addr, tcp_hdr->th_sport, tcp_hdr->th_dport};
+    uint8_t flags = tcp_hdr->th_flags;
+    uint64_t now_ms = (uint64_t)pkt_hdr->ts.tv_sec * 1000 + pkt_hdr->ts.tv_usec / 1000;
+    m->stats.packets++;
+    m->stats.bytes += pkt_hdr->caplen;
+    flowtable_expire(m->flows, now_ms);
+
+    // 连接重置, 两个方向都不会再有数据
+    if (flags & TH_RST)
+    {
+        struct flow_key rkey = flow_keyReverse(&key);
+        flowtable_remove(m->flows, &key);
+        flowtable_remove(m->flows, &rkey);
+        return;
+    }
+
+    // 本方向的 ack 说明对端已经收到, 反方向 ack 之前的空洞不会再重传了
+    if (flags & TH_ACK)
+    {
+        struct flow_key rkey = flow_keyReverse(&key);
+        struct flow *f = flowtable_find(m->flows, &rkey);
+        if (f && f->ud)
+        {
+            struct reasm *r = &((struct conn *)f->ud)->reasm;
+            reasm_ack(r, ntohl(tcp_hdr->th_ack), on_data, f);
+            if (reasm_finished(r))
+            {
+                flowtable_remove(m->flows, &rkey);
+            }
+        }
+    }
+
+    // 获取或初始化连接对象, 按 seq 重组后再解析
+    // FIN 也要进重组: 可能先于前面的数据到达, 交付到 FIN 之后才删本方向; 反方向等它自己的 FIN 或空闲超时
+    if (payload_size > 0 || flags & (TH_SYN | TH_FIN))
+    {
+        struct flow *f = flowtable_get(m->flows, &key, now_ms, payload_size > 0 || flags & TH_SYN);
+        struct conn *c = f ? conn_get(m, f) : NULL;
+        if (c)
+        {
+            reasm_push(&c->reasm, ntohl(tcp_hdr->th_seq), flags, payload, payload_size, on_data, f);
+            if (reasm_finished(&c->reasm))
+            {
+                flowtable_remove(m->flows, &key);
+            }
+        }
+    }
+}
+
+size_t sniff_mysql_count(struct sniff_mysql *m)
+{
+    return flowtable_count(m->flows);
+}
+
+const struct sniff_mysql_stats *sniff_mysql_getStats(struct sniff_mysql *m)
+{
+    return &m->stats;
+}
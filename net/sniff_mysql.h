@@ -0,0 +1,40 @@
+#ifndef SNIFF_MYSQL_H
+#define SNIFF_MYSQL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "sniff.h"
+
+// 抓包 -> 流表 (flowtable) -> 按 seq 重组 (reasm) -> 按 mysql 包头分包
+// sniff_test (在线 / -r 回放) 与 sniff_replay_test 共用; 这里假定端口上都是 mysql 数据, 不处理 compressed header 与 SSL
+
+#define MYSQL_MAX_PACKET_LEN 0xFFFFFF
+
+struct flow;
+struct sniff_mysql;
+
+// 一个完整的 mysql 包, body 不含 4 字节包头, 只在回调内有效
+typedef void (*sniff_mysql_proc)(void *ud, const struct flow *f, bool is_response, uint8_t pkt_id, const char *body, uint32_t len);
+
+struct sniff_mysql_stats
+{
+    unsigned long long packets;   // 收到的 tcp 包
+    unsigned long long bytes;     // caplen 累计
+    unsigned long long delivered; // 重组后交付的字节
+    unsigned long long gaps;      // 重组跳过的空洞
+    unsigned long long pdus;      // 完整的 mysql 包
+    unsigned long long malformed; // 包头非法, 丢弃缓存的数据
+};
+
+// server_port 区分请求 / 应答; proc 可为 NULL (只统计)
+struct sniff_mysql *sniff_mysql_create(uint16_t server_port, int idle_timeout_ms, size_t buf_size, sniff_mysql_proc proc, void *ud);
+void sniff_mysql_release(struct sniff_mysql *m);
+// tcpsniff 的包回调, tcpsniff_opt.ud 填 struct sniff_mysql *
+void sniff_mysql_handle(void *ud, const struct pcap_pkthdr *pkt_hdr, const struct ip *ip_hdr, const struct tcphdr *tcp_hdr,
+                        const struct tcpopt *tcp_opt, const u_char *payload, size_t payload_size);
+// 当前单向连接数
+size_t sniff_mysql_count(struct sniff_mysql *m);
+const struct sniff_mysql_stats *sniff_mysql_getStats(struct sniff_mysql *m);
+
+#endif
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <net/ethernet.h>
+#include "sniff.h"
+#include "sniff_mysql.h"
+
+// 生成合成的 pcap 文件 (以太网), 离线回放走完整的 解码 -> 流表 -> 重组 -> mysql 分包, 不需要 root 和网卡
+
+#define MSS 1460
+#define SERVER_IP IPV4_ADDR(10, 0, 0, 1)
+#define SERVER_PORT 3306
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* -=-=-=-=-=--=-=-=-=-=--=-=-=-=-=- 合成 pcap -=-=-=-=-=--=-=-=-=-=--=-=-=-=-=- */
+
+struct gen
+{
+    FILE *fp;
+    long long ts_us;
+    int step_us;
+    unsigned long long packets;
+    unsigned long long payload;
+    unsigned long long pdus;
+};
+
+struct gen_flow
+{
+    uint32_t cip;
+    uint16_t cport;
+    uint32_t cseq; // 客户端下一个 seq
+    uint32_t sseq; // 服务端下一个 seq
+};
+
+static void gen_open(struct gen *g, const char *file, int step_us)
+{
+    memset(g, 0, sizeof(*g));
+    g->fp = fopen(file, "wb");
+    assert(g->fp);
+    g->ts_us = 1500000000LL * 1000000;
+    g->step_us = step_us;
+
+    // pcap 文件头, 本机字节序, 读的一方按 magic 判断
+    uint32_t magic = 0xa1b2c3d4, snaplen = 65535, linktype = DLT_EN10MB;
+    uint16_t major = 2, minor = 4;
+    int32_t zone = 0;
+    uint32_t sigfigs = 0;
+    fwrite(&magic, 4, 1, g->fp);
+    fwrite(&major, 2, 1, g->fp);
+    fwrite(&minor, 2, 1, g->fp);
+    fwrite(&zone, 4, 1, g->fp);
+    fwrite(&sigfigs, 4, 1, g->fp);
+    fwrite(&snaplen, 4, 1, g->fp);
+    fwrite(&linktype, 4, 1, g->fp);
+}
+
+static void gen_close(struct gen *g)
+{
+    fclose(g->fp);
+}
+
+static void gen_pkt(struct gen *g, uint32_t sip, uint16_t sport, uint32_t dip, uint16_t dport,
+                    uint32_t seq, uint32_t ack, uint8_t flags, const uint8_t *payload, uint32_t len)
+{
+    // 以太网头 14 字节, 前面空 2 字节让 ip 头 4 字节对齐
+    uint32_t raw[(2 + 14 + 20 + 20 + MSS + 3) / 4];
+    uint8_t *pkt = (uint8_t *)raw + 2;
+    memset(pkt, 0, 14 + 20 + 20);
+
+    struct ether_header *eh = (struct ether_header *)pkt;
+    eh->ether_type = htons(ETHERTYPE_IP);
+
+    struct ip *ip = (struct ip *)(pkt + 14);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(20 + 20 + len);
+    ip->ip_ttl = 64;
+    ip->ip_p = IPPROTO_TCP;
+    ip->ip_src.s_addr = htonl(sip);
+    ip->ip_dst.s_addr = htonl(dip);
+
+    struct tcphdr *th = (struct tcphdr *)(pkt + 14 + 20);
+    th->th_sport = htons(sport);
+    th->th_dport = htons(dport);
+    th->th_seq = htonl(seq);
+    th->th_ack = htonl(ack);
+    th->th_off = 5;
+    th->th_flags = flags;
+    th->th_win = htons(65535);
+    if (len)
+    {
+        memcpy(pkt + 14 + 20 + 20, payload, len);
+    }
+
+    uint32_t caplen = 14 + 20 + 20 + len;
+    uint32_t rec[4] = {g->ts_us / 1000000, g->ts_us % 1000000, caplen, caplen};
+    fwrite(rec, sizeof(rec), 1, g->fp);
+    fwrite(pkt, caplen, 1, g->fp);
+    g->ts_us += g->step_us;
+    g->packets++;
+}
+
+static void gen_client(struct gen *g, struct gen_flow *f, uint8_t flags, const uint8_t *payload, uint32_t len)
+{
+    gen_pkt(g, f->cip, f->cport, SERVER_IP, SERVER_PORT, f->cseq, f->sseq, flags, payload, len);
+}
+
+static void gen_server(struct gen *g, struct gen_flow *f, uint8_t flags, const uint8_t *payload, uint32_t len)
+{
+    gen_pkt(g, SERVER_IP, SERVER_PORT, f->cip, f->cport, f->sseq, f->cseq, flags, payload, len);
+}
+
+// 一个 mysql 包按 MSS 切段; 多于一段时第 1 2 段对调, 再重传第 1 段
+static void gen_mysql(struct gen *g, struct gen_flow *f, bool from_server, uint8_t id, uint32_t body_len)
+{
+    static uint8_t pdu[4 + 65536];
+    assert(body_len <= 65536);
+    pdu[0] = body_len & 0xff;
+    pdu[1] = (body_len >> 8) & 0xff;
+    pdu[2] = (body_len >> 16) & 0xff;
+    pdu[3] = id;
+    memset(pdu + 4, 'a' + id % 26, body_len);
+
+    uint32_t total = 4 + body_len;
+    uint32_t *seq = from_server ? &f->sseq : &f->cseq;
+    uint32_t base = *seq;
+    uint32_t nseg = (total + MSS - 1) / MSS, i;
+    for (i = 0; i < nseg; i++)
+    {
+        uint32_t k = i;
+        if (nseg > 1 && i < 2)
+        {
+            k = 1 - i;
+        }
+        uint32_t off = k * MSS;
+        uint32_t len = total - off < MSS ? total - off : MSS;
+        *seq = base + off;
+        if (from_server)
+        {
+            gen_server(g, f, TH_ACK | TH_PUSH, pdu + off, len);
+        }
+        else
+        {
+            gen_client(g, f, TH_ACK | TH_PUSH, pdu + off, len);
+        }
+    }
+    if (nseg > 1)
+    {
+        *seq = base;
+        if (from_server)
+        {
+            gen_server(g, f, TH_ACK, pdu, MSS);
+        }
+        else
+        {
+            gen_client(g, f, TH_ACK, pdu, MSS);
+        }
+    }
+    *seq = base + total;
+    g->payload += total;
+    g->pdus++;
+}
+
+// flows 条连接交错进行, 每条 rounds 次请求 / 应答, 应答大小轮流 100B / 4KB / 20KB
+static void gen_capture(const char *file, int flows, int rounds, int step_us, struct gen *g)
+{
+    gen_open(g, file, step_us);
+    struct gen_flow *fs = calloc(flows, sizeof(*fs));
+    int i, r;
+    for (i = 0; i < flows; i++)
+    {
+        struct gen_flow *f = &fs[i];
+        f->cip = IPV4_ADDR(10, 1, i >> 8, i & 0xff);
+        f->cport = 40000 + i % 20000;
+        f->cseq = 1000 + i * 7919;
+        f->sseq = 0xFFFFF000 + i; // 服务端 seq 回绕
+
+        gen_client(g, f, TH_SYN, NULL, 0);
+        gen_server(g, f, TH_SYN | TH_ACK, NULL, 0);
+        f->cseq++;
+        f->sseq++;
+        gen_client(g, f, TH_ACK, NULL, 0);
+    }
+    const uint32_t sizes[] = {100, 4096, 20000};
+    for (r = 0; r < rounds; r++)
+    {
+        for (i = 0; i < flows; i++)
+        {
+            struct gen_flow *f = &fs[i];
+            gen_mysql(g, f, false, 0, 32 + r % 64);
+            gen_server(g, f, TH_ACK, NULL, 0);
+            gen_mysql(g, f, true, 1, sizes[(i + r) % 3]);
+            gen_client(g, f, TH_ACK, NULL, 0);
+        }
+    }
+    for (i = 0; i < flows; i++)
+    {
+        struct gen_flow *f = &fs[i];
+        gen_client(g, f, TH_FIN | TH_ACK, NULL, 0);
+        gen_server(g, f, TH_FIN | TH_ACK, NULL, 0);
+    }
+    free(fs);
+    gen_close(g);
+}
+
+/* -=-=-=-=-=--=-=-=-=-=--=-=-=-=-=- 回放 -=-=-=-=-=--=-=-=-=-=--=-=-=-=-=- */
+
+// 只解码不重组, 对比流表 + 重组 + 分包的开销
+static void pkt_count(void *ud, const struct pcap_pkthdr *pkt_hdr, const struct ip *ip_hdr, const struct tcphdr *tcp_hdr,
+                      const struct tcpopt *tcp_opt, const u_char *payload, size_t payload_size)
+{
+    struct sniff_mysql_stats *st = ud;
+    st->packets++;
+    st->bytes += pkt_hdr->caplen;
+}
+
+// full 为 false 时只数包
+static bool replay(const char *file, bool fast, bool full, struct sniff_mysql_stats *st)
+{
+    memset(st, 0, sizeof(*st));
+    struct sniff_mysql *m = sniff_mysql_create(SERVER_PORT, 60000, 4096, NULL, NULL);
+    assert(m);
+    struct tcpsniff_opt opt = {
+        .snaplen = 65535,
+        .filter_exp = "tcp",
+        .pcap_file = (char *)file,
+        .replay_fast = fast,
+        .ud = full ? (void *)m : (void *)st};
+    bool ok = tcpsniff(&opt, full ? sniff_mysql_handle : pkt_count);
+    if (full)
+    {
+        assert(sniff_mysql_count(m) == 0);
+        *st = *sniff_mysql_getStats(m);
+    }
+    sniff_mysql_release(m);
+    return ok;
+}
+
+static void tmp_file(char *file)
+{
+    strcpy(file, "/tmp/sniff_replay_XXXXXX");
+    int fd = mkstemp(file);
+    assert(fd >= 0);
+    close(fd);
+}
+
+// 乱序 + 重传 + seq 回绕的合成流量, 重组后 mysql 包一个不少
+void test_replay()
+{
+    char file[64];
+    struct gen g;
+    struct sniff_mysql_stats rp;
+    tmp_file(file);
+    gen_capture(file, 50, 10, 10, &g);
+
+    assert(replay(file, true, true, &rp));
+    assert(rp.packets == g.packets);
+    assert(rp.delivered == g.payload && rp.pdus == g.pdus && rp.gaps == 0 && rp.malformed == 0);
+    unlink(file);
+}
+
+// 客户端发完请求先半关闭, 服务端应答切两段, 后一段先到, 接着 FIN, 最后才是前一段:
+// 半关闭后的应答照常交付, 乱序缓存里的数据等补齐后交付, 两个方向各自 FIN 后删除
+void test_fin_reorder()
+{
+    char file[64];
+    struct gen g;
+    struct sniff_mysql_stats rp;
+    tmp_file(file);
+    gen_open(&g, file, 10);
+
+    struct gen_flow f = {IPV4_ADDR(10, 1, 0, 1), 40000, 1000, 5000};
+    gen_client(&g, &f, TH_SYN, NULL, 0);
+    gen_server(&g, &f, TH_SYN | TH_ACK, NULL, 0);
+    f.cseq++;
+    f.sseq++;
+    gen_client(&g, &f, TH_ACK, NULL, 0);
+    gen_mysql(&g, &f, false, 0, 32);
+    gen_client(&g, &f, TH_FIN | TH_ACK, NULL, 0);
+    f.cseq++;
+
+    static uint8_t pdu[4 + 2000];
+    uint32_t total = sizeof(pdu), base = f.sseq;
+    pdu[0] = 2000 & 0xff;
+    pdu[1] = 2000 >> 8;
+    pdu[3] = 1;
+    f.sseq = base + MSS;
+    gen_server(&g, &f, TH_ACK | TH_PUSH, pdu + MSS, total - MSS);
+    f.sseq = base + total;
+    gen_server(&g, &f, TH_FIN | TH_ACK, NULL, 0);
+    f.sseq = base;
+    gen_server(&g, &f, TH_ACK, pdu, MSS);
+    gen_close(&g);
+
+    assert(replay(file, true, true, &rp));
+    assert(rp.pdus == g.pdus + 1 && rp.gaps == 0 && rp.malformed == 0);
+    unlink(file);
+}
+
+// 不加 replay_fast 按时间戳间隔回放
+void test_paced()
+{
+    char file[64];
+    struct gen g;
+    struct sniff_mysql_stats rp;
+    tmp_file(file);
+    gen_capture(file, 1, 1, 20000, &g); // 每个包间隔 20ms
+
+    long long start = now_us();
+    assert(replay(file, false, true, &rp));
+    long long us = now_us() - start;
+    assert(rp.packets == g.packets && rp.pdus == g.pdus);
+    assert(us >= (long long)(g.packets - 1) * 20000);
+    unlink(file);
+}
+
+void bench()
+{
+    char file[64];
+    struct gen g;
+    struct sniff_mysql_stats rp;
+    tmp_file(file);
+    gen_capture(file, 1000, 20, 1, &g);
+    printf("synthetic capture: %d flows, %llu packets, %llu MB payload, %llu mysql packets\n",
+           1000, g.packets, g.payload >> 20, g.pdus);
+
+    const char *names[] = {"decode only", "full pipeline"};
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        long long start = now_us();
+        assert(replay(file, true, i == 1, &rp));
+        long long us = now_us() - start;
+        assert(rp.packets == g.packets);
+        printf("%-14s %llu pkts in %lld ms: %.0f kpps, %.0f MB/s\n",
+               names[i], rp.packets, us / 1000, (double)rp.packets * 1000 / us, (double)rp.bytes / us);
+    }
+    assert(rp.pdus == g.pdus && rp.gaps == 0);
+    unlink(file);
+}
+
+int main(int argc, char **argv)
+{
+    test_replay();
+    test_fin_reorder();
+    test_paced();
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
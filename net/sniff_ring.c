@@ -0,0 +1,227 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include "sniff_ring.h"
+
+#ifdef __linux__
+
+struct sniff_ring
+{
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    int block_size;
+    int block_nr;
+    int cur; // 下一个要处理的 block
+    struct sniff_ring_stats stats;
+};
+
+static int sniff_ringSetopt(int fd, int name, const void *val, socklen_t len, const char *desc)
+{
+    if (setsockopt(fd, SOL_PACKET, name, val, len) < 0)
+    {
+        fprintf(stderr, "ERROR setsockopt %s: %s\n", desc, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+struct sniff_ring *sniff_ringOpen(const struct sniff_ring_opts *opts)
+{
+    struct sniff_ring *r = calloc(1, sizeof(*r));
+    if (r == NULL)
+    {
+        return NULL;
+    }
+    r->block_size = opts->block_size > 0 ? opts->block_size : SNIFF_RING_BLOCK_SIZE;
+    r->block_nr = opts->block_nr > 0 ? opts->block_nr : SNIFF_RING_BLOCK_NR;
+    int timeout = opts->timeout_ms > 0 ? opts->timeout_ms : SNIFF_RING_TIMEOUT_MS;
+
+    int ifindex = 0;
+    if (opts->device && strcmp(opts->device, "any") != 0)
+    {
+        ifindex = if_nametoindex(opts->device);
+        if (ifindex == 0)
+        {
+            fprintf(stderr, "ERROR unknown device %s\n", opts->device);
+            free(r);
+            return NULL;
+        }
+    }
+
+    // protocol 0: bind 之前不收包, 避免过滤器挂上之前混进别的包
+    r->fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (r->fd < 0)
+    {
+        perror("ERROR socket AF_PACKET");
+        free(r);
+        return NULL;
+    }
+
+    int version = TPACKET_V3;
+    if (sniff_ringSetopt(r->fd, PACKET_VERSION, &version, sizeof(version), "PACKET_VERSION") < 0)
+    {
+        goto fail;
+    }
+    if (opts->filter && setsockopt(r->fd, SOL_SOCKET, SO_ATTACH_FILTER, opts->filter, sizeof(*opts->filter)) < 0)
+    {
+        perror("ERROR setsockopt SO_ATTACH_FILTER");
+        goto fail;
+    }
+
+    // V3 的包在 block 里变长紧挨着放, frame 参数只用于内核校验
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = r->block_size;
+    req.tp_block_nr = r->block_nr;
+    req.tp_frame_size = 2048;
+    req.tp_frame_nr = (unsigned)r->block_size / req.tp_frame_size * r->block_nr;
+    req.tp_retire_blk_tov = timeout;
+    if (sniff_ringSetopt(r->fd, PACKET_RX_RING, &req, sizeof(req), "PACKET_RX_RING") < 0)
+    {
+        goto fail;
+    }
+
+    r->map_size = (size_t)r->block_size * r->block_nr;
+    r->map = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, 0);
+    if (r->map == MAP_FAILED)
+    {
+        r->map = NULL;
+        perror("ERROR mmap PACKET_RX_RING");
+        goto fail;
+    }
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = ifindex;
+    if (bind(r->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+    {
+        perror("ERROR bind AF_PACKET");
+        goto fail;
+    }
+
+    // 要在 bind 之后; DEFRAG 让分片重组后再算哈希, 同一个包的分片不会分到不同 ring
+    if (opts->fanout_group)
+    {
+        unsigned int fanout = (opts->fanout_group & 0xffff) | ((unsigned int)(PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if (sniff_ringSetopt(r->fd, PACKET_FANOUT, &fanout, sizeof(fanout), "PACKET_FANOUT") < 0)
+        {
+            goto fail;
+        }
+    }
+    return r;
+
+fail:
+    sniff_ringClose(r);
+    return NULL;
+}
+
+void sniff_ringClose(struct sniff_ring *r)
+{
+    if (r->map)
+    {
+        munmap(r->map, r->map_size);
+    }
+    close(r->fd);
+    free(r);
+}
+
+int sniff_ringFd(struct sniff_ring *r)
+{
+    return r->fd;
+}
+
+static struct tpacket_block_desc *sniff_ringBlock(struct sniff_ring *r)
+{
+    struct tpacket_block_desc *bd = (struct tpacket_block_desc *)(r->map + (size_t)r->cur * r->block_size);
+    // 与内核写 block_status 配对
+    if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+    {
+        return NULL;
+    }
+    return bd;
+}
+
+static int sniff_ringWalk(struct sniff_ring *r, struct tpacket_block_desc *bd, sniff_ring_proc proc, void *ud)
+{
+    uint32_t i, n = bd->hdr.bh1.num_pkts;
+    int handled = 0;
+    struct tpacket3_hdr *h = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+    for (i = 0; i < n; i++)
+    {
+        const struct sockaddr_ll *sll = (const struct sockaddr_ll *)((uint8_t *)h + TPACKET_ALIGN(sizeof(*h)));
+        // lo 上每个包发出与收到各出现一次, 与 pcap 一样丢掉发出的那份
+        if (!(sll->sll_hatype == ARPHRD_LOOPBACK && sll->sll_pkttype == PACKET_OUTGOING))
+        {
+            struct timeval ts = {h->tp_sec, h->tp_nsec / 1000};
+            proc(ud, &ts, (const uint8_t *)h + h->tp_mac, h->tp_snaplen, h->tp_len);
+            handled++;
+        }
+        h = (struct tpacket3_hdr *)((uint8_t *)h + h->tp_next_offset);
+    }
+    return handled;
+}
+
+int sniff_ringDispatch(struct sniff_ring *r, int timeout_ms, sniff_ring_proc proc, void *ud)
+{
+    struct tpacket_block_desc *bd = sniff_ringBlock(r);
+    if (bd == NULL)
+    {
+        struct pollfd pfd = {r->fd, POLLIN | POLLERR, 0};
+        if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR)
+        {
+            perror("ERROR poll AF_PACKET");
+            return -1;
+        }
+        bd = sniff_ringBlock(r);
+    }
+
+    int handled = 0, blocks = 0;
+    // 最多转一圈, 处理过程中内核可能又交出新 block
+    while (bd && blocks < r->block_nr)
+    {
+        handled += sniff_ringWalk(r, bd, proc, ud);
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        r->cur = (r->cur + 1) % r->block_nr;
+        r->stats.blocks++;
+        blocks++;
+        bd = sniff_ringBlock(r);
+    }
+    return handled;
+}
+
+bool sniff_ringStats(struct sniff_ring *r, struct sniff_ring_stats *st)
+{
+    struct tpacket_stats_v3 kst;
+    socklen_t len = sizeof(kst);
+    if (getsockopt(r->fd, SOL_PACKET, PACKET_STATISTICS, &kst, &len) < 0)
+    {
+        perror("ERROR getsockopt PACKET_STATISTICS");
+        return false;
+    }
+    // tp_packets 包含被丢掉的
+    r->stats.packets += kst.tp_packets;
+    r->stats.drops += kst.tp_drops;
+    r->stats.freezes += kst.tp_freeze_q_cnt;
+    *st = r->stats;
+    return true;
+}
+
+#endif
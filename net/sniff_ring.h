@@ -0,0 +1,52 @@
+#ifndef SNIFF_RING_H
+#define SNIFF_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+// linux AF_PACKET + TPACKET_V3 mmap 环形缓冲区抓包, 替代 pcap_next_ex 逐包从内核拷贝
+// 内核把包直接写进与用户态共享的 block, 一个 block 写满或超时 (retire) 后整块交给用户态, 处理完整块归还
+// 只收 IPv4 (ETH_P_IP), SOCK_DGRAM: 包从 ip 头开始, 对应 DLT_RAW, 任何网卡 (包括 any / lo) 都一样
+// fanout: 同一组的多个 ring 按流的对称哈希分包, 一条连接两个方向总落在同一个 ring, 每个线程一个 ring 即可无锁解码
+// 过滤器为 classic BPF, 可以用 pcap_compile(pcap_open_dead(DLT_RAW, snaplen), ...) 编译后传入, 截断长度由过滤器返回值决定
+
+#define SNIFF_RING_BLOCK_SIZE (1 << 20)
+#define SNIFF_RING_BLOCK_NR 64
+#define SNIFF_RING_TIMEOUT_MS 10
+
+struct sock_fprog;
+struct sniff_ring;
+
+struct sniff_ring_opts
+{
+    const char *device;              // NULL 或 "any" 为所有网卡
+    int block_size;                  // 需为页大小的整数倍, 0 用默认
+    int block_nr;                    // 0 用默认
+    int timeout_ms;                  // block 没写满多久也交给用户态, 0 用默认
+    const struct sock_fprog *filter; // 可为 NULL
+    int fanout_group;                // 非 0: 加入该 id (16 位) 的 PACKET_FANOUT_HASH 组
+};
+
+// 累计值; PACKET_STATISTICS 每次读取内核会清零, 这里累加
+struct sniff_ring_stats
+{
+    unsigned long long packets; // 内核收到的 (过滤后)
+    unsigned long long drops;   // ring 满被丢掉的
+    unsigned long long freezes; // ring 满导致冻结的次数
+    unsigned long long blocks;  // 用户态处理过的 block
+};
+
+// pkt 指向 ip 头, caplen 为实际拿到的长度, len 为原始长度; 只在回调里有效
+typedef void (*sniff_ring_proc)(void *ud, const struct timeval *ts, const uint8_t *pkt, uint32_t caplen, uint32_t len);
+
+// 失败返回 NULL (EPERM 需要 CAP_NET_RAW)
+struct sniff_ring *sniff_ringOpen(const struct sniff_ring_opts *opts);
+void sniff_ringClose(struct sniff_ring *r);
+int sniff_ringFd(struct sniff_ring *r);
+// 没有就绪 block 时最多等 timeout_ms (-1 一直等), 处理所有就绪 block, 返回回调的包数, 出错返回 -1
+int sniff_ringDispatch(struct sniff_ring *r, int timeout_ms, sniff_ring_proc proc, void *ud);
+// 取一次内核统计并累加
+bool sniff_ringStats(struct sniff_ring *r, struct sniff_ring_stats *st);
+
+#endif
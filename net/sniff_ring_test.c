@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include "sniff_ring.h"
+
+// 需要 root / CAP_NET_RAW, 没有权限时跳过
+
+static long long now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// 从 ip 头开始的 "udp dst port <port>", 相当于 pcap_compile 在 DLT_RAW 上的结果
+static struct sock_filter udp_port_insns[] = {
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 4),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1), // port 运行时填
+    BPF_STMT(BPF_RET | BPF_K, 0xffff),
+    BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+static struct sock_fprog udp_port_filter(uint16_t port)
+{
+    udp_port_insns[4].k = port;
+    struct sock_fprog prog = {sizeof(udp_port_insns) / sizeof(udp_port_insns[0]), udp_port_insns};
+    return prog;
+}
+
+// 一个绑在 127.0.0.1 随机端口上不读的 udp socket, 作为发送目标
+static int udp_sink(struct sockaddr_in *addr)
+{
+    socklen_t len = sizeof(*addr);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd >= 0);
+    assert(bind(fd, (struct sockaddr *)addr, len) == 0);
+    assert(getsockname(fd, (struct sockaddr *)addr, &len) == 0);
+    return fd;
+}
+
+struct captured
+{
+    int n;
+    uint16_t port;
+};
+
+static void on_pkt(void *ud, const struct timeval *ts, const uint8_t *pkt, uint32_t caplen, uint32_t len)
+{
+    struct captured *c = ud;
+    const struct ip *ip = (const struct ip *)pkt;
+    const struct udphdr *udp = (const struct udphdr *)(pkt + ip->ip_hl * 4);
+    char expect[32];
+    assert(caplen == len && ts->tv_sec > 0);
+    assert(ip->ip_v == 4 && ip->ip_p == IPPROTO_UDP);
+    assert(ntohs(udp->uh_dport) == c->port);
+    int n = snprintf(expect, sizeof(expect), "pkt %d", c->n);
+    assert(ntohs(udp->uh_ulen) == sizeof(*udp) + n);
+    assert(memcmp(udp + 1, expect, n) == 0);
+    c->n++;
+}
+
+void test_capture(struct sniff_ring *r, int sink, struct sockaddr_in *dst)
+{
+    struct captured c = {0, ntohs(dst->sin_port)};
+    struct sniff_ring_stats st;
+    char buf[32];
+    int i;
+    for (i = 0; i < 100; i++)
+    {
+        int n = snprintf(buf, sizeof(buf), "pkt %d", i);
+        assert(sendto(sink, buf, n, 0, (struct sockaddr *)dst, sizeof(*dst)) == n);
+    }
+    // 100 个小包填不满 block, 靠 retire 超时交出来; lo 上发出的那份被去掉, 按顺序各一次
+    long long start = now_us();
+    while (c.n < 100 && now_us() - start < 2000000)
+    {
+        assert(sniff_ringDispatch(r, 100, on_pkt, &c) >= 0);
+    }
+    assert(c.n == 100);
+    assert(sniff_ringDispatch(r, 50, on_pkt, &c) == 0);
+    assert(sniff_ringStats(r, &st));
+    assert(st.packets >= 100 && st.drops == 0 && st.blocks > 0);
+}
+
+// 记下每个包属于哪条流 (客户端端口), 用来检查流不会被拆到两个 ring
+struct flows
+{
+    uint16_t server;
+    int n;
+    uint16_t clients[256];
+};
+
+static void on_flow(void *ud, const struct timeval *ts, const uint8_t *pkt, uint32_t caplen, uint32_t len)
+{
+    struct flows *f = ud;
+    const struct ip *ip = (const struct ip *)pkt;
+    const struct udphdr *udp = (const struct udphdr *)(pkt + ip->ip_hl * 4);
+    uint16_t sport = ntohs(udp->uh_sport), dport = ntohs(udp->uh_dport);
+    assert(f->n < 256);
+    f->clients[f->n++] = sport == f->server ? dport : sport;
+}
+
+static bool has_client(const struct flows *f, uint16_t port)
+{
+    int i;
+    for (i = 0; i < f->n; i++)
+    {
+        if (f->clients[i] == port)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 两个 ring 组成 PACKET_FANOUT_HASH 组: 每条流 (请求与应答两个方向) 只落在一个 ring 上, 合起来不多不少
+void test_fanout()
+{
+    struct sockaddr_in dst;
+    int sink = udp_sink(&dst);
+    uint16_t server = ntohs(dst.sin_port);
+    struct sock_fprog filter = {0};
+    // 只抓与 sink 之间的包: 匹配任一端口为 server
+    struct sock_filter insns[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, server, 2, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, server, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xffff),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    filter.len = sizeof(insns) / sizeof(insns[0]);
+    filter.filter = insns;
+    struct sniff_ring_opts opts = {"lo", 1 << 16, 8, 20, &filter, getpid() & 0xffff};
+    struct sniff_ring *rings[2];
+    struct flows flows[2];
+    int i;
+    memset(flows, 0, sizeof(flows));
+    for (i = 0; i < 2; i++)
+    {
+        rings[i] = sniff_ringOpen(&opts);
+        assert(rings[i]);
+        flows[i].server = server;
+    }
+
+    // 16 个客户端各发一个请求, sink 逐个应答
+    int clients[16];
+    uint16_t ports[16];
+    for (i = 0; i < 16; i++)
+    {
+        struct sockaddr_in addr;
+        clients[i] = udp_sink(&addr);
+        ports[i] = ntohs(addr.sin_port);
+        assert(sendto(clients[i], "req", 3, 0, (struct sockaddr *)&dst, sizeof(dst)) == 3);
+    }
+    char buf[16];
+    for (i = 0; i < 16; i++)
+    {
+        struct sockaddr_in from;
+        socklen_t len = sizeof(from);
+        assert(recvfrom(sink, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len) == 3);
+        assert(sendto(sink, "rsp", 3, 0, (struct sockaddr *)&from, len) == 3);
+    }
+
+    long long start = now_us();
+    while (flows[0].n + flows[1].n < 32 && now_us() - start < 2000000)
+    {
+        sniff_ringDispatch(rings[0], 10, on_flow, &flows[0]);
+        sniff_ringDispatch(rings[1], 10, on_flow, &flows[1]);
+    }
+    assert(flows[0].n + flows[1].n == 32);
+    for (i = 0; i < 16; i++)
+    {
+        int j;
+        int count = 0;
+        for (j = 0; j < flows[0].n; j++)
+        {
+            count += flows[0].clients[j] == ports[i];
+        }
+        for (j = 0; j < flows[1].n; j++)
+        {
+            count += flows[1].clients[j] == ports[i];
+        }
+        assert(count == 2);
+        assert(has_client(&flows[0], ports[i]) != has_client(&flows[1], ports[i]));
+        close(clients[i]);
+    }
+    sniff_ringClose(rings[0]);
+    sniff_ringClose(rings[1]);
+    close(sink);
+}
+
+#define BENCH_SECONDS 2
+
+#define BENCH_FLOWS 8
+
+struct sender
+{
+    int fds[BENCH_FLOWS]; // 多个源端口, fanout 才有流可分
+    struct sockaddr_in dst;
+    volatile bool stop;
+    unsigned long long sent;
+};
+
+static void *bench_send(void *arg)
+{
+    struct sender *s = arg;
+    char payload[64];
+    int i = 0;
+    memset(payload, 'p', sizeof(payload));
+    while (!s->stop)
+    {
+        if (sendto(s->fds[i++ % BENCH_FLOWS], payload, sizeof(payload), 0, (struct sockaddr *)&s->dst, sizeof(s->dst)) > 0)
+        {
+            s->sent++;
+        }
+    }
+    return NULL;
+}
+
+struct fanout_worker
+{
+    struct sniff_ring *ring;
+    pthread_t tid;
+    volatile bool *stop;
+    unsigned long long captured;
+};
+
+static void count_pkt(void *ud, const struct timeval *ts, const uint8_t *pkt, uint32_t caplen, uint32_t len);
+
+static void *fanout_run(void *arg)
+{
+    struct fanout_worker *w = arg;
+    while (!*w->stop)
+    {
+        sniff_ringDispatch(w->ring, 100, count_pkt, &w->captured);
+    }
+    return NULL;
+}
+
+static void count_pkt(void *ud, const struct timeval *ts, const uint8_t *pkt, uint32_t caplen, uint32_t len)
+{
+    (*(unsigned long long *)ud)++;
+}
+
+// 对照: 每个包一次 recvfrom 从内核拷贝, 即 pcap_next_ex 不走 ring 时的路径
+static int copy_open(const struct sock_fprog *filter)
+{
+    int fd = socket(AF_PACKET, SOCK_DGRAM, 0);
+    assert(fd >= 0);
+    assert(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, filter, sizeof(*filter)) == 0);
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = if_nametoindex("lo");
+    assert(bind(fd, (struct sockaddr *)&sll, sizeof(sll)) == 0);
+    struct timeval tv = {0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+// 发送线程往 lo 上打 64 字节 udp (BENCH_FLOWS 条流), 本线程抓或两个线程 fanout 抓; 统计抓到的包/秒与内核丢包
+void bench()
+{
+    const char *names[] = {"recvfrom", "tpacket_v3", "fanout x2"};
+    int mode, i;
+    for (mode = 0; mode < 3; mode++)
+    {
+        struct sender s;
+        pthread_t t;
+        memset(&s, 0, sizeof(s));
+        int sink = udp_sink(&s.dst);
+        for (i = 0; i < BENCH_FLOWS; i++)
+        {
+            s.fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        }
+        struct sock_fprog filter = udp_port_filter(ntohs(s.dst.sin_port));
+
+        struct sniff_ring *r = NULL;
+        struct fanout_worker workers[2];
+        volatile bool stop = false;
+        int fd = -1;
+        memset(workers, 0, sizeof(workers));
+        if (mode == 0)
+        {
+            fd = copy_open(&filter);
+        }
+        else if (mode == 1)
+        {
+            struct sniff_ring_opts opts = {"lo", 0, 0, 0, &filter, 0};
+            r = sniff_ringOpen(&opts);
+            assert(r);
+        }
+        else
+        {
+            struct sniff_ring_opts opts = {"lo", 0, 0, 0, &filter, getpid() & 0xffff};
+            for (i = 0; i < 2; i++)
+            {
+                workers[i].ring = sniff_ringOpen(&opts);
+                assert(workers[i].ring);
+                workers[i].stop = &stop;
+            }
+            for (i = 0; i < 2; i++)
+            {
+                pthread_create(&workers[i].tid, NULL, fanout_run, &workers[i]);
+            }
+        }
+
+        unsigned long long captured = 0, kpackets = 0, kdrops = 0, kfreezes = 0;
+        pthread_create(&t, NULL, bench_send, &s);
+        long long start = now_us();
+        while (now_us() - start < BENCH_SECONDS * 1000000LL)
+        {
+            if (mode == 0)
+            {
+                char buf[2048];
+                if (recv(fd, buf, sizeof(buf), 0) > 0)
+                {
+                    captured++;
+                }
+            }
+            else if (mode == 1)
+            {
+                sniff_ringDispatch(r, 100, count_pkt, &captured);
+            }
+            else
+            {
+                usleep(10000);
+            }
+        }
+        long long us = now_us() - start;
+        s.stop = true;
+        pthread_join(t, NULL);
+        stop = true;
+
+        if (mode == 0)
+        {
+            struct tpacket_stats kst;
+            socklen_t len = sizeof(kst);
+            assert(getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &kst, &len) == 0);
+            kpackets = kst.tp_packets;
+            kdrops = kst.tp_drops;
+            close(fd);
+        }
+        else if (mode == 1)
+        {
+            struct sniff_ring_stats st;
+            assert(sniff_ringStats(r, &st));
+            kpackets = st.packets;
+            kdrops = st.drops;
+            kfreezes = st.freezes;
+            sniff_ringClose(r);
+        }
+        else
+        {
+            for (i = 0; i < 2; i++)
+            {
+                struct sniff_ring_stats st;
+                pthread_join(workers[i].tid, NULL);
+                assert(sniff_ringStats(workers[i].ring, &st));
+                printf("  ring %d: captured %llu\n", i, workers[i].captured);
+                captured += workers[i].captured;
+                kpackets += st.packets;
+                kdrops += st.drops;
+                kfreezes += st.freezes;
+                sniff_ringClose(workers[i].ring);
+            }
+        }
+
+        printf("%-10s: sent %llu, captured %llu (%.0f pkts/s), kernel packets %llu drops %llu freezes %llu\n",
+               names[mode], s.sent, captured, (double)captured * 1000000 / us, kpackets, kdrops, kfreezes);
+        for (i = 0; i < BENCH_FLOWS; i++)
+        {
+            close(s.fds[i]);
+        }
+        close(sink);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in dst;
+    int sink = udp_sink(&dst);
+    struct sock_fprog filter = udp_port_filter(ntohs(dst.sin_port));
+    struct sniff_ring_opts opts = {"lo", 1 << 16, 8, 20, &filter, 0};
+    struct sniff_ring *r = sniff_ringOpen(&opts);
+    if (r == NULL)
+    {
+        assert(errno == EPERM);
+        fprintf(stderr, "need CAP_NET_RAW, skipped\n");
+        close(sink);
+        return 0;
+    }
+    test_capture(r, sink, &dst);
+    sniff_ringClose(r);
+    test_fanout();
+    close(sink);
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+    }
+    return 0;
+}
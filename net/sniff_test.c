@@ -8,154 +8,26 @@
 #include "sniff.h"
 #include "../base/buffer.h"
 #include "../base/endian.h"
-#include "../base/queue.h"
 #include "../base/log.h"
+#include "sniff_mysql.h"
 
 #if !defined(UNUSED)
 #define UNUSED(x)	((void)(x))
 #endif
 
-#define MYSQL_MAX_PACKET_LEN 0xFFFFFF
-
-// 每个端口挂一个 struct conn(单向连接) 链表
-#define PORT_QUEUE_SIZE 65535
-static QUEUE PORT_QUEUE[PORT_QUEUE_SIZE];
+// 流表 + 重组 + mysql 分包见 sniff_mysql.c
+#define CONN_IDLE_TIMEOUT_MS (5 * 60 * 1000)
+#define CONN_BUF_SIZE 8192
+static struct sniff_mysql *sniffer;
 
 static int16_t mysql_server_port;
 
-struct conn
-{
-    uint32_t ip;   // 网络字节序
-    uint16_t port; // 本机字节序
-    struct buffer *buf;
-    QUEUE node;
-};
-
-static struct conn *conn_create(uint32_t ip, uint16_t port)
-{
-    struct conn *c = malloc(sizeof(*c));
-    if (c == NULL)
-        return NULL;
-    memset(c, 0, sizeof(*c));
-    c->ip = ip;
-    c->port = port;
-    c->buf = buf_create(8192);
-    return c;
-}
-
-static void conn_release(struct conn *c)
-{
-    assert(c);
-    buf_release(c->buf);
-    free(c);
-}
-
-static void pq_init()
-{
-    int i = 0;
-    for (; i < PORT_QUEUE_SIZE; i++)
-    {
-        QUEUE_INIT(&PORT_QUEUE[i]);
-    }
-}
-
-static void pq_release()
-{
-    QUEUE *q;
-    QUEUE *el;
-    struct conn *c;
-    int i = 0;
-
-    for (; i < PORT_QUEUE_SIZE; i++)
-    {
-        q = &PORT_QUEUE[i];
-        if (QUEUE_EMPTY(q))
-        {
-            continue;
-        }
-
-        QUEUE_FOREACH(el, q)
-        {
-            c = QUEUE_DATA(el, struct conn, node);
-            conn_release(c);
-        }
-    }
-}
-
-static void pq_dump()
-{
-    QUEUE *q;
-    QUEUE *el;
-    struct conn *c;
-    int i = 0;
-    char ip_buf[INET_ADDRSTRLEN];
-
-    int bytes = 0;
-    for (; i < PORT_QUEUE_SIZE; i++)
-    {
-        q = &PORT_QUEUE[i];
-        if (QUEUE_EMPTY(q))
-        {
-            continue;
-        }
-
-        QUEUE_FOREACH(el, q)
-        {
-            c = QUEUE_DATA(el, struct conn, node);
-            inet_ntop(AF_INET, &c->ip, ip_buf, INET_ADDRSTRLEN);
-            printf("%s:%d %zu\n", ip_buf, c->port, buf_readable(c->buf));
-            bytes += buf_internalCapacity(c->buf);
-        }
-        printf("bytes: %d\n", bytes);
-    }
-}
-
-static struct conn *pq_get_internal(uint32_t ip, uint16_t port, int is_remove)
-{
-    QUEUE *q = &PORT_QUEUE[port];
-    if (QUEUE_EMPTY(q))
-    {
-        return NULL;
-    }
-
-    QUEUE *el;
-    struct conn *c;
-    QUEUE_FOREACH(el, q)
-    {
-        c = QUEUE_DATA(el, struct conn, node);
-        if (c->ip == ip)
-        {
-            if (is_remove)
-            {
-                QUEUE_REMOVE(el);
-            }
-            return c;
-        }
-    }
-    return NULL;
-}
-
-static struct conn *pq_get(uint32_t ip, uint16_t port)
-{
-    return pq_get_internal(ip, port, 0);
-}
-
-struct conn *pq_del(uint32_t ip, uint16_t port)
-{
-    return pq_get_internal(ip, port, 1);
-}
-
-void pq_add(struct conn *c)
+static void conn_dump()
 {
-    QUEUE *q = &PORT_QUEUE[c->port];
-    if (pq_get(c->ip, c->port) == NULL)
-    {
-        QUEUE_INSERT_TAIL(q, &c->node);
-    }
-    else
-    {
-        assert(false);
-    }
+    const struct sniff_mysql_stats *st = sniff_mysql_getStats(sniffer);
+    printf("conns: %zu\n", sniff_mysql_count(sniffer));
+    printf("packets: %llu, mysql packets: %llu, gaps: %llu, malformed: %llu\n",
+           st->packets, st->pdus, st->gaps, st->malformed);
 }
 
 void print_bytes(const char *payload, size_t size)
@@ -203,20 +75,18 @@ mysql_dissect_compressed_header(struct buffer *buf)
     UNUSED(cmp_pkt_uncmp_sz);
 }
 
-// TOOD 未处理 compressed header
-bool is_completed_mysql_pdu(struct buffer *buf)
+static void on_mysql_packet(void *ud, const struct flow *f, bool is_response, uint8_t pkt_id, const char *body, uint32_t len)
 {
-    if (buf_readable(buf) < 4) /* regular header 3+1 (len+id) */
-    {
-        return false;
-    }
-    int32_t sz = buf_peekInt32LE24(buf);
-    if (sz <= 0 || sz >= MYSQL_MAX_PACKET_LEN)
-    {
-        PANIC("malformed mysql packet(size=%d)\n", sz);
-        return false;
+    LOG_INFO("packet size %u\n", len);
+    LOG_INFO("packet id %d\n", pkt_id);
+
+    // TODO 检测是否是 SSL !!!
+
+    if (is_response) {
+        LOG_INFO("RESPONSE\n");
+    } else {
+        LOG_INFO("REQUEST\n");
     }
-    return buf_readable(buf) >= sz + 4;
 }
 
 void pkt_handle(void *ud,
@@ -246,77 +116,20 @@ void pkt_handle(void *ud,
     // printf("   SRC PORT: %d\n", ntohs(tcp_hdr->th_sport));
     // printf("   DST PORT: %d\n", ntohs(tcp_hdr->th_dport));
 
-    struct conn *c;
-    uint32_t s_ip = ip_hdr->ip_src.s_addr;
-    uint16_t s_port = ntohs(tcp_hdr->th_sport);
+    sniff_mysql_handle(sniffer, pkt_hdr, ip_hdr, tcp_hdr, tcp_opt, payload, payload_size);
 
-    // 连接关闭, 清理数据
-    if (tcp_hdr->th_flags & TH_FIN || tcp_hdr->th_flags & TH_RST)
+    // 连接关闭, 流表由 sniff_mysql_handle 清理
+    if (tcp_hdr->th_flags & (TH_FIN | TH_RST))
     {
         char s_ip_buf[INET_ADDRSTRLEN];
         char d_ip_buf[INET_ADDRSTRLEN];
-        // uint32_t d_ip = ip_hdr->ip_dst.s_addr;
+        uint16_t s_port = ntohs(tcp_hdr->th_sport);
         uint16_t d_port = ntohs(tcp_hdr->th_dport);
 
         inet_ntop(AF_INET, &(ip_hdr->ip_src.s_addr), s_ip_buf, INET_ADDRSTRLEN);
         inet_ntop(AF_INET, &(ip_hdr->ip_dst.s_addr), d_ip_buf, INET_ADDRSTRLEN);
 
         LOG_INFO("%s:%d %s:%d 关闭连接\n", s_ip_buf, s_port, d_ip_buf, d_port);
-        c = pq_del(s_ip, s_port);
-        if (c)
-        {
-            conn_release(c);
-        }
-        c = pq_del(ip_hdr->ip_dst.s_addr, ntohs(tcp_hdr->th_dport));
-        if (c)
-        {
-            conn_release(c);
-        }
-    }
-
-    if (payload_size <= 0)
-    {
-        return;
-    }
-
-    // 这里假定一定是 mysql 数据 !!!
-    // 获取或初始化连接对象
-    c = pq_get(s_ip, s_port);
-    if (c == NULL)
-    {
-        c = conn_create(s_ip, s_port);
-        pq_add(c);
-    }
-
-    struct buffer *buf = c->buf;
-    buf_append(buf, (const char *)payload, payload_size);
-    
-    if (!is_completed_mysql_pdu(buf)) {
-        return;
-    }
-    
-    bool is_response = false;
-    if (s_port == mysql_server_port) {
-        is_response = true;
-    }
-    
-    int32_t pkt_sz = buf_readInt32LE24(buf);
-    uint8_t pkt_id = buf_readInt8(buf); 
-
-    LOG_INFO("packet size %d\n", pkt_sz);
-    LOG_INFO("packet id %d\n", pkt_id);
-   
-    // TODO 检测是否是 SSL !!!
-
-    if (is_response) {
-        LOG_INFO("RESPONSE\n");
-    } else {
-        LOG_INFO("REQUEST\n");
-    }
-
-    if (buf_internalCapacity(buf) > 1024 * 1024)
-    {
-        buf_shrink(c->buf, 0);
     }
 }
 
@@ -344,11 +157,21 @@ int main(int argc, char **argv)
         .ud = NULL};
 
 
-    pq_init();
+    // sniff_test -r file.pcap: 离线回放
+    if (argc > 2 && strcmp(argv[1], "-r") == 0)
+    {
+        opt.pcap_file = argv[2];
+        opt.replay_fast = 1;
+    }
+
+    sniffer = sniff_mysql_create(mysql_server_port, CONN_IDLE_TIMEOUT_MS, CONN_BUF_SIZE, on_mysql_packet, NULL);
+    assert(sniffer);
 
     if (!tcpsniff(&opt, pkt_handle))
     {
         fprintf(stderr, "fail to sniff\n");
     }
+    conn_dump();
+    sniff_mysql_release(sniffer);
     return 0;
 }
\ No newline at end of file
@@ -1,6 +1,3 @@
-#ifndef SOCKET_H
-#define SOCKET_H
-
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
 #endif
@@ -19,42 +16,144 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 #include "socket.h"
 #include "sa.h"
 
-static int socket_ctor(const char *host, const char *port, bool nonblock);
-static int socket_create_(bool nonblock);
+static int socket_ctor(const char *host, const char *port, bool nonblock, const struct socket_opts *opts);
+static int socket_create_(int family, bool nonblock);
 static int socket_accept_(int sockfd, union sockaddr_all *addr, socklen_t *addrlen, bool nonblock);
 static void socket_setNonblock(int sockfd);
 
 int socket_client(const char *host, const char *port)
 {
-    return socket_ctor(host, port, true);
+    return socket_ctor(host, port, true, NULL);
 }
 
 int socket_clientSync(const char *host, const char *port)
 {
-    return socket_ctor(host, port, false);
+    return socket_ctor(host, port, false, NULL);
 }
 
 int socket_server(const char *port)
 {
-    return socket_ctor(NULL, port, true);
+    return socket_ctor(NULL, port, true, NULL);
 }
 
 int socket_serverSync(const char *port)
 {
-    return socket_ctor(NULL, port, false);
+    return socket_ctor(NULL, port, false, NULL);
+}
+
+int socket_clientOpts(const char *host, const char *port, const struct socket_opts *opts)
+{
+    return socket_ctor(host, port, true, opts);
+}
+
+int socket_serverOpts(const char *port, const struct socket_opts *opts)
+{
+    return socket_ctor(NULL, port, true, opts);
+}
+
+static bool socket_setInt(int sockfd, int level, int name, int val, const char *desc)
+{
+    if (setsockopt(sockfd, level, name, &val, sizeof(val)) < 0)
+    {
+        fprintf(stderr, "ERROR setsockopt %s: %s\n", desc, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool socket_setOpts(int sockfd, const struct socket_opts *opts, bool isServer)
+{
+    bool ok = true;
+    if (opts->fastopen)
+    {
+        if (isServer)
+        {
+#ifdef TCP_FASTOPEN
+            ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_FASTOPEN, opts->fastopen, "TCP_FASTOPEN");
+#endif
+        }
+        else
+        {
+#ifdef TCP_FASTOPEN_CONNECT
+            ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1, "TCP_FASTOPEN_CONNECT");
+#endif
+        }
+    }
+#ifdef TCP_QUICKACK
+    if (opts->quickack)
+    {
+        ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+    }
+#endif
+#ifdef TCP_DEFER_ACCEPT
+    if (isServer && opts->defer_accept > 0)
+    {
+        ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, opts->defer_accept, "TCP_DEFER_ACCEPT");
+    }
+#endif
+    if (opts->rcvbuf > 0)
+    {
+        ok = ok && socket_setInt(sockfd, SOL_SOCKET, SO_RCVBUF, opts->rcvbuf, "SO_RCVBUF");
+    }
+    if (opts->sndbuf > 0)
+    {
+        ok = ok && socket_setInt(sockfd, SOL_SOCKET, SO_SNDBUF, opts->sndbuf, "SO_SNDBUF");
+    }
+#ifdef TCP_USER_TIMEOUT
+    if (opts->user_timeout_ms > 0)
+    {
+        ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_USER_TIMEOUT, opts->user_timeout_ms, "TCP_USER_TIMEOUT");
+    }
+#endif
+    if (opts->keepidle > 0 || opts->keepintvl > 0 || opts->keepcnt > 0)
+    {
+        ok = ok && socket_setInt(sockfd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+#if defined(TCP_KEEPIDLE)
+        if (opts->keepidle > 0)
+        {
+            ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_KEEPIDLE, opts->keepidle, "TCP_KEEPIDLE");
+        }
+#elif defined(TCP_KEEPALIVE)
+        if (opts->keepidle > 0)
+        {
+            ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_KEEPALIVE, opts->keepidle, "TCP_KEEPALIVE");
+        }
+#endif
+#ifdef TCP_KEEPINTVL
+        if (opts->keepintvl > 0)
+        {
+            ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_KEEPINTVL, opts->keepintvl, "TCP_KEEPINTVL");
+        }
+#endif
+#ifdef TCP_KEEPCNT
+        if (opts->keepcnt > 0)
+        {
+            ok = ok && socket_setInt(sockfd, IPPROTO_TCP, TCP_KEEPCNT, opts->keepcnt, "TCP_KEEPCNT");
+        }
+#endif
+    }
+    return ok;
 }
 
 int socket_create()
 {
-    return socket_create_(true);
+    return socket_create_(PF_INET, true);
+}
+
+int socket_createFamily(int family)
+{
+    return socket_create_(family, true);
 }
 
 int socket_createSync()
 {
-    return socket_create_(false);
+    return socket_create_(PF_INET, false);
 }
 
 bool socket_bind(int sockfd, const union sockaddr_all *addr, socklen_t addrlen)
@@ -79,6 +178,73 @@ bool socket_listen(int sockfd)
     return true;
 }
 
+// 返回 cpu % n 作为组内下标, 下标即 socket 加入组 (bind) 的顺序
+static bool socket_attachCpuBPF(int sockfd, int n)
+{
+#if defined(SO_ATTACH_REUSEPORT_CBPF) && defined(SKF_AD_CPU)
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, n},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog = {sizeof(code) / sizeof(code[0]), code};
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0)
+    {
+        perror("ERROR setsockopt SO_ATTACH_REUSEPORT_CBPF");
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+int socket_serverGroup(const char *port, int n, int *fds, bool byCpu)
+{
+    char bound[8];
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        fds[i] = socket_server(port);
+        if (fds[i] < 0 || !socket_listen(fds[i]))
+        {
+            if (fds[i] >= 0)
+            {
+                close(fds[i]);
+            }
+            goto fail;
+        }
+        // port 为 "0" 时后面的 socket 绑到第一个拿到的端口上
+        if (i == 0)
+        {
+            union sockaddr_all addr;
+            socklen_t addrlen = sizeof(addr);
+            if (getsockname(fds[0], &addr.s, &addrlen) < 0)
+            {
+                perror("ERROR getsockname");
+                i++;
+                goto fail;
+            }
+            snprintf(bound, sizeof(bound), "%u", ntohs(addr.v4.sin_port));
+            port = bound;
+        }
+    }
+
+    // 组里任意一个 socket 挂上即对整组生效
+    if (byCpu && n > 1)
+    {
+        socket_attachCpuBPF(fds[0], n);
+    }
+    return n;
+
+fail:
+    while (i-- > 0)
+    {
+        close(fds[i]);
+    }
+    return -1;
+}
+
 int socket_accept(int sockfd, union sockaddr_all *addr, socklen_t *addrlen)
 {
     return socket_accept_(sockfd, addr, addrlen, true);
@@ -89,6 +255,75 @@ int socket_acceptSync(int sockfd, union sockaddr_all *addr, socklen_t *addrlen)
     return socket_accept_(sockfd, addr, addrlen, false);
 }
 
+bool socket_acceptorInit(struct socket_acceptor *a, int listenfd)
+{
+    a->fd = listenfd;
+    a->accepted = 0;
+    a->dropped = 0;
+    a->reserve = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (a->reserve < 0)
+    {
+        perror("ERROR open reserve fd");
+        return false;
+    }
+    return true;
+}
+
+void socket_acceptorRelease(struct socket_acceptor *a)
+{
+    if (a->reserve >= 0)
+    {
+        close(a->reserve);
+        a->reserve = -1;
+    }
+}
+
+// fd 用尽时 listen 队列里的连接会让 fd 一直可读, 接下来关掉, 客户端收到 FIN 而不是一直等
+static void socket_acceptDrop(struct socket_acceptor *a)
+{
+    if (a->reserve < 0)
+    {
+        return;
+    }
+    close(a->reserve);
+    a->reserve = -1;
+    int fd = accept(a->fd, NULL, NULL);
+    if (fd >= 0)
+    {
+        close(fd);
+        a->dropped++;
+    }
+    a->reserve = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+int socket_acceptBatch(struct socket_acceptor *a, int *fds, union sockaddr_all *addrs, int max)
+{
+    int n = 0;
+    while (n < max)
+    {
+        union sockaddr_all addr;
+        socklen_t addrlen = sizeof(addr);
+        int fd = socket_accept_(a->fd, addrs ? &addrs[n] : &addr, &addrlen, true);
+        if (fd >= 0)
+        {
+            fds[n++] = fd;
+            continue;
+        }
+        if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+        {
+            continue;
+        }
+        if (errno == EMFILE || errno == ENFILE)
+        {
+            socket_acceptDrop(a);
+            errno = EMFILE;
+        }
+        break;
+    }
+    a->accepted += n;
+    return n;
+}
+
 int socket_connect(int sockfd, const union sockaddr_all *addr, socklen_t addrlen)
 {
     return connect(sockfd, (struct sockaddr *)addr, addrlen);
@@ -210,12 +445,12 @@ static void socket_setNonblock(int sockfd)
     }
 }
 
-static int socket_create_(bool nonblock)
+static int socket_create_(int family, bool nonblock)
 {
 #ifdef __APPLE__
-    int sockfd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int sockfd = socket(family, SOCK_STREAM, IPPROTO_TCP);
 #else
-    int sockfd = socket(PF_INET, SOCK_STREAM | (nonblock ? SOCK_NONBLOCK : 0) | SOCK_CLOEXEC, IPPROTO_TCP);
+    int sockfd = socket(family, SOCK_STREAM | (nonblock ? SOCK_NONBLOCK : 0) | SOCK_CLOEXEC, IPPROTO_TCP);
 #endif
 
     if (sockfd < 0)
@@ -282,9 +517,9 @@ static int socket_accept_(int sockfd, union sockaddr_all *addr, socklen_t *addrl
     }
 
 #ifdef __APPLE__
-    if (nonblock)
+    if (nonblock && connfd >= 0)
     {
-        socket_setNonblock(sockfd);
+        socket_setNonblock(connfd);
     }
 #endif
 
@@ -295,7 +530,7 @@ static int socket_accept_(int sockfd, union sockaddr_all *addr, socklen_t *addrl
 // server 不能传递host, 自行查找绑定
 // server :: socket_createSync(NULL, 9999)
 // client :: socket_createSync("www.google.com", 90)
-static int socket_ctor(const char *host, const char *port, bool nonblock)
+static int socket_ctor(const char *host, const char *port, bool nonblock, const struct socket_opts *opts)
 {
     bool isServer = host == NULL;
 
@@ -305,7 +540,7 @@ static int socket_ctor(const char *host, const char *port, bool nonblock)
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_flags = AI_PASSIVE; /* For wildcard IP address */
 
-    // !!! sync for client
+    // !!! sync for client, loop 里的客户端用 resolver.h 异步解析
     int status = getaddrinfo(host, port, &hints, &servinfo);
     if (status != 0)
     {
@@ -374,6 +609,14 @@ static int socket_ctor(const char *host, const char *port, bool nonblock)
             return -1;
         }
 
+        // 缓冲区大小与 fastopen 都要在 bind / connect 之前
+        if (opts && !socket_setOpts(sockfd, opts, isServer))
+        {
+            freeaddrinfo(servinfo);
+            close(sockfd);
+            return -1;
+        }
+
         // SO_REUSEADDR needs to be set before bind().
         // However, not all options need to be set before bind(), or even before connect().
         if (isServer && bind(sockfd, p->ai_addr, p->ai_addrlen) < 0)
@@ -410,7 +653,8 @@ static int socket_ctor(const char *host, const char *port, bool nonblock)
     }
     else
     {
-        if (connect(sockfd, servinfo->ai_addr, servinfo->ai_addrlen) < 0)
+        // 非阻塞时 EINPROGRESS 由调用方等可写; TCP_FASTOPEN_CONNECT 下 connect 直接返回 0, SYN 推迟到第一次 write
+        if (connect(sockfd, servinfo->ai_addr, servinfo->ai_addrlen) < 0 && !(nonblock && errno == EINPROGRESS))
         {
             perror("ERROR connect");
             freeaddrinfo(servinfo);
@@ -422,5 +666,3 @@ static int socket_ctor(const char *host, const char *port, bool nonblock)
 
     return sockfd;
 }
-
-#endif
\ No newline at end of file
@@ -10,9 +10,36 @@
 // 快速创建server与client
 int socket_client(const char *host, const char *port);
 int socket_server(const char *port);
+// SO_REUSEPORT 监听组: n 个绑定同一端口且已 listen 的非阻塞 socket 写入 fds, 每个交给一个线程/loop accept
+// byCpu 挂 SO_ATTACH_REUSEPORT_CBPF, 新连接给 fds[处理该包的 CPU % n], 线程 i 应绑在 CPU i 上; 不支持时退回内核哈希
+// 成功返回 n, 失败返回 -1 并关闭已建的 socket
+int socket_serverGroup(const char *port, int n, int *fds, bool byCpu);
+
+// 连接参数, 字段为 0 表示不设置, 用系统默认; 平台不支持的选项跳过
+// 短连接 RPC: fastopen 省掉建连的一个 RTT; 大块传输: 调大 rcvbuf / sndbuf (要在 listen / connect 前设才影响窗口扩大因子)
+struct socket_opts
+{
+    int fastopen;        // server: TFO 队列长度; client: 非 0 开 TCP_FASTOPEN_CONNECT, 第一次 write 随 SYN 发出
+    int quickack;        // TCP_QUICKACK, 内核会自行退回延迟确认, 需要时读完后再调 socket_setOpts
+    int defer_accept;    // server: TCP_DEFER_ACCEPT 秒, 收到数据才唤醒 accept
+    int rcvbuf;          // SO_RCVBUF 字节
+    int sndbuf;          // SO_SNDBUF 字节
+    int user_timeout_ms; // TCP_USER_TIMEOUT, 发出的数据这么久没被确认就断开
+    int keepidle;        // 秒, 以下三个任一非 0 即开 SO_KEEPALIVE
+    int keepintvl;       // 秒
+    int keepcnt;
+};
+
+// 带参数的 socket_client / socket_server, opts 可为 NULL
+int socket_clientOpts(const char *host, const char *port, const struct socket_opts *opts);
+int socket_serverOpts(const char *port, const struct socket_opts *opts);
+// 给已有 socket 设置, isServer 决定 fastopen 的含义; 出错返回 false
+bool socket_setOpts(int sockfd, const struct socket_opts *opts, bool isServer);
 
 // 辅助函数
 int socket_create();
+// 非阻塞, family 为 PF_INET / PF_INET6
+int socket_createFamily(int family);
 bool socket_bind(int sockfd, const union sockaddr_all *addr, socklen_t addrlen);
 bool socket_listen(int sockfd);
 int socket_accept(int sockfd, union sockaddr_all *addr, socklen_t *addrlen);
@@ -26,6 +53,22 @@ int socket_getError(int sockfd);
 // FIXME gethostname
 // FIXME getpeername
 
+// 批量 accept: 一次可读事件里最多接 max 个连接, 新连接为 非阻塞 + CLOEXEC (accept4, 不再逐个 fcntl)
+// TCP_NODELAY / SO_KEEPALIVE 在 listen socket 上设置 (socket_server 已设), 由新连接继承, 不再逐个 setsockopt
+// fd 用尽 (EMFILE/ENFILE) 时释放预留 fd 接下一个连接立即关闭, 计入 dropped, 避免 listen fd 一直可读空转
+struct socket_acceptor
+{
+    int fd;      // listen fd
+    int reserve; // 预留 fd, -1 表示没有
+    unsigned long accepted;
+    unsigned long dropped;
+};
+
+bool socket_acceptorInit(struct socket_acceptor *a, int listenfd);
+void socket_acceptorRelease(struct socket_acceptor *a);
+// 返回本次接到的连接数, 写入 fds (addrs 可为 NULL); 0 且 errno 为 EMFILE/ENFILE 表示 fd 不够了
+int socket_acceptBatch(struct socket_acceptor *a, int *fds, union sockaddr_all *addrs, int max);
+
 // 阻塞版本
 int socket_clientSync(const char *host, const char *port);
 int socket_serverSync(const char *port);
@@ -4,6 +4,11 @@
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <poll.h>
 #include "poller.h"
 #include "socket.h"
 #include "sa.h"
@@ -22,7 +27,7 @@ void test_cli()
     //     perror("ERROR connect");
     //     exit(1);
     // }
-    poller_add(pfd, fd, NULL);
+    poller_add(pfd, fd, NULL, 0);
 
     // FIXME 客户端连接时候什么时候加入写事件
     poller_write(pfd, fd, NULL, true);
@@ -34,7 +39,7 @@ void test_cli()
 
     while (true)
     {
-        n = poller_wait(pfd, evts, sizeof(evts));
+        n = poller_wait(pfd, evts, sizeof(evts) / sizeof(evts[0]), -1);
         if (n <= 0)
         {
             n = 0;
@@ -97,7 +102,7 @@ void test_serv()
     socket_listen(fd);
 
     poll_fd pfd = poller_create();
-    poller_add(pfd, fd, NULL);
+    poller_add(pfd, fd, NULL, 0);
 
     struct event evts[1];
     struct event evt;
@@ -105,7 +110,7 @@ void test_serv()
 
     while (true)
     {
-        int n = poller_wait(pfd, evts, sizeof(evts));
+        int n = poller_wait(pfd, evts, sizeof(evts) / sizeof(evts[0]), -1);
         if (n <= 0)
         {
             n = 0;
@@ -136,7 +141,7 @@ void test_serv()
             else
             {
                 cfd = socket_accept(fd, &acceptSA, &addrlen);
-                poller_add(pfd, cfd, NULL);
+                poller_add(pfd, cfd, NULL, 0);
             }
         }
         else if (evt.write)
@@ -218,8 +223,158 @@ void test_sync_serv()
     puts(res);
 }
 
+static int connect_local(uint16_t port)
+{
+    union sockaddr_all addr = sa_fromip("127.0.0.1", port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(fd, &addr.s, sizeof(addr.v4)) == 0);
+    return fd;
+}
+
+// 批量 accept: 一次最多 max 个, 新连接非阻塞, 继承 listen socket 的 TCP_NODELAY
+// fd 用尽时丢弃一个连接而不是一直可读
+void test_accept_batch()
+{
+    int lfd;
+    union sockaddr_all addr;
+    socklen_t addrlen = sizeof(addr);
+    assert(socket_serverGroup("0", 1, &lfd, false) == 1);
+    getsockname(lfd, &addr.s, &addrlen);
+    uint16_t port = sa_toport(&addr);
+
+    struct socket_acceptor a;
+    assert(socket_acceptorInit(&a, lfd));
+    int fds[8], cli[5], i;
+    union sockaddr_all addrs[8];
+    assert(socket_acceptBatch(&a, fds, addrs, 8) == 0 && errno == EAGAIN);
+    for (i = 0; i < 5; i++)
+    {
+        cli[i] = connect_local(port);
+    }
+    assert(socket_acceptBatch(&a, fds, addrs, 3) == 3);
+    assert(socket_acceptBatch(&a, fds + 3, addrs + 3, 8) == 2);
+    assert(a.accepted == 5 && a.dropped == 0);
+    for (i = 0; i < 5; i++)
+    {
+        int yes = 0;
+        socklen_t len = sizeof(yes);
+        assert(fcntl(fds[i], F_GETFL) & O_NONBLOCK);
+        assert(getsockopt(fds[i], IPPROTO_TCP, TCP_NODELAY, &yes, &len) == 0 && yes);
+        assert(sa_family(&addrs[i]) == AF_INET);
+        close(fds[i]);
+        close(cli[i]);
+    }
+
+    // 把 fd 上限压到当前已用的数量
+    struct rlimit old, rl;
+    getrlimit(RLIMIT_NOFILE, &old);
+    int hole = dup(0);
+    close(hole);
+    rl = old;
+    rl.rlim_cur = hole + 1;
+    int c = connect_local(port); // 占掉 hole
+    assert(setrlimit(RLIMIT_NOFILE, &rl) == 0);
+    int c2 = socket(AF_INET, SOCK_STREAM, 0);
+    assert(c2 < 0 && errno == EMFILE);
+    assert(setrlimit(RLIMIT_NOFILE, &old) == 0);
+    c2 = connect_local(port);
+    assert(setrlimit(RLIMIT_NOFILE, &rl) == 0);
+
+    assert(socket_acceptBatch(&a, fds, NULL, 8) == 0 && errno == EMFILE);
+    assert(a.dropped == 1);
+    assert(setrlimit(RLIMIT_NOFILE, &old) == 0);
+    // 被丢弃的连接收到 EOF
+    char ch;
+    struct timeval tv = {1, 0};
+    setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    assert(read(c, &ch, 1) == 0);
+    // 另一个还在队列里
+    assert(socket_acceptBatch(&a, fds, NULL, 8) == 1);
+    close(fds[0]);
+    close(c);
+    close(c2);
+
+    socket_acceptorRelease(&a);
+    close(lfd);
+}
+
+static int getint(int fd, int level, int name)
+{
+    int val = 0;
+    socklen_t len = sizeof(val);
+    assert(getsockopt(fd, level, name, &val, &len) == 0);
+    return val;
+}
+
+static void wait_fd(int fd, short events)
+{
+    struct pollfd pfd = {fd, events, 0};
+    assert(poll(&pfd, 1, 1000) == 1);
+}
+
+void test_opts()
+{
+    struct socket_opts sopts = {0};
+    sopts.fastopen = 16;
+    sopts.defer_accept = 1;
+    sopts.rcvbuf = 64 * 1024;
+    sopts.user_timeout_ms = 5000;
+    sopts.keepidle = 30;
+    sopts.keepintvl = 5;
+    sopts.keepcnt = 3;
+    int lfd = socket_serverOpts("0", &sopts);
+    assert(lfd >= 0 && socket_listen(lfd));
+    assert(getint(lfd, SOL_SOCKET, SO_RCVBUF) >= 64 * 1024);
+    assert(getint(lfd, IPPROTO_TCP, TCP_USER_TIMEOUT) == 5000);
+    assert(getint(lfd, SOL_SOCKET, SO_KEEPALIVE));
+    assert(getint(lfd, IPPROTO_TCP, TCP_KEEPIDLE) == 30);
+    assert(getint(lfd, IPPROTO_TCP, TCP_KEEPINTVL) == 5);
+    assert(getint(lfd, IPPROTO_TCP, TCP_KEEPCNT) == 3);
+    assert(getint(lfd, IPPROTO_TCP, TCP_FASTOPEN) == 16);
+    assert(getint(lfd, IPPROTO_TCP, TCP_DEFER_ACCEPT) > 0);
+
+    union sockaddr_all addr;
+    socklen_t addrlen = sizeof(addr);
+    getsockname(lfd, &addr.s, &addrlen);
+    char port[8];
+    snprintf(port, sizeof(port), "%u", sa_toport(&addr));
+
+    // 客户端 TFO: connect 立即返回, 数据随 SYN (有 cookie 时) 或握手后发出
+    struct socket_opts copts = {0};
+    copts.fastopen = 1;
+    copts.quickack = 1;
+    copts.sndbuf = 128 * 1024;
+    int cfd = socket_clientOpts("127.0.0.1", port, &copts);
+    assert(cfd >= 0);
+    assert(getint(cfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT) == 1);
+    assert(getint(cfd, SOL_SOCKET, SO_SNDBUF) >= 128 * 1024);
+
+    // TCP_DEFER_ACCEPT: 握手完成但没数据时不可 accept
+    union sockaddr_all peer;
+    addrlen = sizeof(peer);
+    assert(socket_accept(lfd, &peer, &addrlen) < 0 && errno == EAGAIN);
+    ssize_t n;
+    while ((n = write(cfd, "hello", 5)) < 0 && (errno == EINPROGRESS || errno == EAGAIN))
+    {
+        wait_fd(cfd, POLLOUT);
+    }
+    assert(n == 5);
+    wait_fd(lfd, POLLIN);
+    addrlen = sizeof(peer);
+    int sfd = socket_accept(lfd, &peer, &addrlen);
+    assert(sfd >= 0);
+    wait_fd(sfd, POLLIN);
+    assert(read(sfd, buf, sizeof(buf)) == 5 && memcmp(buf, "hello", 5) == 0);
+
+    close(sfd);
+    close(cfd);
+    close(lfd);
+}
+
 int main(void)
 {
+    test_accept_batch();
+    test_opts();
     // test_cli();
     // test_serv();
     // test_dns();